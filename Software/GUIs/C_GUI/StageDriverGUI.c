@@ -47,6 +47,7 @@ static void setUpParamRings(void);
 // *****************************************************************************************
 static int g_panMain;
 static int g_devHandle = 0;
+static SD_ConfigSnapshot g_configSnapshot; // parameters of the last loaded or saved file
 
 // *****************************************************************************************
 // main
@@ -457,14 +458,22 @@ int CVICALLBACK cb_FileLoad (int panel, int control, int event,
 														 void *callbackData, int eventData1, int eventData2)
 {
 	char fileName[MAX_FILENAME_SIZE];
+	char msgStr[MAX_FILENAME_SIZE];
+	int numChanged;
 	
 	switch (event)
 	{
 		case EVENT_COMMIT:
 
 			GetCtrlVal(panel, PAN_MAIN_STR_FILENAME, fileName);
-			int status = SD_LoadConfigFromFile(g_devHandle, fileName);
+			// only the parameters that differ from the device are sent
+			int status = SD_LoadConfigSnapshot(fileName, &g_configSnapshot);
+			if (!status) status = SD_ApplyConfigSnapshot(g_devHandle, &g_configSnapshot, &numChanged);
 			if (status) newTextLine (g_panMain, PAN_MAIN_BOX_STATUS, "Could not load parameters from file.");
+			else {
+				sprintf(msgStr, "Parameters loaded, %d values changed.", numChanged);
+				newTextLine (g_panMain, PAN_MAIN_BOX_STATUS, msgStr);
+			}
 			
 			break;
 	}
@@ -481,7 +490,9 @@ int CVICALLBACK cb_FileSave (int panel, int control, int event,
 		case EVENT_COMMIT:
 
 			GetCtrlVal(panel, PAN_MAIN_STR_FILENAME, fileName);
-			int status = SD_SaveConfigToFile(g_devHandle, fileName);
+			int status = SD_ReadConfigSnapshot(g_devHandle, &g_configSnapshot);
+			if (g_configSnapshot.numMotors > 0) status |= SD_SaveConfigSnapshot(fileName, &g_configSnapshot);
+			else status = -1;
 			if (status) newTextLine (g_panMain, PAN_MAIN_BOX_STATUS, "Could not save parameters to file.");
 			
 			break;
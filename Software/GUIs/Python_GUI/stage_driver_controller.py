@@ -2,14 +2,21 @@
 
 This module wires UI events (button presses, periodic updates) to
 actions on the low-level PicoStage class. It also routes logging
-messages to the panel's communication area.
+messages to the panel's communication area. The motor status is read
+by a background thread, so slow queries don't block the GUI.
 """
 
 from stage_driver_view import Panel
 from picostage import PicoStage
 import logging
 import logging_texthandler
-from time import sleep
+import queue
+import threading
+
+# period of the status queries in the background thread (s)
+STATUS_POLL_PERIOD = 0.2
+# status values, read with one pipelined batch per poll
+STATUS_NAMES = ["GetStatus", "ActualPosition", "TargetPosition", "EncoderPosition", "Temperature"]
 
 
 class Controller:
@@ -26,7 +33,8 @@ class Controller:
         self.panel = panel
 
         # Attach text widget to logger so controller/stage logs are visible
-        logging_texthandler.TextHandler(self.panel.comm_print_line, logger_name="StageDriver")
+        self.log_queue = queue.Queue()
+        logging_texthandler.TextHandler(self.print_line, logger_name="StageDriver")
         self.logger = logging.getLogger("StageDriver")
         self.logger.setLevel(logging.ERROR)
 
@@ -55,13 +63,23 @@ class Controller:
         self.panel.bind_button('disableRemote', self.disable_remote)
         self.panel.bind_button('checkError', self.check_error)
 
+        # status thread: polls the selected motor and hands the values to
+        # the GUI thread through a queue
+        self.status_queue = queue.Queue()
+        self.status_motor = self.panel.get_motor_selected()
+        self.status_stop = threading.Event()
+        self.status_thread = threading.Thread(target=self.status_loop, daemon=True)
+        self.status_thread.start()
+
         # communication and status callbacks
         self.panel.comm_associate(self.send_command)
         self.panel.status_motors_associate(self.check_status)
 
     def run(self):
-        """Start the GUI mainloop."""
+        """Start the GUI mainloop, stop the status thread when it ends."""
         self.panel.mainloop()
+        self.status_stop.set()
+        self.status_thread.join()
 
     def check_num_devices(self):
         """Query connected device count and update the panel display."""
@@ -166,41 +184,74 @@ class Controller:
         self.stages.set_motor_status(motor, "EncoderPosition", enc)
 
     def set_all_position(self, event):
-        """Set multiple position/status fields atomically to a given value.
+        """Set the actual, target and encoder positions atomically to a given value.
 
-        This temporarily disables the motor to avoid movement while the
-        reported positions are updated.
+        The controller sets all three in one command without moving or
+        disabling the motor (MC_ORIG).
         """
         motor = self.panel.get_motor_selected()
         enc = self.panel.get_setpos_value()
-        # turn off to prevent movement while setting values
-        is_enabled = self.stages.get_motor_status(motor, "Enabled")
-        self.stages.set_motor_status(motor, "Enabled", 0)
-        self.stages.set_motor_status(motor, "TargetPosition", enc)
-        self.stages.set_motor_status(motor, "ActualPosition", enc)
-        self.stages.set_motor_status(motor, "Enabled", is_enabled)
-        # give motor time to engage
-        sleep(0.1)
-        self.stages.set_motor_status(motor, "EncoderPosition", enc)
+        self.stages.set_motor_command(motor, "SetOrigin", enc)
 
     def check_status(self):
-        """Poll motor status bits and update the status panel display."""
-        motor = self.panel.get_motor_selected()
-        motor_type = self.stages.get_motor_parameter(motor, "TypeDevice")
-        if motor_type is None or motor_type == 0:
+        """Update the status panel display with the latest values of the status thread.
+
+        Called by the panel timer on the GUI thread. Only the newest update
+        is displayed, older ones queued since the last call are dropped. The
+        log lines of the status thread are printed here as well.
+        """
+        while True:
+            try:
+                self.panel.comm_print_line(self.log_queue.get_nowait())
+            except queue.Empty:
+                break
+        self.status_motor = self.panel.get_motor_selected()
+        latest = None
+        while True:
+            try:
+                latest = self.status_queue.get_nowait()
+            except queue.Empty:
+                break
+        if latest is None:
+            return
+        motor, values = latest
+        if motor != self.status_motor or None in values.values():
             return
-        status_byte = self.stages.get_motor_command(motor, "GetStatus")
-        motor_pos = self.stages.get_motor_status(motor, "ActualPosition")
-        motor_target = self.stages.get_motor_status(motor, "TargetPosition")
-        enc_pos = self.stages.get_motor_status(motor, "EncoderPosition")
-        temp_C = self.stages.get_motor_status(motor, "Temperature")
-        self.panel.status_motors_update(status_byte, motor_pos, motor_target, enc_pos, temp_C)
+        self.panel.status_motors_update(*(values[name] for name in STATUS_NAMES))
+
+    def status_loop(self):
+        """Body of the status thread: query the selected motor every STATUS_POLL_PERIOD.
+
+        The device type is read once per motor selection, the status values
+        with one pipelined batch. The thread never touches Tk widgets.
+        """
+        motor_types = {}
+        while not self.status_stop.wait(STATUS_POLL_PERIOD):
+            motor = self.status_motor
+            try:
+                if motor not in motor_types:
+                    motor_types = {motor: self.stages.get_motor_parameter(motor, "TypeDevice")}
+                if not motor_types[motor]:
+                    motor_types = {} # not configured (or no answer), check again next time
+                    continue
+                values = self.stages.get_parameter_array(None, motor, STATUS_NAMES)
+            except Exception as e:
+                self.logger.error(f"Status query failed: {e}")
+                continue
+            self.status_queue.put((motor, values))
 
     def check_error(self, event):
         result = self.stages.get_error()
         if result is not None:
             self.panel.comm_print_line(result)
 
+    def print_line(self, text):
+        """Print a log line, lines of the status thread are queued for the GUI thread."""
+        if threading.current_thread() is threading.main_thread():
+            self.panel.comm_print_line(text)
+        else:
+            self.log_queue.put(text)
+
     def send_command(self, text):
         """Send a raw command to the PicoStage and print the response."""
         resp = self.stages.send_direct_command(text)
@@ -11,6 +11,7 @@
 #include <ansi_c.h>
 #include <visa.h>
 #include <userint.h>
+#include <utility.h>
 
 #include "StageDriver.h"
 #include "cJSON.h"
@@ -27,6 +28,25 @@
 #define SERIAL_BAUDRATE	115200         // Baud rate for serial communication
 #define SERIAL_TERMCHAR	0xA            // Line terminator character (newline)
 
+// Binary protocol (see SerialComm.h in the controller firmware)
+#define SD_BIN_SYNC			0xA5	// first byte of a request frame
+#define SD_BIN_REPLY_SYNC	0x5A	// first byte of a reply frame
+#define SD_BIN_REQUEST_SIZE	14		// request: sync, group, ID[4], board, sub, value[4], CRC16
+#define SD_BIN_REPLY_SIZE	8		// reply: sync, error, value[4], CRC16
+
+// Bulk parameter transfer (GMP_PALL/SMP_PALL, see CommandList.md): the motor parameters up to
+// MP_TDEV in the order of motorParameterCommands, followed by the remote parameters
+#define SD_NUM_BULK_MOTOR_PARAMS	34
+#define SD_NUM_BULK_PARAMS			(SD_NUM_BULK_MOTOR_PARAMS + 5)
+
+// Number of motor parameters (motorParameterNames), the remote parameters follow in a
+// snapshot (SD_SNAPSHOT_NUM_PARAMS counts both)
+#define SD_NUM_MOTOR_PARAMS			(SD_NUM_BULK_MOTOR_PARAMS + 2)
+
+// Parameter cache (client-side mirror of the GMP_PALL values)
+#define SD_CACHE_MAX_MOTORS			8		// motors covered by the mirror
+#define SD_CACHE_CHECK_INTERVAL_S	0.5		// the change counter (GPC_PCNT) is checked at most this often
+
 // Buffer size limits
 #define MAX_ERROR_STRING_LENGTH 1024    // Maximum length for error message strings
 #define MAX_FORMAT_STRING_LENGTH 100    // Maximum length for command format strings
@@ -96,14 +116,22 @@ static const char *motorStatusCommands[] =
 static const char *motorCommandNames[] =
 	{
 		"FindHome", "Config", "StatusClear",
-		"MoveToPosition", "MoveAtVelocity", "HasPositionReached", "GetStatus"
+		"MoveToPosition", "MoveAtVelocity", "HasPositionReached", "GetStatus", "SetOrigin"
 	};
 
 // Command codes for motor actions (parallel to motorCommandNames)
 static const char *motorCommandCommands[] =
 	{
 		"MC_HOME", "MC_CONF", "MC_SCLR",
-		"MC_MPOS", "MC_MVEL", "MC_POSR", "MC_STAT"
+		"MC_MPOS", "MC_MVEL", "MC_POSR", "MC_STAT", "MC_ORIG"
+	};
+
+
+// Command groups of the binary protocol, the group code is the index into this list
+static const char *binaryGroupList[] =
+	{
+		"GMC_", "GMP_", "GMS_", "GPC_", "GRP_",
+		"SMC_", "SMP_", "SMS_", "SPC_", "SRP_"
 	};
 
 
@@ -114,6 +142,53 @@ static const char *motorCommandCommands[] =
 // VISA resource manager handle - manages all serial connections
 static ViSession g_resManager = 0;
 
+// Flag whether the get/set functions use binary frames instead of ASCII commands
+static int g_binaryMode = 0;
+
+// Asynchronous command waiting for (or holding the result of) its response
+typedef struct {
+	int ticket;								// ticket number, 0 -> slot never used
+	int isDone;								// flag if the response was processed
+	int error;								// 0 -> success, -1 -> error response or communication error
+	char code[8];							// command code of a typed get (e.g. "MS_XACT"), "" for raw commands
+	int motor;								// motor number of a typed get
+	int *value;								// receives the value of a typed get (NULL if not used)
+	SD_AsyncCallback callback;				// called on completion (NULL if not used)
+	void *callbackData;						// passed to the callback
+} AsyncRequest;
+
+// Queue of the asynchronous commands, the pending ones are numPending slots starting at head.
+// Completed slots keep their result until they are reused.
+static AsyncRequest g_asyncQueue[SD_ASYNC_MAX_PENDING];
+static int g_asyncHead = 0;					// slot of the oldest pending command
+static int g_asyncNumPending = 0;			// number of commands waiting for their response
+static int g_asyncNextTicket = 1;			// ticket number of the next command
+static int g_asyncIsLocked = 0;				// flag if the device is locked for the pending commands
+static int g_asyncHasFailed = 0;			// flag if a command failed since the last SD_WaitForAll
+
+// Client-side mirror of the motor and remote parameters (see SD_SetParameterCache)
+typedef struct {
+	int handle;								// device the mirror belongs to, 0 -> none
+	int isFilled;							// flag if the values are complete
+	int numMotors;							// number of mirrored motors (PC_NDEV), 0 -> not known yet
+	int values[SD_CACHE_MAX_MOTORS][SD_NUM_BULK_PARAMS];	// values in GMP_PALL order
+	int isMotorRead[SD_CACHE_MAX_MOTORS];	// flags of cacheFill, motor read successfully
+	unsigned int changeCount;				// device change counter the values correspond to
+	int isCountRead;						// flag of cacheFill, counter read successfully
+	int isUnsupported;						// flag if the firmware has no counter or bulk get
+	double lastCheck;						// Timer() of the last counter check
+} ParamCache;
+
+static ParamCache g_cache;
+static int g_cacheEnabled = 1;				// flag if the parameter gets use the mirror
+
+// Destination of a pipelined GMP_PALL of SD_ReadConfigSnapshot
+typedef struct {
+	int motor;								// motor number of the command
+	int values[SD_NUM_BULK_PARAMS];			// values in GMP_PALL order
+	int isRead;								// flag if the response was parsed successfully
+} BulkRead;
+
 
 // *****************************************************************************************
 // Internal Function Prototypes
@@ -137,14 +212,57 @@ static int SD_SetMotorValue(int handle, int motor, const char *command, int valu
 // Low-level VISA communication - sends command and receives response
 static int SD_SendCommandGetResponse(int handle, const char *command, char *responseStr);
 
+// Low-level binary communication - sends one request frame and receives the reply frame
+static int SD_SendBinaryCommand(int handle, char getSet, const char *command, int motor, int sub, int value, int *result);
+
+// Asynchronous commands - queues a command and writes it to the device
+static int asyncSubmit(int handle, const char *command, const char *code, int motor, int *value,
+					   SD_AsyncCallback callback, void *callbackData);
+
+// Asynchronous commands - reads the response of the oldest pending command and completes it
+static int asyncReadResponse(int handle);
+
+// Asynchronous commands - completes the oldest pending command with a response
+static void asyncComplete(int handle, const char *response, int error);
+
+// Asynchronous commands - processes all pending responses (before a synchronous command)
+static int asyncDrain(int handle);
+
+// CRC-16/CCITT-FALSE used by the binary frames
+static unsigned short crc16(const unsigned char *data, int len);
+
 // Checks if a response indicates an error and retrieves the error message
 static int checkErrorResponse(int handle, char* response);
 
-// JSON conversion helper - extracts parameter from device and adds to JSON object
-static int SD_ToJSONFromParam(int handle, int motor, cJSON *object, char *paramName, char *paramCommand);
+// Bulk transfer - parses the values of a GMP_PALL response
+static int parseAllParams(const char *response, int motor, int *values);
+
+// Parameter cache - gets the index of a parameter in the mirror (-1 if not mirrored)
+static int cacheIndex(const char* nameListPtr[], int numNames, const char *paramName, int offset);
+
+// Parameter cache - gets a value from the mirror, checks and refills the mirror as needed
+static int cacheGetValue(int handle, int motor, int index, int *value);
+
+// Parameter cache - updates the mirror after a successful set
+static void cacheSetValue(int handle, int motor, int index, int value);
+
+// Parameter cache - reads the change counter and all parameters, pipelined
+static int cacheFill(int handle);
+
+// Parameter cache - callback of the pipelined commands of cacheFill
+static void cacheFillCallback(int handle, int ticket, int error, const char *response, void *callbackData);
 
-// JSON conversion helper - reads parameter from JSON object and sets it on device
-static int SD_SetParamFromJSON(int handle, int motor, cJSON *object, char *paramName, char *paramCommand);
+// Configuration snapshot - gets the name and the command code of a snapshot value
+static const char *snapshotName(int index);
+static const char *snapshotCommand(int index);
+
+// Configuration snapshot - gets the snapshot index of a GMP_PALL value
+static int snapshotIndex(int bulkIndex);
+
+// Configuration snapshot - callbacks of the pipelined commands
+static void bulkReadCallback(int handle, int ticket, int error, const char *response, void *callbackData);
+static void snapshotValidCallback(int handle, int ticket, int error, const char *response, void *callbackData);
+static void snapshotSetCallback(int handle, int ticket, int error, const char *response, void *callbackData);
 
 // Error reporting functions - log errors with location information
 static void reportError(int line, const char* function, char* description );
@@ -205,6 +323,8 @@ int SD_Init(int *handle, const char *address)
 	viSetAttribute(io, VI_ATTR_ASRL_FLOW_CNTRL, VI_ASRL_FLOW_NONE);
 	viSetAttribute(io, VI_ATTR_TERMCHAR, SERIAL_TERMCHAR);
 	viSetAttribute(io, VI_ATTR_ASRL_END_IN, VI_ASRL_END_TERMCHAR);
+	// socket sessions (port multiplexer, "TCPIP::localhost::5025::SOCKET") end reads at the termchar this way
+	if (strncmp(address, "TCPIP", 5) == 0) viSetAttribute(io, VI_ATTR_TERMCHAR_EN, VI_TRUE);
 
 	// ask for identification; here I use printf/read because of the spaces in the return string
 	status = viPrintf(io, "*IDN?\n");
@@ -234,6 +354,7 @@ int SD_Init(int *handle, const char *address)
 	}
 
 	*handle = (int) io;
+	SD_InvalidateParameterCache(*handle);
 	return 0;
 	
 fail:
@@ -264,6 +385,7 @@ int SD_Close(int *handle)
 {
 	ViStatus status;
 	if (*handle) {
+		SD_InvalidateParameterCache(*handle);
 		status = viClose((ViSession) *handle);
 		if(status) {
 			reportVisaError (__LINE__-2, __func__,(ViSession) *handle, status);
@@ -293,6 +415,8 @@ int SD_Close(int *handle)
 int SD_GetMotorParameter(int handle, int motor, const char *paramName, int *value)
 {
 	int numCommands = sizeof(motorParameterCommands) / sizeof(motorParameterCommands[0]);
+	int index = cacheIndex(motorParameterNames, SD_NUM_BULK_MOTOR_PARAMS, paramName, 0);
+	if (cacheGetValue(handle, motor, index, value) == 0) return 0;
 	int status = SD_GetRequest(handle, motorParameterNames, motorParameterCommands, numCommands,
 							  motor, paramName, value);
 	return status;
@@ -305,6 +429,7 @@ int SD_SetMotorParameter(int handle, int motor, const char *paramName, int value
 	int numCommands = sizeof(motorParameterCommands) / sizeof(motorParameterCommands[0]);
 	int status = SD_SetRequest(handle, motorParameterNames, motorParameterCommands, numCommands,
 							  motor, paramName, value);
+	if (!status) cacheSetValue(handle, motor, cacheIndex(motorParameterNames, SD_NUM_BULK_MOTOR_PARAMS, paramName, 0), value);
 	return status;
 }
 
@@ -313,6 +438,8 @@ int SD_SetMotorParameter(int handle, int motor, const char *paramName, int value
 int SD_GetRemoteParameter(int handle, int motor, const char *paramName, int *value)
 {
 	int numCommands = sizeof(remoteParameterCommands) / sizeof(remoteParameterCommands[0]);
+	int index = cacheIndex(remoteParameterNames, numCommands, paramName, SD_NUM_BULK_MOTOR_PARAMS);
+	if (cacheGetValue(handle, motor, index, value) == 0) return 0;
 	int status = SD_GetRequest(handle, remoteParameterNames, remoteParameterCommands, numCommands,
 							  motor, paramName, value);
 	return status;
@@ -325,6 +452,7 @@ int SD_SetRemoteParameter(int handle, int motor, const char *paramName, int valu
 	int numCommands = sizeof(remoteParameterCommands) / sizeof(remoteParameterCommands[0]);
 	int status = SD_SetRequest(handle, remoteParameterNames, remoteParameterCommands, numCommands,
 							  motor, paramName, value);
+	if (!status) cacheSetValue(handle, motor, cacheIndex(remoteParameterNames, numCommands, paramName, SD_NUM_BULK_MOTOR_PARAMS), value);
 	return status;
 }
 
@@ -365,7 +493,7 @@ int SD_GetMotorCommand(int handle, int motor, const char *paramName, int *value)
 
 	// some values are not gettable
 	if (strcmp(paramName, "MC_HOME")==0 || strcmp(paramName, "MC_CONF")==0 || strcmp(paramName, "MC_SCLR")==0
-		  || strcmp(paramName, "MC_MPOS")==0 || strcmp(paramName, "MC_MVEL")==0) {
+		  || strcmp(paramName, "MC_MPOS")==0 || strcmp(paramName, "MC_MVEL")==0 || strcmp(paramName, "MC_ORIG")==0) {
 		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Not a gettable motor command: %s.", paramName);
 		reportError (__LINE__-2, __func__, errStr);
 		return -1;
@@ -392,6 +520,7 @@ int SD_SetMotorCommand(int handle, int motor, const char *paramName, int value)
 	int numCommands = sizeof(motorCommandCommands) / sizeof(motorCommandCommands[0]);
 	int status = SD_SetRequest(handle, motorCommandNames, motorCommandCommands, numCommands,
 							  motor, paramName, value);
+	if (strcmp(paramName, "Config")==0) SD_InvalidateParameterCache(handle); // the config can adjust parameters
 	return status;
 }
 
@@ -411,13 +540,14 @@ int SD_GetPicoCommand(int handle, const char *command, int *value)
 	char errStr[MAX_ERROR_STRING_LENGTH];
 	char formatStr[MAX_FORMAT_STRING_LENGTH];
 	
-	if (strcmp(command, "PC_NDEV")==0 || strcmp(command, "PC_VERS")==0)	
+	if (strcmp(command, "PC_NDEV")==0 || strcmp(command, "PC_VERS")==0 || strcmp(command, "PC_PCNT")==0)	
 		snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "G%s", command);
 	else {
 		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Not a gettable Pico command: %s.", command);
 		reportError (__LINE__-1, __func__, errStr);
 		return -1;
 	}		
+	if (g_binaryMode) return SD_SendBinaryCommand(handle, 'G', command, 0, 0, 0, value);
 	err = SD_SendCommandGetResponse(handle,commandStr, instrResp);
 	if(err) {
 		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Could not get value from Pico in reponse to %s.", commandStr);
@@ -507,6 +637,7 @@ int SD_SendDirectCommand(int handle, const char *command, char* response, int bu
 {
 	int err = 0;
 	char instrResp[SD_MAX_INSTR_RESP_LENGTH];
+	if (command[0]=='S' || command[0]=='s') SD_InvalidateParameterCache(handle); // may change a parameter
 	err = SD_SendCommandGetResponse(handle, command, instrResp);
 	if (err) return err;
 	strncpy(response, instrResp, (bufSize<SD_MAX_INSTR_RESP_LENGTH ? bufSize : SD_MAX_INSTR_RESP_LENGTH));
@@ -532,6 +663,182 @@ int SD_GetErrorMessage(int handle, char* response, int bufSize)
 }
 
 
+////////////////////////////////////////////////////////
+// Protocol Mode - ASCII or Binary Frames
+////////////////////////////////////////////////////////
+// In binary mode, the get/set functions exchange fixed-size frames with a CRC instead
+// of ASCII lines. This avoids formatting and parsing on both ends and shortens the
+// replies. Commands with text replies (error message, ID) always use ASCII, the
+// controller accepts both formats at any time.
+//
+// Parameters:
+//   handle    - Device connection handle
+//   enable    - 1 for binary frames, 0 for ASCII commands (default)
+//
+// Returns: 0 on success, -1 on failure
+int SD_SetBinaryMode(int handle, int enable)
+{
+	int version;
+
+	if (!handle) {
+		reportError (__LINE__-1, __func__, "Device not open.");
+		return -1;
+	}
+	g_binaryMode = enable ? 1 : 0;
+	if (g_binaryMode && SD_GetPicoCommand(handle, "PC_VERS", &version)) { // check that the firmware understands frames
+		reportError (__LINE__-1, __func__, "Controller does not support binary frames.");
+		g_binaryMode = 0;
+		return -1;
+	}
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Asynchronous Commands - Submit
+////////////////////////////////////////////////////////
+// The submit functions write a command to the device and return a ticket right away,
+// without waiting for the response. The controller answers the commands in order, so
+// the responses are matched to the pending commands in order. Up to SD_ASYNC_MAX_PENDING
+// commands can be on their way, a submit to a full queue first processes the oldest
+// response. The device stays locked from the first submit until the last pending
+// response was processed, so one lock covers a whole batch.
+//
+// The responses are processed by SD_PollResponses, SD_WaitForTicket and SD_WaitForAll,
+// the callbacks are called from these functions (they must not call the library).
+// Error responses are not followed by an error message query as in the synchronous
+// functions, use SD_GetErrorMessage if needed. Asynchronous commands always use ASCII
+// commands. A synchronous function first waits for all pending responses.
+//
+// Parameters:
+//   command      - Raw command string (without newline), e.g. "SMC_MPOS0,1000"
+//   callback     - Called when the response was processed (NULL if not used)
+//   callbackData - Passed to the callback
+//
+// Returns: ticket number (>0) on success, -1 on failure
+int SD_SubmitCommand(int handle, const char *command, SD_AsyncCallback callback, void *callbackData)
+{
+	if (command[0]=='S' || command[0]=='s') SD_InvalidateParameterCache(handle); // may change a parameter
+	return asyncSubmit(handle, command, "", 0, NULL, callback, callbackData);
+}
+
+// Submits a motor status get by name (e.g., "ActualPosition"), the value is written to
+// *value when the response is processed (value must stay valid until then).
+// Returns: ticket number (>0) on success, -1 on failure or unknown parameter name
+int SD_SubmitGetMotorStatus(int handle, int motor, const char *paramName, int *value,
+							SD_AsyncCallback callback, void *callbackData)
+{
+	char commandStr[MAX_FORMAT_STRING_LENGTH];
+	char errStr[MAX_ERROR_STRING_LENGTH];
+	int numCommands = sizeof(motorStatusCommands) / sizeof(motorStatusCommands[0]);
+
+	for (int idx = 0; idx < numCommands; ++idx) {
+		if (strcmp(paramName, motorStatusNames[idx]) == 0) {
+			snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "G%s%d", motorStatusCommands[idx], motor);
+			return asyncSubmit(handle, commandStr, motorStatusCommands[idx], motor, value, callback, callbackData);
+		}
+	}
+	snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Unknown parameter: %s.", paramName);
+	reportError (__LINE__-1, __func__, errStr);
+	return -1;
+}
+
+
+////////////////////////////////////////////////////////
+// Asynchronous Commands - Collect Responses
+////////////////////////////////////////////////////////
+// Processes the responses of the submitted commands, in order of submission.
+
+// Processes the responses that have arrived so far, returns without waiting for
+// the others (a response line that only arrived partially is read to its end).
+// Returns: number of completed commands, -1 on a communication error
+int SD_PollResponses(int handle)
+{
+	ViStatus status;
+	ViUInt32 numAvail;
+	int numCompleted = 0;
+
+	while (g_asyncNumPending > 0) {
+		status = viGetAttribute((ViSession) handle, VI_ATTR_ASRL_AVAIL_NUM, &numAvail);
+		if(status) {
+			reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
+			return -1;
+		}
+		if (numAvail == 0) break;
+		if (asyncReadResponse(handle)) return -1;
+		numCompleted++;
+	}
+	return numCompleted;
+}
+
+// Waits until the command with the given ticket (and all submitted before) have completed
+// Returns: 0 if the command succeeded, -1 on failure or if its result is no longer available
+int SD_WaitForTicket(int handle, int ticket)
+{
+	AsyncRequest *request = NULL;
+
+	for (int z=0; z<SD_ASYNC_MAX_PENDING; z++) {
+		if (g_asyncQueue[z].ticket == ticket && ticket > 0) request = &g_asyncQueue[z];
+	}
+	if (request == NULL) {
+		reportError (__LINE__-1, __func__, "Unknown ticket or result no longer available.");
+		return -1;
+	}
+	while (!request->isDone) {
+		if (asyncReadResponse(handle)) break; // all pending commands failed
+	}
+	return request->error;
+}
+
+// Waits until all submitted commands have completed
+// Returns: 0 if all commands since the last call succeeded, -1 otherwise
+int SD_WaitForAll(int handle)
+{
+	int err = asyncDrain(handle);
+
+	if (g_asyncHasFailed) err = -1;
+	g_asyncHasFailed = 0;
+	return err;
+}
+
+
+////////////////////////////////////////////////////////
+// Parameter Cache - Client-Side Mirror of the Parameters
+////////////////////////////////////////////////////////
+// The motor and remote parameter gets are answered from a mirror of the parameter
+// tables. The mirror is filled with one pipelined bulk read (GMP_PALL of each motor),
+// the sets update it. It is dropped on SMC_CONF, SD_LoadConfigFromFile, raw set
+// commands, SD_Init and SD_Close. To see changes made by others (e.g. the remote
+// taking control), a get checks the change counter of the device (GPC_PCNT) if the last
+// check was more than SD_CACHE_CHECK_INTERVAL_S ago and refills the mirror if it differs.
+// The device and axis types are not mirrored. Firmware without the counter or the
+// bulk command is read directly, as without the mirror.
+//
+// Parameters:
+//   handle    - Device connection handle
+//   enable    - 1 to use the mirror (default), 0 to read every parameter from the device
+//
+// Returns: 0 on success, -1 on failure
+int SD_SetParameterCache(int handle, int enable)
+{
+	g_cacheEnabled = enable ? 1 : 0;
+	return SD_InvalidateParameterCache(handle);
+}
+
+// Drops the mirror, the next parameter get reads all parameters again
+// Returns: 0 on success
+int SD_InvalidateParameterCache(int handle)
+{
+	g_cache.isFilled = 0;
+	if (g_cache.handle != handle) { // a new device, which may not be the same firmware
+		g_cache.handle = handle;
+		g_cache.numMotors = 0;
+		g_cache.isUnsupported = 0;
+	}
+	return 0;
+}
+
+
 ////////////////////////////////////////////////////////
 // Direct Register Access - Low-Level Hardware Control
 ////////////////////////////////////////////////////////
@@ -554,6 +861,7 @@ int SD_GetRegisterValue(int handle, int motor, int reg, int *value)
 	char errStr[MAX_ERROR_STRING_LENGTH];
 	int respDev;
 	
+	if (g_binaryMode) return SD_SendBinaryCommand(handle, 'G', "MC_DREG", motor, 0, reg, value);
 	snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "GMC_DREG%d,%d", motor, reg);
 	err = SD_SendCommandGetResponse(handle, commandStr, instrResp);
 	if(err) {
@@ -588,6 +896,7 @@ int SD_SetRegisterValue(int handle, int motor, int reg, int value)
 	char commandStr[MAX_FORMAT_STRING_LENGTH];
 	char errStr[MAX_ERROR_STRING_LENGTH];
 	
+	if (g_binaryMode) return SD_SendBinaryCommand(handle, 'S', "MC_DREG", motor, reg, value, NULL);
 	snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "SMC_DREG%d,%d,%d", motor, reg, value);
 	err = SD_SendCommandGetResponse(handle, commandStr, instrResp);
 	if(err) {
@@ -600,10 +909,137 @@ int SD_SetRegisterValue(int handle, int motor, int reg, int value)
 
 
 ////////////////////////////////////////////////////////
-// Configuration File I/O - Load Configuration from JSON File
+// Configuration Snapshot - Read from the Device
+////////////////////////////////////////////////////////
+// Reads the motor and remote parameters of all motors into a compact in-memory snapshot.
+// The GMP_PALL of each motor and the gets of the device and axis types are submitted as
+// asynchronous commands, so the whole configuration is read in about one round trip.
+// Firmware without the bulk command is read parameter by parameter. Values that could
+// not be read are marked invalid.
+//
+// Parameters:
+//   handle    - Device connection handle
+//   snapshot  - Receives the values
+//
+// Returns: 0 on success, -1 on failure (the snapshot may be incomplete)
+int SD_ReadConfigSnapshot(int handle, SD_ConfigSnapshot *snapshot)
+{
+	int numMotors;
+	int isComplete = 1;
+	int isOk = 1;
+	char commandStr[MAX_FORMAT_STRING_LENGTH];
+	char errStr[MAX_ERROR_STRING_LENGTH];
+	int isFallbackReported = 0;
+	BulkRead bulkReads[SD_SNAPSHOT_MAX_MOTORS];
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	memset(bulkReads, 0, sizeof(bulkReads));
+	if (SD_GetPicoCommand(handle, "PC_NDEV", &numMotors)) {
+		reportError (__LINE__-1, __func__, "Could not get max number of motors");
+		return -1;
+	}
+	snapshot->numMotors = (numMotors < SD_SNAPSHOT_MAX_MOTORS) ? numMotors : SD_SNAPSHOT_MAX_MOTORS;
+
+	// all parameters but the device and axis type with one command, the types as typed gets
+	for (int motor=0; motor<snapshot->numMotors && isOk; motor++) {
+		bulkReads[motor].motor = motor;
+		snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "GMP_PALL%d", motor);
+		isOk = (asyncSubmit(handle, commandStr, "", 0, NULL, bulkReadCallback, &bulkReads[motor]) > 0);
+		for (int idx=SD_NUM_BULK_MOTOR_PARAMS; idx<SD_NUM_MOTOR_PARAMS && isOk; idx++) {
+			snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "G%s%d", motorParameterCommands[idx], motor);
+			isOk = (asyncSubmit(handle, commandStr, motorParameterCommands[idx], motor, &snapshot->values[motor][idx],
+								snapshotValidCallback, &snapshot->isValid[motor][idx]) > 0);
+		}
+	}
+	asyncDrain(handle);
+	for (int motor=0; motor<snapshot->numMotors; motor++) {
+		if (!bulkReads[motor].isRead) continue;
+		for (int iParam=0; iParam<SD_NUM_BULK_PARAMS; iParam++) {
+			int idx = snapshotIndex(iParam);
+			snapshot->values[motor][idx] = bulkReads[motor].values[iParam];
+			snapshot->isValid[motor][idx] = 1;
+		}
+	}
+
+	// the rest one by one (firmware without the bulk command, failed reads)
+	for (int motor=0; motor<snapshot->numMotors; motor++) {
+		if (!bulkReads[motor].isRead && !isFallbackReported) {
+			reportError (0, NULL, "Bulk parameter transfer not available, reading the parameters one by one.");
+			isFallbackReported = 1;
+		}
+		for (int idx=0; idx<SD_SNAPSHOT_NUM_PARAMS; idx++) {
+			if (snapshot->isValid[motor][idx]) continue;
+			if (SD_GetMotorValue(handle, motor, snapshotCommand(idx), &snapshot->values[motor][idx])) {
+				snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Unable to get parameter %s for motor %d.", snapshotName(idx), motor);
+				reportError (__LINE__-2, __func__, errStr);
+				isComplete = 0;
+				continue;
+			}
+			snapshot->isValid[motor][idx] = 1;
+		}
+	}
+	return isComplete ? 0 : -1;
+}
+
+
 ////////////////////////////////////////////////////////
-// Loads motor and remote parameters from a JSON configuration file and 
-// applies them to all motors on the device.
+// Configuration Snapshot - Apply to the Device
+////////////////////////////////////////////////////////
+// Compares a snapshot with the current device state (see SD_ReadConfigSnapshot) and sends
+// only the values that differ, as asynchronous commands. Values marked invalid and motors
+// beyond the ones of the device are left unchanged. The device and axis types go last,
+// as they reconfigure the board.
+//
+// Parameters:
+//   handle     - Device connection handle
+//   snapshot   - Values to apply
+//   numChanged - Receives the number of values sent to the device (NULL if not used)
+//
+// Returns: 0 on success, -1 on failure
+int SD_ApplyConfigSnapshot(int handle, const SD_ConfigSnapshot *snapshot, int *numChanged)
+{
+	SD_ConfigSnapshot current;
+	int numMotors;
+	int numSent = 0;
+	int numFailed = 0;
+	char commandStr[MAX_FORMAT_STRING_LENGTH];
+	char errStr[MAX_ERROR_STRING_LENGTH];
+
+	if (numChanged) *numChanged = 0;
+	// a value that could not be read counts as different
+	if (SD_ReadConfigSnapshot(handle, &current) && current.numMotors == 0) return -1;
+	numMotors = (snapshot->numMotors < current.numMotors) ? snapshot->numMotors : current.numMotors;
+	for (int isTypePass=0; isTypePass<2; isTypePass++) {
+		for (int motor=0; motor<numMotors; motor++) {
+			for (int idx=0; idx<SD_SNAPSHOT_NUM_PARAMS; idx++) {
+				int isType = (idx >= SD_NUM_BULK_MOTOR_PARAMS && idx < SD_NUM_MOTOR_PARAMS);
+				int value = snapshot->values[motor][idx];
+
+				if (isType != isTypePass || !snapshot->isValid[motor][idx]) continue;
+				if (current.isValid[motor][idx] && current.values[motor][idx] == value) continue;
+				snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "S%s%d,%d", snapshotCommand(idx), motor, value);
+				if (asyncSubmit(handle, commandStr, "", 0, NULL, snapshotSetCallback, &numFailed) > 0) numSent++;
+				else numFailed++;
+			}
+		}
+	}
+	asyncDrain(handle);
+	SD_InvalidateParameterCache(handle); // values were set without going through the mirror
+	if (numChanged) *numChanged = numSent;
+	if (numFailed) {
+		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Could not set %d of the %d changed parameters.", numFailed, numSent);
+		reportError (__LINE__-1, __func__, errStr);
+		return -1;
+	}
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Configuration Snapshot - Load from JSON File
+////////////////////////////////////////////////////////
+// Loads a snapshot from a JSON configuration file. Parameters and motors missing in the
+// file are marked invalid, unknown keys are ignored.
 //
 // JSON Format Expected:
 // {
@@ -613,72 +1049,121 @@ int SD_SetRegisterValue(int handle, int motor, int reg, int value)
 // }
 //
 // Parameters:
-//   handle    - Device connection handle
 //   fileName  - Path to JSON configuration file
+//   snapshot  - Receives the values
 //
 // Returns: 0 on success, -1 on failure
-int SD_LoadConfigFromFile(int handle, char *fileName)
+int SD_LoadConfigSnapshot(const char *fileName, SD_ConfigSnapshot *snapshot)
 {
-	int maxNumDevs;
 	char *data;
 	char errStr[MAX_ERROR_STRING_LENGTH];
-	int status;
-	int numMotorParams = sizeof(motorParameterNames) / sizeof(motorParameterNames[0]);
-	int numRemoteParams = sizeof(remoteParameterNames) / sizeof(remoteParameterNames[0]);
-
-	// get the maximum number of motors
-	status = SD_GetPicoCommand(handle, "PC_NDEV", &maxNumDevs);	
-  if (status) {
-		reportError (__LINE__-2, __func__, "Could not get max number of motors");
-    return -1;
-  }
+	char key[16];
+
+	memset(snapshot, 0, sizeof(*snapshot));
 	FILE *fp = fopen(fileName, "r");
-  if (fp == NULL) {
+	if (fp == NULL) {
 		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Unable to open config file %s.", fileName);
 		reportError (__LINE__-2, __func__, errStr);
-    return -1;
-  }
+		return -1;
+	}
 	// figure out how big of a buffer I need and allocate the buffer
-  fseek(fp, 0, SEEK_END);
-  long len = ftell(fp);
-  rewind(fp);
+	fseek(fp, 0, SEEK_END);
+	long len = ftell(fp);
+	rewind(fp);
 	data = malloc(len + 1);
-  if (!data) { fclose(fp); reportError (__LINE__-2, __func__, "Could not allocate memory."); return -1; }
+	if (!data) { fclose(fp); reportError (__LINE__-2, __func__, "Could not allocate memory."); return -1; }
 
 	// read to contents
-	fread(data, 1, len, fp);
-  data[len] = '\0';  // null-terminate
-  fclose(fp);
-	
+	len = (long) fread(data, 1, len, fp);
+	data[len] = '\0';  // null-terminate
+	fclose(fp);
+
 	// start parsing
 	cJSON *root = cJSON_Parse(data);
-  if (!root) {
+	free(data);
+	if (!root) {
 		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "JSON parse error:  %s.", cJSON_GetErrorPtr());
 		reportError (__LINE__-3, __func__, errStr);
-    return -1;
-  }
+		return -1;
+	}
+	for (int motor=0; motor<SD_SNAPSHOT_MAX_MOTORS; motor++) {
+		snprintf(key, sizeof(key), "motor%d", motor);
+		cJSON *motorObj = cJSON_GetObjectItemCaseSensitive(root, key);
+		if (!motorObj) continue;
+		for (int idx=0; idx<SD_SNAPSHOT_NUM_PARAMS; idx++) {
+			cJSON *item = cJSON_GetObjectItemCaseSensitive(motorObj, snapshotName(idx));
+			if (!cJSON_IsNumber(item)) continue;
+			snapshot->values[motor][idx] = item->valueint;
+			snapshot->isValid[motor][idx] = 1;
+		}
+		snapshot->numMotors = motor + 1;
+	}
+	cJSON_Delete(root);  // free memory
+	return 0;
+}
 
-  // Iterate over motors
-  for (int idx = 0; idx < maxNumDevs; idx++) {
-    char key[16];
-    snprintf(key, sizeof(key), "motor%d", idx);
 
-    cJSON *motorObj = cJSON_GetObjectItemCaseSensitive(root, key);
-    if (!motorObj) continue;
+////////////////////////////////////////////////////////
+// Configuration Snapshot - Save to JSON File
+////////////////////////////////////////////////////////
+// Saves the valid values of a snapshot to a JSON configuration file, in the format read
+// by SD_LoadConfigSnapshot().
+//
+// Parameters:
+//   fileName  - Path to JSON configuration file (will be created/overwritten)
+//   snapshot  - Values to save
+//
+// Returns: 0 on success, -1 on failure
+int SD_SaveConfigSnapshot(const char *fileName, const SD_ConfigSnapshot *snapshot)
+{
+	char *data;
+	char errStr[MAX_ERROR_STRING_LENGTH];
+	char labelStr[20];
 
-		// motor parameters
-		for (int iParam=0; iParam<numMotorParams; iParam++) {
-			status = SD_SetParamFromJSON(handle, idx, motorObj, motorParameterNames[iParam], motorParameterCommands[iParam]);
-			if (status) reportError (__LINE__-1, __func__, "Could not set parameter value");
+	cJSON *root = cJSON_CreateObject();
+	for (int motor=0; motor<snapshot->numMotors; motor++) {
+		cJSON *motorObj = cJSON_CreateObject();
+		for (int idx=0; idx<SD_SNAPSHOT_NUM_PARAMS; idx++) {
+			if (snapshot->isValid[motor][idx]) cJSON_AddNumberToObject(motorObj, snapshotName(idx), snapshot->values[motor][idx]);
 		}
-		// remote parameters
-		for (int iParam=0; iParam<numRemoteParams; iParam++) {
-			status = SD_SetParamFromJSON(handle, idx, motorObj, remoteParameterNames[iParam], remoteParameterCommands[iParam]);
-			if (status) reportError (__LINE__-1, __func__, "Could not set parameter value");
-		}
-  }	
+		snprintf(labelStr, 20, "motor%d", motor);
+		cJSON_AddItemToObject(root, labelStr, motorObj);
+	}
+	data = cJSON_Print(root);  // pretty-printed JSON
 	cJSON_Delete(root);  // free memory
-  return 0;
+	if (!data) return -1;
+	FILE *fp = fopen(fileName, "w");
+	if (fp == NULL) {
+		free(data);
+		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Unable to write config file %s.", fileName);
+		reportError (__LINE__-4, __func__, errStr);
+		return -1;
+	}
+	fputs(data, fp);
+	fclose(fp);
+	free(data);
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Configuration File I/O - Load Configuration from JSON File
+////////////////////////////////////////////////////////
+// Loads motor and remote parameters from a JSON configuration file (format see
+// SD_LoadConfigSnapshot) and applies them to all motors on the device. Only the values
+// that differ from the device are sent, parameters missing in the file keep their value.
+//
+// Parameters:
+//   handle    - Device connection handle
+//   fileName  - Path to JSON configuration file
+//
+// Returns: 0 on success, -1 on failure
+int SD_LoadConfigFromFile(int handle, char *fileName)
+{
+	SD_ConfigSnapshot snapshot;
+
+	if (SD_LoadConfigSnapshot(fileName, &snapshot)) return -1;
+	return SD_ApplyConfigSnapshot(handle, &snapshot, NULL);
 }
 
 
@@ -696,46 +1181,13 @@ int SD_LoadConfigFromFile(int handle, char *fileName)
 // Returns: 0 on success, -1 on failure
 int SD_SaveConfigToFile(int handle, char *fileName)
 {
-	int maxNumDevs;
-	char *data;
-	char labelStr[20];
-	int status;
-	int numMotorParams = sizeof(motorParameterNames) / sizeof(motorParameterNames[0]);
-	int numRemoteParams = sizeof(remoteParameterNames) / sizeof(remoteParameterNames[0]);
-
-	// get the maximum number of motors
-	status = SD_GetPicoCommand(handle, "PC_NDEV", &maxNumDevs);	
-  if (status) {
-		reportError (__LINE__-2, __func__, "Could not get max number of motors");
-    return -1;
-  }
-  cJSON *root = cJSON_CreateObject();
-  // Iterate over motors
-  for (int idx = 0; idx < maxNumDevs; idx++) {
-    cJSON *motorObj = cJSON_CreateObject();
-		// motor parameters
-		for (int iParam=0; iParam<numMotorParams; iParam++) {
-			SD_ToJSONFromParam(handle, idx, motorObj, motorParameterNames[iParam], motorParameterCommands[iParam]);					
-		}
-		// remote parameters
-		for (int iParam=0; iParam<numRemoteParams; iParam++) {
-			SD_ToJSONFromParam(handle, idx, motorObj, remoteParameterNames[iParam], remoteParameterCommands[iParam]);					
-		}
-		snprintf(labelStr, 20, "motor%d", idx);
-		cJSON_AddItemToObject(root, labelStr, motorObj);
-  }
+	SD_ConfigSnapshot snapshot;
+	int status = SD_ReadConfigSnapshot(handle, &snapshot);
 
-	data = cJSON_Print(root);  // pretty-printed JSON
-  if (!data) return -1;
-  FILE *fp = fopen(fileName, "w");
-  if (fp) {
-      fputs(data, fp);
-      fclose(fp);
-  }
-  free(data);	
-	
-	cJSON_Delete(root);  // free memory
-  return 0;
+	if (snapshot.numMotors == 0) return -1;
+	// an incomplete read is saved without the missing values
+	if (SD_SaveConfigSnapshot(fileName, &snapshot)) return -1;
+	return status;
 }
 
 
@@ -820,6 +1272,7 @@ static int SD_GetMotorValue(int handle, int motor, const char *command, int *val
 	char formatStr[MAX_FORMAT_STRING_LENGTH];
 	int respDev;
 
+	if (g_binaryMode) return SD_SendBinaryCommand(handle, 'G', command, motor, 0, 0, value);
 	snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "G%s%d,%d", command, motor, value);
 	err = SD_SendCommandGetResponse(handle, commandStr, instrResp);
 	if(err) {
@@ -858,6 +1311,7 @@ static int SD_SetMotorValue(int handle, int motor, const char *command, int valu
 	char instrResp[SD_MAX_INSTR_RESP_LENGTH];
 	char commandStr[MAX_FORMAT_STRING_LENGTH];
 
+	if (g_binaryMode) return SD_SendBinaryCommand(handle, 'S', command, motor, 0, value, NULL);
 	snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "S%s%d,%d", command, motor, value);
 	err = SD_SendCommandGetResponse(handle, commandStr, instrResp);
 	if(err) {
@@ -894,6 +1348,7 @@ static int SD_SendCommandGetResponse(int handle, const char *command, char *resp
 		reportError (__LINE__-1, __func__, "Device not open.");
 		goto fail;
 	}
+	if (g_asyncNumPending > 0) asyncDrain(handle); // keep the responses in order
 	status = viLock ((ViSession) handle, VI_EXCLUSIVE_LOCK, 100, VI_NULL, VI_NULL);
 	if(status) {
 		reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
@@ -942,58 +1397,487 @@ fail:
 
 
 ////////////////////////////////////////////////////////
-// JSON Helper - Get Parameter and Add to JSON Object
+// Binary Communication - Send Request Frame and Get Reply Frame
 ////////////////////////////////////////////////////////
-// Retrieves a parameter value from the device and adds it to a JSON object.
-// Used by SD_SaveConfigToFile to build the JSON configuration.
+// Low-level counterpart of SD_SendCommandGetResponse for the binary protocol.
+// The command is given as in ASCII mode (e.g. "MS_XACT") plus the get/set prefix.
+//
+// Request: sync, group code, ID[4], board, sub, value (int32 LE), CRC16 (LE)
+// Reply:   sync, error code, value (int32 LE), CRC16 (LE)
 //
 // Parameters:
-//   object      - JSON object to add the parameter to
-//   paramName   - User-friendly parameter name (key for JSON)
-//   paramCommand - Command code to use for retrieving the value
+//   getSet   - 'G' for get commands, 'S' for set commands
+//   command  - Command code without prefix (e.g. "MS_XACT")
+//   motor    - Motor/device number
+//   sub      - Additional small argument (register number for MC_DREG), 0 if not used
+//   value    - Value to send (ignored by get commands)
+//   result   - Pointer to receive the returned value (NULL if not used)
 //
-// Returns: 0 on success, -1 on failure (but continues processing)
-static int SD_ToJSONFromParam(int handle, int motor, cJSON *object, char *paramName, char *paramCommand)
+// Returns: 0 on success, -1 on communication error or device error response
+static int SD_SendBinaryCommand(int handle, char getSet, const char *command, int motor, int sub, int value, int *result)
 {
-	int paramVal;
+	ViStatus status;
+	ViUInt32 count;
+	unsigned char frame[SD_BIN_REQUEST_SIZE];
+	unsigned char reply[SD_BIN_REPLY_SIZE];
+	char group[5];
 	char errStr[MAX_ERROR_STRING_LENGTH];
+	char errorResp[SD_MAX_INSTR_RESP_LENGTH];
+	unsigned short crc;
+	int numGroups = sizeof(binaryGroupList) / sizeof(binaryGroupList[0]);
+	int code = -1;
+	int isLocked=0;
 
-	int status = SD_GetMotorValue(handle, motor, paramCommand, &paramVal);
-	if (status) {
-		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Unable to get parameter %s for motor %d.", paramName, motor);
-		reportError (__LINE__-3, __func__, errStr);
+	if (!handle) {
+		reportError (__LINE__-1, __func__, "Device not open.");
+		return -1;
+	}
+	if (strlen(command) != 7 || command[2] != '_') {
+		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Invalid command for binary mode: %s.", command);
+		reportError (__LINE__-2, __func__, errStr);
+		return -1;
+	}
+	snprintf(group, sizeof(group), "%c%.3s", getSet, command);
+	for (int idx = 0; idx < numGroups; ++idx) {
+		if (strcmp(group, binaryGroupList[idx]) == 0) code = idx;
+	}
+	if (code < 0) {
+		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Command group not available in binary mode: %s.", group);
+		reportError (__LINE__-2, __func__, errStr);
+		return -1;
+	}
+
+	// assemble the request frame
+	frame[0] = SD_BIN_SYNC;
+	frame[1] = (unsigned char) code;
+	memcpy(frame+2, command+3, 4);
+	frame[6] = (unsigned char) motor;
+	frame[7] = (unsigned char) sub;
+	for (int z=0; z<4; z++) frame[8+z] = (unsigned char) ((unsigned int)value >> (8*z));
+	crc = crc16(frame, SD_BIN_REQUEST_SIZE-2);
+	frame[12] = (unsigned char) (crc & 0xFF);
+	frame[13] = (unsigned char) (crc >> 8);
+
+	if (g_asyncNumPending > 0) asyncDrain(handle); // keep the responses in order
+	status = viLock ((ViSession) handle, VI_EXCLUSIVE_LOCK, 100, VI_NULL, VI_NULL);
+	if(status) {
+		reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
+		goto fail;
+	}
+	isLocked=1;
+
+	status = viWrite ((ViSession) handle, frame, SD_BIN_REQUEST_SIZE, &count);
+	if(status) {
+		reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
+		goto fail;
+	}
+	// the reply may contain the termination char, so read a fixed number of bytes
+	viSetAttribute((ViSession) handle, VI_ATTR_ASRL_END_IN, VI_ASRL_END_NONE);
+	status = viRead ((ViSession) handle, reply, SD_BIN_REPLY_SIZE, &count);
+	viSetAttribute((ViSession) handle, VI_ATTR_ASRL_END_IN, VI_ASRL_END_TERMCHAR);
+	if(status) {
+		reportVisaError (__LINE__-4, __func__, (ViSession) handle, status);
+		goto fail;
+	}
+	crc = (unsigned short) (reply[6] | (reply[7] << 8));
+	if (count != SD_BIN_REPLY_SIZE || reply[0] != SD_BIN_REPLY_SYNC || crc != crc16(reply, SD_BIN_REPLY_SIZE-2)) {
+		reportError (__LINE__-1, __func__, "Invalid binary reply frame received.");
+		goto fail;
+	}
+
+	// check for error response
+	if (reply[1] != 0) {
+		snprintf(errStr, MAX_ERROR_STRING_LENGTH, "ERROR=%d", (signed char) reply[1]);
+		reportSDError (__LINE__-1, __func__, errStr);
+		checkErrorResponse(handle, errorResp);
+		reportSDError (__LINE__-3, __func__, errorResp);
+		goto fail;
+	}
+	if (result) *result = (int) ((unsigned int)reply[2] | ((unsigned int)reply[3] << 8) |
+							((unsigned int)reply[4] << 16) | ((unsigned int)reply[5] << 24));
+
+	status = viUnlock ((ViSession) handle);
+	if(status) {
+		reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
+		goto fail;
 	}
-	cJSON_AddNumberToObject(object, paramName, paramVal);
 	return 0;
+
+fail:
+	if (isLocked) viUnlock((ViSession) handle);
+	return -1;
 }
 
-// JSON Helper - Set Parameter from JSON Object
-// Retrieves a parameter value from a JSON object and sets it on the device.
-// Used by SD_LoadConfigFromFile to apply configuration from JSON.
+
+////////////////////////////////////////////////////////
+// Asynchronous Commands - Queue and Write a Command
+////////////////////////////////////////////////////////
+// Locks the device for the batch if no command is pending, makes room in a full queue
+// and writes the command.
 //
 // Parameters:
-//   object      - JSON object containing the parameter
-//   paramName   - User-friendly parameter name (key to lookup in JSON)
-//   paramCommand - Command code to use for setting the value
+//   command  - Command string to send (without newline)
+//   code     - Command code of a typed get (e.g. "MS_XACT"), "" for raw commands
+//   motor    - Motor number of a typed get
+//   value    - Receives the value of a typed get (NULL if not used)
 //
-// Returns: 0 on success or if parameter not found in JSON, -1 on error
-static int SD_SetParamFromJSON(int handle, int motor, cJSON *object, char *paramName, char *paramCommand)
+// Returns: ticket number (>0) on success, -1 on failure
+static int asyncSubmit(int handle, const char *command, const char *code, int motor, int *value,
+					   SD_AsyncCallback callback, void *callbackData)
 {
-	char errStr[MAX_ERROR_STRING_LENGTH];
+	ViStatus status;
+	ViUInt32 count;
+	char commandStr[SD_MAX_COMMAND_LENGTH+2];
+	AsyncRequest *request;
+	int len;
 
-	cJSON *name = cJSON_GetObjectItemCaseSensitive(object, paramName); 
-	if ( cJSON_IsNumber(name) ) {
-		int paramVal = name->valueint;	
-		int status = SD_SetMotorValue(handle, motor, paramCommand, paramVal);
-		if (status) {
-			reportError (__LINE__-1, __func__, "Could not set parameter value");
-			snprintf(errStr, MAX_ERROR_STRING_LENGTH, "Unable to set parameter %s for motor %d.", paramName, motor);
-			reportError (__LINE__-1, __func__, errStr);
+	if (!handle) {
+		reportError (__LINE__-1, __func__, "Device not open.");
+		return -1;
+	}
+	len = snprintf(commandStr, sizeof(commandStr), "%s\n", command);
+	if (len >= (int) sizeof(commandStr)) {
+		reportError (__LINE__-2, __func__, "Command too long.");
+		return -1;
+	}
+	if (g_asyncNumPending == SD_ASYNC_MAX_PENDING && asyncReadResponse(handle)) return -1;
+	if (!g_asyncIsLocked) {
+		status = viLock ((ViSession) handle, VI_EXCLUSIVE_LOCK, 100, VI_NULL, VI_NULL);
+		if(status) {
+			reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
+			return -1;
+		}
+		g_asyncIsLocked = 1;
+	}
+
+	status = viWrite ((ViSession) handle, (ViBuf) commandStr, (ViUInt32) len, &count);
+	if(status) {
+		reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
+		if (g_asyncNumPending == 0) {
+			viUnlock((ViSession) handle);
+			g_asyncIsLocked = 0;
 		}
-  }
+		return -1;
+	}
+
+	request = &g_asyncQueue[(g_asyncHead + g_asyncNumPending) % SD_ASYNC_MAX_PENDING];
+	request->ticket = g_asyncNextTicket;
+	request->isDone = 0;
+	request->error = 0;
+	strncpy(request->code, code, sizeof(request->code)-1);
+	request->code[sizeof(request->code)-1] = '\0';
+	request->motor = motor;
+	request->value = value;
+	request->callback = callback;
+	request->callbackData = callbackData;
+	g_asyncNumPending++;
+	if (++g_asyncNextTicket <= 0) g_asyncNextTicket = 1;
+	return request->ticket;
+}
+
+
+////////////////////////////////////////////////////////
+// Asynchronous Commands - Read One Response
+////////////////////////////////////////////////////////
+// Reads the next response line (blocking up to the VISA timeout) and completes the oldest
+// pending command with it. After a communication error the order of the responses is
+// lost, so all pending commands fail and the input buffer is discarded.
+//
+// Returns: 0 on success (also for an error response), -1 on communication error
+static int asyncReadResponse(int handle)
+{
+	ViStatus status;
+	ViUInt32 charsRead;
+	char responseStr[SD_MAX_INSTR_RESP_LENGTH+1];
+
+	if (g_asyncNumPending == 0) return 0;
+	status = viRead ((ViSession) handle, (unsigned char*)responseStr, SD_MAX_INSTR_RESP_LENGTH, &charsRead);
+	if (status || charsRead < 7) { // at least it should return "XX_XXXX=" or "ERROR=..."
+		if (status) reportVisaError (__LINE__-2, __func__, (ViSession) handle, status);
+		else reportError (__LINE__-3, __func__, "No command response received.");
+		while (g_asyncNumPending > 0) asyncComplete(handle, "", -1);
+		viFlush((ViSession) handle, VI_ASRL_IN_BUF_DISCARD);
+		return -1;
+	}
+	// make sure the response is null-terminated
+	responseStr[charsRead]='\0';
+	stripEndChars(responseStr);
+	asyncComplete(handle, responseStr, 0);
 	return 0;
 }
-	
+
+
+////////////////////////////////////////////////////////
+// Asynchronous Commands - Complete the Oldest Command
+////////////////////////////////////////////////////////
+// Checks the response for an error, parses the value of a typed get, calls the callback
+// and unlocks the device when no command is pending anymore.
+//
+// Parameters:
+//   response - Response line of the device ("" on a communication error)
+//   error    - -1 if the command failed because of a communication error, 0 otherwise
+static void asyncComplete(int handle, const char *response, int error)
+{
+	AsyncRequest *request = &g_asyncQueue[g_asyncHead];
+	char formatStr[MAX_FORMAT_STRING_LENGTH];
+	int respDev, respValue;
+
+	g_asyncHead = (g_asyncHead + 1) % SD_ASYNC_MAX_PENDING;
+	g_asyncNumPending--;
+
+	// check for error response
+	if (!error && strnicmp(response, "ERROR=", 6)==0 && response[6]!='0') {
+		reportSDError (__LINE__-1, __func__, (char *) response);
+		error = -1;
+	}
+	if (!error && request->value) {
+		snprintf(formatStr, MAX_FORMAT_STRING_LENGTH, "%s%%d=%%d", request->code);
+		if (sscanf(response, formatStr, &respDev, &respValue) != 2 || respDev != request->motor) {
+			reportError (__LINE__-1, __func__, "Invalid response received (want motor number and value).");
+			error = -1;
+		} else {
+			*request->value = respValue;
+		}
+	}
+	request->error = error;
+	request->isDone = 1;
+	if (error) g_asyncHasFailed = 1;
+	if (g_asyncNumPending == 0 && g_asyncIsLocked) {
+		viUnlock((ViSession) handle);
+		g_asyncIsLocked = 0;
+	}
+	if (request->callback) request->callback(handle, request->ticket, error, response, request->callbackData);
+}
+
+
+////////////////////////////////////////////////////////
+// Asynchronous Commands - Process All Pending Responses
+////////////////////////////////////////////////////////
+// Returns: 0 on success, -1 on communication error
+static int asyncDrain(int handle)
+{
+	while (g_asyncNumPending > 0) {
+		if (asyncReadResponse(handle)) return -1;
+	}
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Binary Communication - CRC16
+////////////////////////////////////////////////////////
+// CRC-16/CCITT-FALSE (polynomial 0x1021, start value 0xFFFF), same as in the firmware.
+//
+// Parameters:
+//   data - Bytes to check
+//   len  - Number of bytes
+//
+// Returns: the CRC value
+static unsigned short crc16(const unsigned char *data, int len)
+{
+	unsigned short crc = 0xFFFF;
+
+	for (int z=0; z<len; z++) {
+		crc ^= (unsigned short) (data[z] << 8);
+		for (int bit=0; bit<8; bit++)
+			crc = (crc & 0x8000) ? (unsigned short) ((crc << 1) ^ 0x1021) : (unsigned short) (crc << 1);
+	}
+	return crc;
+}
+
+
+////////////////////////////////////////////////////////
+// Bulk Transfer - Parse a GMP_PALL Response
+////////////////////////////////////////////////////////
+// Parameters:
+//   response - Response line, e.g. "MP_PALL0=<v0>,<v1>,..."
+//   values   - Receives SD_NUM_BULK_PARAMS values
+//
+// Returns: 0 on success, -1 on a malformed response or unexpected number of values
+static int parseAllParams(const char *response, int motor, int *values)
+{
+	const char *p;
+	char *end;
+	int respDev, offset = 0;
+	int num = 0;
+
+	if (sscanf(response, "MP_PALL%d=%n", &respDev, &offset) != 1 || offset == 0 || respDev != motor) {
+		reportError (__LINE__-1, __func__, "Invalid bulk parameter response received.");
+		return -1;
+	}
+	for (p = response + offset; num < SD_NUM_BULK_PARAMS; p = end + 1) {
+		values[num++] = (int) strtol(p, &end, 10);
+		if (end == p || *end != ',') break;
+	}
+	if (num != SD_NUM_BULK_PARAMS || end == p || *end != '\0') {
+		reportError (__LINE__-1, __func__, "Unexpected number of values in the bulk parameter response.");
+		return -1;
+	}
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Parameter Cache - Index of a Parameter
+////////////////////////////////////////////////////////
+// Parameters:
+//   nameListPtr - Array of parameter names
+//   numNames    - Number of mirrored names in the array (from the start)
+//   paramName   - Name of the parameter
+//   offset      - Index of the first name of the list in the GMP_PALL values
+//
+// Returns: index into the mirrored values, -1 if the parameter is not mirrored
+static int cacheIndex(const char* nameListPtr[], int numNames, const char *paramName, int offset)
+{
+	for (int idx = 0; idx < numNames; ++idx) {
+		if (strcmp(paramName, nameListPtr[idx]) == 0) return offset + idx;
+	}
+	return -1;
+}
+
+
+////////////////////////////////////////////////////////
+// Parameter Cache - Get a Value
+////////////////////////////////////////////////////////
+// Checks the change counter of the device if the last check is older than
+// SD_CACHE_CHECK_INTERVAL_S and refills the mirror if it is empty or out of date.
+//
+// Returns: 0 if the value was taken from the mirror, -1 if it has to be read from the device
+static int cacheGetValue(int handle, int motor, int index, int *value)
+{
+	int changeCount;
+
+	if (!g_cacheEnabled || index < 0 || motor < 0 || motor >= SD_CACHE_MAX_MOTORS || !handle) return -1;
+	if (g_cache.handle != handle) SD_InvalidateParameterCache(handle);
+	if (g_cache.isUnsupported) return -1;
+	if (g_cache.isFilled && Timer() - g_cache.lastCheck >= SD_CACHE_CHECK_INTERVAL_S) {
+		if (SD_GetPicoCommand(handle, "PC_PCNT", &changeCount)) return -1;
+		g_cache.lastCheck = Timer();
+		if ((unsigned int) changeCount != g_cache.changeCount) g_cache.isFilled = 0;
+	}
+	if (!g_cache.isFilled && cacheFill(handle)) return -1;
+	if (motor >= g_cache.numMotors) return -1;
+	*value = g_cache.values[motor][index];
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Parameter Cache - Update a Value after a Set
+////////////////////////////////////////////////////////
+// The device counts each changed value, so the expected counter follows the changes.
+// A motor of -1 (remote enable) sets the value of all motors.
+static void cacheSetValue(int handle, int motor, int index, int value)
+{
+	if (!g_cache.isFilled || g_cache.handle != handle || index < 0) return;
+	for (int z=0; z<g_cache.numMotors; z++) {
+		if (z != motor && motor != -1) continue;
+		if (g_cache.values[z][index] != value) g_cache.changeCount++;
+		g_cache.values[z][index] = value;
+	}
+}
+
+
+////////////////////////////////////////////////////////
+// Parameter Cache - Fill the Mirror
+////////////////////////////////////////////////////////
+// Submits the counter query and the bulk get of every motor as asynchronous commands,
+// so the mirror is filled in about one round trip. The counter is read first, so a
+// change during the read shows up at the next check.
+//
+// Returns: 0 on success, -1 on failure (the mirror stays empty)
+static int cacheFill(int handle)
+{
+	char commandStr[MAX_FORMAT_STRING_LENGTH];
+	int numMotors;
+	int isOk;
+
+	if (g_cache.numMotors == 0) { // first fill for this device, check that the firmware has the counter
+		if (SD_GetPicoCommand(handle, "PC_PCNT", &numMotors)) {
+			reportError (__LINE__-1, __func__, "Parameter cache not supported by the firmware, reading parameters directly.");
+			g_cache.isUnsupported = 1;
+			return -1;
+		}
+		if (SD_GetPicoCommand(handle, "PC_NDEV", &numMotors)) return -1;
+		g_cache.numMotors = (numMotors < SD_CACHE_MAX_MOTORS) ? numMotors : SD_CACHE_MAX_MOTORS;
+	}
+	g_cache.isCountRead = 0;
+	memset(g_cache.isMotorRead, 0, sizeof(g_cache.isMotorRead));
+	isOk = (asyncSubmit(handle, "GPC_PCNT", "", 0, NULL, cacheFillCallback, NULL) > 0);
+	for (int z=0; z<g_cache.numMotors && isOk; z++) {
+		snprintf(commandStr, MAX_FORMAT_STRING_LENGTH, "GMP_PALL%d", z);
+		isOk = (asyncSubmit(handle, commandStr, "", 0, NULL, cacheFillCallback, (void *) (size_t) (z+1)) > 0);
+	}
+	asyncDrain(handle);
+	for (int z=0; z<g_cache.numMotors; z++) {
+		if (!g_cache.isMotorRead[z]) isOk = 0;
+	}
+	if (!isOk || !g_cache.isCountRead) return -1;
+	g_cache.isFilled = 1;
+	g_cache.lastCheck = Timer();
+	return 0;
+}
+
+// Parameter Cache - Callback of the Fill Commands
+// callbackData is the motor+1 of a GMP_PALL command, NULL for the counter query.
+static void cacheFillCallback(int handle, int ticket, int error, const char *response, void *callbackData)
+{
+	int motor = (int) (size_t) callbackData - 1;
+
+	if (error) return;
+	if (motor < 0) {
+		g_cache.isCountRead = (sscanf(response, "PC_PCNT=%u", &g_cache.changeCount) == 1);
+	} else if (parseAllParams(response, motor, g_cache.values[motor]) == 0) {
+		g_cache.isMotorRead[motor] = 1;
+	}
+}
+
+
+////////////////////////////////////////////////////////
+// Configuration Snapshot - Name and Command of a Value
+////////////////////////////////////////////////////////
+// The values of a snapshot are the motor parameters followed by the remote parameters.
+static const char *snapshotName(int index)
+{
+	return (index < SD_NUM_MOTOR_PARAMS) ? motorParameterNames[index] : remoteParameterNames[index-SD_NUM_MOTOR_PARAMS];
+}
+
+static const char *snapshotCommand(int index)
+{
+	return (index < SD_NUM_MOTOR_PARAMS) ? motorParameterCommands[index] : remoteParameterCommands[index-SD_NUM_MOTOR_PARAMS];
+}
+
+// Configuration Snapshot - Index of a GMP_PALL Value
+// The bulk values skip the device and axis types between the motor and the remote parameters.
+static int snapshotIndex(int bulkIndex)
+{
+	return (bulkIndex < SD_NUM_BULK_MOTOR_PARAMS) ? bulkIndex : bulkIndex + (SD_NUM_MOTOR_PARAMS - SD_NUM_BULK_MOTOR_PARAMS);
+}
+
+
+////////////////////////////////////////////////////////
+// Configuration Snapshot - Callbacks of the Pipelined Commands
+////////////////////////////////////////////////////////
+// GMP_PALL of SD_ReadConfigSnapshot, callbackData is the BulkRead of the motor
+static void bulkReadCallback(int handle, int ticket, int error, const char *response, void *callbackData)
+{
+	BulkRead *bulkRead = (BulkRead *) callbackData;
+
+	if (!error && parseAllParams(response, bulkRead->motor, bulkRead->values) == 0) bulkRead->isRead = 1;
+}
+
+// Typed get of SD_ReadConfigSnapshot, callbackData is the valid flag of the value
+static void snapshotValidCallback(int handle, int ticket, int error, const char *response, void *callbackData)
+{
+	if (!error) *(unsigned char *) callbackData = 1;
+}
+
+// Set of SD_ApplyConfigSnapshot, callbackData is the counter of the failed sets
+static void snapshotSetCallback(int handle, int ticket, int error, const char *response, void *callbackData)
+{
+	if (error) (*(int *) callbackData)++;
+}
+
 
 ////////////////////////////////////////////////////////
 // Check for Error Response from Device
@@ -12,7 +12,27 @@
 #define SD_MAX_INSTR_RESP_LENGTH 1024
 // Maximum length for commands sent to the stage driver
 #define SD_MAX_COMMAND_LENGTH	100
+// Maximum number of asynchronous commands waiting for their response
+#define SD_ASYNC_MAX_PENDING	32
 
+// Callback of an asynchronous command, called when its response was processed
+//   ticket   - ticket number returned by the submit function
+//   error    - 0 on success, -1 on an error response or communication error
+//   response - response line of the device ("" on a communication error)
+typedef void (*SD_AsyncCallback)(int handle, int ticket, int error, const char *response, void *callbackData);
+
+// Maximum number of motors in a configuration snapshot
+#define SD_SNAPSHOT_MAX_MOTORS	8
+// Number of values per motor in a configuration snapshot: the motor parameters followed by the
+// remote parameters, in the order of SD_GetMotorParameterNames and SD_GetRemoteParameterNames
+#define SD_SNAPSHOT_NUM_PARAMS	41
+
+// Compact in-memory copy of the motor and remote parameters of all motors
+typedef struct {
+	int numMotors;														// number of motors in the snapshot
+	int values[SD_SNAPSHOT_MAX_MOTORS][SD_SNAPSHOT_NUM_PARAMS];			// parameter values
+	unsigned char isValid[SD_SNAPSHOT_MAX_MOTORS][SD_SNAPSHOT_NUM_PARAMS];	// 0 -> value not known (not read, missing in the file)
+} SD_ConfigSnapshot;
 
 
 
@@ -110,9 +130,64 @@ int SD_SendDirectCommand(int handle, const char *command, char* response, int bu
 // Returns: 0 on success, -1 on failure
 int SD_GetErrorMessage(int handle, char* response, int bufSize);
 
+// Switches the get/set functions between ASCII commands (default) and compact binary frames
+// Returns: 0 on success, -1 on failure
+int SD_SetBinaryMode(int handle, int enable);
+
+// ============ Asynchronous Commands (pipelined) ============
+
+// Sends a raw command without waiting for its response, the responses are matched in order
+// Returns: ticket number (>0) on success, -1 on failure
+int SD_SubmitCommand(int handle, const char *command, SD_AsyncCallback callback, void *callbackData);
+
+// Submits a motor status get (e.g. "ActualPosition"), *value is written when the response is processed
+// Returns: ticket number (>0) on success, -1 on failure
+int SD_SubmitGetMotorStatus(int handle, int motor, const char *param, int *value,
+							SD_AsyncCallback callback, void *callbackData);
+
+// Processes the responses that have arrived, without waiting for the others
+// Returns: number of completed commands, -1 on failure
+int SD_PollResponses(int handle);
+
+// Waits until the command with the given ticket has completed
+// Returns: 0 if the command succeeded, -1 on failure
+int SD_WaitForTicket(int handle, int ticket);
+
+// Waits until all submitted commands have completed
+// Returns: 0 if all commands since the last call succeeded, -1 on failure
+int SD_WaitForAll(int handle);
+
+// ============ Parameter Cache ============
+
+// Turns the client-side mirror of the motor and remote parameters on (default) or off
+// Returns: 0 on success, -1 on failure
+int SD_SetParameterCache(int handle, int enable);
+
+// Drops the mirror, the next parameter get reads all parameters from the device again
+// Returns: 0 on success, -1 on failure
+int SD_InvalidateParameterCache(int handle);
+
+// ============ Configuration Snapshots ============
+
+// Reads the motor and remote parameters of all motors into a snapshot (pipelined bulk reads)
+// Returns: 0 on success, -1 on failure (values that could not be read are marked invalid)
+int SD_ReadConfigSnapshot(int handle, SD_ConfigSnapshot *snapshot);
+
+// Sends the values of a snapshot that differ from the device, *numChanged receives their number
+// Returns: 0 on success, -1 on failure
+int SD_ApplyConfigSnapshot(int handle, const SD_ConfigSnapshot *snapshot, int *numChanged);
+
+// Loads a snapshot from a JSON configuration file (values missing in the file are marked invalid)
+// Returns: 0 on success, -1 on failure
+int SD_LoadConfigSnapshot(const char *fileName, SD_ConfigSnapshot *snapshot);
+
+// Saves the valid values of a snapshot to a JSON configuration file
+// Returns: 0 on success, -1 on failure
+int SD_SaveConfigSnapshot(const char *fileName, const SD_ConfigSnapshot *snapshot);
+
 // ============ Configuration File I/O ============
 
-// Loads motor and remote parameters from a JSON configuration file and applies them to the device
+// Loads motor and remote parameters from a JSON configuration file and sends the ones that differ
 // Returns: 0 on success, -1 on failure
 int SD_LoadConfigFromFile(int handle, char *fileName);
 
@@ -0,0 +1,424 @@
+// *****************************************************************************************
+//
+// Round-trip benchmark for the Pico Stage Driver - runs standard workloads through the
+// C library and reports commands per second and the p50/p99 latency of each workload.
+// Use it before and after firmware or library changes to check that they are faster.
+//
+// Usage: StageDriverBenchmark <VISA address> [-n <iterations>] [-b] [-sim]
+//   -n    number of iterations per workload (default 1000)
+//   -b    use binary frames instead of ASCII commands (SD_SetBinaryMode)
+//   -sim  configure motors 0 and 1 as MOTOR_SIM first, so no motors are needed
+//         (the configuration is not saved to flash)
+//
+// *****************************************************************************************
+
+#include <ansi_c.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "StageDriver.h"
+
+
+// *****************************************************************************************
+// Configuration Defines
+// *****************************************************************************************
+
+#define BENCH_DEFAULT_ITERATIONS	1000	// iterations per workload if -n is not given
+#define BENCH_MOVE_DISTANCE			5120	// distance of the XY moves in microsteps
+#define BENCH_MOVE_TIMEOUT_S		10.0	// max time for one XY move before the workload is aborted
+#define BENCH_MOTOR_X				0		// motors used for the single axis and XY workloads
+#define BENCH_MOTOR_Y				1
+#define BENCH_CONFIG_FILE			"StageDriverBenchmark.json"	// temporary file of the config workload
+#define BENCH_SNAPSHOT_CMDS			3		// commands per motor of a snapshot read (GMP_PALL, device and axis type)
+
+
+// *****************************************************************************************
+// Types
+// *****************************************************************************************
+
+// Latencies of one workload (one entry per timed operation)
+typedef struct {
+	const char *name;	// workload name for the report
+	double *latency;	// latency of each operation in s
+	int numOps;			// number of timed operations
+	int maxOps;			// size of the latency buffer
+	long numCommands;	// number of commands sent (an operation can consist of several)
+	double totalTime;	// wall time of the workload in s
+	int failed;			// flag if the workload was aborted
+} BenchResult;
+
+
+// *****************************************************************************************
+// Internal Function Prototypes
+// *****************************************************************************************
+
+static double benchTime(void);
+static int benchAlloc(BenchResult *result, const char *name, int maxOps);
+static void benchAdd(BenchResult *result, double latency, int numCommands);
+static void benchReport(BenchResult *result);
+static int compareDouble(const void *a, const void *b);
+
+static int benchPositionQuery(int handle, int iterations, BenchResult *result);
+static int benchPipelinedQuery(int handle, int iterations, BenchResult *result);
+static int benchDirectCommand(int handle, int iterations, BenchResult *result);
+static int benchParameterSweep(int handle, int iterations, BenchResult *result);
+static int benchMoveBusy(int handle, int iterations, BenchResult *result);
+static int benchConfigLoadSave(int handle, int iterations, BenchResult *result);
+static int setupSimMotors(int handle);
+
+
+// *****************************************************************************************
+// Main
+// *****************************************************************************************
+
+int main(int argc, char *argv[])
+{
+	int handle = 0;
+	int iterations = BENCH_DEFAULT_ITERATIONS;
+	int binary = 0;
+	int sim = 0;
+	const char *address = NULL;
+	BenchResult results[6];
+	int numResults = 0;
+	int status = -1;
+
+	for (int z=1; z<argc; z++) {
+		if (strcmp(argv[z], "-n")==0 && z+1<argc) iterations = atoi(argv[++z]);
+		else if (strcmp(argv[z], "-b")==0) binary = 1;
+		else if (strcmp(argv[z], "-sim")==0) sim = 1;
+		else address = argv[z];
+	}
+	if (address==NULL || iterations<=0) {
+		printf("Usage: %s <VISA address, e.g. ASRL3::INSTR> [-n <iterations>] [-b] [-sim]\n", argv[0]);
+		return -1;
+	}
+
+	if (SD_Init(&handle, address)) {
+		printf("Could not open the stage driver at %s.\n", address);
+		return -1;
+	}
+	if (binary && SD_SetBinaryMode(handle, 1)) {
+		printf("Could not switch to binary commands.\n");
+		goto done;
+	}
+	if (sim && setupSimMotors(handle)) goto done;
+
+	printf("Stage driver benchmark: %s, %d iterations, %s commands\n\n", address, iterations, binary ? "binary" : "ASCII");
+	printf("%-24s %8s %8s %10s %10s %10s %10s\n", "Workload", "Ops", "Cmds", "Cmds/s", "p50 [ms]", "p99 [ms]", "max [ms]");
+
+	benchPositionQuery(handle, iterations, &results[numResults]);
+	benchReport(&results[numResults++]);
+	benchPipelinedQuery(handle, iterations, &results[numResults]);
+	benchReport(&results[numResults++]);
+	benchDirectCommand(handle, iterations, &results[numResults]);
+	benchReport(&results[numResults++]);
+	benchParameterSweep(handle, iterations, &results[numResults]);
+	benchReport(&results[numResults++]);
+	benchMoveBusy(handle, iterations/10 > 0 ? iterations/10 : 1, &results[numResults]);
+	benchReport(&results[numResults++]);
+	benchConfigLoadSave(handle, iterations/100 > 0 ? iterations/100 : 1, &results[numResults]);
+	benchReport(&results[numResults++]);
+
+	status = 0;
+	for (int z=0; z<numResults; z++) {
+		if (results[z].failed) status = -1;
+		free(results[z].latency);
+	}
+	remove(BENCH_CONFIG_FILE);
+
+done:
+	if (binary) SD_SetBinaryMode(handle, 0);
+	SD_Close(&handle);
+	return status;
+}
+
+
+// *****************************************************************************************
+// Workloads
+// *****************************************************************************************
+
+////////////////////////////////////////////////////////
+// Tight Position Query Loop
+////////////////////////////////////////////////////////
+// Reads the actual position of one motor back to back (the typical polling load of a GUI).
+static int benchPositionQuery(int handle, int iterations, BenchResult *result)
+{
+	int value;
+	double start, t0;
+
+	if (benchAlloc(result, "Position query", iterations)) return -1;
+	start = benchTime();
+	for (int z=0; z<iterations; z++) {
+		t0 = benchTime();
+		if (SD_GetMotorStatus(handle, BENCH_MOTOR_X, "ActualPosition", &value)) { result->failed = 1; break; }
+		benchAdd(result, benchTime()-t0, 1);
+	}
+	result->totalTime = benchTime()-start;
+	return result->failed ? -1 : 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Pipelined Position Query
+////////////////////////////////////////////////////////
+// Same queries as the position query loop, but submitted asynchronously in batches of
+// SD_ASYNC_MAX_PENDING. The latency of an operation is the time of a full batch.
+static int benchPipelinedQuery(int handle, int iterations, BenchResult *result)
+{
+	int value[SD_ASYNC_MAX_PENDING];
+	int batchSize;
+	double start, t0;
+
+	if (benchAlloc(result, "Pipelined position query", iterations/SD_ASYNC_MAX_PENDING + 1)) return -1;
+	start = benchTime();
+	for (int z=0; z<iterations; z+=batchSize) {
+		batchSize = (iterations-z < SD_ASYNC_MAX_PENDING) ? iterations-z : SD_ASYNC_MAX_PENDING;
+		t0 = benchTime();
+		for (int k=0; k<batchSize; k++) {
+			if (SD_SubmitGetMotorStatus(handle, BENCH_MOTOR_X, "ActualPosition", &value[k], NULL, NULL) < 0) {
+				result->failed = 1;
+				break;
+			}
+		}
+		if (SD_WaitForAll(handle)) result->failed = 1;
+		if (result->failed) break;
+		benchAdd(result, benchTime()-t0, batchSize);
+	}
+	result->totalTime = benchTime()-start;
+	return result->failed ? -1 : 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Raw Command Round Trip
+////////////////////////////////////////////////////////
+// Sends a short command without name lookup (link and command parser only).
+static int benchDirectCommand(int handle, int iterations, BenchResult *result)
+{
+	char response[SD_MAX_INSTR_RESP_LENGTH];
+	double start, t0;
+
+	if (benchAlloc(result, "Direct command", iterations)) return -1;
+	start = benchTime();
+	for (int z=0; z<iterations; z++) {
+		t0 = benchTime();
+		if (SD_SendDirectCommand(handle, "GPC_VERS", response, sizeof(response))) { result->failed = 1; break; }
+		benchAdd(result, benchTime()-t0, 1);
+	}
+	result->totalTime = benchTime()-start;
+	return result->failed ? -1 : 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Set/Get Parameter Sweep
+////////////////////////////////////////////////////////
+// Reads each motor parameter and writes the same value back, so the configuration stays as is.
+// The device and axis types are skipped, setting them resets the board.
+// The parameter cache is off during the sweep, so every get is a transaction with the device.
+static int benchParameterSweep(int handle, int iterations, BenchResult *result)
+{
+	const char **names;
+	size_t numNames;
+	int value;
+	double start, t0;
+
+	if (benchAlloc(result, "Parameter get/set", 2*iterations)) return -1;
+	if (SD_GetMotorParameterNames(&names, &numNames) || SD_SetParameterCache(handle, 0)) {
+		result->failed = 1;
+		return -1;
+	}
+	start = benchTime();
+	for (int z=0; z<iterations && !result->failed; z++) {
+		const char *name = names[z % numNames];
+		if (strcmp(name, "TypeDevice")==0 || strcmp(name, "TypeAxis")==0) continue;
+		t0 = benchTime();
+		if (SD_GetMotorParameter(handle, BENCH_MOTOR_X, name, &value)) { result->failed = 1; break; }
+		benchAdd(result, benchTime()-t0, 1);
+		t0 = benchTime();
+		if (SD_SetMotorParameter(handle, BENCH_MOTOR_X, name, value)) { result->failed = 1; break; }
+		benchAdd(result, benchTime()-t0, 1);
+	}
+	result->totalTime = benchTime()-start;
+	SD_SetParameterCache(handle, 1);
+	return result->failed ? -1 : 0;
+}
+
+
+////////////////////////////////////////////////////////
+// XY Move + Busy Cycle
+////////////////////////////////////////////////////////
+// Moves X and Y back and forth and polls both for position reached, like a scan step.
+// The latency of an operation is the time of the full move, so it includes the ramp.
+static int benchMoveBusy(int handle, int iterations, BenchResult *result)
+{
+	int reachedX, reachedY, numCommands;
+	int target;
+	double start, t0;
+
+	if (benchAlloc(result, "XY move + busy", iterations)) return -1;
+	start = benchTime();
+	for (int z=0; z<iterations; z++) {
+		target = (z % 2) ? 0 : BENCH_MOVE_DISTANCE;
+		t0 = benchTime();
+		if (SD_SetMotorCommand(handle, BENCH_MOTOR_X, "MoveToPosition", target)
+			  || SD_SetMotorCommand(handle, BENCH_MOTOR_Y, "MoveToPosition", target)) { result->failed = 1; break; }
+		numCommands = 2;
+		do {
+			if (SD_GetMotorCommand(handle, BENCH_MOTOR_X, "HasPositionReached", &reachedX)
+				  || SD_GetMotorCommand(handle, BENCH_MOTOR_Y, "HasPositionReached", &reachedY)) { result->failed = 1; break; }
+			numCommands += 2;
+			if (benchTime()-t0 > BENCH_MOVE_TIMEOUT_S) {
+				printf("XY move did not finish within %.0f s.\n", BENCH_MOVE_TIMEOUT_S);
+				result->failed = 1;
+				break;
+			}
+		} while (!reachedX || !reachedY);
+		if (result->failed) break;
+		benchAdd(result, benchTime()-t0, numCommands);
+	}
+	result->totalTime = benchTime()-start;
+	return result->failed ? -1 : 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Config Save/Load Cycle
+////////////////////////////////////////////////////////
+// Saves the configuration to a JSON file and loads it back (the same values, so nothing changes).
+static int benchConfigLoadSave(int handle, int iterations, BenchResult *result)
+{
+	SD_ConfigSnapshot snapshot;
+	int numDevices, numChanged, numReadCommands;
+	double start, t0;
+
+	if (benchAlloc(result, "Config save + load", 2*iterations)) return -1;
+	if (SD_GetPicoCommand(handle, "PC_NDEV", &numDevices)) {
+		result->failed = 1;
+		return -1;
+	}
+	if (numDevices > SD_SNAPSHOT_MAX_MOTORS) numDevices = SD_SNAPSHOT_MAX_MOTORS;
+	// a snapshot read is PC_NDEV and the bulk read of each device, a load adds the sets of the changed
+	// values (none here). Firmware without GMP_PALL is read one by one, the counts are too low then.
+	numReadCommands = 1 + numDevices*BENCH_SNAPSHOT_CMDS;
+	start = benchTime();
+	for (int z=0; z<iterations; z++) {
+		t0 = benchTime();
+		if (SD_SaveConfigToFile(handle, BENCH_CONFIG_FILE)) { result->failed = 1; break; }
+		benchAdd(result, benchTime()-t0, numReadCommands);
+		t0 = benchTime(); // as SD_LoadConfigFromFile, but with the number of sets
+		if (SD_LoadConfigSnapshot(BENCH_CONFIG_FILE, &snapshot)
+			  || SD_ApplyConfigSnapshot(handle, &snapshot, &numChanged)) { result->failed = 1; break; }
+		benchAdd(result, benchTime()-t0, numReadCommands + numChanged);
+	}
+	result->totalTime = benchTime()-start;
+	return result->failed ? -1 : 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Simulated Motors
+////////////////////////////////////////////////////////
+// Configures the X and Y motors as MOTOR_SIM and enables them.
+static int setupSimMotors(int handle)
+{
+	int motors[] = {BENCH_MOTOR_X, BENCH_MOTOR_Y};
+
+	for (int z=0; z<2; z++) {
+		if (SD_SetMotorParameter(handle, motors[z], "TypeDevice", 1)
+			  || SD_SetMotorCommand(handle, motors[z], "Config", 0)
+			  || SD_SetMotorStatus(handle, motors[z], "Enabled", 1)) {
+			printf("Could not configure motor %d as MOTOR_SIM.\n", motors[z]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+// *****************************************************************************************
+// Statistics
+// *****************************************************************************************
+
+////////////////////////////////////////////////////////
+// Monotonic Time in Seconds
+////////////////////////////////////////////////////////
+static double benchTime(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq = {0};
+	LARGE_INTEGER count;
+
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+#endif
+}
+
+
+////////////////////////////////////////////////////////
+// Allocate the Latency Buffer
+////////////////////////////////////////////////////////
+static int benchAlloc(BenchResult *result, const char *name, int maxOps)
+{
+	memset(result, 0, sizeof(BenchResult));
+	result->name = name;
+	result->latency = malloc(maxOps * sizeof(double));
+	if (!result->latency) {
+		printf("Could not allocate memory.\n");
+		result->failed = 1;
+		return -1;
+	}
+	result->maxOps = maxOps;
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////
+// Add One Operation
+////////////////////////////////////////////////////////
+static void benchAdd(BenchResult *result, double latency, int numCommands)
+{
+	if (result->numOps < result->maxOps) result->latency[result->numOps++] = latency;
+	result->numCommands += numCommands;
+}
+
+
+////////////////////////////////////////////////////////
+// Print One Line of the Report
+////////////////////////////////////////////////////////
+// The percentiles use the nearest rank of the sorted latencies.
+static void benchReport(BenchResult *result)
+{
+	double p50, p99, pmax;
+
+	if (result->numOps == 0) {
+		printf("%-24s %8s\n", result->name ? result->name : "", "failed");
+		return;
+	}
+	qsort(result->latency, result->numOps, sizeof(double), compareDouble);
+	p50 = result->latency[(int)(0.50*(result->numOps-1) + 0.5)];
+	p99 = result->latency[(int)(0.99*(result->numOps-1) + 0.5)];
+	pmax = result->latency[result->numOps-1];
+	printf("%-24s %8d %8ld %10.1f %10.3f %10.3f %10.3f%s\n", result->name, result->numOps, result->numCommands,
+		   result->totalTime > 0 ? result->numCommands/result->totalTime : 0.0,
+		   1e3*p50, 1e3*p99, 1e3*pmax, result->failed ? "  (aborted)" : "");
+}
+
+
+static int compareDouble(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
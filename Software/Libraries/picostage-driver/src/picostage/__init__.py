@@ -6,6 +6,6 @@ This package exposes a single high-level class, :class:`PicoStage`, used to
 connect to and operate a Pico stage driver over a VISA serial connection.
 """
 
-from .stage_driver import PicoStage
+from .stage_driver import PicoStage, AsyncPicoStage
 
-__all__ = ["PicoStage"]
\ No newline at end of file
+__all__ = ["PicoStage", "AsyncPicoStage"]
\ No newline at end of file
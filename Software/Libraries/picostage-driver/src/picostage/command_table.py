@@ -65,6 +65,7 @@ table = {
     "MC_SCLR": "StatusClear", # set only
     "MC_MPOS": "MoveToPosition", # set only
     "MC_MVEL": "MoveAtVelocity", # set only
+    "MC_ORIG": "SetOrigin", # set only
     "MC_POSR": "HasPositionReached", # get only
     "MC_STAT": "GetStatus", # get only
 
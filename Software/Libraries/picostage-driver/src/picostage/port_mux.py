@@ -0,0 +1,344 @@
+"""Port multiplexer for the Pico stage driver
+
+Only one process can open the USB serial port of the controller. This module
+is a small daemon that owns the port and lets several clients (the Python
+GUI, LabWindows programs using the C library, notebooks) share it over local
+TCP connections, with the same line protocol as the serial port:
+
+- The commands of all clients are sent in a fair order (round robin, one
+    command per client in turn) and each client gets the responses to its own
+    commands, in order. Up to ``PIPELINE_DEPTH`` commands are in flight.
+    Every command reserves a place in the reply order of its client, answers
+    (also merged and local ones) are released in that order only.
+- Identical get commands are merged into one query: a get that is already
+    waiting for its response (with no set command queued after it), or that
+    was answered less than ``tick`` seconds ago, is answered from that query.
+    Set commands drop the answers kept for merging.
+- ASCII telemetry records (``TELE=...``) are forwarded to every client that
+    asked for the stream. ``SPC_TELE,<rate>`` sets the rate of the client, the
+    device runs at the highest rate requested by the connected clients.
+- Responses are matched to the commands by their order. If the device misses
+    an answer, the multiplexer resynchronizes: the commands in flight are
+    answered with ERROR=-1, nothing is forwarded until the device is quiet,
+    and a marker query (``*IDN?``) is sent. Lines up to its response are
+    dropped, then forwarding resumes.
+
+VISA clients connect with the resource string ``TCPIP::localhost::<port>::SOCKET``
+(default port 5025), e.g. ``PicoStage('TCPIP::localhost::5025::SOCKET', logger)``
+or ``SD_Init(&handle, "TCPIP::localhost::5025::SOCKET")``.
+
+Notes:
+- The binary frames (``SD_SetBinaryMode``, telemetry format 1) are not
+    supported through the multiplexer. Neither is the capture dump
+    (``GPC_CDMP``, ``PicoStage.read_capture``), whose response is followed by
+    binary data; it is answered with ERROR=-4.
+- The controller keeps one error message (``GPC_EMSG``), so a client may see
+    the message of an error caused by another one. ``GPC_EMSG`` is never merged.
+
+Usage: ``python -m picostage.port_mux COM9 [--port 5025] [--tick 0.005]``
+"""
+
+import argparse
+import asyncio
+import logging
+import threading
+import time
+from collections import deque
+
+import serial
+
+# maximum number of commands sent to the device before their responses are read
+PIPELINE_DEPTH = 16
+# time (s) the oldest command in flight waits for its response before the multiplexer
+# resynchronizes; above the worst-case answer time of the firmware (MOTORS_QUEUE_TIMEOUT_MS, 2 s)
+ANSWER_TIMEOUT = 3.0
+# time (s) the device must be quiet after a missed response before the marker query is sent
+DRAIN_TIME = 0.2
+# interval (s) of the timeout checks
+CHECK_INTERVAL = 0.05
+# query sent to resynchronize and the start of its response (SERIAL_ID_STRING of the firmware)
+RESYNC_MARKER = "*IDN?"
+RESYNC_REPLY = "Stage Driver Pico"
+# commands whose response is followed by binary data, which the line protocol can't pass on
+BINARY_COMMANDS = ("GPC_CDMP",)
+# reply to requests the multiplexer can't pass on (ERR_Parameter of the firmware)
+ERROR_REPLY = "ERROR=-4"
+
+
+class _Client:
+    """A connected client: its queued commands, reply order and requested telemetry rate."""
+
+    def __init__(self, writer):
+        self.writer = writer
+        self.pending = deque()
+        self.replies = deque() # _Reply of each command passed on, in the order of the commands
+        self.tele_rate = 0
+        self.connected = True
+
+    def send(self, line):
+        if self.connected:
+            self.writer.write((line + "\n").encode("ascii", "replace"))
+
+    def reserve(self):
+        reply = _Reply(self)
+        self.replies.append(reply)
+        return reply
+
+    def flush(self):
+        """Send the answers at the front of the reply order, up to the first one still missing."""
+        while self.replies and self.replies[0].line is not None:
+            self.send(self.replies.popleft().line)
+
+
+class _Reply:
+    """The place of a response in the reply order of a client."""
+
+    def __init__(self, client):
+        self.client = client
+        self.line = None
+
+    def set(self, line):
+        self.line = line
+        self.client.flush()
+
+
+class _Entry:
+    """A command sent to the device, with the replies waiting for its response."""
+
+    def __init__(self, command, waiters):
+        self.command = command
+        self.waiters = waiters
+        self.sent = time.monotonic()
+
+
+class PortMux:
+    """Owns the serial port of a controller and serves it to TCP clients.
+
+    Args:
+        port: serial port of the controller, e.g. 'COM9' or '/dev/ttyACM0'.
+        tcp_port: local TCP port of the server.
+        tick: time (s) an answer to a get command is reused for identical gets.
+        logger: logging-like object for informational and error output.
+    """
+
+    def __init__(self, port, tcp_port=5025, tick=0.005, logger=None):
+        self.logger = logger or logging.getLogger("PortMux")
+        self.tcp_port = tcp_port
+        self.tick = tick
+        self.serial = serial.serial_for_url(port, 115200, timeout=0.1)
+        self.clients = deque() # round robin order, the client in turn first
+        self.inflight = deque()
+        self.answers = {} # get command -> (time, response) for merging
+        self.device_rate = 0
+        self.head_since = 0.0 # time the oldest command in flight started to wait for its response
+        self.resync = None # None, "drain" (waiting for the device to be quiet) or "marker"
+        self.last_line = 0.0 # time of the last line from the device during a resync
+        self.marker_sent = 0.0
+        self.loop = None
+        self.running = False
+
+    def run(self):
+        """Serve the clients until interrupted."""
+        asyncio.run(self.serve())
+
+    async def serve(self):
+        self.loop = asyncio.get_running_loop()
+        self.running = True
+        self.serial.reset_input_buffer()
+        self.send_to_device("SPC_TELE,0", []) # start without a stream
+        reader = threading.Thread(target=self.read_device, daemon=True)
+        reader.start()
+        self.loop.call_later(CHECK_INTERVAL, self.check_timeouts)
+        server = await asyncio.start_server(self.handle_client, "127.0.0.1", self.tcp_port)
+        self.logger.info(f"Serving {self.serial.port} on port {self.tcp_port}.")
+        try:
+            async with server:
+                await server.serve_forever()
+        finally:
+            self.running = False
+            reader.join()
+            self.serial.close()
+
+    async def handle_client(self, reader, writer):
+        """Queue the command lines of a client until it disconnects."""
+        client = _Client(writer)
+        self.clients.append(client)
+        self.logger.info(f"Client {writer.get_extra_info('peername')} connected.")
+        try:
+            while True:
+                data = await reader.readline()
+                if not data:
+                    break
+                line = data.decode("ascii", "replace").strip()
+                if line:
+                    client.pending.append(line)
+                    self.pump()
+                await writer.drain()
+        except ConnectionError:
+            pass
+        finally:
+            client.connected = False
+            self.clients.remove(client)
+            if client.tele_rate:
+                self.update_tele_rate(None)
+            writer.close()
+            self.logger.info(f"Client {writer.get_extra_info('peername')} disconnected.")
+
+    def pump(self):
+        """Pass the queued commands on in round robin order while the pipeline has room."""
+        if self.resync:
+            return
+        while len(self.inflight) < PIPELINE_DEPTH:
+            for _ in range(len(self.clients)):
+                client = self.clients[0]
+                self.clients.rotate(-1)
+                if client.pending:
+                    self.handle_command(client, client.pending.popleft())
+                    break
+            else:
+                return # no client has a command
+
+    def handle_command(self, client, command):
+        reply = client.reserve()
+        if command.startswith(BINARY_COMMANDS):
+            reply.set(ERROR_REPLY)
+            return
+        if command.startswith("SPC_TELE"):
+            args = command[len("SPC_TELE"):].lstrip(",").split(",")
+            try:
+                rate = int(args[0])
+                binary = len(args) > 1 and int(args[1]) != 0
+            except ValueError:
+                reply.set(ERROR_REPLY)
+                return
+            if binary or rate < 0:
+                reply.set(ERROR_REPLY)
+                return
+            client.tele_rate = rate
+            self.update_tele_rate(reply)
+            return
+        if self.is_mergeable(command):
+            answer = self.answers.get(command)
+            if answer is not None and time.monotonic() - answer[0] < self.tick:
+                reply.set(answer[1])
+                return
+            for entry in reversed(self.inflight):
+                if not entry.command.startswith("G"):
+                    break # don't answer from a query sent before a set command
+                if entry.command == command:
+                    entry.waiters.append(reply)
+                    return
+        self.send_to_device(command, [reply])
+
+    def update_tele_rate(self, reply):
+        """Run the stream at the highest requested rate, answer the SPC_TELE of ``reply``."""
+        rate = max((c.tele_rate for c in self.clients), default=0)
+        if rate == self.device_rate or self.resync:
+            self.device_rate = rate # during a resync, the rate is sent when forwarding resumes
+            if reply is not None:
+                reply.set("ERROR=0")
+            return
+        self.device_rate = rate
+        self.send_to_device(f"SPC_TELE,{rate}", [reply] if reply is not None else [])
+
+    def send_to_device(self, command, waiters):
+        if not command.startswith("G"):
+            self.answers.clear() # a set command may change any value
+        self.inflight.append(_Entry(command, waiters))
+        self.serial.write((command + "\n").encode("ascii", "replace"))
+
+    def read_device(self):
+        """Body of the serial reader thread: hands each line to the event loop."""
+        while self.running:
+            try:
+                data = self.serial.readline()
+            except serial.SerialException as e:
+                self.logger.error(f"Serial port failed: {e}")
+                self.loop.call_soon_threadsafe(self.loop.stop)
+                return
+            if data:
+                line = data.decode("ascii", "replace").rstrip("\r\n")
+                self.loop.call_soon_threadsafe(self.handle_device_line, line)
+
+    def handle_device_line(self, line):
+        if line.startswith("TELE="):
+            for client in self.clients:
+                if client.tele_rate:
+                    client.send(line)
+            return
+        if self.resync:
+            self.last_line = time.monotonic()
+            if self.resync == "marker" and line.startswith(RESYNC_REPLY):
+                self.end_resync()
+            else:
+                self.logger.info(f"Response {line!r} dropped while resynchronizing.")
+            return
+        if not self.inflight:
+            self.logger.info(f"Unexpected response {line!r} dropped.")
+            return
+        entry = self.inflight.popleft()
+        if self.is_mergeable(entry.command):
+            self.answers[entry.command] = (time.monotonic(), line)
+        for reply in entry.waiters:
+            reply.set(line)
+        self.head_since = time.monotonic()
+        self.pump()
+
+    def check_timeouts(self):
+        """Detect a missed response and step through the resynchronization."""
+        now = time.monotonic()
+        if self.resync == "drain":
+            if now - self.last_line >= DRAIN_TIME:
+                self.send_marker()
+        elif self.resync == "marker":
+            if now - self.marker_sent > ANSWER_TIMEOUT:
+                self.logger.error("No response to the resync marker, sending it again.")
+                self.send_marker()
+        elif self.inflight and now - max(self.inflight[0].sent, self.head_since) > ANSWER_TIMEOUT:
+            self.start_resync()
+        if self.running:
+            self.loop.call_later(CHECK_INTERVAL, self.check_timeouts)
+
+    def start_resync(self):
+        """Fail the commands in flight, their responses can't be matched by position anymore."""
+        self.logger.error(f"No response to {self.inflight[0].command!r}, resynchronizing.")
+        for entry in self.inflight:
+            for reply in entry.waiters:
+                reply.set("ERROR=-1")
+        self.inflight.clear()
+        self.answers.clear()
+        self.resync = "drain"
+        self.last_line = time.monotonic()
+
+    def send_marker(self):
+        self.resync = "marker"
+        self.marker_sent = time.monotonic()
+        self.serial.write((RESYNC_MARKER + "\n").encode("ascii"))
+
+    def end_resync(self):
+        self.logger.info("Resynchronized with the device.")
+        self.resync = None
+        self.head_since = time.monotonic()
+        self.send_to_device(f"SPC_TELE,{self.device_rate}", []) # in case a rate change was missed
+        self.pump()
+
+    @staticmethod
+    def is_mergeable(command):
+        return command.startswith("G") and command != "GPC_EMSG"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Share the serial port of a Pico stage driver between several clients.")
+    parser.add_argument("port", help="serial port of the controller, e.g. COM9 or /dev/ttyACM0")
+    parser.add_argument("--port", dest="tcp_port", type=int, default=5025, help="local TCP port (default 5025)")
+    parser.add_argument("--tick", type=float, default=0.005, help="time (s) an answer is reused for identical gets (default 0.005)")
+    args = parser.parse_args()
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(message)s")
+    try:
+        PortMux(args.port, args.tcp_port, args.tick).run()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
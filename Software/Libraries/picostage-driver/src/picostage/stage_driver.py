@@ -10,6 +10,8 @@ Notes:
     access (``visa_lock``) to serialize communication.
 - The module expects pyvisa to be available and a VISA resource string to be
     provided when constructing :class:`PicoStage`.
+- :class:`AsyncPicoStage` wraps a :class:`PicoStage` for asyncio code, so
+    scan scripts can overlap stage I/O with other I/O (e.g. a camera).
 """
 
 import pyvisa
@@ -17,9 +19,27 @@ import sys
 import re
 import threading
 import json
+import asyncio
+import functools
+import struct
+from concurrent.futures import ThreadPoolExecutor
 from .command_table import table
 from typing import List, Dict
 
+# maximum number of commands sent before their responses are read
+PIPELINE_DEPTH = 16
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE of the binary blocks of the device (polynomial 0x1021)."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
 class InstrumentError(Exception):
     """Raised when an unexpected or fatal instrument condition is detected.
 
@@ -76,7 +96,8 @@ class PicoStage:
         self.logger.info(f"Instrument: {self._inst}")
         self._inst.read_termination = "\n"
         self._inst.write_termination = "\n"
-        self._inst.baud_rate = 9600
+        if hasattr(self._inst, "baud_rate"): # not for sockets (port multiplexer)
+            self._inst.baud_rate = 9600
         self.logger.info("Requesting ID from instrument")
         resp = self._inst.query("*IDN?").rstrip("\r\n")
         if not resp.startswith("Stage Driver Pico"):
@@ -88,6 +109,11 @@ class PicoStage:
         # prepare lookup dictionary
         self.pico_to_ext = table
         self.ext_to_pico = {v: k for k, v in table.items()}
+        # order of the values of the bulk command GMP_PALL (the device and axis
+        # types are not included, setting them reconfigures the board)
+        self.bulk_params = [k for k in self.get_pico_names("MP_") if k not in ("MP_TDEV", "MP_TAXI")]
+        self.bulk_params.extend(self.get_pico_names("RP_"))
+        self.bulk_available = True
 
 
     def __del__(self):
@@ -184,62 +210,210 @@ class PicoStage:
         with self.visa_lock:
             return self._inst.query(command).rstrip("\r\n")
 
-    def save_parameters_to_file(self, filename):
-        """Save readable parameters for all motors to a JSON file.
+    def send_pipelined_commands(self, commands: List[str]) -> List[str]:
+        """Send several commands before reading their responses.
 
-        The saved JSON contains one object per motor, keyed as ``motor0``,
-        ``motor1`` etc. Only parameters that successfully read are included.
+        The device answers every command with one line in the order of the
+        commands, so the responses are matched by position. Up to
+        ``PIPELINE_DEPTH`` commands are in flight at a time, a list costs
+        about one round trip per ``PIPELINE_DEPTH`` commands instead of one
+        per command.
 
         Args:
-            filename: path to write the JSON file to.
+            commands: list of raw command strings.
+
+        Returns:
+            list of the responses (trimmed), one per command.
         """
+        responses = []
+        with self.visa_lock:
+            for start in range(0, len(commands), PIPELINE_DEPTH):
+                chunk = commands[start:start + PIPELINE_DEPTH]
+                for command in chunk:
+                    self._inst.write(command)
+                for _ in chunk:
+                    responses.append(self._inst.read().rstrip("\r\n"))
+        return responses
+
+    def read_capture(self, first=0, num=None):
+        """Read the samples of the on-device capture buffer.
+
+        The capture is configured and started with the pico commands, e.g.
+        ``SPC_CCFG,1,7,5000`` (motor 0, XACT/XENC/VACTUAL at 5 kHz) and
+        ``SPC_CAPT,2`` (start with the next move). It has to be stopped (or
+        finished) before it is read.
+
+        Args:
+            first: index of the first sample (0 -> oldest).
+            num: number of samples, None for all samples from ``first``.
 
+        Returns:
+            list of samples, each a tuple (time_us, signals of each motor...),
+            or None on an error.
+        """
+        command = f"GPC_CDMP,{first}" if num is None else f"GPC_CDMP,{first},{num}"
+        with self.visa_lock:
+            resp = self._inst.query(command).rstrip("\r\n")
+            if not resp.startswith("PC_CDMP="):
+                self.log_error(resp)
+                return
+            _, count, size = (int(v) for v in resp[len("PC_CDMP="):].split(","))
+            data = bytes(self._inst.read_bytes(4 * count * size + 2))
+        if crc16(data[:-2]) != struct.unpack("<H", data[-2:])[0]:
+            self.logger.error("CRC error in the capture dump.")
+            return
+        values = struct.unpack(f"<{count * size}i", data[:-2])
+        samples = [values[k * size:(k + 1) * size] for k in range(count)]
+        # the time stamps are unsigned micros()
+        return [(sample[0] & 0xFFFFFFFF,) + sample[1:] for sample in samples]
+
+    def get_all_parameters(self, motor) -> Dict[str, int]:
+        """Read all motor and remote parameters of a motor with one command.
+
+        Uses the bulk command GMP_PALL (the device and axis types are not
+        included). Returns a dict mapping external names to values, or None if
+        the firmware does not support the command (``bulk_available`` is
+        cleared then, so the callers use single parameters).
+        """
+        if not self.bulk_available:
+            return
+        with self.visa_lock:
+            resp = self._inst.query(f"GMP_PALL{motor}").rstrip("\r\n")
+        return self.parse_bulk_response(motor, resp)
+
+    def parse_bulk_response(self, motor, resp) -> Dict[str, int]:
+        """Map the values of a GMP_PALL response to external names.
+
+        Returns None (and clears ``bulk_available``) if the firmware does not
+        support the command.
+        """
+        prefix = f"MP_PALL{motor}="
+        values = resp[len(prefix):].split(",") if resp.startswith(prefix) else []
+        if len(values) != len(self.bulk_params):
+            if self.bulk_available:
+                self.logger.info(f"Bulk parameter transfer not available ({resp!r}), using single parameters.")
+            self.bulk_available = False
+            return
+        return {self.pico_to_ext[k]: int(v) for k, v in zip(self.bulk_params, values)}
+
+    def get_config_snapshot(self) -> Dict[str, Dict[str, int]]:
+        """Read the motor and remote parameters of all motors.
+
+        The bulk command GMP_PALL and the gets of the device and axis types
+        of all motors are pipelined, so the configuration is read in about
+        one round trip. Firmware without the bulk command is read parameter
+        by parameter. Parameters that could not be read are left out.
+
+        Returns:
+            dict keyed ``motor0``, ``motor1`` etc., each mapping external
+            parameter names to values (the format of the JSON files).
+        """
         param_list = self.get_pico_names("MP_")
         param_list.extend(self.get_pico_names("RP_"))
-        param_list_ext = [self.pico_to_ext[k] for k in param_list]
-        all_data = {}
-        for motor in range(4):
+        type_params = [k for k in param_list if k not in self.bulk_params]
+        num_motors = self.get_value_from_dev(None, "PC_NDEV")
+        if num_motors is None:
+            return {}
+        commands = []
+        for motor in range(num_motors):
+            commands.append(f"GMP_PALL{motor}")
+            commands.extend(f"G{k}{motor}" for k in type_params)
+        responses = iter(self.send_pipelined_commands(commands))
+        snapshot = {}
+        for motor in range(num_motors):
             motor_data = {}
-            for param in param_list_ext: 
+            motor_data.update(self.parse_bulk_response(motor, next(responses)) or {})
+            for param in type_params:
+                resp = next(responses)
+                prefix = f"{param}{motor}="
+                if resp.startswith(prefix):
+                    motor_data[self.pico_to_ext[param]] = int(resp[len(prefix):])
+            for param in param_list:
+                name = self.pico_to_ext[param]
+                if name in motor_data:
+                    continue
                 try:
-                    param_val = self.get_value(None, motor, param)
+                    param_val = self.get_value(None, motor, name)
                 except Exception as e:
                     # skip identifier if get_value fails
-                    self.logger.info(f"Warning: could not get {param!r} for motor{motor}: {e}")
+                    self.logger.info(f"Warning: could not get {name!r} for motor{motor}: {e}")
                     continue
                 if param_val is not None:
-                    motor_data[param] = param_val
-            all_data[f'motor{motor}'] = motor_data
+                    motor_data[name] = param_val
+            snapshot[f'motor{motor}'] = motor_data
+        return snapshot
+
+    def apply_config_snapshot(self, snapshot: Dict[str, Dict[str, int]]) -> int:
+        """Send the parameters of a snapshot that differ from the device.
+
+        The snapshot is compared with the device state from
+        :meth:`get_config_snapshot` and only the differing values are sent,
+        as pipelined sets. Parameters missing in the snapshot keep their
+        value. The device and axis types go last, as they reconfigure the
+        board.
+
+        Args:
+            snapshot: dict in the format of :meth:`get_config_snapshot`.
+
+        Returns:
+            number of values sent to the device.
+        """
+        current = self.get_config_snapshot()
+        commands = [[], []] # motor and remote parameters, then the device and axis types
+        for label, data in snapshot.items():
+            if label not in current:
+                self.logger.error(f"Illegal label {label} in snapshot.")
+                continue
+            motor = int(label[len("motor"):])
+            for param, val in data.items():
+                pico_param = self.ext_to_pico.get(param)
+                if pico_param is None or pico_param[:3] not in ("MP_", "RP_"):
+                    self.logger.info(f"Warning: could not set {param!r} for motor{motor}: unknown parameter")
+                    continue
+                if current[label].get(param) == int(val):
+                    continue
+                commands[pico_param not in self.bulk_params].append(f"S{pico_param}{motor},{int(val)}")
+        commands = commands[0] + commands[1]
+        for command, resp in zip(commands, self.send_pipelined_commands(commands)):
+            if not resp.startswith("ERROR=0"):
+                self.logger.error(f"{command}: {resp}")
+                self.logger.error(self.get_error())
+        return len(commands)
+
+    def save_parameters_to_file(self, filename):
+        """Save readable parameters for all motors to a JSON file.
+
+        The saved JSON contains one object per motor, keyed as ``motor0``,
+        ``motor1`` etc. (see :meth:`get_config_snapshot`).
+
+        Args:
+            filename: path to write the JSON file to.
+        """
         with open(filename, "w") as f:
-            json.dump(all_data, f, indent=4)
+            json.dump(self.get_config_snapshot(), f, indent=4)
 
 
     def load_parameters_from_file(self, filename):
         """Load parameter values from a file and apply them to the device.
 
         The file format is the same as written by :meth:`save_parameters_to_file`.
+        Only the values that differ from the device are sent (see
+        :meth:`apply_config_snapshot`).
 
         Args:
             filename: path to the JSON file to read.
+
+        Returns:
+            number of values sent to the device.
         """
 
         with open(filename, "r") as f:
             all_data = json.load(f)
-        for label, data in all_data.items():
-            # loop through motors
-            match = re.fullmatch(r'motor(\d+)', label)
-            if match:
-                motor = int(match.group(1))
-            else:
+        for label in all_data:
+            if not re.fullmatch(r'motor(\d+)', label):
                 self.logger.error(f"Illegal label {label} in file.")
                 return
-            for param, val in data.items():
-                try:
-                    self.set_value(None, motor, param, val)
-                except Exception as e:
-                    # skip identifier if set_value fails
-                    self.logger.info(f"Warning: could not set {param!r} for motor{motor}: {e}")
-                    continue
+        return self.apply_config_snapshot(all_data)
                             
 
 
@@ -274,8 +448,23 @@ class PicoStage:
         """
         if isinstance(params, list): # handle list case
             retDict = {}
+            # motor and remote parameters: one bulk command if the firmware has it
+            if ID in ('MP', 'RP') and motor is not None and len(params) > 1 and self.bulk_available \
+                    and all(self.ext_to_pico.get(param) in self.bulk_params for param in params):
+                bulk_data = self.get_all_parameters(motor)
+                if bulk_data is not None:
+                    return {param: bulk_data[param] for param in params}
+            # otherwise all queries pipelined, matched to the responses in order
+            queries = {}
             for param in params:
-                retDict[param] = self.get_value(ID, motor, param)
+                pico_param = self.get_readable_name(ID, motor, param)
+                if pico_param is not None:
+                    queries[param] = pico_param
+                retDict[param] = None
+            responses = self.send_pipelined_commands(
+                [f"G{pico_param}{motor if motor is not None else ''}" for pico_param in queries.values()])
+            for (param, pico_param), resp in zip(queries.items(), responses):
+                retDict[param] = self.parse_value(pico_param, resp)
             return retDict
         else: # must be a list
             self.logger.error(f"params is not a list.")
@@ -304,15 +493,26 @@ class PicoStage:
 
         Returns an integer or None if the parameter is not readable/valid.
         """
+        pico_param = self.get_readable_name(ID, motor, param)
+        if pico_param is None:
+            return
+        return self.get_value_from_dev(motor, pico_param)
+
+    def get_readable_name(self, ID, motor, param):
+        """Translate an external parameter name for a get.
+
+        Returns the Pico parameter ID, or None (logged) if the parameter is
+        not of type ``ID`` or not readable.
+        """
         self.logger.info(f"Getting value {param} for motor {motor}.")
         pico_param = self.ext_to_pico[param]
         if ID is not None and not (ID+'_') in pico_param:
             self.logger.error(f"Value {param} not of type {ID}.")
             return
-        if pico_param in [ "PC_SAFL", "MC_HOME", "MC_CONF", "MC_SCLR", "MC_MPOS", "MC_MVEL"]:
+        if pico_param in [ "PC_SAFL", "MC_HOME", "MC_CONF", "MC_SCLR", "MC_MPOS", "MC_MVEL", "MC_ORIG"]:
             self.logger.error(f"Value {param} not readable.")
             return
-        return self.get_value_from_dev(motor, pico_param)
+        return pico_param
 
     def get_value_from_dev(self, motor=None, queryString=None):
         """Query the device using a raw Pico query string and return an int.
@@ -325,6 +525,13 @@ class PicoStage:
         query = f"G{queryString}{motor if motor is not None else ''}"
         with self.visa_lock:
             resp = self._inst.query(query).rstrip("\r\n").rstrip("\r\n")
+        return self.parse_value(queryString, resp)
+
+    def parse_value(self, queryString, resp):
+        """Parse the integer of a get response, log an error response.
+
+        Returns the value or None if the response is an error or malformed.
+        """
         if resp.startswith(queryString):
             parts = resp.rsplit("=", 1)
             results = parts[1]
@@ -345,8 +552,15 @@ class PicoStage:
             params: dict of external names to values.
         """
         if isinstance(params, dict): # handle dict case
+            # all set commands pipelined, matched to the responses in order
+            commands = []
             for param, val in params.items():
-                self.set_value(ID, motor, param, val)
+                pico_param = self.get_writeable_name(ID, motor, param)
+                if pico_param is not None:
+                    valStr = f"{',' + str(val) if val is not None else ''}"
+                    commands.append(f"S{pico_param}{motor if motor is not None else ''}{valStr}")
+            for resp in self.send_pipelined_commands(commands):
+                self.log_error(resp)
         else:
             self.logger.error(f"params is not a dict.")
 
@@ -370,6 +584,17 @@ class PicoStage:
         Performs validation of ID/type and write-ability, then issues the
         command with :meth:`set_value_to_dev`.
         """
+        pico_param = self.get_writeable_name(ID, motor, param)
+        if pico_param is None:
+            return
+        self.set_value_to_dev(motor, pico_param, value)
+
+    def get_writeable_name(self, ID, motor, param):
+        """Translate an external parameter name for a set.
+
+        Returns the Pico parameter ID, or None (logged) if the parameter is
+        not of type ``ID`` or not writeable.
+        """
         self.logger.info(f"Setting value {param} for motor {motor}.")
         pico_param = self.ext_to_pico[param]
         if ID is not None and not (ID+'_') in pico_param:
@@ -378,7 +603,7 @@ class PicoStage:
         if pico_param in ["PC_NDEV", "PC_VERS", "MS_TEMP", "MS_PULL", "MC_POSR", "MC_STAT"]:
             self.logger.error(f"Value {param} not writeable.")
             return
-        self.set_value_to_dev(motor, pico_param, value)
+        return pico_param
 
 
     def set_value_to_dev(self, motor=None, queryString=None, value=None):
@@ -408,4 +633,32 @@ class PicoStage:
             self.logger.error(errMsg)
 
 
-     
\ No newline at end of file
+class AsyncPicoStage:
+    """asyncio front end of a :class:`PicoStage`.
+
+    Every method of the wrapped stage is available as a coroutine with the
+    same arguments, e.g. ``await astage.get_motor_status(0, 'ActualPosition')``.
+    The calls run on one worker thread per stage, so they reach the device in
+    the order they were awaited while the event loop serves other tasks.
+
+    >>> astage = AsyncPicoStage(PicoStage('ASRL3::INSTR', logger))
+    >>> pos, frame = await asyncio.gather(astage.get_motor_status(0, 'ActualPosition'), camera.snap())
+    """
+
+    def __init__(self, stage: PicoStage):
+        self.stage = stage
+        self._executor = ThreadPoolExecutor(max_workers=1)
+
+    def __getattr__(self, name):
+        attr = getattr(self.stage, name)
+        if not callable(attr):
+            return attr
+
+        async def call(*args, **kwargs):
+            loop = asyncio.get_running_loop()
+            return await loop.run_in_executor(self._executor, functools.partial(attr, *args, **kwargs))
+        return call
+
+    def shutdown(self):
+        """Wait for the pending calls and stop the worker thread (the stage stays open)."""
+        self._executor.shutdown(wait=True)
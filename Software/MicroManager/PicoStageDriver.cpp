@@ -4,6 +4,9 @@
 
 #include "ModuleInterface.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
 #include <string>
 #include <sstream>
@@ -27,6 +30,7 @@ const char* g_PicoAuxStageName = "Pico-AuxStage";
 #define ERR_INVALID_RETURN_VAL 107
 #define ERR_INVALID_AXIS_LABEL 108
 #define ERR_DYNAMIC_DESCRIPTION 109
+#define ERR_SEQUENCE_POSITION 110 // internal: SetPositionSteps recorded a sequence position instead of moving
 
 
 using namespace std;
@@ -79,8 +83,14 @@ MODULE_API void DeleteDevice(MM::Device* pDevice)
 //
 CPicoHub::CPicoHub() : 
    initialized_(false),
-   portAvailable_(false)
+   portAvailable_(false),
+   statusValid_(false),
+   multiStatusUnsupported_(false),
+   telemetryRate_(0),
+   readerRunning_(false),
+   teleFresh_(false)
 {
+   for (int idx = 0; idx < maxChannels_; idx++) teleValid_[idx] = false;
    InitializeDefaultErrorMessages();
 
    SetErrorText(ERR_BOARD_NOT_FOUND, "Did not find a Pico board with the correct ID. Is the Pico connected to this serial port?");
@@ -127,6 +137,14 @@ int CPicoHub::Initialize()
    PurgeComPort(port_.c_str());
    ret = GetControllerID();
    if (DEVICE_OK != ret) return ret;
+   statusValid_ = false;
+   multiStatusUnsupported_ = false;
+
+   // telemetry stream, the stages get their positions from it instead of polling
+   CPropertyAction* pAct = new CPropertyAction(this, &CPicoHub::OnTelemetryRate);
+   ret = CreateIntegerProperty("TelemetryRate [Hz]", 0, false, pAct); // 0 -> off
+   if (DEVICE_OK != ret) return ret;
+   SetPropertyLimits("TelemetryRate [Hz]", 0, 500);
 
    ret = UpdateStatus();
    if (DEVICE_OK != ret) return ret;
@@ -138,6 +156,8 @@ int CPicoHub::Initialize()
 
 int CPicoHub::Shutdown()
 {
+   if (initialized_ && telemetryRate_ > 0) SetTelemetryRate(0);
+   StopReader();
    initialized_ = false;
    return DEVICE_OK;
 }
@@ -302,7 +322,7 @@ int CPicoHub::GetIntegerFromDevice(const char* command, int axis, int& value, ch
    if (ret != DEVICE_OK) return ret;
 
    std::string answer;
-   ret = GetSerialAnswer(port_.c_str(), termChar_, answer);
+   ret = ReadAnswer(answer);
    if (ret != DEVICE_OK) return ret;
 
    // the response should be in the form "command=1234" (no "G" here)
@@ -345,11 +365,326 @@ int CPicoHub::SendIntegerToDevice(const char* command, int axis, int value, char
       // otherwise we query the value for a specific axis 
       snprintf(buf, bufSize, "S%s%i,%i", command, axis, value);
    }
+   InvalidateStatus(); // the command may start a move or change a position
+   ret = SendSerialCommand(port_.c_str(), buf, termChar_);
+   if (ret != DEVICE_OK) return ret;
+
+   ret = GetSetCommandAnswer(errStr);
+   InvalidateStatus(); // a record that arrived before the answer predates the command
+   return ret;
+}
+
+
+// sends the values for two axes in one command line (batched move),
+// the controller starts both axes in the same loop pass and answers once
+int CPicoHub::SendIntegerPairToDevice(const char* command, int axis1, int value1, int axis2, int value2, char* errStr)
+{
+   int ret = DEVICE_OK;
+
+   if (errStr) errStr[0] = '\0';
+   const std::lock_guard<std::mutex> lock(mutex_);
+
+   const int bufSize = 60;
+   char buf[bufSize];
+   snprintf(buf, bufSize, "S%s%i,%i,%i,%i", command, axis1, value1, axis2, value2);
+   InvalidateStatus(); // the command may start a move or change a position
    ret = SendSerialCommand(port_.c_str(), buf, termChar_);
    if (ret != DEVICE_OK) return ret;
 
+   ret = GetSetCommandAnswer(errStr);
+   InvalidateStatus(); // a record that arrived before the answer predates the command
+   return ret;
+}
+
+
+// sends a list of values for one axis, split into several command lines
+// (the controller accepts lines of up to 512 chars and 48 arguments). All lines are
+// sent before the answers are read, so an upload costs about one round trip
+int CPicoHub::SendIntegerListToDevice(const char* command, int axis, const std::vector<long>& values, char* errStr)
+{
+   int ret = DEVICE_OK;
+   const size_t valuesPerLine = 40; // 40 values of up to 12 chars each, plus the command and the axis
+   size_t numLines = 0;
+   bool isFailed = false;
+
+   if (errStr) errStr[0] = '\0';
+   const std::lock_guard<std::mutex> lock(mutex_);
+
+   InvalidateStatus();
+   for (size_t start = 0; start < values.size(); start += valuesPerLine)
+   {
+      std::ostringstream buf;
+      buf << "S" << command << axis;
+      for (size_t idx = start; idx < values.size() && idx < start + valuesPerLine; idx++)
+      {
+         buf << "," << values[idx];
+      }
+      ret = SendSerialCommand(port_.c_str(), buf.str().c_str(), termChar_);
+      if (ret != DEVICE_OK) break;
+      numLines++;
+   }
+   // each line is answered once, read all answers to keep the replies in step
+   for (size_t line = 0; line < numLines; line++)
+   {
+      std::string answer;
+      int err = ReadAnswer(answer);
+      if (err != DEVICE_OK) return err;
+      if (answer.find("ERROR=0") == std::string::npos) isFailed = true;
+   }
+   InvalidateStatus();
+   if (ret != DEVICE_OK) return ret;
+   if (isFailed) { // at least one line was rejected, get the message
+      std::string answer;
+      SendSerialCommand(port_.c_str(), "GPC_EMSG", termChar_);
+      ReadAnswer(answer);
+      LogMessage("Pico Hub: " + answer, false);
+      if (errStr) snprintf(errStr, MM::MaxStrLength, "Pico Hub: %s", answer.c_str());
+      return ERR_DYNAMIC_DESCRIPTION;
+   }
+   return DEVICE_OK;
+}
+
+
+// motion done and position of one axis. While the telemetry stream runs, the latest
+// record answers without serial I/O. Otherwise Busy() and the position reads of all
+// stages share one GPC_MSTA query while it is younger than statusMaxAgeMs_
+int CPicoHub::GetAxisStatus(int axis, int& isDone, int& position, char* errStr)
+{
+   int ret = DEVICE_OK;
+
+   if (errStr) errStr[0] = '\0';
+   if (axis < 0 || axis >= maxChannels_) return ERR_INVALID_AXIS_LABEL;
+   if (readerRunning_)
+   {
+      const std::lock_guard<std::mutex> lock(statusMutex_);
+      if (teleFresh_) {
+         if (!teleValid_[axis]) return ERR_INVALID_RESPONSE; // axis not configured
+         isDone = teleDone_[axis];
+         position = telePosition_[axis];
+         return DEVICE_OK;
+      }
+      // the reader itself can't wait for an answer (a listener calling back after a set command)
+      if (std::this_thread::get_id() == reader_.get_id()) return ERR_INVALID_RESPONSE;
+   }
+   {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      if (!multiStatusUnsupported_) {
+         ret = UpdateAxisStatus(errStr);
+         if (ret != DEVICE_OK) return ret;
+      }
+      if (!multiStatusUnsupported_) {
+         if (!channelValid_[axis]) return ERR_INVALID_RESPONSE; // axis not configured
+         isDone = channelDone_[axis];
+         position = channelPosition_[axis];
+         return DEVICE_OK;
+      }
+   }
+   // older firmware: one query for each value
+   ret = GetIntegerFromDevice("MC_POSR", axis, isDone, errStr);
+   if (ret != DEVICE_OK) return ret;
+   return GetIntegerFromDevice("MS_XACT", axis, position, errStr);
+}
+
+
+// private and expects caller to guard the port
+int CPicoHub::UpdateAxisStatus(char* errStr)
+{
+   if (statusValid_ && (GetCurrentMMTime() - statusTime_).getMsec() < statusMaxAgeMs_) return DEVICE_OK;
+
+   int ret = SendSerialCommand(port_.c_str(), "GPC_MSTA", termChar_);
+   if (ret != DEVICE_OK) return ret;
+
    std::string answer;
-   ret = GetSerialAnswer(port_.c_str(), termChar_, answer);
+   ret = ReadAnswer(answer);
+   if (ret != DEVICE_OK) return ret;
+
+   // the response should be in the form "PC_MSTA=0,1,1200,3072;1,0,-350,3584" (axis, done, position, flags)
+   std::string prefix = "PC_MSTA=";
+   size_t pos = answer.find(prefix);
+   if (pos == std::string::npos) {
+      if (answer.find("ERROR=") == std::string::npos) return ERR_INVALID_RESPONSE;
+      // unknown command: clear the error message and fall back to the single queries
+      SendSerialCommand(port_.c_str(), "GPC_EMSG", termChar_);
+      ReadAnswer(answer);
+      LogMessage("Pico Hub: controller without GPC_MSTA, querying the axes one by one", false);
+      multiStatusUnsupported_ = true;
+      return DEVICE_OK;
+   }
+
+   for (int idx = 0; idx < maxChannels_; idx++) channelValid_[idx] = false;
+   std::istringstream entries(answer.substr(pos + prefix.length()));
+   std::string entry;
+   while (std::getline(entries, entry, ';')) {
+      int axis, isDone, position, flags;
+      if (sscanf(entry.c_str(), "%d,%d,%d,%d", &axis, &isDone, &position, &flags) != 4) return ERR_INVALID_RETURN_VAL;
+      if (axis < 0 || axis >= maxChannels_) continue;
+      channelValid_[axis] = true;
+      channelDone_[axis] = isDone;
+      channelPosition_[axis] = position;
+   }
+   statusTime_ = GetCurrentMMTime();
+   statusValid_ = true;
+   return DEVICE_OK;
+}
+
+
+// private, marks the cached positions as outdated (a set command may start a move)
+void CPicoHub::InvalidateStatus()
+{
+   statusValid_ = false;
+   const std::lock_guard<std::mutex> lock(statusMutex_);
+   teleFresh_ = false;
+}
+
+
+// private and expects caller to guard the port. Reads the next answer line, from the
+// port or, while the telemetry reader runs, from the lines it queued
+int CPicoHub::ReadAnswer(std::string& answer)
+{
+   if (!readerRunning_) return GetSerialAnswer(port_.c_str(), termChar_, answer);
+
+   std::unique_lock<std::mutex> lock(answerMutex_);
+   if (!answerCond_.wait_for(lock, std::chrono::milliseconds((long long)answerTimeoutMs_), [this] { return !answers_.empty(); }))
+      return DEVICE_SERIAL_TIMEOUT;
+   answer = answers_.front();
+   answers_.pop_front();
+   return DEVICE_OK;
+}
+
+
+// private, starts or stops the telemetry stream and the reader thread
+int CPicoHub::SetTelemetryRate(long rate)
+{
+   int ret = DEVICE_OK;
+   std::string answer;
+   char buf[30];
+
+   const std::lock_guard<std::mutex> lock(mutex_);
+   if (rate > 0 && !readerRunning_) {
+      // the reader has to run before the first record arrives
+      PurgeComPort(port_.c_str());
+      {
+         const std::lock_guard<std::mutex> statusLock(statusMutex_);
+         teleFresh_ = false;
+      }
+      readerRunning_ = true;
+      reader_ = std::thread(&CPicoHub::ReaderLoop, this);
+   }
+   snprintf(buf, sizeof(buf), "SPC_TELE,%ld", rate);
+   ret = SendSerialCommand(port_.c_str(), buf, termChar_);
+   if (ret == DEVICE_OK) ret = ReadAnswer(answer);
+   if (ret == DEVICE_OK && answer.find("ERROR=0") == std::string::npos) {
+      SendSerialCommand(port_.c_str(), "GPC_EMSG", termChar_);
+      ReadAnswer(answer);
+      LogMessage("Pico Hub: " + answer, false);
+      ret = ERR_INVALID_RESPONSE;
+   }
+   if (ret == DEVICE_OK) telemetryRate_ = rate;
+   if (telemetryRate_ == 0) {
+      // the stream is off once the controller answered, no more records follow
+      StopReader();
+      PurgeComPort(port_.c_str());
+      statusValid_ = false;
+   }
+   return ret;
+}
+
+
+// private, ends the reader thread and drops the answers it didn't deliver
+void CPicoHub::StopReader()
+{
+   if (!reader_.joinable()) return;
+   readerRunning_ = false;
+   reader_.join();
+   const std::lock_guard<std::mutex> lock(answerMutex_);
+   answers_.clear();
+}
+
+
+// body of the reader thread: splits the port input into lines, telemetry records
+// update the cache, all other lines are answers to the commands of ReadAnswer()
+void CPicoHub::ReaderLoop()
+{
+   std::string line;
+   unsigned char buf[256];
+
+   while (readerRunning_) {
+      unsigned long numRead = 0;
+      if (ReadFromComPort(port_.c_str(), buf, sizeof(buf), numRead) != DEVICE_OK || numRead == 0) {
+         CDeviceUtils::SleepMs(1);
+         continue;
+      }
+      for (unsigned long idx = 0; idx < numRead; idx++) {
+         char c = (char)buf[idx];
+         if (c == '\r') continue;
+         if (c != '\n') {
+            line += c;
+            continue;
+         }
+         if (line.compare(0, 5, "TELE=") == 0) {
+            ProcessTelemetry(line);
+         } else if (!line.empty()) {
+            const std::lock_guard<std::mutex> lock(answerMutex_);
+            answers_.push_back(line);
+            answerCond_.notify_one();
+         }
+         line.clear();
+      }
+   }
+}
+
+
+// private, called by the reader for each record "TELE=<ms>;<axis>,<XACT>,<XENC>,<status>;..."
+void CPicoHub::ProcessTelemetry(const std::string& line)
+{
+   int changedMask = 0;
+   {
+      const std::lock_guard<std::mutex> lock(statusMutex_);
+      bool wasValid[maxChannels_];
+      std::istringstream entries(line.substr(5));
+      std::string entry;
+
+      std::getline(entries, entry, ';'); // time stamp
+      for (int idx = 0; idx < maxChannels_; idx++) {
+         wasValid[idx] = teleValid_[idx];
+         teleValid_[idx] = false;
+      }
+      while (std::getline(entries, entry, ';')) {
+         int axis, position, encoder, flags;
+         if (sscanf(entry.c_str(), "%d,%d,%d,%d", &axis, &position, &encoder, &flags) != 4) continue;
+         if (axis < 0 || axis >= maxChannels_) continue;
+         if (!wasValid[axis] || telePosition_[axis] != position) changedMask |= 0x1 << axis;
+         teleValid_[axis] = true;
+         teleDone_[axis] = (flags & teleMovingFlag_) ? 0 : 1;
+         telePosition_[axis] = position;
+      }
+      teleFresh_ = true;
+   }
+   if (!changedMask) return;
+   const std::lock_guard<std::mutex> lock(listenerMutex_);
+   for (IPicoPositionListener* listener : listeners_) listener->OnChannelPositionsChanged(changedMask);
+}
+
+
+void CPicoHub::AddPositionListener(IPicoPositionListener* listener)
+{
+   const std::lock_guard<std::mutex> lock(listenerMutex_);
+   if (std::find(listeners_.begin(), listeners_.end(), listener) == listeners_.end()) listeners_.push_back(listener);
+}
+
+
+void CPicoHub::RemovePositionListener(IPicoPositionListener* listener)
+{
+   const std::lock_guard<std::mutex> lock(listenerMutex_);
+   listeners_.erase(std::remove(listeners_.begin(), listeners_.end(), listener), listeners_.end());
+}
+
+
+// private and expects caller to guard the port
+int CPicoHub::GetSetCommandAnswer(char* errStr)
+{
+   std::string answer;
+   int ret = ReadAnswer(answer);
    if (ret != DEVICE_OK) return ret;
 
    // the response should be in the form "ERROR=0"
@@ -359,10 +694,8 @@ int CPicoHub::SendIntegerToDevice(const char* command, int axis, int value, char
       return DEVICE_OK;
    }
    else { // we have an error
-      
-      snprintf(buf, bufSize, "GPC_EMSG");
-      SendSerialCommand(port_.c_str(), buf, termChar_);
-      GetSerialAnswer(port_.c_str(), termChar_, answer);
+      SendSerialCommand(port_.c_str(), "GPC_EMSG", termChar_);
+      ReadAnswer(answer);
       LogMessage("Pico Hub: " + answer, false);
       if (errStr) snprintf(errStr, MM::MaxStrLength, "Pico Hub: %s", answer.c_str());
       return ERR_DYNAMIC_DESCRIPTION;
@@ -440,6 +773,24 @@ int CPicoHub::OnPort(MM::PropertyBase* pProp, MM::ActionType pAct)
 }
 
 
+int CPicoHub::OnTelemetryRate(MM::PropertyBase* pProp, MM::ActionType pAct)
+{
+   if (pAct == MM::BeforeGet)
+   {
+      pProp->Set(telemetryRate_);
+   }
+   else if (pAct == MM::AfterSet)
+   {
+      long rate;
+      pProp->Get(rate);
+      if (rate == telemetryRate_) return DEVICE_OK;
+      int ret = SetTelemetryRate(rate);
+      if (ret != DEVICE_OK) return ret;
+   }
+   return DEVICE_OK;
+}
+
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // CPicoXYStage implementation
@@ -451,7 +802,11 @@ CPicoXYStage::CPicoXYStage() :
    stepSizeYUm_(0.1), // um
    channelX_(-1), // channel on the controller, -1 means not set
    channelY_(-1), // channel on the controller, -1 means not set
-   motionInProgress_(false)
+   motionInProgress_(false),
+   sequenceMaxLength_(0),
+   capturingSequence_(false),
+   capturedX_(0),
+   capturedY_(0)
 {
    InitializeDefaultErrorMessages();
 
@@ -540,6 +895,11 @@ int CPicoXYStage::Initialize()
    ret = CreateIntegerProperty("SettleTime [ms]", 0, false);
    if (ret != DEVICE_OK) return ret;
 
+   ret = CreateProperty("SyncArrival", "0", MM::Integer, false); // [0 or 1] scale the ramps so X and Y arrive together
+   if (ret != DEVICE_OK) return ret;
+   AddAllowedValue("SyncArrival", "0");
+   AddAllowedValue("SyncArrival", "1");
+
    pAct = new CPropertyAction(this, &CPicoXYStage::OnRemote);
    ret = CreateProperty("IsRemoteControlled", "0", MM::Integer, false, pAct); // [0 or 1]
    if (ret != DEVICE_OK) return ret;
@@ -560,6 +920,12 @@ int CPicoXYStage::Initialize()
    ret = SendIntegerToDevice("MS_ENAB", channelY_, 1);
    if (ret != DEVICE_OK) return ret;
 
+   // the stage is sequenceable if the controller has a trigger input (firmware without sequences answers with an error)
+   int maxLength = 0;
+   if (GetIntegerFromDevice("PC_SQML", -2, maxLength) != DEVICE_OK) maxLength = 0;
+   sequenceMaxLength_ = maxLength;
+
+   hub_->AddPositionListener(this);
    initialized_ = true;
    return DEVICE_OK;
 }
@@ -567,6 +933,7 @@ int CPicoXYStage::Initialize()
 
 int CPicoXYStage::Shutdown()
 {
+   if (initialized_ && hub_) hub_->RemovePositionListener(this);
    initialized_ = false;
    return DEVICE_OK;
 }
@@ -608,17 +975,71 @@ int CPicoXYStage::SendIntegerToDevice(const char* command, int channel, int valu
 }
 
 
+int CPicoXYStage::SendIntegerPairToDevice(const char* command, int valueX, int valueY)
+{
+   char errorString[MM::MaxStrLength];
+
+   if (!hub_ || !hub_->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   int ret = hub_->SendIntegerPairToDevice(command, channelX_, valueX, channelY_, valueY, errorString);
+   if (ret != DEVICE_OK) {
+      if (ERR_DYNAMIC_DESCRIPTION == ret) {
+         SetErrorText(ERR_DYNAMIC_DESCRIPTION, errorString);
+      }
+      return ret;
+   }
+   return DEVICE_OK;
+}
+
+
+int CPicoXYStage::SendIntegerListToDevice(const char* command, int channel, const std::vector<long>& values)
+{
+   char errorString[MM::MaxStrLength];
+
+   if (!hub_ || !hub_->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   int ret = hub_->SendIntegerListToDevice(command, channel, values, errorString);
+   if (ret != DEVICE_OK) {
+      if (ERR_DYNAMIC_DESCRIPTION == ret) {
+         SetErrorText(ERR_DYNAMIC_DESCRIPTION, errorString);
+      }
+      return ret;
+   }
+   return DEVICE_OK;
+}
+
+
+int CPicoXYStage::GetAxisStatus(int channel, int& isDone, int& position)
+{
+   char errorString[MM::MaxStrLength];
+
+   if (!hub_ || !hub_->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   int ret = hub_->GetAxisStatus(channel, isDone, position, errorString);
+   if (ret != DEVICE_OK) {
+      if (ERR_DYNAMIC_DESCRIPTION == ret) {
+         SetErrorText(ERR_DYNAMIC_DESCRIPTION, errorString);
+      }
+      return ret;
+   }
+   return DEVICE_OK;
+}
+
+
 /**
  * Returns true if any axis (X or Y) is still moving.
  */
 bool CPicoXYStage::Busy()
 {
-   int isDoneX, isDoneY;
+   int isDoneX, isDoneY, posX, posY;
    long delayTime;
 
-   int ret = GetIntegerFromDevice("MC_POSR", channelX_, isDoneX);
+   int ret = GetAxisStatus(channelX_, isDoneX, posX);
    if (ret != DEVICE_OK) return false;
-   ret = GetIntegerFromDevice("MC_POSR", channelY_, isDoneY);
+   ret = GetAxisStatus(channelY_, isDoneY, posY);
    if (ret != DEVICE_OK) return false;
 
    if (isDoneX == 1 && isDoneY == 1) {
@@ -639,9 +1060,17 @@ bool CPicoXYStage::Busy()
  */
 int CPicoXYStage::SetPositionSteps(long x, long y)
 {
-   int ret = SendIntegerToDevice("MC_MPOS", channelX_, (int)x);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MC_MPOS", channelY_, (int)y);
+   long syncArrival;
+
+   if (capturingSequence_) { // called through SetPositionUm by AddToXYStageSequence, don't move
+      capturedX_ = x;
+      capturedY_ = y;
+      return ERR_SEQUENCE_POSITION; // also keeps SetPositionUm from reporting a position change
+   }
+
+   // both axes in one line: MC_MPOS starts them together, MC_SPOS also makes them arrive together
+   GetProperty("SyncArrival", syncArrival);
+   int ret = SendIntegerPairToDevice(syncArrival ? "MC_SPOS" : "MC_MPOS", (int)x, (int)y);
    if (ret != DEVICE_OK) return ret;
    motionInProgress_ = true;
 
@@ -654,10 +1083,11 @@ int CPicoXYStage::SetPositionSteps(long x, long y)
 int CPicoXYStage::GetPositionSteps(long& x, long& y)
 {
    int xInt, yInt; // even though int and long are the same here, compiler enforces the types
+   int isDone;
 
-   int ret = GetIntegerFromDevice("MS_XACT", channelX_, xInt);
+   int ret = GetAxisStatus(channelX_, isDone, xInt);
    if (ret != DEVICE_OK) return ret;
-   ret = GetIntegerFromDevice("MS_XACT", channelY_, yInt);
+   ret = GetAxisStatus(channelY_, isDone, yInt);
    if (ret != DEVICE_OK) return ret;
 
    x = (long)xInt; // convert to long
@@ -666,34 +1096,24 @@ int CPicoXYStage::GetPositionSteps(long& x, long& y)
 }
 
 
+// called by the telemetry reader of the hub, positions come from the latest record
+void CPicoXYStage::OnChannelPositionsChanged(int channelMask)
+{
+   double x, y;
+
+   if (!(channelMask & ((0x1 << channelX_) | (0x1 << channelY_)))) return;
+   if (GetPositionUm(x, y) == DEVICE_OK) OnXYStagePositionChanged(x, y);
+}
+
+
 // sets the current position to 0,0
 int CPicoXYStage::SetOrigin()
 {
    int ret;
 
-   // sequence: disable motors, set the current, target, encoder positions to 0, enable motors again
-   // xChannel
-   ret = SendIntegerToDevice("MS_ENAB", channelX_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XACT", channelX_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XTAR", channelX_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XENC", channelX_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_ENAB", channelX_, 1);
-   if (ret != DEVICE_OK) return ret;
-
-   // yChannel
-   ret = SendIntegerToDevice("MS_ENAB", channelY_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XACT", channelY_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XTAR", channelY_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XENC", channelY_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_ENAB", channelY_, 1);
+   // the current, target and encoder positions of both axes are set to 0 in one command,
+   // the controller checks both axes first and doesn't move or disable the motors
+   ret = SendIntegerPairToDevice("MC_ORIG", 0, 0);
    if (ret != DEVICE_OK) return ret;
 
    ret = SetAdapterOriginUm(0.0, 0.0); // set the adapter origin to 0,0
@@ -742,6 +1162,62 @@ int CPicoXYStage::Home()
 }
 
 
+// the sequence is armed on the controller: it moves to the first position right away,
+// then every edge on the trigger input moves X and Y to the next position
+int CPicoXYStage::StartXYStageSequence()
+{
+   int ret = SendIntegerPairToDevice("MC_SQST", 1, 1); // in one line, so X and Y start from the same edge
+   if (ret != DEVICE_OK) return ret;
+   motionInProgress_ = true;
+   return DEVICE_OK;
+}
+
+
+int CPicoXYStage::StopXYStageSequence()
+{
+   return SendIntegerPairToDevice("MC_SQST", 0, 0);
+}
+
+
+// clears the local list only, the controller keeps its sequence until SendXYStageSequence
+int CPicoXYStage::ClearXYStageSequence()
+{
+   sequenceX_.clear();
+   sequenceY_.clear();
+   return DEVICE_OK;
+}
+
+
+// units are um
+int CPicoXYStage::AddToXYStageSequence(double positionX, double positionY)
+{
+   if ((long)sequenceX_.size() >= sequenceMaxLength_) return DEVICE_SEQUENCE_TOO_LARGE;
+   // convert as SetXYPosition does (adapter origin, mirrored axes), SetPositionSteps records the steps
+   capturingSequence_ = true;
+   int ret = SetPositionUm(positionX, positionY);
+   capturingSequence_ = false;
+   if (ret != ERR_SEQUENCE_POSITION) return (ret != DEVICE_OK ? ret : DEVICE_ERR);
+   sequenceX_.push_back(capturedX_);
+   sequenceY_.push_back(capturedY_);
+   return DEVICE_OK;
+}
+
+
+// replaces the sequences on the controller with the local lists
+int CPicoXYStage::SendXYStageSequence()
+{
+   int ret = SendIntegerToDevice("MC_SQCL", channelX_, 0);
+   if (ret != DEVICE_OK) return ret;
+   ret = SendIntegerToDevice("MC_SQCL", channelY_, 0);
+   if (ret != DEVICE_OK) return ret;
+   ret = SendIntegerListToDevice("MC_SQAD", channelX_, sequenceX_);
+   if (ret != DEVICE_OK) return ret;
+   ret = SendIntegerListToDevice("MC_SQAD", channelY_, sequenceY_);
+   if (ret != DEVICE_OK) return ret;
+   return DEVICE_OK;
+}
+
+
 int CPicoXYStage::GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax)  
 {  
     (void)xMin; (void)xMax; (void)yMin; (void)yMax; // Suppress unused parameter warnings  
@@ -910,7 +1386,8 @@ CPicoStage::CPicoStage(const char* deviceName) :
    originSteps_(0),
    channel_(-1), // -1 means not set
    id_("-"), // axis ID, e.g. "Z" or "Aux"
-   motionInProgress_(false)
+   motionInProgress_(false),
+   sequenceMaxLength_(0)
 {
    InitializeDefaultErrorMessages();
 
@@ -1017,6 +1494,12 @@ int CPicoStage::Initialize()
    ret = SendIntegerToDevice("MS_ENAB", channel_, 1);
    if (ret != DEVICE_OK) return ret;
 
+   // the stage is sequenceable if the controller has a trigger input (firmware without sequences answers with an error)
+   int maxLength = 0;
+   if (GetIntegerFromDevice("PC_SQML", -2, maxLength) != DEVICE_OK) maxLength = 0;
+   sequenceMaxLength_ = maxLength;
+
+   hub_->AddPositionListener(this);
    initialized_ = true;
    return DEVICE_OK;
 }
@@ -1024,6 +1507,7 @@ int CPicoStage::Initialize()
 
 int CPicoStage::Shutdown()
 {
+   if (initialized_ && hub_) hub_->RemovePositionListener(this);
    initialized_ = false;
    return DEVICE_OK;
 }
@@ -1065,15 +1549,51 @@ int CPicoStage::SendIntegerToDevice(const char* command, int channel, int value)
 }
 
 
+int CPicoStage::SendIntegerListToDevice(const char* command, int channel, const std::vector<long>& values)
+{
+   char errorString[MM::MaxStrLength];
+
+   if (!hub_ || !hub_->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   int ret = hub_->SendIntegerListToDevice(command, channel, values, errorString);
+   if (ret != DEVICE_OK) {
+      if (ERR_DYNAMIC_DESCRIPTION == ret) {
+         SetErrorText(ERR_DYNAMIC_DESCRIPTION, errorString);
+      }
+      return ret;
+   }
+   return DEVICE_OK;
+}
+
+
+int CPicoStage::GetAxisStatus(int channel, int& isDone, int& position)
+{
+   char errorString[MM::MaxStrLength];
+
+   if (!hub_ || !hub_->IsPortAvailable()) {
+      return ERR_NO_PORT_SET;
+   }
+   int ret = hub_->GetAxisStatus(channel, isDone, position, errorString);
+   if (ret != DEVICE_OK) {
+      if (ERR_DYNAMIC_DESCRIPTION == ret) {
+         SetErrorText(ERR_DYNAMIC_DESCRIPTION, errorString);
+      }
+      return ret;
+   }
+   return DEVICE_OK;
+}
+
+
 /**
  * Returns true if the axis is still moving.
  */
 bool CPicoStage::Busy()
 {
-   int isDone;
+   int isDone, posInt;
    long delayTime;
 
-   int ret = GetIntegerFromDevice("MC_POSR", channel_, isDone);
+   int ret = GetAxisStatus(channel_, isDone, posInt);
    if (ret != DEVICE_OK) return false;
 
    if (isDone == 1) {
@@ -1116,7 +1636,8 @@ int CPicoStage::GetPositionUm(double& pos)
 int CPicoStage::GetPositionSteps(long& steps)
 {
    int posInt; // even though int and long are the same here, compiler enforces the types
-   int ret = GetIntegerFromDevice("MS_XACT", channel_, posInt);
+   int isDone;
+   int ret = GetAxisStatus(channel_, isDone, posInt);
    if (ret != DEVICE_OK) return ret;
    steps = (long)posInt - originSteps_; // convert to long
    return DEVICE_OK;
@@ -1124,6 +1645,16 @@ int CPicoStage::GetPositionSteps(long& steps)
 
 
 
+// called by the telemetry reader of the hub, the position comes from the latest record
+void CPicoStage::OnChannelPositionsChanged(int channelMask)
+{
+   double pos;
+
+   if (!(channelMask & (0x1 << channel_))) return;
+   if (GetPositionUm(pos) == DEVICE_OK) OnStagePositionChanged(pos);
+}
+
+
 double CPicoStage::GetStepSizeUm()
 {
    return stepSizeUm_;
@@ -1134,16 +1665,8 @@ int CPicoStage::SetOrigin()
 {
    int ret;
 
-   // sequence: disable motors, set the current, target, encoder positions to 0, enable motors again
-   ret = SendIntegerToDevice("MS_ENAB", channel_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XACT", channel_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XTAR", channel_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_XENC", channel_, 0);
-   if (ret != DEVICE_OK) return ret;
-   ret = SendIntegerToDevice("MS_ENAB", channel_, 1);
+   // the current, target and encoder positions are set to 0 in one command (the motor stays enabled)
+   ret = SendIntegerToDevice("MC_ORIG", channel_, 0);
    if (ret != DEVICE_OK) return ret;
 
    originSteps_ = 0; // set the adapter origin to 0
@@ -1177,6 +1700,49 @@ int CPicoStage::Stop()
 }
 
 
+// the sequence is armed on the controller: it moves to the first position right away,
+// then every edge on the trigger input moves the axis to the next position
+int CPicoStage::StartStageSequence()
+{
+   int ret = SendIntegerToDevice("MC_SQST", channel_, 1);
+   if (ret != DEVICE_OK) return ret;
+   motionInProgress_ = true;
+   return DEVICE_OK;
+}
+
+
+int CPicoStage::StopStageSequence()
+{
+   return SendIntegerToDevice("MC_SQST", channel_, 0);
+}
+
+
+// clears the local list only, the controller keeps its sequence until SendStageSequence
+int CPicoStage::ClearStageSequence()
+{
+   sequence_.clear();
+   return DEVICE_OK;
+}
+
+
+// units are um
+int CPicoStage::AddToStageSequence(double position)
+{
+   if ((long)sequence_.size() >= sequenceMaxLength_) return DEVICE_SEQUENCE_TOO_LARGE;
+   sequence_.push_back(nint(position / stepSizeUm_) + originSteps_); // add the origin offset in steps
+   return DEVICE_OK;
+}
+
+
+// replaces the sequence on the controller with the local list
+int CPicoStage::SendStageSequence()
+{
+   int ret = SendIntegerToDevice("MC_SQCL", channel_, 0);
+   if (ret != DEVICE_OK) return ret;
+   return SendIntegerListToDevice("MC_SQAD", channel_, sequence_);
+}
+
+
 int CPicoStage::GetLimits(double& min, double& max)
 {
    (void)min; (void)max; // Suppress unused parameter warnings
@@ -4,11 +4,24 @@
 
 #include "MMDevice.h"
 #include "DeviceBase.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 
-
+// implemented by the stages, the hub calls it from its telemetry reader thread
+// when a record reports a new position for at least one channel
+class IPicoPositionListener
+{
+public:
+   virtual ~IPicoPositionListener() {}
+   virtual void OnChannelPositionsChanged(int channelMask) = 0; // bit n set -> channel n moved
+};
 
 
 class CPicoHub : public HubBase<CPicoHub>
@@ -28,27 +41,69 @@ public:
 
     // property handlers
     int OnPort(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnTelemetryRate(MM::PropertyBase* pProp, MM::ActionType eAct);
 
     // custom interface for child devices
     bool IsPortAvailable() { return portAvailable_; }
 
     int GetIntegerFromDevice(const char* command, int channel, int& value, char* errStr);
     int SendIntegerToDevice(const char* command, int channel, int value, char* errStr);
+    int SendIntegerPairToDevice(const char* command, int channel1, int value1, int channel2, int value2, char* errStr);
+    int SendIntegerListToDevice(const char* command, int channel, const std::vector<long>& values, char* errStr);
+    int GetAxisStatus(int channel, int& isDone, int& position, char* errStr);
     int IdentifyAxisChannel(const char* axisLabel, int& channel);
+    void AddPositionListener(IPicoPositionListener* listener);
+    void RemovePositionListener(IPicoPositionListener* listener);
 
     std::mutex& GetLock() { return mutex_; }
 
 private:
     int GetControllerID();
+    int GetSetCommandAnswer(char* errStr);
+    int UpdateAxisStatus(char* errStr);
+    void InvalidateStatus();
+    int ReadAnswer(std::string& answer);
+    int SetTelemetryRate(long rate);
+    void StopReader();
+    void ReaderLoop();
+    void ProcessTelemetry(const std::string& line);
     std::string port_;
     bool portAvailable_;
     bool initialized_;
     std::mutex mutex_;
     static constexpr char termChar_[] = "\n"; // LF
+
+    // motion done and position of all axes from one GPC_MSTA query, shared by the stages
+    static constexpr int maxChannels_ = 4;
+    static constexpr double statusMaxAgeMs_ = 1.0; // queries within this time share one transaction
+    bool statusValid_; // false after a set command, which may have started a move
+    bool multiStatusUnsupported_; // firmware without GPC_MSTA, the axes are queried one by one
+    MM::MMTime statusTime_;
+    bool channelValid_[maxChannels_];
+    int channelDone_[maxChannels_];
+    int channelPosition_[maxChannels_];
+
+    // telemetry stream (SPC_TELE): a reader thread owns the port input while it runs, it keeps
+    // the latest record of each channel and queues all other lines as answers for ReadAnswer()
+    static constexpr int teleMovingFlag_ = 0x1 << 12; // status bit of the records: move in progress
+    static constexpr int answerTimeoutMs_ = 1000;
+    long telemetryRate_; // records per second, 0 -> off (the stages poll)
+    std::thread reader_;
+    std::atomic<bool> readerRunning_;
+    std::mutex answerMutex_;
+    std::condition_variable answerCond_;
+    std::deque<std::string> answers_;
+    std::mutex statusMutex_; // guards the tele* members, which the reader writes
+    bool teleFresh_; // false after a set command until the first record after its answer arrives
+    bool teleValid_[maxChannels_];
+    int teleDone_[maxChannels_];
+    int telePosition_[maxChannels_];
+    std::mutex listenerMutex_;
+    std::vector<IPicoPositionListener*> listeners_;
 };
 
 
-class CPicoXYStage : public CXYStageBase<CPicoXYStage>
+class CPicoXYStage : public CXYStageBase<CPicoXYStage>, public IPicoPositionListener
 {
 public:
    CPicoXYStage();
@@ -71,7 +126,16 @@ public:
    int Stop();
    int GetLimitsUm(double& xMin, double& xMax, double& yMin, double& yMax);
    int GetStepLimits(long& xMin, long& xMax, long& yMin, long& yMax);
-   int IsXYStageSequenceable(bool& isSequenceable) const { isSequenceable = false; return DEVICE_OK; }
+   int IsXYStageSequenceable(bool& isSequenceable) const { isSequenceable = (sequenceMaxLength_ > 0); return DEVICE_OK; }
+   int GetXYStageSequenceMaxLength(long& nrEvents) const { nrEvents = sequenceMaxLength_; return DEVICE_OK; }
+   int StartXYStageSequence();
+   int StopXYStageSequence();
+   int ClearXYStageSequence();
+   int AddToXYStageSequence(double positionX, double positionY);
+   int SendXYStageSequence();
+
+   // IPicoPositionListener
+   void OnChannelPositionsChanged(int channelMask);
 
    // action interface
    int OnStepSizeX(MM::PropertyBase* pProp, MM::ActionType eAct);
@@ -85,6 +149,9 @@ public:
 private:
    int GetIntegerFromDevice(const char* command, int channel, int& value);
    int SendIntegerToDevice(const char* command, int channel, int value);
+   int SendIntegerPairToDevice(const char* command, int valueX, int valueY);
+   int SendIntegerListToDevice(const char* command, int channel, const std::vector<long>& values);
+   int GetAxisStatus(int channel, int& isDone, int& position);
 
    CPicoHub* hub_;
    bool initialized_;
@@ -93,10 +160,16 @@ private:
    double stepSizeXUm_;
    double stepSizeYUm_;
    bool motionInProgress_;
+   long sequenceMaxLength_; // max number of positions in the controller sequence, 0 means not sequenceable
+   std::vector<long> sequenceX_; // X positions in steps, uploaded by SendXYStageSequence
+   std::vector<long> sequenceY_; // Y positions in steps, uploaded by SendXYStageSequence
+   bool capturingSequence_; // true while AddToXYStageSequence converts a position through SetPositionUm
+   long capturedX_; // steps recorded by SetPositionSteps while capturingSequence_ is set
+   long capturedY_;
 };
 
 
-class CPicoStage : public CStageBase<CPicoStage>
+class CPicoStage : public CStageBase<CPicoStage>, public IPicoPositionListener
 {
 public:
    CPicoStage(const char* deviceName);
@@ -121,7 +194,16 @@ public:
    int GetLimits(double& min, double& max);
 //   int GetStepLimits(long& xMin, long& xMax, long& yMin, long& yMax);
    bool IsContinuousFocusDrive() const { return false; }
-   int IsStageSequenceable(bool& isSequenceable) const { isSequenceable = false; return DEVICE_OK; }
+   int IsStageSequenceable(bool& isSequenceable) const { isSequenceable = (sequenceMaxLength_ > 0); return DEVICE_OK; }
+   int GetStageSequenceMaxLength(long& nrEvents) const { nrEvents = sequenceMaxLength_; return DEVICE_OK; }
+   int StartStageSequence();
+   int StopStageSequence();
+   int ClearStageSequence();
+   int AddToStageSequence(double position);
+   int SendStageSequence();
+
+   // IPicoPositionListener
+   void OnChannelPositionsChanged(int channelMask);
 
    // action interface
    int OnID(MM::PropertyBase* pProp, MM::ActionType eAct);
@@ -133,6 +215,8 @@ public:
 private:
    int GetIntegerFromDevice(const char* command, int channel, int& value);
    int SendIntegerToDevice(const char* command, int channel, int value);
+   int SendIntegerListToDevice(const char* command, int channel, const std::vector<long>& values);
+   int GetAxisStatus(int channel, int& isDone, int& position);
 
    CPicoHub* hub_;
    std::string id_;
@@ -141,4 +225,6 @@ private:
    double stepSizeUm_;
    long originSteps_;
    bool motionInProgress_;
+   long sequenceMaxLength_; // max number of positions in the controller sequence, 0 means not sequenceable
+   std::vector<long> sequence_; // positions in steps, uploaded by SendStageSequence
 };
@@ -67,12 +67,24 @@ typedef enum {
 // Module-specific defines
 // *************************************************************************************
 
-#define PRARAMETERS_FLASH_SIZE            1024 // size of the flash memory for the parameters in bytes
+#define PRARAMETERS_FLASH_SIZE            1024 // size of the flash memory for the parameters in bytes (legacy EEPROM layout)
+#define PARAMS_STORE_SECTORS              4 // number of 4 kB flash sectors for the parameter log (needs board_build.filesystem_size >= 16k)
 
 #define SERIAL_BAUDRATE                   115200 // baudrate for the serial communication
 #define SERIAL_TERMCHAR                   0xA  // termination char can be 0xA (LF) or 0xD (CR)
 #define SERIAL_ID_STRING                  "Stage Driver Pico" // ID string for the serial communication
-#define SERIAL_CHECK_INTERVAL_MS          20 // check interval for serial commands in ms
+#define SERIAL_ID_CONFIGURING             " (configuring)" // appended to the ID string while the boot config is in progress
+#define SERIAL_MAX_LINE_LENGTH            512 // maximum length of a serial command line (without the termination char), fits SMP_PALL
+#define SERIAL_MAX_ARGS                   48 // maximum number of integer arguments (incl. the board) in a serial command
+#define SERIAL_BIN_SYNC                   0xA5 // first byte of a binary request frame (never starts an ASCII line)
+#define SERIAL_BIN_REPLY_SYNC             0x5A // first byte of a binary reply frame
+#define SERIAL_BIN_REQUEST_SIZE           14 // size of a binary request frame in bytes (incl. sync and CRC)
+#define SERIAL_BIN_REPLY_SIZE             8 // size of a binary reply frame in bytes (incl. sync and CRC)
+#define SERIAL_BIN_SUB_VALUE              0x01 // sub-argument flag for commands without board: the value is passed as argument
+#define SERIAL_BIN_TIMEOUT_MS             50 // an incomplete binary frame is discarded after this time
+#define SERIAL_TELE_SYNC                  0x5B // first byte of a binary telemetry record
+#define SERIAL_TELE_MAX_RATE_HZ           500 // maximum rate of the telemetry stream
+#define SERIAL_TELE_MOVING_FLAG           (0x1 << 12) // status bit of the telemetry records: move in progress
 
 #define REMOTE_ENABLED                    1 // set to 0 if no remote present (turns off UART communication)
 #define REMOTE_NUM_PARAMS                 5 // number of parameters in Parameters::remoteIDList
@@ -81,15 +93,54 @@ typedef enum {
 #define REMOTE_UART_BUFFER_SIZE           1024 // size of the UART buffer for the remote communication
 #define REMOTE_PIN_TX                     PIN_SERIAL1_TX // TX pin for the remote communication
 #define REMOTE_PIN_RX                     PIN_SERIAL1_RX // RX pin for the remote communication
-#define REMOTE_SEND_INTERVAL_MS           200 // interval in ms to send commands to the remote controller
+#define REMOTE_SEND_INTERVAL_MS           40 // interval in ms to check for position changes to send to the remote
+#define REMOTE_POS_THRESHOLD              8 // position changes (in microsteps) below this are only sent once the axis is at rest
+#define REMOTE_POS_REST_MS                200 // a position that didn't change by REMOTE_POS_THRESHOLD for this time is sent as is
+#define REMOTE_POS_KEYFRAME_COUNT         16 // every n-th update of a moving axis is absolute (recovers from lost updates)
 #define REMOTE_RECEIVE_INTERVAL_MS        10 // interval in ms to receive commands from the remote controller
+#define REMOTE_HANDSHAKE_INTERVAL_MS      50 // interval in ms to ping the remote until it answers
+#define REMOTE_HANDSHAKE_TIMEOUT_MS       1000 // after this time the parameters are sent anyway (remote firmware without handshake)
+#define REMOTE_LINK_PING_INTERVAL_MS      1000 // interval in ms of the timestamped round-trip pings for the link statistics (0 -> off)
 
 #define MOTORS_NUM_PARAMS                 34 // number of parameters in Parameters::motParamsIDList
+#define PARAMS_NUM_BULK                   (MOTORS_NUM_PARAMS + REMOTE_NUM_PARAMS) // number of values of GMP_PALL/SMP_PALL
+#define PARAMS_GROUP_CURRENT              0x01 // parameter groups by the first letter of the ID: C..
+#define PARAMS_GROUP_MODE                 0x02 // M..
+#define PARAMS_GROUP_HOMING               0x04 // H..
+#define PARAMS_GROUP_RATE                 0x08 // R..
+#define PARAMS_GROUP_ENCODER              0x10 // E..
+#define PARAMS_GROUP_SWITCH               0x20 // S..
+#define PARAMS_GROUP_LIMITS               0x40 // L..
+#define PARAMS_GROUP_ALL                  0x7F // all parameter groups
 #define MOTORS_NUM_STATUS                 8 // number of status parameters in Motors::motStatIDList
 #define MOTORS_CHECK_ERROR_INTERVAL_MS    50 // check interval in ms for motor errors
 #define MOTORS_CHECK_STATUS_INTERVAL_MS   10 // check interval in ms for motor status
+#define MOTORS_SNAPSHOT_MAX_AGE_MS        25 // max age in ms of the register snapshot used for host queries
+#define MOTORS_CL_CHECK_INTERVAL_MS       1 // check interval in ms for closed loop moves (starts the correction right after the ramp)
+#define MOTORS_CL_APPROACH_SCALE          0.5f // ramp scaling of the closed loop corrections (slower final approach, less overshoot)
+#define MOTORS_CL_GAIN_MIN                0.5f // limits for the learned ratio of encoder motion to commanded motion
+#define MOTORS_CL_GAIN_MAX                2.0f
+#define MOTORS_DUAL_CORE                  1 // set to 1 to run the motor supervision on core 1 (serial and remote comm stay on core 0)
+#define MOTORS_QUEUE_SIZE                 8 // number of slots in the core 0 <-> core 1 request/response queues
+#define MOTORS_QUEUE_TIMEOUT_MS           2000 // max time in ms core 0 waits for core 1 to answer a request
+#define MOTORS_REQUEST_MAX_POSITIONS      (SERIAL_MAX_ARGS - 1) // max number of positions of one SMC_SQAD request to core 1
 #define MOTORS_DEFAULT_DEV_TYPE           {MOTOR_SIM, MOTOR_SIM, MOTOR_NONE, MOTOR_NONE} // default device types for the motors
 #define MOTORS_DEFAULT_AX_TYPE            {AXIS_X, AXIS_Y, AXIS_Z, AXIS_AUX} // default axis types for the motors
 #define MOTORS_DEFAULT_DRIVER_CS          {22, 21, 20, 17} // default CS pins for the motors, -1 means no driver
+#define MOTORS_DEFAULT_DIAG0_PIN          {-1, -1, -1, -1} // GPIOs wired to DIAG0 (INT) of the drivers, -1 means not connected (polling only)
+#define MOTORS_DEFAULT_DIAG1_PIN          {-1, -1, -1, -1} // GPIOs wired to DIAG1 (PP, position compare) of the drivers, -1 means not connected
+#define MOTORS_SEQ_MAX_LENGTH             256 // max number of positions per board in the triggered position sequence
+#define MOTORS_SEQ_TRIGGER_PIN            -1 // GPIO for the sequence trigger input (e.g. camera exposure out), -1 means not connected
+#define MOTORS_SEQ_TRIGGER_EDGE           RISING // edge of the trigger input that advances the sequence
+#define MOTORS_TRAJ_MAX_SEGMENTS          64 // max number of queued segments per board in the trajectory queue
+#define MOTORS_SETTLED_PIN                -1 // GPIO output that signals when all axes of the settled group reached their target, -1 means not connected
+#define MOTORS_SETTLED_PULSE_US           100 // min. width of the settled pulse in us (pulse mode of SPC_STLD), it ends on the next pass of the supervision loop after this time
+#define MOTORS_SETTLED_MAX_TIME_MS        10000 // max settle time in ms
+#define MOTORS_CAPTURE_BUFFER_SIZE        16384 // number of 32-bit values in the capture ring buffer (time stamp + signals of each board per sample)
+#define MOTORS_CAPTURE_NUM_SIGNALS        5 // number of signals the capture can record (see TMC::ReadCapture)
+#define MOTORS_CAPTURE_MAX_RATE_HZ        5000 // max sample rate of the capture
+
+#define PERF_ENABLED                      1 // set to 0 to compile out the performance counters (GPC_PERF, SPC_PERF)
+#define PERF_LOOP_HIST_BINS               16 // number of power-of-two bins of the loop period histogram (last bin: >=16 ms)
 
 #endif // COMMON_H
\ No newline at end of file
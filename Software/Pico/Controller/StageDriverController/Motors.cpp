@@ -4,6 +4,7 @@
 #include "SPI.h"
 #include "Motors.h"
 #include "TMC.h"
+#include "Perf.h"
 
 #define SERIAL_DEBUG  0
 #include "Serial_Debug.h"
@@ -42,7 +43,7 @@ int8_t Motors::Init(Parameters *paramPtr)
   D_println("Motors::Init");
   params = paramPtr;
   SPI.begin();
-  SPI.beginTransaction(SPISettings(115200, MSBFIRST, SPI_MODE3));
+  SPI.beginTransaction(SPISettings(TMC_SPI_CLOCK_HZ, MSBFIRST, SPI_MODE3));
   delay(10);
 
   // disable CS pins by default
@@ -56,6 +57,13 @@ int8_t Motors::Init(Parameters *paramPtr)
   for (int8_t z=0; z<MAXNUMMOTORS; z++) {
     tmcArr[z].Init(z, this, params->GetMotorParamPtr(z), params->GetHWParamPtr());
   }
+  if (MOTORS_SETTLED_PIN>=0) {
+    pinMode(MOTORS_SETTLED_PIN, OUTPUT);
+    digitalWrite(MOTORS_SETTLED_PIN, LOW);
+  }
+#if !MOTORS_DUAL_CORE
+  AttachPinInterrupts(); // otherwise done by core 1 when the supervision starts
+#endif // !MOTORS_DUAL_CORE
   return ERR_None;
 }
 
@@ -82,15 +90,18 @@ int8_t Motors::Init(Parameters *paramPtr)
 // Configure -> do the entire config sequence
 // ----------------------------
 
-int8_t Motors::ConfigBoard(int8_t board)
+int8_t Motors::ConfigBoard(int8_t board, int8_t full)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_CONFIG, board, full, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
   int32_t index;
 //  int32_t eMaxValue, encConstValue, toleranceValue, resetXafterCLValue;
 
   if (board == -1) { // all motors
     for (int8_t z=0; z<MAXNUMMOTORS; z++) {
       if (!params->IsActiveMotor(z)) continue; // silently skip if not defined
-      if (tmcArr[z].Config() != ERR_None) {
+      if (ConfigChangedGroups(z, full) != ERR_None) {
         SetErrorMsg("Board", z, "Could not configure board");
         return ERR_Motor;
       } 
@@ -106,7 +117,7 @@ int8_t Motors::ConfigBoard(int8_t board)
     // tolerance[board] = toleranceValue;
     // resetXafterCL[board] = resetXafterCLValue;
 
-    if (tmcArr[board].Config() != ERR_None) {
+    if (ConfigChangedGroups(board, full) != ERR_None) {
       SetErrorMsg("Board", board, "Could not configure board");
       return ERR_Motor;
     }
@@ -118,18 +129,54 @@ int8_t Motors::ConfigBoard(int8_t board)
 }
 
 
+// ----------------------------
+// Apply the parameter groups changed since the last config
+// ----------------------------
+
+int8_t Motors::ConfigChangedGroups(int8_t board, int8_t full)
+{
+  uint8_t groups = full ? PARAMS_GROUP_ALL : params->GetDirtyGroups(board);
+
+  if (int8_t err=tmcArr[board].Config(groups)) return err;
+  if (groups & PARAMS_GROUP_ENCODER) ResetClosedLoopModel(board, 1); // the encoder setup may have changed
+  params->SetDirtyGroups(board, groups, 0);
+  return ERR_None;
+}
+
+
 // ----------------------------
 // Function to periodically check the motors and process changes. Called from the loop control in the main controller
 // ----------------------------
 
 void Motors::ProcessUpdateChanges(void)
 {
-  int8_t err;
-  int32_t isMotionDone;
   unsigned long currentTime = millis();
   static unsigned long lastErrorCheckTime = 0; // only one instance of the class, so it is static
   static unsigned long lastStatusCheckTime = 0; // only one instance of the class, so it is static
-  int32_t currPos, deviation;
+  static unsigned long lastTelemetryTime = 0; // only one instance of the class, so it is static
+  static unsigned long lastClosedLoopCheckTime = 0; // only one instance of the class, so it is static
+
+  // handle DIAG pin events right away, the periodic checks below remain as the fallback
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (!diagEvent[z]) continue;
+    diagEvent[z] = 0;
+    if (!params->IsActiveMotor(z)) continue;
+    tmcArr[z].CheckError();
+    CheckBoardStatus(z);
+  }
+
+  // advance the position sequences on trigger edges (only this loop writes seqTriggerHandled)
+  uint32_t triggerCount = seqTriggerCount;
+  if (triggerCount != seqTriggerHandled) {
+    StepSequence(triggerCount - seqTriggerHandled);
+    seqTriggerHandled = triggerCount;
+  }
+
+  // load the next trajectory segments right away, the host doesn't have to be involved
+  AdvanceTrajectories();
+
+  // sample the capture on every pass, it paces itself with micros()
+  UpdateCapture();
 
   // check for errors occasionally
   if (currentTime - lastErrorCheckTime > MOTORS_CHECK_ERROR_INTERVAL_MS) {
@@ -141,66 +188,1017 @@ void Motors::ProcessUpdateChanges(void)
     lastErrorCheckTime = currentTime;
   } // if (currentTime - lastErrorCheckTime > MOTORS_CHECK_ERROR_INTERVAL_MS)
 
+  // check the closed loop moves more often, so each correction starts right after the previous ramp
+  if (currentTime - lastClosedLoopCheckTime >= MOTORS_CL_CHECK_INTERVAL_MS) {
+    for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+      if (isMotorSearching[z] && isMotorMoving[z] && params->IsActiveMotor(z)) CheckBoardStatus(z);
+    }
+    lastClosedLoopCheckTime = currentTime;
+  }
+
   // check for status updates that occur during motion
   if (currentTime - lastStatusCheckTime > MOTORS_CHECK_STATUS_INTERVAL_MS) {
-    // check all drivers that are currently moving
+    // check all drivers that are currently moving, refresh the register snapshot of the others
     for (int8_t z=0; z<MAXNUMMOTORS; z++) {
-      if (!params->IsActiveMotor(z) || !isMotorEnabled[z]) continue; // skip if not enabled
-      
-      if ( isMotorHoming[z] ) { // homing in progress
-
-        err = tmcArr[z].CheckStatus(isMotionDone);
-        if (isMotionDone || err) isMotorMoving[z]=0;
-
-      } else if (isMotorSearching[z] ) { // closed loop search in progress
-
-        err = tmcArr[z].CheckStatus(isMotionDone);
-        if (err) {
-          isMotorMoving[z]=0;
-          isMotorSearching[z]=0;
-          SetErrorMsg("Board", z, "Error during closed loop mode");
-        } else if (isMotionDone) { 
-          isMotorMoving[z]=0;
-          // get the encoder position
-          err = tmcArr[z].GetEnc(currPos);
-          deviation = currPos - targetPosition[z];
-          if (abs(deviation)>tmcArr[z].tolerance) { // still not at the right spot
-            if (iterationsLeft[z]==-1 || iterationsLeft[z]>0) { // keep adjusting
-              if (tmcArr[z].maxIterations>1) iterationsLeft[z]--;
-              isMotorMoving[z]=1;
-              setPosition[z] -= deviation; 
-              err = tmcArr[z].MoveToPos(setPosition[z], 0);
-            } else { // iterationsLeft==0, i.e. not there but no more tries left
-              SetErrorMsg("Board", z, "Closed loop motion did not converge");
-              isMotorMoving[z]=0;
-              isMotorSearching[z]=0;
-            }
-          } else { // reached the target
-            isMotorMoving[z]=0;
-            if (iterationsLeft[z]!=-1) isMotorSearching[z]=0;
-            if (tmcArr[z].resetXafterCL) tmcArr[z].SetXPos(currPos); // set X positions to encoder
-          }
-        }
-
-      } else if (isMotorMoving[z]) { // open loop motion in progress
-
-        err = tmcArr[z].CheckStatus(isMotionDone);
-        if (isMotionDone || err) isMotorMoving[z]=0;
-
-      }
+      if (!params->IsActiveMotor(z)) continue; // silently skip if not defined
+      CheckBoardStatus(z);
     }
     lastStatusCheckTime = currentTime;
   } // if (currentTime - lastStatusCheckTime > MOTORS_CHECK_STATUS_INTERVAL_MS)
+
+  // every pass, so the settle time is measured with the resolution of the loop
+  UpdateSettledOutput();
+
+  // take a telemetry snapshot for the host stream
+  if (telemetryInterval_ms && currentTime - lastTelemetryTime >= telemetryInterval_ms) {
+    UpdateTelemetry();
+    lastTelemetryTime = currentTime;
+  }
+}
+
+
+// ----------------------------
+// DIAG pin interrupts (one per board, they only flag the board)
+// ----------------------------
+
+volatile uint8_t Motors::diagEvent[MAXNUMMOTORS] = {0};
+
+void Motors::DiagISR0() { diagEvent[0] = 1; }
+void Motors::DiagISR1() { diagEvent[1] = 1; }
+void Motors::DiagISR2() { diagEvent[2] = 1; }
+void Motors::DiagISR3() { diagEvent[3] = 1; }
+
+
+// ----------------------------
+// Sequence trigger interrupt (only counts the edges)
+// ----------------------------
+
+volatile uint32_t Motors::seqTriggerCount = 0;
+
+void Motors::SeqTriggerISR() { seqTriggerCount++; }
+
+
+// ----------------------------
+// Attach the DIAG and trigger pin interrupts (called on the core that runs the supervision)
+// ----------------------------
+
+void Motors::AttachPinInterrupts(void)
+{
+  static void (*const isr[MAXNUMMOTORS])(void) = {DiagISR0, DiagISR1, DiagISR2, DiagISR3};
+
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    // DIAG0 (INT) signals the ramp events, DIAG1 (PP) the position compare; both are push-pull, active high
+    if (tmcArr[z].diag0Pin>=0) {
+      pinMode(tmcArr[z].diag0Pin, INPUT_PULLDOWN);
+      attachInterrupt(digitalPinToInterrupt(tmcArr[z].diag0Pin), isr[z], RISING);
+    }
+    if (tmcArr[z].diag1Pin>=0) {
+      pinMode(tmcArr[z].diag1Pin, INPUT_PULLDOWN);
+      attachInterrupt(digitalPinToInterrupt(tmcArr[z].diag1Pin), isr[z], RISING);
+    }
+  }
+  if (MOTORS_SEQ_TRIGGER_PIN>=0) {
+    pinMode(MOTORS_SEQ_TRIGGER_PIN, INPUT_PULLDOWN);
+    attachInterrupt(digitalPinToInterrupt(MOTORS_SEQ_TRIGGER_PIN), SeqTriggerISR, MOTORS_SEQ_TRIGGER_EDGE);
+  }
+}
+
+
+// ----------------------------
+// Check the status of one board and advance homing and closed loop moves
+// ----------------------------
+
+void Motors::CheckBoardStatus(int8_t board)
+{
+  int8_t err;
+  int32_t isMotionDone;
+
+  if (!isMotorEnabled[board]) {
+    tmcArr[board].RefreshSnapshot();
+    return;
+  }
+
+  if ( isMotorHoming[board] ) { // homing in progress
+
+    err = tmcArr[board].CheckStatus(isMotionDone);
+    if (isMotionDone || err) isMotorMoving[board]=0;
+
+  } else if (isMotorSearching[board] ) { // closed loop search in progress
+
+    err = tmcArr[board].CheckStatus(isMotionDone);
+    if (err) {
+      isMotorMoving[board]=0;
+      isMotorSearching[board]=0;
+      SetErrorMsg("Board", board, "Error during closed loop mode");
+    } else if (isMotionDone) { 
+      ContinueClosedLoop(board);
+    }
+
+  } else if (isMotorMoving[board]) { // open loop motion in progress
+
+    err = tmcArr[board].CheckStatus(isMotionDone);
+    if (isMotionDone || err) isMotorMoving[board]=0;
+    if (!isMotorMoving[board]) UpdateSettledOutput();
+
+  } else { // idle
+    tmcArr[board].RefreshSnapshot();
+  }
+}
+
+
+// ----------------------------
+// Next step of a closed loop move (the ramp is done)
+// ----------------------------
+
+void Motors::ContinueClosedLoop(int8_t board)
+{
+  int32_t currPos, xact, deviation, step;
+  float gain;
+
+  isMotorMoving[board]=0;
+  if (tmcArr[board].GetEnc(currPos)!=ERR_None) {
+    isMotorSearching[board]=0;
+    SetErrorMsg("Board", board, "Error during closed loop mode");
+    return;
+  }
+
+  // learn the encoder/command ratio from the last correction (short ones are too noisy)
+  if (abs(clStep[board]) > 2*tmcArr[board].tolerance && clStep[board] != 0) {
+    gain = (float)(currPos - clStartEnc[board]) / (float)clStep[board];
+    if (gain >= MOTORS_CL_GAIN_MIN && gain <= MOTORS_CL_GAIN_MAX) clGain[board] = 0.75f*clGain[board] + 0.25f*gain;
+  }
+
+  deviation = currPos - targetPosition[board];
+  if (abs(deviation)>tmcArr[board].tolerance) { // still not at the right spot
+    if (iterationsLeft[board]==-1 || iterationsLeft[board]>0) { // keep adjusting
+      if (tmcArr[board].maxIterations>1) iterationsLeft[board]--;
+      step = (int32_t)lroundf(-deviation / clGain[board]);
+      if (step == 0) step = (deviation > 0 ? -1 : 1);
+      clStep[board] = step;
+      clStartEnc[board] = currPos;
+      clDir[board] = (step > 0 ? 1 : 0);
+      setPosition[board] += step;
+      isMotorMoving[board]=1;
+      if (tmcArr[board].MoveToPos(setPosition[board], 1, MOTORS_CL_APPROACH_SCALE)!=ERR_None) {
+        isMotorMoving[board]=0;
+        isMotorSearching[board]=0;
+        SetErrorMsg("Board", board, "Error during closed loop mode");
+      }
+    } else { // iterationsLeft==0, i.e. not there but no more tries left
+      SetErrorMsg("Board", board, "Closed loop motion did not converge");
+      isMotorSearching[board]=0;
+    }
+    return;
+  }
+
+  // reached the target, remember where the motor had to go for the next move in this direction
+  if (iterationsLeft[board]!=-1) isMotorSearching[board]=0;
+  if (tmcArr[board].GetPos(xact)==ERR_None) {
+    clOffset[board][clDir[board]] = xact - currPos;
+    if (tmcArr[board].resetXafterCL) { // XACT jumps to XENC, so the offsets move along
+      clOffset[board][0] -= xact - currPos;
+      clOffset[board][1] -= xact - currPos;
+    }
+  }
+  clStep[board] = 0;
+  if (tmcArr[board].resetXafterCL) tmcArr[board].SetXPos(currPos); // set X positions to encoder
+  UpdateSettledOutput(); // converged, don't wait for the next pass
+}
+
+
+// ----------------------------
+// Forget the learned closed loop corrections
+// ----------------------------
+
+void Motors::ResetClosedLoopModel(int8_t board, int8_t resetGain)
+{
+  clOffset[board][0] = clOffset[board][1] = 0;
+  clStep[board] = 0;
+  if (resetGain) clGain[board] = 1.0f;
+}
+
+
+// ----------------------------
+// Configure the settled output
+// ----------------------------
+
+int8_t Motors::SetSettledOutput(uint8_t mask, uint16_t settleTime_ms, int8_t pulse)
+{
+#if MOTORS_DUAL_CORE
+  // the pulse flag goes into bit 8 of the argument
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SET_SETTLED, -1, mask | (pulse ? 0x100 : 0), settleTime_ms, nullptr);
+#endif // MOTORS_DUAL_CORE
+  if (MOTORS_SETTLED_PIN<0 && mask) {
+    SetErrorMsg("Board", -1, "No settled output pin defined");
+    return ERR_Motor;
+  }
+  if (mask >= (1 << MAXNUMMOTORS)) {
+    SetErrorMsg("Board", -1, "Invalid board mask for the settled output");
+    return ERR_Motor;
+  }
+  settledMask = mask;
+  settledTime_ms = settleTime_ms;
+  settledPulse = pulse;
+  settledPending = (pulse ? 0 : 1); // a level is set right away if the boards are settled, a pulse waits for a move
+  settledStart = millis();
+  settledPulseActive = 0;
+  if (MOTORS_SETTLED_PIN>=0) digitalWrite(MOTORS_SETTLED_PIN, LOW);
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Set or clear the settled output
+// ----------------------------
+
+void Motors::UpdateSettledOutput(void)
+{
+  unsigned long currentTime = millis();
+
+  if (MOTORS_SETTLED_PIN<0) return;
+  if (settledPulseActive && (long)(micros() - settledPulseEnd) >= 0) { // end the pulse on a later pass
+    settledPulseActive = 0;
+    digitalWrite(MOTORS_SETTLED_PIN, LOW);
+  }
+  if (!settledMask) return;
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (!(settledMask & (1 << z)) || !params->IsActiveMotor(z)) continue;
+    if (isMotorMoving[z] || isMotorSearching[z]) { // not settled (yet)
+      if (!settledPulse && !settledPending) digitalWrite(MOTORS_SETTLED_PIN, LOW);
+      settledPending = 1;
+      settledStart = currentTime;
+      return;
+    }
+  }
+  if (!settledPending || currentTime - settledStart < settledTime_ms) return;
+  settledPending = 0;
+  digitalWrite(MOTORS_SETTLED_PIN, HIGH);
+  if (settledPulse) {
+    settledPulseActive = 1;
+    settledPulseEnd = micros() + MOTORS_SETTLED_PULSE_US;
+  }
+}
+
+
+// ----------------------------
+// Configure the capture
+// ----------------------------
+
+int8_t Motors::ConfigCapture(uint8_t boardMask, uint8_t signalMask, uint16_t rate)
+{
+#if MOTORS_DUAL_CORE
+  // the signal mask goes into bits 8 to 15 of the argument
+  if (IsForwardRequired()) return ForwardRequest(MREQ_CAPTURE_CONFIG, -1, boardMask | (signalMask << 8), rate, nullptr);
+#endif // MOTORS_DUAL_CORE
+  if (captureState != CAPTURE_OFF) {
+    SetErrorMsg("Board", -1, "Capture is running");
+    return ERR_Motor;
+  }
+  if (!boardMask || boardMask >= (1 << MAXNUMMOTORS)) {
+    SetErrorMsg("Board", -1, "Invalid board mask for the capture");
+    return ERR_Motor;
+  }
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if ((boardMask & (1 << z)) && !params->IsActiveMotor(z)) {
+      SetErrorMsg("Board", z, "Motor not active");
+      return ERR_Motor;
+    }
+  }
+  if (!signalMask || signalMask >= (1 << MOTORS_CAPTURE_NUM_SIGNALS)) {
+    SetErrorMsg("Board", -1, "Invalid signal mask for the capture");
+    return ERR_Motor;
+  }
+  if (rate < 1 || rate > MOTORS_CAPTURE_MAX_RATE_HZ) {
+    SetErrorMsg("Board", -1, "Invalid capture rate");
+    return ERR_Motor;
+  }
+  captureBoards = boardMask;
+  captureSignals = signalMask;
+  captureInterval_us = 1000000UL / rate;
+  captureSampleSize = 1 + __builtin_popcount(boardMask) * __builtin_popcount(signalMask);
+  captureMaxSamples = MOTORS_CAPTURE_BUFFER_SIZE / captureSampleSize;
+  captureCount = 0;
+  return ERR_None;
 }
 
+
+// ----------------------------
+// Start, arm or stop the capture
+// ----------------------------
+
+int8_t Motors::StartCapture(int8_t mode)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_CAPTURE_START, -1, mode, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
+  if (mode < 0 || mode > 2) {
+    SetErrorMsg("Board", -1, "Invalid capture mode");
+    return ERR_Motor;
+  }
+  if (mode == 0) {
+    captureState = CAPTURE_OFF;
+    return ERR_None;
+  }
+  if (!captureSampleSize) {
+    SetErrorMsg("Board", -1, "Capture is not configured");
+    return ERR_Motor;
+  }
+  captureCount = 0;
+  captureUntilRest = (mode == 2) ? 1 : 0;
+  captureLast_us = micros() - captureInterval_us; // first sample right away
+  captureState = (mode == 2) ? CAPTURE_ARMED : CAPTURE_RUNNING;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Take a capture sample (called from the supervision loop)
+// ----------------------------
+
+void Motors::UpdateCapture(void)
+{
+  unsigned long currentTime_us;
+  int8_t isMoving = 0;
+  int32_t *sample;
+  uint16_t len = 1;
+
+  if (captureState == CAPTURE_OFF) return;
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if ((captureBoards & (1 << z)) && (isMotorMoving[z] || isMotorSearching[z])) isMoving = 1;
+  }
+  if (captureState == CAPTURE_ARMED) {
+    if (!isMoving) return; // wait for the move
+    captureState = CAPTURE_RUNNING;
+    captureLast_us = micros() - captureInterval_us; // first sample right at the start of the move
+  } else if (captureUntilRest && !isMoving) {
+    captureState = CAPTURE_OFF;
+    return;
+  }
+
+  currentTime_us = micros();
+  if (currentTime_us - captureLast_us < captureInterval_us) return;
+  // keep the pace, but skip the samples a slow pass missed instead of taking them in a burst
+  captureLast_us = (currentTime_us - captureLast_us < 2*captureInterval_us) ? captureLast_us + captureInterval_us : currentTime_us;
+
+  sample = captureBuffer + (captureCount % captureMaxSamples) * captureSampleSize;
+  sample[0] = (int32_t)currentTime_us;
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (captureBoards & (1 << z)) len += tmcArr[z].ReadCapture(captureSignals, sample+len);
+  }
+  captureCount++;
+  if (captureUntilRest && captureCount >= captureMaxSamples) { // armed captures keep the start of the move
+    __sync_synchronize(); // the samples are complete before core 0 can read them
+    captureState = CAPTURE_OFF;
+  }
+}
+
+
+// ----------------------------
+// Get the number of captured samples
+// ----------------------------
+
+uint32_t Motors::GetCaptureLength(void)
+{
+  uint32_t count = captureCount;
+
+  return (count < captureMaxSamples) ? count : captureMaxSamples;
+}
+
+
+// ----------------------------
+// Get a sample of the capture buffer (oldest first)
+// ----------------------------
+
+const int32_t* Motors::GetCaptureSample(uint32_t index)
+{
+  uint32_t first;
+
+  if (captureState != CAPTURE_OFF || index >= GetCaptureLength()) return nullptr;
+  __sync_synchronize();
+  first = (captureCount > captureMaxSamples) ? captureCount % captureMaxSamples : 0; // the ring buffer wrapped
+  return captureBuffer + ((first + index) % captureMaxSamples) * captureSampleSize;
+}
+
+
+// ----------------------------
+// Set the telemetry interval
+// ----------------------------
+
+void Motors::SetTelemetryInterval(uint16_t interval_ms)
+{
+  telemetryInterval_ms = interval_ms;
+}
+
+
+// ----------------------------
+// Take a telemetry snapshot (called from the supervision loop)
+// ----------------------------
+
+void Motors::UpdateTelemetry(void)
+{
+  int32_t xact, xenc, status;
+  int8_t fresh = (telemetryInterval_ms < MOTORS_CHECK_STATUS_INTERVAL_MS); // faster than the snapshot refresh
+  int8_t num = 0;
+
+  telemetrySeq++; // odd -> snapshot is being written
+  __sync_synchronize();
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (!params->IsActiveMotor(z)) continue; // silently skip if not defined
+    telemetry.board[num] = z;
+    if (tmcArr[z].ReadSnapshot(xact, xenc, status, fresh)!=ERR_None) xact = xenc = status = 0;
+    if (isMotorMoving[z] || isMotorSearching[z]) status |= SERIAL_TELE_MOVING_FLAG; // MC_POSR would be 0
+    telemetry.xact[num] = xact;
+    telemetry.xenc[num] = xenc;
+    telemetry.status[num] = status;
+    num++;
+  }
+  telemetry.num = num;
+  telemetry.time = millis();
+  __sync_synchronize();
+  telemetrySeq++; // even -> snapshot is complete
+}
+
+
+// ----------------------------
+// Copy the latest telemetry snapshot (from either core)
+// ----------------------------
+
+int8_t Motors::GetTelemetry(MotorTelemetry &tele, uint32_t &seq)
+{
+  for (int8_t tries=0; tries<10; tries++) {
+    uint32_t start = telemetrySeq;
+    if (start & 1) continue; // the supervision loop is writing right now
+    __sync_synchronize();
+    tele = telemetry;
+    __sync_synchronize();
+    if (telemetrySeq == start) {
+      seq = start;
+      return ERR_None;
+    }
+  }
+  return ERR_Motor;
+}
+
+uint32_t Motors::GetTelemetrySeq(void)
+{
+  return telemetrySeq;
+}
+
+// ----------------------------
+// Hand the supervision over to core 1 (called from core 0)
+// ----------------------------
+
+void Motors::StartSupervisor(void)
+{
+#if MOTORS_DUAL_CORE
+  D_println("Motors::StartSupervisor");
+  supervisorRequested = 1;
+  while (!supervisorActive) delayMicroseconds(10); // wait for core 1 to take over
+#endif // MOTORS_DUAL_CORE
+}
+
+
+// ----------------------------
+// One pass of the supervision loop (called from core 1)
+// ----------------------------
+
+void Motors::RunSupervisor(void)
+{
+#if MOTORS_DUAL_CORE
+  MotorRequest req;
+
+  if (!supervisorRequested) return; // core 0 is still setting up
+  if (!supervisorActive) AttachPinInterrupts(); // the interrupts are handled on this core
+  supervisorActive = 1;
+  while (requestQueue.Pop(req)) ExecuteRequest(req);
+  PERF_START(perfStart);
+  ProcessUpdateChanges();
+  PERF_STOP(PERF_UPDATE_COUNT, perfStart);
+#endif // MOTORS_DUAL_CORE
+}
+
+
+#if MOTORS_DUAL_CORE
+// ----------------------------
+// Check whether the call needs to go through the queue
+// ----------------------------
+
+int8_t Motors::IsForwardRequired(void)
+{
+  return (supervisorActive && rp2040.cpuid()==0) ? 1 : 0;
+}
+
+
+// ----------------------------
+// Send a request to core 1 and wait for the response (called from core 0)
+// ----------------------------
+
+int8_t Motors::ForwardRequest(uint8_t type, int8_t board, int32_t arg, int32_t value, int32_t *result,
+                              const void *data, size_t dataSize, MotorMultiStatus *multi)
+{
+  MotorRequest req;
+  MotorResponse resp;
+  unsigned long startTime = millis();
+
+  req.seq = ++requestSeq;
+  if (req.seq == 0) req.seq = ++requestSeq; // 0 marks "no pending request"
+  req.type = type;
+  req.board = board;
+  req.arg = arg;
+  req.value = value;
+  if (dataSize > sizeof(req.data)) {
+    errorMsgQueue = "Supervisor request too large"; // core 1 owns the other error messages
+    return ERR_Motor;
+  }
+  if (data) memcpy(&req.data, data, dataSize); // the request may outlive the caller after a timeout
+
+  pendingSeq = req.seq;
+  while (!requestQueue.Push(req)) {
+    if (millis() - startTime > MOTORS_QUEUE_TIMEOUT_MS) {
+      pendingSeq = 0;
+      errorMsgQueue = "Supervisor request queue full";
+      return ERR_Motor;
+    }
+  }
+  int8_t isClaimed = 0;
+  while (1) {
+    if (responseQueue.Pop(resp)) {
+      if (resp.seq != req.seq) continue; // response of an earlier request (can't happen, cancelled ones don't answer)
+      if (result) *result = resp.value;
+      if (multi) *multi = resp.multi;
+      return resp.err;
+    }
+    if (!isClaimed && millis() - startTime > MOTORS_QUEUE_TIMEOUT_MS) {
+      // cancel unless core 1 claimed it already, then it runs and answers shortly
+      if (__sync_bool_compare_and_swap(&pendingSeq, req.seq, 0)) {
+        errorMsgQueue = "Supervisor did not respond";
+        return ERR_Motor;
+      }
+      isClaimed = 1;
+    }
+  }
+}
+
+
+// ----------------------------
+// Execute a request from core 0 (called from core 1)
+// ----------------------------
+
+void Motors::ExecuteRequest(const MotorRequest &req)
+{
+  MotorResponse resp;
+
+  // claim the request, unless core 0 cancelled it after a timeout (then nobody waits for it)
+  if (!__sync_bool_compare_and_swap(&pendingSeq, req.seq, 0)) return;
+
+  resp.seq = req.seq;
+  resp.value = 0;
+  resp.multi.num = 0;
+  switch (req.type) {
+    case MREQ_CONFIG:           resp.err = ConfigBoard(req.board, (int8_t)req.arg); break;
+    case MREQ_CLEAR_STATUS:     resp.err = ClearStatusRegs(req.board); break;
+    case MREQ_MOVE_AT_VEL:      resp.err = MoveAtVel(req.board, req.value); break;
+    case MREQ_MOVE_TO_POS:      resp.err = MoveToPos(req.board, req.value, req.arg); break;
+    case MREQ_GET_POS:          resp.err = GetPos(req.board, resp.value); break;
+    case MREQ_START_HOMING:     resp.err = StartHoming(req.board); break;
+    case MREQ_SET_STATUS:       resp.err = SetStatusValue(req.board, req.arg, req.value); break;
+    case MREQ_GET_STATUS:       resp.err = GetStatusValue(req.board, req.arg, resp.value, (int8_t)req.value); break;
+    case MREQ_SET_REGISTER:     resp.err = SetRegisterValue(req.board, (uint8_t)req.arg, req.value); break;
+    case MREQ_GET_REGISTER:     resp.err = GetRegisterValue(req.board, (uint8_t)req.arg, resp.value, (int8_t)req.value); break;
+    case MREQ_GET_STATUS_FLAGS: resp.err = GetStatusFlags(req.board, resp.value, (int8_t)req.arg); break;
+    case MREQ_MOVE_TO_POS_MULTI:
+      resp.err = MoveToPosMulti(req.data.moves, (int8_t)req.arg);
+      break;
+    case MREQ_SEQ_CLEAR:        resp.err = ClearSequence(req.board); break;
+    case MREQ_SEQ_ADD:
+      resp.err = AddToSequence(req.board, req.data.pos, (int16_t)req.arg);
+      break;
+    case MREQ_SEQ_START:
+      resp.err = StartSequence(req.data.moves);
+      break;
+    case MREQ_SEQ_TRIGGER:      resp.err = TriggerSequence(); break;
+    case MREQ_SEQ_LENGTH:       resp.err = GetSequenceLength(req.board, resp.value); break;
+    case MREQ_SET_SETTLED:
+      resp.err = SetSettledOutput((uint8_t)(req.arg & 0xFF), (uint16_t)req.value, (req.arg & 0x100) ? 1 : 0);
+      break;
+    case MREQ_TRAJ_CLEAR:       resp.err = ClearTrajectory(req.board); break;
+    case MREQ_TRAJ_ADD:
+      resp.err = AddToTrajectory(req.board, req.data.seg);
+      break;
+    case MREQ_TRAJ_START:       resp.err = StartTrajectory(req.board, (int8_t)req.arg); break;
+    case MREQ_TRAJ_LENGTH:      resp.err = GetTrajectoryLength(req.board, resp.value); break;
+    case MREQ_SET_ORIGIN:
+      resp.err = SetOrigin(req.data.moves);
+      break;
+    case MREQ_GET_STATUS_MULTI: // the result goes back in the response
+      resp.err = GetStatusMulti(req.arg, resp.multi, (int8_t)req.value);
+      break;
+    case MREQ_CAPTURE_CONFIG:
+      resp.err = ConfigCapture((uint8_t)(req.arg & 0xFF), (uint8_t)((req.arg >> 8) & 0xFF), (uint16_t)req.value);
+      break;
+    case MREQ_CAPTURE_START:    resp.err = StartCapture((int8_t)req.arg); break;
+    default:
+      SetErrorMsg("Board", -1, "Unknown supervisor request");
+      resp.err = ERR_Motor;
+      break;
+  }
+  // core 0 waits for the response, so the queue cannot stay full for long
+  while (!responseQueue.Push(resp)) delayMicroseconds(1);
+}
+#endif // MOTORS_DUAL_CORE
+
+
 // ----------------------------
 // Move to position
 // ----------------------------
 
 int8_t Motors::MoveToPos(int8_t board, int32_t pos, int setVel)
 {
-  int8_t err;
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_MOVE_TO_POS, board, setVel, pos, nullptr);
+#endif // MOTORS_DUAL_CORE
+  if (int8_t err=CheckMoveAllowed(board)) return err;
+  return StartMoveToPos(board, pos, setVel, 1.0f);
+}
+
+
+// ----------------------------
+// Move several motors to their positions at once
+// ----------------------------
 
+int8_t Motors::MoveToPosMulti(const MotorMoveList &moves, int8_t sync)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_MOVE_TO_POS_MULTI, -1, sync, 0, nullptr, &moves, sizeof(moves));
+#endif // MOTORS_DUAL_CORE
+  float scale[MAXNUMMOTORS];
+  float moveTime[MAXNUMMOTORS];
+  float maxTime = 0.0f;
+  int32_t currPos;
+
+  if (moves.num<1 || moves.num>MAXNUMMOTORS) {
+    SetErrorMsg("Board", -1, "Invalid number of motors for a batched move");
+    return ERR_Motor;
+  }
+  // check all boards first, so either all motors move or none
+  for (int8_t z=0; z<moves.num; z++) {
+    if (int8_t err=CheckMoveAllowed(moves.board[z])) return err;
+    for (int8_t y=0; y<z; y++) {
+      if (moves.board[y] == moves.board[z]) {
+        SetErrorMsg("Board", moves.board[z], "Motor is listed twice in a batched move");
+        return ERR_Motor;
+      }
+    }
+  }
+
+  // for a synchronized arrival, slow down the ramps of the shorter moves to match the longest one
+  for (int8_t z=0; z<moves.num; z++) {
+    scale[z] = 1.0f;
+    moveTime[z] = 0.0f;
+    if (sync && tmcArr[moves.board[z]].GetPos(currPos)==ERR_None) {
+      moveTime[z] = tmcArr[moves.board[z]].EstimateMoveTime(moves.pos[z] - currPos);
+    }
+    if (moveTime[z] > maxTime) maxTime = moveTime[z];
+  }
+  if (maxTime > 0.0f) {
+    for (int8_t z=0; z<moves.num; z++) scale[z] = moveTime[z]/maxTime;
+  }
+
+  for (int8_t z=0; z<moves.num; z++) {
+    if (int8_t err=StartMoveToPos(moves.board[z], moves.pos[z], 1, scale[z])) return err;
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Clear the position sequence
+// ----------------------------
+
+int8_t Motors::ClearSequence(int8_t board)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SEQ_CLEAR, board, 0, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
+  if (board == -1) { // all motors
+    for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+      isSequenceArmed[z] = 0;
+      seqLength[z] = 0;
+      seqIndex[z] = 0;
+    }
+    return ERR_None;
+  }
+  if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+  isSequenceArmed[board] = 0;
+  seqLength[board] = 0;
+  seqIndex[board] = 0;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Append positions to the sequence
+// ----------------------------
+
+int8_t Motors::AddToSequence(int8_t board, const int32_t *pos, int16_t num)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) {
+    if (num<0 || num > MOTORS_REQUEST_MAX_POSITIONS) {
+      errorMsgQueue = "Sequence too long for one request"; // core 1 owns the other error messages
+      return ERR_Motor;
+    }
+    return ForwardRequest(MREQ_SEQ_ADD, board, num, 0, nullptr, pos, num*sizeof(int32_t));
+  }
+#endif // MOTORS_DUAL_CORE
+  if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+  if (isSequenceArmed[board]) {
+    SetErrorMsg("Board", board, "Sequence is running");
+    return ERR_Motor;
+  }
+  if (num<0 || seqLength[board]+num > MOTORS_SEQ_MAX_LENGTH) {
+    SetErrorMsg("Board", board, "Sequence too long");
+    return ERR_Motor;
+  }
+  for (int16_t z=0; z<num; z++) seqPos[board][seqLength[board]++] = pos[z];
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Arm or stop the sequence
+// ----------------------------
+
+int8_t Motors::StartSequence(const MotorMoveList &states)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SEQ_START, -1, 0, 0, nullptr, &states, sizeof(states));
+#endif // MOTORS_DUAL_CORE
+  int8_t board;
+  int8_t isOtherArmed = 0;
+
+  if (states.num<1 || states.num>MAXNUMMOTORS) {
+    SetErrorMsg("Board", -1, "Invalid number of motors for a sequence start");
+    return ERR_Motor;
+  }
+  // check all boards first, so either all sequences start or none
+  for (int8_t z=0; z<states.num; z++) {
+    board = states.board[z];
+    if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+    for (int8_t y=0; y<z; y++) {
+      if (states.board[y] == board) {
+        SetErrorMsg("Board", board, "Motor is listed twice in a sequence start");
+        return ERR_Motor;
+      }
+    }
+    if (!states.pos[z]) continue;
+    if (seqLength[board]==0) {
+      SetErrorMsg("Board", board, "Sequence is empty");
+      return ERR_Motor;
+    }
+    if (int8_t err=CheckMoveAllowed(board)) return err;
+  }
+  for (int8_t z=0; z<states.num; z++) isSequenceArmed[states.board[z]] = 0;
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) isOtherArmed |= isSequenceArmed[z];
+  // ignore edges from before the start, unless they are still due for a running sequence
+  if (!isOtherArmed) seqTriggerHandled = seqTriggerCount;
+  for (int8_t z=0; z<states.num; z++) {
+    if (!states.pos[z]) continue;
+    board = states.board[z];
+    seqIndex[board] = 0;
+    if (int8_t err=StartMoveToPos(board, seqPos[board][0], 1, 1.0f)) return err;
+    isSequenceArmed[board] = 1;
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Advance the sequence by software
+// ----------------------------
+
+int8_t Motors::TriggerSequence(void)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SEQ_TRIGGER, -1, 0, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
+  return StepSequence(1);
+}
+
+
+// ----------------------------
+// Get the number of positions in the sequence
+// ----------------------------
+
+int8_t Motors::GetSequenceLength(int8_t board, int32_t &len)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SEQ_LENGTH, board, 0, 0, &len);
+#endif // MOTORS_DUAL_CORE
+  if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+  len = seqLength[board];
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Move all armed boards to their next sequence position
+// ----------------------------
+
+int8_t Motors::StepSequence(uint32_t steps)
+{
+  int8_t err = ERR_None;
+
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (!isSequenceArmed[z]) continue;
+    seqIndex[z] = (int16_t)((seqIndex[z] + steps) % seqLength[z]);
+    if (CheckMoveAllowed(z)!=ERR_None || StartMoveToPos(z, seqPos[z][seqIndex[z]], 1, 1.0f)!=ERR_None) {
+      SetErrorMsg("Board", z, "Sequence stopped, could not move to the next position");
+      isSequenceArmed[z] = 0;
+      err = ERR_Motor;
+    }
+  }
+  return err;
+}
+
+
+// ----------------------------
+// Clear the trajectory queue
+// ----------------------------
+
+int8_t Motors::ClearTrajectory(int8_t board)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_TRAJ_CLEAR, board, 0, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
+  if (board == -1) { // all motors
+    for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+      if (params->IsActiveMotor(z)) StartTrajectory(z, 0);
+      trajLength[z] = 0;
+      trajHead[z] = 0;
+    }
+    return ERR_None;
+  }
+  if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+  StartTrajectory(board, 0);
+  trajLength[board] = 0;
+  trajHead[board] = 0;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Append a segment to the trajectory queue
+// ----------------------------
+
+int8_t Motors::AddToTrajectory(int8_t board, const MotorSegment &seg)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_TRAJ_ADD, board, 0, 0, nullptr, &seg, sizeof(seg));
+#endif // MOTORS_DUAL_CORE
+  if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+  if (trajLength[board] >= MOTORS_TRAJ_MAX_SEGMENTS) {
+    SetErrorMsg("Board", board, "Trajectory queue is full");
+    return ERR_Motor;
+  }
+  if (seg.velMode && seg.vel == 0) {
+    SetErrorMsg("Board", board, "Velocity segment without velocity");
+    return ERR_Motor;
+  }
+  if (seg.acc < 0) {
+    SetErrorMsg("Board", board, "Invalid segment acceleration");
+    return ERR_Motor;
+  }
+  trajSeg[board][(trajHead[board] + trajLength[board]) % MOTORS_TRAJ_MAX_SEGMENTS] = seg;
+  trajLength[board]++;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Start or stop the trajectory
+// ----------------------------
+
+int8_t Motors::StartTrajectory(int8_t board, int8_t state)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_TRAJ_START, board, state, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
+  if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+  if (!state) {
+    if (isTrajRunning[board] && isTrajLoaded[board] && trajActive[board].velMode) {
+      tmcArr[board].MoveAtVel(0); // ramp down, a position segment just finishes
+    }
+    isTrajRunning[board] = 0;
+    isTrajLoaded[board] = 0;
+    return ERR_None;
+  }
+  if (isTrajRunning[board]) return ERR_None;
+  if (trajLength[board]==0) {
+    SetErrorMsg("Board", board, "Trajectory is empty");
+    return ERR_Motor;
+  }
+  if (int8_t err=CheckMoveAllowed(board)) return err;
+  isSequenceArmed[board] = 0; // only one of them can drive the motor
+  if (int8_t err=LoadTrajectorySegment(board)) return err;
+  isTrajRunning[board] = 1;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Get the number of queued segments
+// ----------------------------
+
+int8_t Motors::GetTrajectoryLength(int8_t board, int32_t &len)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_TRAJ_LENGTH, board, 0, 0, &len);
+#endif // MOTORS_DUAL_CORE
+  if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+  len = trajLength[board];
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Load the next trajectory segment
+// ----------------------------
+
+int8_t Motors::LoadTrajectorySegment(int8_t board)
+{
+  isTrajLoaded[board] = 0;
+  if (trajLength[board]==0) return ERR_None; // wait for more segments
+  trajActive[board] = trajSeg[board][trajHead[board]];
+  trajHead[board] = (trajHead[board] + 1) % MOTORS_TRAJ_MAX_SEGMENTS;
+  trajLength[board]--;
+
+  iterationsLeft[board] = 0; // segments are open loop
+  isMotorSearching[board] = 0;
+  isMotorMoving[board] = 1;
+  if (tmcArr[board].StartSegment(trajActive[board].pos, trajActive[board].vel, trajActive[board].acc, trajActive[board].velMode)) {
+    isMotorMoving[board] = 0;
+    SetErrorMsg("Board", board, "Error starting a trajectory segment");
+    return ERR_Motor;
+  }
+  isTrajLoaded[board] = 1;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Move on to the next segment of the running trajectories
+// ----------------------------
+
+void Motors::AdvanceTrajectories(void)
+{
+  int32_t pos;
+  int8_t isDone;
+
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (!isTrajRunning[z]) continue;
+    if (!isMotorEnabled[z] || isMotorHoming[z]) {
+      SetErrorMsg("Board", z, "Trajectory stopped, the motor cannot move");
+      StartTrajectory(z, 0);
+      continue;
+    }
+    if (isTrajLoaded[z]) {
+      if (tmcArr[z].GetPos(pos)!=ERR_None) continue;
+      const MotorSegment &seg = trajActive[z];
+      if (seg.velMode) {
+        isDone = (seg.vel > 0) ? (pos >= seg.pos) : (pos <= seg.pos);
+      } else {
+        isDone = (pos == seg.pos);
+      }
+      if (!isDone) {
+        if (isMotorMoving[z]) continue;
+        // the ramp ended short of the segment (limit, stall or stop), the trajectory can't continue
+        SetErrorMsg("Board", z, "Trajectory stopped, the segment ended before its target");
+        StartTrajectory(z, 0);
+        continue;
+      }
+      if (trajLength[z]==0 && seg.velMode) { // nothing to chain, don't run away
+        tmcArr[z].MoveAtVel(0);
+        isTrajLoaded[z] = 0;
+        continue;
+      }
+    } else if (trajLength[z]==0) {
+      continue; // idle until the host appends more segments
+    }
+    if (LoadTrajectorySegment(z)) {
+      SetErrorMsg("Board", z, "Trajectory stopped, could not load the next segment");
+      isTrajRunning[z] = 0;
+    }
+  }
+}
+
+
+// ----------------------------
+// Check whether a motor can accept a move
+// ----------------------------
+
+int8_t Motors::CheckMoveAllowed(int8_t board)
+{
   if(!params->IsActiveMotor(board, 1)) return ERR_Motor;
   if (!isMotorEnabled[board]) {
     SetErrorMsg("Board", board, "Driver is not enabled");
@@ -210,19 +1208,39 @@ int8_t Motors::MoveToPos(int8_t board, int32_t pos, int setVel)
     SetErrorMsg("Board", board, "Motor is homing");
     return ERR_Motor;
   }
+  if (isTrajRunning[board]) {
+    SetErrorMsg("Board", board, "Trajectory is running");
+    return ERR_Motor;
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Start a position move (open or closed loop)
+// ----------------------------
+
+int8_t Motors::StartMoveToPos(int8_t board, int32_t pos, int setVel, float scale)
+{
+  int8_t err;
 
   if ( (tmcArr[board].maxIterations==0 || tmcArr[board].maxIterations>1) && tmcArr[board].encConst!=0 ) { // closed loop
+    int32_t currPos = pos;
     targetPosition[board] = pos; // store the desired position
     iterationsLeft[board] = tmcArr[board].maxIterations - 1; // reset iteration counter
     isMotorMoving[board]=1;
     isMotorSearching[board]=1;
-    setPosition[board] = targetPosition[board];
-    err = tmcArr[board].MoveToPos(targetPosition[board], setVel);
+    // aim at the motor position that ended on target the last time in this direction
+    tmcArr[board].GetEnc(currPos);
+    clDir[board] = (pos >= currPos ? 1 : 0);
+    clStep[board] = 0;
+    setPosition[board] = targetPosition[board] + clOffset[board][clDir[board]];
+    err = tmcArr[board].MoveToPos(setPosition[board], setVel, scale);
   } else { // open loop
     iterationsLeft[board] = 0;
     isMotorMoving[board]=1;
     isMotorSearching[board]=0;
-    err = tmcArr[board].MoveToPos(pos, setVel);
+    err = tmcArr[board].MoveToPos(pos, setVel, scale);
   }
   if (err) {
     isMotorMoving[board]=0;
@@ -238,6 +1256,9 @@ int8_t Motors::MoveToPos(int8_t board, int32_t pos, int setVel)
 
 int8_t Motors::MoveAtVel(int8_t board, int32_t vel)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_MOVE_AT_VEL, board, 0, vel, nullptr);
+#endif // MOTORS_DUAL_CORE
   int8_t err;
 
   if(!params->IsActiveMotor(board, 1)) return ERR_Motor;
@@ -253,6 +1274,10 @@ int8_t Motors::MoveAtVel(int8_t board, int32_t vel)
       return ERR_Motor;
     // }
   }
+  if (isTrajRunning[board]) {
+    SetErrorMsg("Board", board, "Trajectory is running");
+    return ERR_Motor;
+  }
 
   err = tmcArr[board].MoveAtVel(vel);
   isMotorMoving[board] = ( vel==0 ? 0 : 1 );
@@ -271,6 +1296,9 @@ int8_t Motors::MoveAtVel(int8_t board, int32_t vel)
 
 int8_t Motors::GetPos(int8_t board, int32_t &pos)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_GET_POS, board, 0, 0, &pos);
+#endif // MOTORS_DUAL_CORE
   if(!params->IsActiveMotor(board, 1)) return ERR_Motor;
   return tmcArr[board].GetPos(pos);
 }
@@ -301,6 +1329,9 @@ int8_t Motors::SetRemoteEnabled(int8_t board, int8_t state)
 
 int8_t Motors::ClearStatusRegs(int8_t board)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_CLEAR_STATUS, board, 0, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
   if (board == -1) { // all motors
     for (int8_t z=0; z<MAXNUMMOTORS; z++) {
       if (!params->IsActiveMotor(z)) continue; // silently skip if not defined
@@ -320,6 +1351,9 @@ int8_t Motors::ClearStatusRegs(int8_t board)
 
 int8_t Motors::StartHoming(int8_t board)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_START_HOMING, board, 0, 0, nullptr);
+#endif // MOTORS_DUAL_CORE
   if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
   if (!isMotorEnabled[board]) {
     SetErrorMsg("Board", board, "Driver is not enabled");
@@ -335,6 +1369,9 @@ int8_t Motors::StartHoming(int8_t board)
 
 int8_t Motors::SetStatusValue(int8_t board, int index, int32_t value)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SET_STATUS, board, index, value, nullptr);
+#endif // MOTORS_DUAL_CORE
   int8_t status;
 
   // ENAB is a special case, it can be set for all motors at once
@@ -351,7 +1388,12 @@ int8_t Motors::SetStatusValue(int8_t board, int index, int32_t value)
   }
 
   if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
-  return tmcArr[board].SetStatusValue(index, value);
+  status = tmcArr[board].SetStatusValue(index, value);
+  // a new XACT or XENC breaks the learned relation between the two
+  if ( status==ERR_None && ((strncmp(motStatIDList[index], "XACT", 4)==0) || (strncmp(motStatIDList[index], "XENC", 4)==0)) ) {
+    ResetClosedLoopModel(board, 0);
+  }
+  return status;
 }
 
 
@@ -359,8 +1401,11 @@ int8_t Motors::SetStatusValue(int8_t board, int index, int32_t value)
 // Get the status value
 // ----------------------------
 
-int8_t Motors::GetStatusValue(int8_t board, int index, int32_t &value)
+int8_t Motors::GetStatusValue(int8_t board, int index, int32_t &value, int8_t fresh)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_GET_STATUS, board, index, fresh, &value);
+#endif // MOTORS_DUAL_CORE
   int32_t idx, max;
 
   if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
@@ -369,7 +1414,7 @@ int8_t Motors::GetStatusValue(int8_t board, int index, int32_t &value)
     value = max - iterationsLeft[board]; 
     return ERR_None;
   } else { 
-    return tmcArr[board].GetStatusValue(index, value);
+    return tmcArr[board].GetStatusValue(index, value, fresh);
   }
 }
 
@@ -380,6 +1425,9 @@ int8_t Motors::GetStatusValue(int8_t board, int index, int32_t &value)
 
 int8_t Motors::SetRegisterValue(int8_t board, uint8_t address, int32_t value)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SET_REGISTER, board, address, value, nullptr);
+#endif // MOTORS_DUAL_CORE
   if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
   return tmcArr[board].SetRegisterValue(address, value);
 }
@@ -389,10 +1437,13 @@ int8_t Motors::SetRegisterValue(int8_t board, uint8_t address, int32_t value)
 // Get a register value
 // ----------------------------
 
-int8_t Motors::GetRegisterValue(int8_t board, uint8_t address, int32_t &value)
+int8_t Motors::GetRegisterValue(int8_t board, uint8_t address, int32_t &value, int8_t fresh)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_GET_REGISTER, board, address, fresh, &value);
+#endif // MOTORS_DUAL_CORE
   if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
-  return tmcArr[board].GetRegisterValue(address, value);
+  return tmcArr[board].GetRegisterValue(address, value, fresh);
 }
 
 
@@ -400,10 +1451,13 @@ int8_t Motors::GetRegisterValue(int8_t board, uint8_t address, int32_t &value)
 // Get the status flags
 // ----------------------------
 
-int8_t Motors::GetStatusFlags(int8_t board, int32_t &status)
+int8_t Motors::GetStatusFlags(int8_t board, int32_t &status, int8_t fresh)
 {
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_GET_STATUS_FLAGS, board, fresh, 0, &status);
+#endif // MOTORS_DUAL_CORE
   if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
-  return tmcArr[board].GetStatusFlags(status);
+  return tmcArr[board].GetStatusFlags(status, fresh);
 }
 
 
@@ -430,6 +1484,83 @@ int8_t Motors::IsMotionDone(int8_t board, int32_t &done)
 }
 
 
+// ----------------------------
+// Set the positions of several boards without moving
+// ----------------------------
+
+int8_t Motors::SetOrigin(const MotorMoveList &origins)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_SET_ORIGIN, -1, 0, 0, nullptr, &origins, sizeof(origins));
+#endif // MOTORS_DUAL_CORE
+  int8_t board;
+
+  if (origins.num<1 || origins.num>MAXNUMMOTORS) {
+    SetErrorMsg("Board", -1, "Invalid number of motors for an origin");
+    return ERR_Motor;
+  }
+  // check all boards first, so either all positions are set or none
+  for (int8_t z=0; z<origins.num; z++) {
+    board = origins.board[z];
+    if (!params->IsActiveMotor(board, 1)) return ERR_Motor;
+    if (isMotorMoving[board] || isMotorSearching[board] || isMotorHoming[board]) {
+      SetErrorMsg("Board", board, "Motor is moving");
+      return ERR_Motor;
+    }
+    if (isTrajRunning[board] || isSequenceArmed[board]) {
+      SetErrorMsg("Board", board, "Sequence or trajectory is running");
+      return ERR_Motor;
+    }
+    for (int8_t y=0; y<z; y++) {
+      if (origins.board[y] == board) {
+        SetErrorMsg("Board", board, "Motor is listed twice in an origin");
+        return ERR_Motor;
+      }
+    }
+  }
+  for (int8_t z=0; z<origins.num; z++) {
+    board = origins.board[z];
+    if (int8_t err=tmcArr[board].SetOrigin(origins.pos[z])) return err;
+    targetPosition[board] = origins.pos[z];
+    ResetClosedLoopModel(board, 0); // the new XACT and XENC break the learned relation between the two
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Get motion state, position and status flags of several boards
+// ----------------------------
+
+int8_t Motors::GetStatusMulti(int32_t mask, MotorMultiStatus &multi, int8_t fresh)
+{
+#if MOTORS_DUAL_CORE
+  if (IsForwardRequired()) return ForwardRequest(MREQ_GET_STATUS_MULTI, -1, mask, fresh, nullptr, nullptr, 0, &multi);
+#endif // MOTORS_DUAL_CORE
+  int32_t xenc;
+
+  multi.num = 0;
+  if (mask != -1 && (mask < 0 || (mask >> MAXNUMMOTORS))) {
+    SetErrorMsg("Board", -1, "Invalid board mask");
+    return ERR_Motor;
+  }
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (mask == -1) {
+      if (!params->IsActiveMotor(z)) continue; // silently skip if not defined
+    } else {
+      if (!(mask & (1 << z))) continue;
+      if (!params->IsActiveMotor(z, 1)) return ERR_Motor;
+    }
+    int8_t num = multi.num;
+    multi.board[num] = z;
+    if (int8_t err=IsMotionDone(z, multi.done[num])) return err;
+    if (int8_t err=tmcArr[z].ReadSnapshot(multi.xact[num], xenc, multi.status[num], fresh)) return err;
+    multi.num++;
+  }
+  return ERR_None;
+}
+
+
 // ----------------------------
 // Set the error message and throw the error flag
 // ----------------------------
@@ -457,8 +1588,16 @@ int8_t Motors::PrintErrorMsg(void)
 {
   int8_t firstError = 1;
 
+  if (errorMsgQueue) {
+    Serial.print("Queue error: ");
+    Serial.print(errorMsgQueue);
+    errorMsgQueue = nullptr;
+    if (!errorFlag) return 1;
+    firstError = 0;
+  }
   if (errorFlag) {
     if (errorFlagGeneral) {
+      if (!firstError) Serial.print("; ");
       Serial.print(errorMsgGeneral);
       errorFlagGeneral = 0;
       firstError = 0;
@@ -3,6 +3,7 @@
 
 #include "Common.h"
 #include "Parameters.h"
+#include "SPSCQueue.h"
 
 
 // *************************************************************************************
@@ -12,6 +13,137 @@ class TMC; // forward declaration
 class Parameters; // forward declaration
 
 
+// *************************************************************************************
+// Typedefs
+// *************************************************************************************
+
+/**
+ * @enum MotorRequestType
+ * @brief Motors functions that are forwarded from core 0 to the supervisor on core 1.
+ */
+typedef enum {
+  MREQ_CONFIG = 0,
+  MREQ_CLEAR_STATUS,
+  MREQ_MOVE_AT_VEL,
+  MREQ_MOVE_TO_POS,
+  MREQ_GET_POS,
+  MREQ_START_HOMING,
+  MREQ_SET_STATUS,
+  MREQ_GET_STATUS,
+  MREQ_SET_REGISTER,
+  MREQ_GET_REGISTER,
+  MREQ_GET_STATUS_FLAGS,
+  MREQ_MOVE_TO_POS_MULTI,
+  MREQ_SEQ_CLEAR,
+  MREQ_SEQ_ADD,
+  MREQ_SEQ_START,
+  MREQ_SEQ_TRIGGER,
+  MREQ_SET_SETTLED,
+  MREQ_TRAJ_CLEAR,
+  MREQ_TRAJ_ADD,
+  MREQ_TRAJ_START,
+  MREQ_GET_STATUS_MULTI,
+  MREQ_SET_ORIGIN,
+  MREQ_CAPTURE_CONFIG,
+  MREQ_CAPTURE_START,
+  MREQ_SEQ_LENGTH,
+  MREQ_TRAJ_LENGTH
+} MotorRequestType;
+
+/**
+ * @enum CaptureState
+ * @brief State of the capture buffer.
+ */
+typedef enum {
+  CAPTURE_OFF = 0, // stopped, the buffer holds the last capture
+  CAPTURE_RUNNING, // sampling into the ring buffer
+  CAPTURE_ARMED    // waiting for the next move of one of the captured boards
+} CaptureState;
+
+/**
+ * @struct MotorMoveList
+ * @brief Target positions for a batched move of several motors.
+ */
+struct MotorMoveList {
+  int8_t num; // number of motors in the list
+  int8_t board[MAXNUMMOTORS]; // board indices
+  int32_t pos[MAXNUMMOTORS]; // target positions in microsteps
+};
+
+/**
+ * @struct MotorSegment
+ * @brief One segment of the trajectory queue of a motor.
+ */
+struct MotorSegment {
+  int32_t pos; // target position in microsteps (velocity segments end when they pass it)
+  int32_t vel; // velocity, 0 -> RSEV (position segments only), the sign gives the direction of velocity segments
+  int32_t acc; // acceleration, 0 -> RSEA
+  int8_t velMode; // 1 -> velocity segment (no stop at the end), 0 -> position segment
+};
+
+/**
+ * @struct MotorTelemetry
+ * @brief Snapshot of the positions and status flags of all active boards, taken by the supervision loop.
+ */
+struct MotorTelemetry {
+  unsigned long time; // millis() when the snapshot was taken
+  int8_t num; // number of boards in the snapshot
+  int8_t board[MAXNUMMOTORS]; // board indices
+  int32_t xact[MAXNUMMOTORS]; // actual positions
+  int32_t xenc[MAXNUMMOTORS]; // encoder positions
+  int32_t status[MAXNUMMOTORS]; // status flags (see TMC::GetStatusFlags)
+};
+
+/**
+ * @struct MotorMultiStatus
+ * @brief Motion state, position and status flags of several boards, read in one pass.
+ */
+struct MotorMultiStatus {
+  int8_t num; // number of boards in the list
+  int8_t board[MAXNUMMOTORS]; // board indices
+  int32_t done[MAXNUMMOTORS]; // 1 -> motion done (see IsMotionDone)
+  int32_t xact[MAXNUMMOTORS]; // actual positions
+  int32_t status[MAXNUMMOTORS]; // status flags (see TMC::GetStatusFlags)
+};
+
+/**
+ * @union MotorRequestData
+ * @brief Additional data of a request, copied into the queue slot.
+ *
+ * Core 0 gives up on a request after MOTORS_QUEUE_TIMEOUT_MS while it may still be in the queue, so
+ * core 1 must not access memory of the caller.
+ */
+union MotorRequestData {
+  MotorMoveList moves; // MREQ_MOVE_TO_POS_MULTI, MREQ_SET_ORIGIN, MREQ_SEQ_START
+  MotorSegment seg; // MREQ_TRAJ_ADD
+  int32_t pos[MOTORS_REQUEST_MAX_POSITIONS]; // MREQ_SEQ_ADD
+};
+
+/**
+ * @struct MotorRequest
+ * @brief Request passed from core 0 to core 1.
+ */
+struct MotorRequest {
+  uint32_t seq; // sequence number to match the response
+  uint8_t type; // one of MotorRequestType
+  int8_t board; // board index (or -1 for all)
+  int32_t arg; // additional argument (status index, register address, setVel flag)
+  int32_t value; // value to set
+  MotorRequestData data; // additional data (see ForwardRequest)
+};
+
+/**
+ * @struct MotorResponse
+ * @brief Response passed from core 1 back to core 0.
+ */
+struct MotorResponse {
+  uint32_t seq; // sequence number of the matching request
+  int8_t err; // return value of the function
+  int32_t value; // returned value for get requests
+  MotorMultiStatus multi; // result of MREQ_GET_STATUS_MULTI
+};
+
+
 // *************************************************************************************
 // Motors class
 // *************************************************************************************
@@ -30,6 +162,202 @@ private:
   Parameters *params; // pointer to the Parameters class instance
   char errorMsgGeneral[MAXERRORSTRINGSIZE]; // genral error message string
   char errorMsgBoard[MAXNUMMOTORS][MAXERRORSTRINGSIZE]; // board-related error message string
+  MotorTelemetry telemetry; // latest telemetry snapshot (written by the supervision loop only)
+  volatile uint32_t telemetrySeq = 0; // snapshot counter, odd while the snapshot is being written
+  volatile uint16_t telemetryInterval_ms = 0; // interval for the telemetry snapshots (0 -> off)
+
+#if MOTORS_DUAL_CORE
+  SPSCQueue<MotorRequest, MOTORS_QUEUE_SIZE> requestQueue; // core 0 -> core 1
+  SPSCQueue<MotorResponse, MOTORS_QUEUE_SIZE> responseQueue; // core 1 -> core 0
+  uint32_t requestSeq = 0; // sequence counter for the requests (core 0 only)
+  volatile uint32_t pendingSeq = 0; // request core 0 waits for, 0 once claimed by core 1 or cancelled by core 0
+  volatile int8_t supervisorRequested = 0; // set by core 0 once the setup is complete
+  volatile int8_t supervisorActive = 0; // set by core 1 once it has taken over the supervision
+
+  /**
+   * @brief Checks whether a call has to be forwarded to the supervisor on core 1.
+   *
+   * @return int8_t Returns 1 if the caller is on core 0 and the supervisor is running, 0 otherwise.
+   */
+  int8_t IsForwardRequired(void);
+
+  /**
+   * @brief Sends a request to core 1 and waits for the response.
+   *
+   * On a timeout, the request is cancelled unless core 1 has already started it, then the call waits
+   * for its result. A cancelled request is dropped by core 1, so it never runs after the error was reported.
+   *
+   * @param type The request type (MotorRequestType).
+   * @param board The index of the motor board.
+   * @param arg Additional argument of the request.
+   * @param value Value to pass along with the request.
+   * @param result Pointer to store the returned value for get requests (nullptr if not used).
+   * @param data Pointer to additional request data (nullptr if not used), copied into the request.
+   * @param dataSize Size of the data in bytes (max sizeof(MotorRequestData)).
+   * @param multi Pointer to store the result of MREQ_GET_STATUS_MULTI (nullptr if not used).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t ForwardRequest(uint8_t type, int8_t board, int32_t arg, int32_t value, int32_t *result,
+                        const void *data = nullptr, size_t dataSize = 0, MotorMultiStatus *multi = nullptr);
+
+  /**
+   * @brief Executes a request on core 1 and queues the response.
+   *
+   * @param req The request to execute.
+   */
+  void ExecuteRequest(const MotorRequest &req);
+#endif // MOTORS_DUAL_CORE
+
+  /**
+   * @brief Configures one board with the parameter groups changed since its last config.
+   *
+   * @param board The index of the motor board to configure (0 to MAXNUMMOTORS-1).
+   * @param full 1 to write all parameter groups.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t ConfigChangedGroups(int8_t board, int8_t full);
+
+  /**
+   * @brief Checks whether a motor can start a position move (active, enabled and not homing).
+   *
+   * @param board The index of the motor board to check (0 to MAXNUMMOTORS-1).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t CheckMoveAllowed(int8_t board);
+
+  /**
+   * @brief Starts a position move in open or closed loop mode (no checks, see CheckMoveAllowed).
+   *
+   * @param board The index of the motor board to move (0 to MAXNUMMOTORS-1).
+   * @param pos The target position in microsteps.
+   * @param setVel Flag whether the velocity should be set.
+   * @param scale Ramp scaling passed on to TMC::MoveToPos (1 for the regular ramp).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t StartMoveToPos(int8_t board, int32_t pos, int setVel, float scale);
+
+  /**
+   * @brief Handles the end of a closed loop move: starts the next correction or finishes the move.
+   *
+   * @param board The index of the motor board (0 to MAXNUMMOTORS-1).
+   */
+  void ContinueClosedLoop(int8_t board);
+
+  /**
+   * @brief Forgets the learned closed loop offsets (and the gain) of a board.
+   *
+   * @param board The index of the motor board (0 to MAXNUMMOTORS-1).
+   * @param resetGain 1 to reset the gain as well.
+   */
+  void ResetClosedLoopModel(int8_t board, int8_t resetGain);
+
+  /**
+   * @brief Reads the positions and status flags of all active boards into the telemetry snapshot.
+   *
+   * Called from ProcessUpdateChanges, i.e. on the core that runs the supervision.
+   */
+  void UpdateTelemetry(void);
+
+  static volatile uint8_t diagEvent[MAXNUMMOTORS]; // set by the DIAG pin interrupts, handled in ProcessUpdateChanges
+  static void DiagISR0(); // interrupt service routine for the DIAG pins of board 0
+  static void DiagISR1(); // interrupt service routine for the DIAG pins of board 1
+  static void DiagISR2(); // interrupt service routine for the DIAG pins of board 2
+  static void DiagISR3(); // interrupt service routine for the DIAG pins of board 3
+
+  static volatile uint32_t seqTriggerCount; // number of trigger edges, counted by the trigger interrupt
+  static void SeqTriggerISR(); // interrupt service routine for the sequence trigger pin
+  uint32_t seqTriggerHandled = 0; // number of trigger edges handled by the supervision loop
+  int32_t seqPos[MAXNUMMOTORS][MOTORS_SEQ_MAX_LENGTH]; // position sequences in microsteps
+  int16_t seqLength[MAXNUMMOTORS] = {0}; // number of positions in the sequence of each board
+  int16_t seqIndex[MAXNUMMOTORS] = {0}; // index of the current position in the sequence of each board
+  int8_t isSequenceArmed[MAXNUMMOTORS] = {0}; // flag whether the trigger advances the sequence of the board
+
+  MotorSegment trajSeg[MAXNUMMOTORS][MOTORS_TRAJ_MAX_SEGMENTS]; // trajectory queues (ring buffers)
+  int16_t trajHead[MAXNUMMOTORS] = {0}; // index of the next segment to load
+  volatile int16_t trajLength[MAXNUMMOTORS] = {0}; // number of segments waiting in the queue
+  int8_t isTrajRunning[MAXNUMMOTORS] = {0}; // flag whether the supervision loop executes the queue of the board
+  int8_t isTrajLoaded[MAXNUMMOTORS] = {0}; // flag whether a segment is in progress (trajActive holds it)
+  MotorSegment trajActive[MAXNUMMOTORS]; // segment in progress
+
+  uint8_t settledMask = 0; // boards (bit mask) that drive the settled output, 0 -> off
+  uint16_t settledTime_ms = 0; // time the boards have to be settled before the output is set
+  int8_t settledPulse = 0; // 1 -> pulse once per move, 0 -> level (high while settled)
+  int8_t settledPending = 0; // flag whether the output still has to be set for the current position
+  unsigned long settledStart = 0; // millis() of the last pass in which one of the boards was still moving
+  int8_t settledPulseActive = 0; // flag whether a settled pulse is being sent
+  unsigned long settledPulseEnd = 0; // micros() at which the current settled pulse ends
+
+  /**
+   * @brief Updates the settled output (see MOTORS_SETTLED_PIN) from the motion state of the settled group.
+   *
+   * Called from ProcessUpdateChanges and right after a board reached its target in CheckBoardStatus.
+   * A pulse is started here and ended on a later pass, so the loop never waits for it.
+   */
+  void UpdateSettledOutput(void);
+
+  int32_t captureBuffer[MOTORS_CAPTURE_BUFFER_SIZE]; // capture ring buffer, each sample is the micros() time stamp followed by the signals of each board
+  uint8_t captureBoards = 0; // boards (bit mask) of the capture
+  uint8_t captureSignals = 0; // signals (bit mask, see TMC::ReadCapture) recorded for each board
+  uint32_t captureInterval_us = 0; // sample interval of the capture
+  uint16_t captureSampleSize = 0; // number of values per sample, 0 -> not configured
+  uint32_t captureMaxSamples = 0; // number of samples that fit into the ring buffer
+  int8_t captureUntilRest = 0; // flag whether the capture stops once the boards are at rest (armed captures)
+  unsigned long captureLast_us = 0; // micros() of the last sample
+  volatile uint8_t captureState = CAPTURE_OFF; // one of CaptureState
+  volatile uint32_t captureCount = 0; // number of samples taken since the start of the capture
+
+  /**
+   * @brief Takes a capture sample if the sample interval has passed, starts and stops armed captures.
+   *
+   * Called from ProcessUpdateChanges on every pass. Samples missed by a slow pass are skipped, not caught
+   * up, so the time stamps of the samples show the actual spacing.
+   */
+  void UpdateCapture(void);
+
+  /**
+   * @brief Attaches the interrupts of the connected DIAG pins (see MOTORS_DEFAULT_DIAG0_PIN) and of the
+   * sequence trigger pin (see MOTORS_SEQ_TRIGGER_PIN).
+   *
+   * Must be called on the core that runs the supervision, since the interrupts are handled by the calling core.
+   */
+  void AttachPinInterrupts(void);
+
+  /**
+   * @brief Advances the sequences of all armed boards and starts the moves to the new positions.
+   *
+   * The sequences wrap around at the end. A board that cannot move is disarmed.
+   *
+   * @param steps Number of positions to advance (more than 1 if trigger edges arrived during one loop pass).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t StepSequence(uint32_t steps);
+
+  /**
+   * @brief Ends the finished segments of the running trajectories and loads the next ones.
+   *
+   * Called in every pass of the supervision loop, so the next segment follows within one pass.
+   * A position segment is finished when the motor reached its target, a velocity segment as soon as
+   * XACT passed its target. If the queue runs dry after a velocity segment, the motor ramps down.
+   * A board that cannot move is stopped.
+   */
+  void AdvanceTrajectories(void);
+
+  /**
+   * @brief Loads the next segment of the trajectory queue of a board.
+   *
+   * @return int8_t Returns 0 on success (or if the queue is empty), or a negative error code on failure.
+   */
+  int8_t LoadTrajectorySegment(int8_t board);
+
+  /**
+   * @brief Checks the status of one board and advances homing and closed loop moves.
+   *
+   * Called periodically from ProcessUpdateChanges for all active boards, and right away after a DIAG pin event.
+   * Boards that are not moving only get their register snapshot refreshed.
+   *
+   * @param board The index of the motor board to check (0 to MAXNUMMOTORS-1).
+   */
+  void CheckBoardStatus(int8_t board);
 
 public:
   TMC *tmcArr; // array of TMC objects, one for each motor
@@ -63,6 +391,7 @@ public:
   int8_t errorFlag = 0; // error flag to indicate if any error has occurred
   int8_t errorFlagGeneral = 0; // error flag to indicate if a general error has occurred
   int8_t errorFlagBoard[MAXNUMMOTORS] = {0}; // error flag to indicate if a board-specific error has occurred
+  const char *errorMsgQueue = nullptr; // error of the request queue, written by core 0 only (the others by the supervision)
   int8_t isMotorEnabled[MAXNUMMOTORS] = {0}; // array to track if each motor is enabled (1) or not (0)
   int8_t isRemoteControlled[MAXNUMMOTORS] = {0}; // array to track if each motor is controlled remotely (1) or serial (0, default)
   
@@ -75,6 +404,15 @@ public:
   int32_t setPosition[MAXNUMMOTORS] = {0}; // current set position for closed loop motion
   int32_t iterationsLeft[MAXNUMMOTORS] = {0}; // iteration counter for closed loop motion, counts backwards to 0
 
+  // Learned closed loop corrections. The offsets are XACT-XENC after the last converged move in each direction
+  // (this includes the backlash), so the next move can be aimed at the right motor position right away.
+  // The gain is the ratio of the encoder motion to the commanded motion, learned from the correction moves.
+  int32_t clOffset[MAXNUMMOTORS][2] = {{0}}; // learned offsets for negative [0] and positive [1] moves
+  float clGain[MAXNUMMOTORS] = {1.0f, 1.0f, 1.0f, 1.0f}; // learned encoder/command ratio
+  int8_t clDir[MAXNUMMOTORS] = {0}; // direction of the current move (0 negative, 1 positive)
+  int32_t clStep[MAXNUMMOTORS] = {0}; // commanded motion of the current correction (0 for the first move)
+  int32_t clStartEnc[MAXNUMMOTORS] = {0}; // encoder position at the start of the current correction
+
   // int32_t encConst[MAXNUMMOTORS] = {0}; // encoder constant (0 means no encoder present)
   // int32_t maxIterations[MAXNUMMOTORS] = {0}; // maximum number of iterations
   // int32_t tolerance[MAXNUMMOTORS] = {0}; // tolerance for closed loop motion
@@ -115,10 +453,13 @@ public:
   /**
    * @brief Configures a motor board.
    * 
+   * Only the parameter groups changed since the last config are written to the driver.
+   * 
    * @param board The index of the motor board to configure (-1 for all).
+   * @param full 1 to write all parameter groups, regardless of changes.
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
-  int8_t ConfigBoard(int8_t board);
+  int8_t ConfigBoard(int8_t board, int8_t full = 0);
 
   /**
    * @brief Processes updates and changes for all motors.
@@ -128,6 +469,46 @@ public:
    */
   void ProcessUpdateChanges(void);
 
+  /**
+   * @brief Hands the motor supervision over to core 1.
+   *
+   * Called by core 0 at the end of the setup. Returns once core 1 is running the supervision loop.
+   * From then on, all calls that access the drivers are forwarded to core 1.
+   * Does nothing if MOTORS_DUAL_CORE is 0.
+   */
+  void StartSupervisor(void);
+
+  /**
+   * @brief Runs one pass of the supervision loop on core 1.
+   *
+   * Executes the pending requests from core 0 and calls ProcessUpdateChanges.
+   * Called from loop1() in the main controller. Does nothing if MOTORS_DUAL_CORE is 0.
+   */
+  void RunSupervisor(void);
+
+  /**
+   * @brief Sets the interval for the telemetry snapshots taken by the supervision loop.
+   *
+   * @param interval_ms Interval in ms (0 turns the snapshots off).
+   */
+  void SetTelemetryInterval(uint16_t interval_ms);
+
+  /**
+   * @brief Copies the latest telemetry snapshot (can be called from either core).
+   *
+   * @param tele Reference to store the snapshot.
+   * @param seq Reference to store the snapshot counter, which changes with every new snapshot.
+   * @return int8_t Returns 0 on success, or a negative error code if no consistent snapshot could be read.
+   */
+  int8_t GetTelemetry(MotorTelemetry &tele, uint32_t &seq);
+
+  /**
+   * @brief Returns the counter of the latest telemetry snapshot (odd while a snapshot is being written).
+   *
+   * @return uint32_t Snapshot counter as returned by GetTelemetry.
+   */
+  uint32_t GetTelemetrySeq(void);
+
   /**
    * @brief Clears the status registers.
    * 
@@ -157,6 +538,193 @@ public:
    */
   int8_t MoveToPos(int8_t board, int32_t pos, int setVel);
 
+  /**
+   * @brief Moves several motors to their positions in one go.
+   *
+   * All boards are checked before any motor is started, so either all motors move or none.
+   * The moves are started back to back in the same pass of the supervision loop.
+   *
+   * @param moves List of boards and target positions.
+   * @param sync Flag whether the motors should arrive together. If set, the ramps (RSEV, RSEA) of the
+   * shorter moves are scaled down so that all moves take as long as the longest one.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t MoveToPosMulti(const MotorMoveList &moves, int8_t sync);
+
+  /**
+   * @brief Sets the actual, target and encoder positions of several motors without moving them.
+   *
+   * All boards are checked first, so either all positions are set or none. The motors must be
+   * at rest (not moving, homing, searching, or running a sequence or trajectory), the enable
+   * state is kept. The learned closed loop offsets are reset.
+   *
+   * @param origins List of boards and their new positions.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t SetOrigin(const MotorMoveList &origins);
+
+  /**
+   * @brief Clears the position sequence of a motor and disarms it.
+   *
+   * @param board The index of the motor board (-1 for all motors).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t ClearSequence(int8_t board);
+
+  /**
+   * @brief Appends positions to the position sequence of a motor.
+   *
+   * @param board The index of the motor board (0 to MAXNUMMOTORS-1).
+   * @param pos Array of positions in microsteps.
+   * @param num Number of positions in the array.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t AddToSequence(int8_t board, const int32_t *pos, int16_t num);
+
+  /**
+   * @brief Arms or disarms the position sequences of several motors at once.
+   *
+   * Arming moves the motor to the first position of the sequence. From then on, every edge on the
+   * trigger pin (or TriggerSequence) moves all armed motors to their next position, without the host.
+   * Motors armed together start from the same edge; pending edges are only dropped if no other
+   * sequence runs.
+   *
+   * @param states Boards and their new state (the pos field): 1 to arm the sequence, 0 to stop it.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t StartSequence(const MotorMoveList &states);
+
+  /**
+   * @brief Advances the sequences of all armed motors by one position, like an edge on the trigger pin.
+   *
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t TriggerSequence(void);
+
+  /**
+   * @brief Gets the number of positions in the sequence of a motor.
+   *
+   * @param board The index of the motor board to query (0 to MAXNUMMOTORS-1).
+   * @param len Reference to store the number of positions.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t GetSequenceLength(int8_t board, int32_t &len);
+
+  /**
+   * @brief Clears the trajectory queue of a motor and stops its execution (see StartTrajectory).
+   *
+   * @param board The index of the motor board (-1 for all motors).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t ClearTrajectory(int8_t board);
+
+  /**
+   * @brief Appends a segment to the trajectory queue of a motor.
+   *
+   * Segments can be appended while the queue runs, so the host can keep a long scan going by topping
+   * the queue up (see GetTrajectoryLength).
+   *
+   * @param board The index of the motor board (0 to MAXNUMMOTORS-1).
+   * @param seg The segment. Velocity segments need a velocity that points towards their target.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t AddToTrajectory(int8_t board, const MotorSegment &seg);
+
+  /**
+   * @brief Starts or stops the execution of the trajectory queue of a motor.
+   *
+   * While running, the supervision loop loads the next segment into the ramp generator as soon as the
+   * current one is finished, without the host. Segments are open loop moves, the closed loop
+   * correction (ECON) is not applied. Stopping ramps down a velocity segment in progress and leaves a
+   * position segment to finish, the remaining segments stay in the queue.
+   *
+   * @param board The index of the motor board (0 to MAXNUMMOTORS-1).
+   * @param state 1 to start, 0 to stop.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t StartTrajectory(int8_t board, int8_t state);
+
+  /**
+   * @brief Gets the number of segments waiting in the trajectory queue of a motor (without the one in progress).
+   *
+   * @param board The index of the motor board to query (0 to MAXNUMMOTORS-1).
+   * @param len Reference to store the number of segments.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t GetTrajectoryLength(int8_t board, int32_t &len);
+
+  /**
+   * @brief Configures the settled output (see MOTORS_SETTLED_PIN).
+   *
+   * The output is set once all boards of the group have reached their target (as MC_POSR) and stayed there for
+   * the settle time, so a camera or DAQ can start right off the line instead of the host polling.
+   *
+   * @param mask Bit mask of the boards in the group (bit 0 -> board 0), 0 turns the output off.
+   * @param settleTime_ms Time in ms the boards have to be settled before the output is set.
+   * @param pulse 1 to send a pulse of MOTORS_SETTLED_PULSE_US per move, 0 to hold the output high while settled.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t SetSettledOutput(uint8_t mask, uint16_t settleTime_ms, int8_t pulse);
+
+  /**
+   * @brief Gets the board mask of the settled output.
+   *
+   * @return uint8_t The bit mask of the boards in the group (0 -> off).
+   */
+  uint8_t GetSettledMask(void) { return settledMask; }
+
+  /**
+   * @brief Configures the capture: boards, signals and sample rate (clears the buffer).
+   *
+   * @param boardMask Bit mask of the boards to record (bit 0 -> board 0), the boards have to be active.
+   * @param signalMask Bit mask of the signals recorded for each board (see TMC::ReadCapture).
+   * @param rate Sample rate in Hz (1 to MOTORS_CAPTURE_MAX_RATE_HZ).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t ConfigCapture(uint8_t boardMask, uint8_t signalMask, uint16_t rate);
+
+  /**
+   * @brief Starts, arms or stops the capture.
+   *
+   * A started capture runs until it is stopped and keeps the latest samples once the buffer is full. An armed
+   * capture starts with the next move of one of the captured boards and stops once all of them are at rest
+   * again, or when the buffer is full.
+   *
+   * @param mode 0 -> stop, 1 -> start now, 2 -> arm (start with the next move).
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t StartCapture(int8_t mode);
+
+  /**
+   * @brief Gets the state of the capture.
+   *
+   * @return uint8_t One of CaptureState.
+   */
+  uint8_t GetCaptureState(void) { return captureState; }
+
+  /**
+   * @brief Gets the number of samples in the capture buffer.
+   *
+   * @return uint32_t The number of samples (at most the capacity of the buffer).
+   */
+  uint32_t GetCaptureLength(void);
+
+  /**
+   * @brief Gets the number of values per capture sample (time stamp and signals of each board).
+   *
+   * @return uint16_t The sample size, 0 if the capture is not configured.
+   */
+  uint16_t GetCaptureSampleSize(void) { return captureSampleSize; }
+
+  /**
+   * @brief Gets a sample of the capture buffer (can be called from either core while the capture is off).
+   *
+   * @param index Index of the sample, 0 is the oldest sample in the buffer.
+   * @return const int32_t* Pointer to the GetCaptureSampleSize() values of the sample, nullptr if the
+   * index is out of range or the capture is not off.
+   */
+  const int32_t* GetCaptureSample(uint32_t index);
+
   /**
    * @brief Gets the current position of a motor.
    *
@@ -200,9 +768,10 @@ public:
    * @param idx Index for the array motStatIDList, defined in Motors.h.
    * This array is a list of acepted status IDs (short strings), also used during serial comm.
    * @param intVal Reference to an integer to store the retrieved status.
+   * @param fresh If 1, the value is read from the driver instead of the register snapshot.
    * @return int8_t Returns 0 on success, or a negative error code on failure. 
    */
-  int8_t GetStatusValue(int8_t board, int idx, int32_t &intVal);
+  int8_t GetStatusValue(int8_t board, int idx, int32_t &intVal, int8_t fresh = 0);
 
   /**
    * @brief Sets a specific register value in the TMC driver.
@@ -220,9 +789,10 @@ public:
    * @param board The index of the motor board to query (0 to MAXNUMMOTORS-1).
    * @param address The register address to read.
    * @param value Reference to an integer to store the retrieved register value.
+   * @param fresh If 1, the register is read from the driver instead of the register shadow.
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
-  int8_t GetRegisterValue(int8_t board, uint8_t address, int32_t &value);
+  int8_t GetRegisterValue(int8_t board, uint8_t address, int32_t &value, int8_t fresh = 0);
 
   /**
    * @brief Checks the status of the TMC driver.
@@ -232,9 +802,10 @@ public:
    *
    * @param board The index of the motor board to check (0 to MAXNUMMOTORS-1).
    * @param isMotionDone Reference to an integer to indicate if the motion is done (1 for done, 0 for not done).
+   * @param fresh If 1, the flags are read from the driver instead of the register snapshot.
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
-  int8_t GetStatusFlags(int8_t board, int32_t &status);
+  int8_t GetStatusFlags(int8_t board, int32_t &status, int8_t fresh = 0);
 
   /**
    * @brief Checks if the motion is complete for a specific motor or all motors.
@@ -244,6 +815,16 @@ public:
    */
   int8_t IsMotionDone(int8_t board, int32_t &done);
 
+  /**
+   * @brief Gets the motion state, position and status flags of several boards in one pass.
+   *
+   * @param mask Boards to read (bit 0 -> board 0), -1 for all active boards.
+   * @param multi Reference to store the values, in the order of the board indices.
+   * @param fresh If 1, the values are read from the driver instead of the register snapshot.
+   * @return int8_t Returns 0 on success, or a negative error code if a board in the mask is not active.
+   */
+  int8_t GetStatusMulti(int32_t mask, MotorMultiStatus &multi, int8_t fresh = 0);
+
 //TODO
   /**
    * @brief Checks if a motor board is valid.
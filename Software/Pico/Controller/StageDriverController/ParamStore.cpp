@@ -0,0 +1,294 @@
+#include <Arduino.h>
+#include "Common.h"
+
+#include <hardware/flash.h>
+
+#include "ParamStore.h"
+#include "SerialComm.h" // Crc16
+
+#define SERIAL_DEBUG  0
+#include "Serial_Debug.h"
+
+
+// *************************************************************************************
+// defines
+// *************************************************************************************
+#define PARAMSTORE_MAGIC            0x50535431 // "PST1" at the start of each sector
+#define PARAMSTORE_REC_ITEM         0x01 // record holds a new item value
+#define PARAMSTORE_REC_COMMIT       0x02 // all records before belong to a complete save
+#define PARAMSTORE_REC_ERASED       0xFF // erased flash, end of the log
+
+static_assert(PARAMSTORE_HEADER_SIZE + (PARAMSTORE_NUM_ITEMS + 1) * PARAMSTORE_RECORD_SIZE <= PARAMSTORE_SECTOR_SIZE,
+              "The parameter snapshot doesn't fit into a flash sector");
+
+// filesystem region of the flash (set by the linker script of the core)
+extern uint8_t _FS_start;
+extern uint8_t _FS_end;
+
+static uint8_t g_storeBuffer[PARAMSTORE_SECTOR_SIZE]; // records of one save or snapshot
+
+
+// *************************************************************************************
+// helpers
+// *************************************************************************************
+
+static uint32_t GetU32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void PutU32(uint8_t *p, uint32_t value)
+{
+  for (int8_t z=0; z<4; z++) p[z] = (uint8_t)(value >> (8*z));
+}
+
+
+// *************************************************************************************
+// ParamStore class
+// *************************************************************************************
+
+// ----------------------------
+// Constructor
+// ----------------------------
+
+ParamStore::ParamStore()
+{
+  numSectors = 0;
+  activeSector = -1;
+  lastSeq = 0;
+  writePos = PARAMSTORE_SECTOR_SIZE;
+  isStoredValid = 0;
+}
+
+
+// ----------------------------
+// Locate the flash region
+// ----------------------------
+
+void ParamStore::Init(void)
+{
+  uint32_t regionSize = (uint32_t)(&_FS_end - &_FS_start);
+
+  D_println("ParamStore::Init");
+  baseAddr = &_FS_start;
+  baseOffset = (uint32_t)((uintptr_t)&_FS_start - XIP_BASE);
+  numSectors = (regionSize / PARAMSTORE_SECTOR_SIZE < PARAMS_STORE_SECTORS) ? (int8_t)(regionSize / PARAMSTORE_SECTOR_SIZE) : PARAMS_STORE_SECTORS;
+  if (numSectors < 2) numSectors = 0; // no rotation possible, use the legacy EEPROM layout
+}
+
+
+// ----------------------------
+// Load the latest committed set
+// ----------------------------
+
+int8_t ParamStore::Load(int32_t *items)
+{
+  static int32_t replayed[PARAMSTORE_NUM_ITEMS];
+  int8_t order[PARAMS_STORE_SECTORS];
+  uint32_t seq[PARAMS_STORE_SECTORS];
+  int8_t numValid = 0;
+  uint16_t endPos;
+
+  if (!numSectors) return ERR_Parameter;
+
+  // collect the sectors with a valid header, newest first
+  for (int8_t s=0; s<numSectors; s++) {
+    const uint8_t *header = baseAddr + (uint32_t)s * PARAMSTORE_SECTOR_SIZE;
+    if (GetU32(header) != PARAMSTORE_MAGIC) continue;
+    if (Crc16(header, 12) != (uint16_t)(header[12] | (header[13] << 8))) continue;
+    if ((header[8] | (header[9] << 8)) != VERSION || (header[10] | (header[11] << 8)) != PARAMSTORE_NUM_ITEMS) continue;
+    uint32_t sectorSeq = GetU32(header+4);
+    if (sectorSeq > lastSeq) lastSeq = sectorSeq;
+    int8_t pos = numValid++;
+    while (pos > 0 && seq[pos-1] < sectorSeq) {
+      seq[pos] = seq[pos-1];
+      order[pos] = order[pos-1];
+      pos--;
+    }
+    seq[pos] = sectorSeq;
+    order[pos] = s;
+  }
+
+  // the newest sector with a commit wins (a sector without one is a snapshot that didn't complete)
+  for (int8_t z=0; z<numValid; z++) {
+    if (!ReplaySector(order[z], replayed, endPos)) continue;
+    memcpy(items, replayed, sizeof(replayed));
+    memcpy(stored, replayed, sizeof(replayed));
+    isStoredValid = 1;
+    activeSector = order[z];
+    writePos = (z == 0) ? endPos : PARAMSTORE_SECTOR_SIZE; // don't append behind a newer sector
+    return ERR_None;
+  }
+  return ERR_Parameter;
+}
+
+
+// ----------------------------
+// Append the changed items
+// ----------------------------
+
+int8_t ParamStore::Save(const int32_t *items)
+{
+  uint8_t *buffer = g_storeBuffer;
+  uint16_t len = 0;
+  uint16_t numChanged = 0;
+
+  if (!numSectors) return ERR_Parameter;
+  if (!isStoredValid || activeSector < 0) return StartSector(items);
+
+  for (uint16_t z=0; z<PARAMSTORE_NUM_ITEMS; z++) {
+    if (items[z] != stored[z]) numChanged++;
+  }
+  if (numChanged == 0) return ERR_None; // nothing to write
+  if (writePos + (uint32_t)(numChanged + 1) * PARAMSTORE_RECORD_SIZE > PARAMSTORE_SECTOR_SIZE) {
+    return StartSector(items); // sector full: continue with a snapshot in the next one
+  }
+
+  for (uint16_t z=0; z<PARAMSTORE_NUM_ITEMS; z++) {
+    if (items[z] != stored[z]) len += PutRecord(buffer+len, PARAMSTORE_REC_ITEM, z, items[z]);
+  }
+  len += PutRecord(buffer+len, PARAMSTORE_REC_COMMIT, 0, 0);
+  if (WriteBytes(activeSector, writePos, buffer, len)) {
+    writePos = PARAMSTORE_SECTOR_SIZE; // the next save starts over in a fresh sector
+    return ERR_Parameter;
+  }
+  writePos += len;
+  memcpy(stored, items, sizeof(stored));
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Replay the records of a sector
+// ----------------------------
+
+int8_t ParamStore::ReplaySector(int8_t sector, int32_t *items, uint16_t &endPos)
+{
+  static int32_t pending[PARAMSTORE_NUM_ITEMS];
+  const uint8_t *data = baseAddr + (uint32_t)sector * PARAMSTORE_SECTOR_SIZE;
+  int8_t hasCommit = 0;
+  uint16_t pos = PARAMSTORE_HEADER_SIZE;
+  uint16_t commitEnd = 0;
+
+  memset(pending, 0, sizeof(pending));
+  endPos = PARAMSTORE_SECTOR_SIZE;
+  while (pos + PARAMSTORE_RECORD_SIZE <= PARAMSTORE_SECTOR_SIZE) {
+    const uint8_t *rec = data + pos;
+    if (rec[0] == PARAMSTORE_REC_ERASED) { // end of the log, the rest of the sector is free
+      endPos = pos;
+      break;
+    }
+    if (Crc16(rec, PARAMSTORE_RECORD_SIZE-2) != (uint16_t)(rec[7] | (rec[8] << 8))) {
+      D_println("ParamStore: bad record CRC");
+      break; // torn or corrupted write, ignore the rest (endPos stays at the end -> next save rotates)
+    }
+    uint16_t item = (uint16_t)(rec[1] | (rec[2] << 8));
+    if (rec[0] == PARAMSTORE_REC_ITEM && item < PARAMSTORE_NUM_ITEMS) {
+      pending[item] = (int32_t)GetU32(rec+3);
+    } else if (rec[0] == PARAMSTORE_REC_COMMIT) {
+      memcpy(items, pending, sizeof(pending));
+      hasCommit = 1;
+      commitEnd = pos + PARAMSTORE_RECORD_SIZE;
+    } else {
+      break;
+    }
+    pos += PARAMSTORE_RECORD_SIZE;
+  }
+  // records of an interrupted save would be committed by the next one, so don't append behind them
+  if (endPos != commitEnd) endPos = PARAMSTORE_SECTOR_SIZE;
+  return hasCommit;
+}
+
+
+// ----------------------------
+// Start the next sector with a snapshot
+// ----------------------------
+
+int8_t ParamStore::StartSector(const int32_t *items)
+{
+  uint8_t *buffer = g_storeBuffer;
+  int8_t sector = (activeSector < 0) ? 0 : (activeSector + 1) % numSectors;
+  uint32_t seq = lastSeq + 1;
+  uint16_t len = PARAMSTORE_HEADER_SIZE;
+  uint16_t crc;
+
+  memset(buffer, 0xFF, PARAMSTORE_HEADER_SIZE);
+  PutU32(buffer, PARAMSTORE_MAGIC);
+  PutU32(buffer+4, seq);
+  buffer[8] = (uint8_t)(VERSION & 0xFF);
+  buffer[9] = (uint8_t)((VERSION >> 8) & 0xFF);
+  buffer[10] = (uint8_t)(PARAMSTORE_NUM_ITEMS & 0xFF);
+  buffer[11] = (uint8_t)(PARAMSTORE_NUM_ITEMS >> 8);
+  crc = Crc16(buffer, 12);
+  buffer[12] = (uint8_t)(crc & 0xFF);
+  buffer[13] = (uint8_t)(crc >> 8);
+  for (uint16_t z=0; z<PARAMSTORE_NUM_ITEMS; z++) len += PutRecord(buffer+len, PARAMSTORE_REC_ITEM, z, items[z]);
+  len += PutRecord(buffer+len, PARAMSTORE_REC_COMMIT, 0, 0);
+
+  noInterrupts();
+  rp2040.idleOtherCore();
+  flash_range_erase(baseOffset + (uint32_t)sector * PARAMSTORE_SECTOR_SIZE, PARAMSTORE_SECTOR_SIZE);
+  rp2040.resumeOtherCore();
+  interrupts();
+
+  activeSector = sector;
+  lastSeq = seq;
+  writePos = PARAMSTORE_SECTOR_SIZE; // unusable until the snapshot is written
+  isStoredValid = 0;
+  if (WriteBytes(sector, 0, buffer, len)) return ERR_Parameter;
+  writePos = len;
+  memcpy(stored, items, sizeof(stored));
+  isStoredValid = 1;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Program bytes into a sector
+// ----------------------------
+
+int8_t ParamStore::WriteBytes(int8_t sector, uint16_t pos, const uint8_t *data, uint16_t len)
+{
+  static uint8_t page[PARAMSTORE_PAGE_SIZE];
+  uint32_t sectorOffset = (uint32_t)sector * PARAMSTORE_SECTOR_SIZE;
+  uint16_t pageStart = pos - (pos % PARAMSTORE_PAGE_SIZE);
+
+  if ((uint32_t)pos + len > PARAMSTORE_SECTOR_SIZE) return ERR_Parameter;
+
+  // the log only ever programs erased bytes (0xFF), so the old content of a page can be rewritten as is
+  for (; pageStart < pos + len; pageStart += PARAMSTORE_PAGE_SIZE) {
+    memcpy(page, baseAddr + sectorOffset + pageStart, PARAMSTORE_PAGE_SIZE);
+    for (uint16_t z=0; z<PARAMSTORE_PAGE_SIZE; z++) {
+      uint16_t src = pageStart + z;
+      if (src >= pos && src < pos + len) page[z] = data[src - pos];
+    }
+    noInterrupts();
+    rp2040.idleOtherCore();
+    flash_range_program(baseOffset + sectorOffset + pageStart, page, PARAMSTORE_PAGE_SIZE);
+    rp2040.resumeOtherCore();
+    interrupts();
+  }
+
+  // read back to catch worn out or protected flash
+  if (memcmp(baseAddr + sectorOffset + pos, data, len) != 0) return ERR_Parameter;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Serialize a record
+// ----------------------------
+
+uint16_t ParamStore::PutRecord(uint8_t *buffer, uint8_t type, uint16_t item, int32_t value)
+{
+  uint16_t crc;
+
+  buffer[0] = type;
+  buffer[1] = (uint8_t)(item & 0xFF);
+  buffer[2] = (uint8_t)(item >> 8);
+  PutU32(buffer+3, (uint32_t)value);
+  crc = Crc16(buffer, PARAMSTORE_RECORD_SIZE-2);
+  buffer[7] = (uint8_t)(crc & 0xFF);
+  buffer[8] = (uint8_t)(crc >> 8);
+  return PARAMSTORE_RECORD_SIZE;
+}
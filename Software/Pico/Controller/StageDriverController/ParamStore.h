@@ -0,0 +1,114 @@
+#ifndef PARAMSTORE_H
+#define PARAMSTORE_H
+
+#include <Arduino.h>
+#include "Common.h"
+
+
+// *************************************************************************************
+// defines
+// *************************************************************************************
+#define PARAMSTORE_ITEMS_PER_BOARD  (3 + MOTORS_NUM_PARAMS + REMOTE_NUM_PARAMS) // device type, CS pin, axis type, motor and remote params
+#define PARAMSTORE_NUM_ITEMS        (MAXNUMMOTORS * PARAMSTORE_ITEMS_PER_BOARD)
+#define PARAMSTORE_SECTOR_SIZE      4096 // flash sector (erase unit)
+#define PARAMSTORE_PAGE_SIZE        256 // flash page (program unit)
+#define PARAMSTORE_HEADER_SIZE      16 // magic, sequence, version, number of items, CRC, padding
+#define PARAMSTORE_RECORD_SIZE      9 // type, item, value, CRC
+
+
+// *************************************************************************************
+// ParamStore class
+// *************************************************************************************
+
+/**
+ * @class ParamStore
+ * @brief Log-structured, wear-leveled storage of the parameter set in flash.
+ *
+ * The parameters are handled as a flat list of PARAMSTORE_NUM_ITEMS int32 items (see
+ * Parameters::PackItems). A save appends one record for each item that changed since the last
+ * save, followed by a commit record. Each record carries a CRC16, a load replays the records of the
+ * newest sector up to the last commit, so a save interrupted by a power loss only drops that save.
+ *
+ * When the active sector is full, the next sector (round robin over PARAMS_STORE_SECTORS) is
+ * erased and starts with a header holding an increasing sequence number and a full snapshot.
+ * The previous sectors are left intact until they are reused, they are the fallback if the
+ * snapshot didn't complete. The sectors are the filesystem region of the flash
+ * (board_build.filesystem_size in platformio.ini), which this firmware doesn't use otherwise.
+ */
+class ParamStore
+{
+private:
+  uint32_t baseOffset; // flash offset of the first sector
+  const uint8_t *baseAddr; // XIP address of the first sector (for reading)
+  int8_t numSectors; // usable sectors, 0 -> no store available
+  int8_t activeSector; // sector that receives the next records, -1 -> none yet
+  uint32_t lastSeq; // highest sequence number found in flash
+  uint16_t writePos; // next free byte in the active sector
+  int32_t stored[PARAMSTORE_NUM_ITEMS]; // item values as stored in flash (after the last load or save)
+  int8_t isStoredValid; // 1 -> stored[] holds the flash content
+
+  /**
+   * @brief Replays the records of a sector.
+   *
+   * @param sector Index of the sector.
+   * @param items Receives the item values up to the last commit record.
+   * @param endPos Receives the end of the valid records (PARAMSTORE_SECTOR_SIZE if the rest can't be written).
+   * @return int8_t 1 if at least one commit was found, 0 otherwise.
+   */
+  int8_t ReplaySector(int8_t sector, int32_t *items, uint16_t &endPos);
+
+  /**
+   * @brief Erases the next sector and writes the header and a full snapshot of the items.
+   */
+  int8_t StartSector(const int32_t *items);
+
+  /**
+   * @brief Programs bytes into the erased part of a sector (read-modify-write of the pages).
+   */
+  int8_t WriteBytes(int8_t sector, uint16_t pos, const uint8_t *data, uint16_t len);
+
+  /**
+   * @brief Serializes one record into the buffer.
+   */
+  static uint16_t PutRecord(uint8_t *buffer, uint8_t type, uint16_t item, int32_t value);
+
+public:
+  /**
+   * @brief Default constructor for the ParamStore class.
+   */
+  ParamStore();
+
+  /**
+   * @brief Locates the flash region and the sectors.
+   */
+  void Init(void);
+
+  /**
+   * @brief Checks whether the flash region is large enough for the store.
+   * @return int8_t 1 if available, 0 otherwise (the caller uses the legacy EEPROM layout).
+   */
+  int8_t IsAvailable(void) { return numSectors > 0; }
+
+  /**
+   * @brief Loads the latest committed parameter set.
+   *
+   * @param items Receives PARAMSTORE_NUM_ITEMS values.
+   * @return int8_t ERR_None on success, ERR_Parameter if no valid set is stored.
+   */
+  int8_t Load(int32_t *items);
+
+  /**
+   * @brief Appends the changed items (or a snapshot into the next sector when the active one is full).
+   *
+   * @param items PARAMSTORE_NUM_ITEMS values.
+   * @return int8_t ERR_None on success, ERR_Parameter on a flash error.
+   */
+  int8_t Save(const int32_t *items);
+
+  /**
+   * @brief Gets the number of free bytes in the active sector.
+   */
+  int32_t GetFreeBytes(void) { return (activeSector < 0) ? 0 : PARAMSTORE_SECTOR_SIZE - writePos; }
+};
+
+#endif // PARAMSTORE_H
@@ -18,7 +18,10 @@
 // Constructor
 // ----------------------------
 
-Parameters::Parameters(void) {}
+Parameters::Parameters(void) 
+{
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) dirtyGroups[z] = PARAMS_GROUP_ALL;
+}
 
 
 // ----------------------------
@@ -38,6 +41,7 @@ int8_t Parameters::Init(Motors *motorPtr, RemoteComm *remotePtr)
   motors = motorPtr;
   remote = remotePtr;
   EEPROM.begin(PRARAMETERS_FLASH_SIZE);
+  store.Init();
   return 0;
 }
 
@@ -49,26 +53,32 @@ int8_t Parameters::Init(Motors *motorPtr, RemoteComm *remotePtr)
 int8_t Parameters::Config(ConfigType confType)
 {
   int8_t err;
-  int address = 0;
-  int version;
 
+  if (err=BeginConfig(confType)) return err;
+  while (IsConfiguring()) {
+    if (err=ConfigNextBoard()) return err;
+  }
+  return ERR_None; 
+}
+
+
+// ----------------------------
+// Set default/saved parameters, the boards follow with ConfigNextBoard
+// ----------------------------
+
+int8_t Parameters::BeginConfig(ConfigType confType)
+{
+  int8_t err;
+  static int32_t items[PARAMSTORE_NUM_ITEMS];
+
+  configBoard = -1;
   if (confType==CONFIG_LOAD_FROM_FLASH) {
-    // load the version number first and make sure it matches
-    EEPROM.get(address, version);
-    if (version==VERSION) {
-      // load the rest of the parameters from flash
-      address += sizeof(version);
-      EEPROM.get(address, hwParameters);
-      address += sizeof(hwParameters);
-      EEPROM.get(address, motorParamArr);
-      address += sizeof(motorParamArr);
-      EEPROM.get(address, remoteParamArr);
-    } else {
-      // version doesn't match
-      for (int mot=0; mot<MAXNUMMOTORS; mot++) 
-        hwParameters.motorType[mot] = MOTOR_NONE;
-      SetErrorMsg("Version mismatch in flash");
-      return ERR_Parameter;
+    // the parameter log first, the old layout only until the first save with this firmware
+    if (store.Load(items)==ERR_None) {
+      UnpackItems(items);
+    } else if (err=LoadLegacyConfig()) {
+      if (!bootTime_ms) bootTime_ms = millis(); // nothing left to configure
+      return err;
     }
   } else if (confType==CONFIG_DEFAULT) {
     for (int mot=0; mot<MAXNUMMOTORS; mot++) {
@@ -80,9 +90,38 @@ int8_t Parameters::Config(ConfigType confType)
     }
   }
 
-  if (motors->ConfigBoard(-1)) { // configure all boards
-    SetErrorMsg("Could not configure motors");
-    return ERR_Parameter;
+  SetDirtyGroups(-1, PARAMS_GROUP_ALL, 1); // the parameter sets were replaced as a whole
+  if (confType!=CONFIG_RECONFIG) changeCount++;
+  configBoard = 0;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Configure the next board of the config in progress
+// ----------------------------
+
+int8_t Parameters::ConfigNextBoard(void)
+{
+  int8_t board = configBoard;
+
+  if (board < 0) return ERR_None; // no config in progress
+  if (board < MAXNUMMOTORS) {
+    configBoard++;
+    if (!IsActiveMotor(board)) return ERR_None; // silently skip if not defined
+    if (motors->ConfigBoard(board)) {
+      configBoard = -1;
+      if (!bootTime_ms) bootTime_ms = millis();
+      SetErrorMsg("Could not configure motors");
+      return ERR_Parameter;
+    }
+    return ERR_None;
+  }
+
+  configBoard = -1; // all boards done, the remote is the last step
+  if (!bootTime_ms) {
+    bootTime_ms = millis();
+    D_print("Boot config completed after [ms] "); D_println(bootTime_ms);
   }
 #if REMOTE_ENABLED
   if (remote->Config(-1)) { // configure all remotes
@@ -90,7 +129,7 @@ int8_t Parameters::Config(ConfigType confType)
     return ERR_Parameter;
   }
 #endif // REMOTE_ENABLED
-  return ERR_None; 
+  return ERR_None;
 }
 
 
@@ -100,9 +139,20 @@ int8_t Parameters::Config(ConfigType confType)
 
 int8_t Parameters::SaveConfigToFlash(void)
 {
+  static int32_t items[PARAMSTORE_NUM_ITEMS];
   int address = 0;
   int version = VERSION;
 
+  if (store.IsAvailable()) {
+    PackItems(items);
+    if (store.Save(items)) {
+      SetErrorMsg("Could not save config to flash");
+      return ERR_Parameter;
+    }
+    return ERR_None;
+  }
+
+  // no flash region for the log: full rewrite of the EEPROM page
   EEPROM.put(address, version);
   address += sizeof(version);
   EEPROM.put(address, hwParameters);
@@ -118,6 +168,70 @@ int8_t Parameters::SaveConfigToFlash(void)
 }
 
 
+// ----------------------------
+// Load the configuration from the legacy EEPROM layout
+// ----------------------------
+
+int8_t Parameters::LoadLegacyConfig(void)
+{
+  int address = 0;
+  int version;
+
+  // load the version number first and make sure it matches
+  EEPROM.get(address, version);
+  if (version==VERSION) {
+    // load the rest of the parameters from flash
+    address += sizeof(version);
+    EEPROM.get(address, hwParameters);
+    address += sizeof(hwParameters);
+    EEPROM.get(address, motorParamArr);
+    address += sizeof(motorParamArr);
+    EEPROM.get(address, remoteParamArr);
+  } else {
+    // version doesn't match
+    for (int mot=0; mot<MAXNUMMOTORS; mot++) 
+      hwParameters.motorType[mot] = MOTOR_NONE;
+    SetErrorMsg("Version mismatch in flash");
+    return ERR_Parameter;
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Pack the parameters into the flat item list of the store
+// ----------------------------
+
+void Parameters::PackItems(int32_t *items)
+{
+  for (int8_t b=0; b<MAXNUMMOTORS; b++) {
+    int32_t *boardItems = items + b*PARAMSTORE_ITEMS_PER_BOARD;
+    boardItems[0] = hwParameters.motorType[b];
+    boardItems[1] = hwParameters.DRIVER_CS[b];
+    boardItems[2] = hwParameters.axisType[b];
+    memcpy(boardItems+3, motorParamArr[b], sizeof(motorParamArr[b]));
+    memcpy(boardItems+3+MOTORS_NUM_PARAMS, remoteParamArr[b], sizeof(remoteParamArr[b]));
+  }
+}
+
+
+// ----------------------------
+// Unpack the flat item list of the store into the parameters
+// ----------------------------
+
+void Parameters::UnpackItems(const int32_t *items)
+{
+  for (int8_t b=0; b<MAXNUMMOTORS; b++) {
+    const int32_t *boardItems = items + b*PARAMSTORE_ITEMS_PER_BOARD;
+    hwParameters.motorType[b] = (MotorType)boardItems[0];
+    hwParameters.DRIVER_CS[b] = (int8_t)boardItems[1];
+    hwParameters.axisType[b] = (AxisType)boardItems[2];
+    memcpy(motorParamArr[b], boardItems+3, sizeof(motorParamArr[b]));
+    memcpy(remoteParamArr[b], boardItems+3+MOTORS_NUM_PARAMS, sizeof(remoteParamArr[b]));
+  }
+}
+
+
 // ----------------------------
 // Set the type of device (TMC, SIM, or None)
 // ----------------------------
@@ -131,6 +245,7 @@ int8_t Parameters::SetDeviceType(int8_t board, int32_t value)
     case 2: hwParameters.motorType[board] = MOTOR_TMC; break;
     default: SetErrorMsg("Invalid device type (0..2)"); return ERR_Parameter;
   }
+  SetDirtyGroups(board, PARAMS_GROUP_ALL, 1); // a new device needs the full config
   return ERR_None;
 }
 
@@ -220,6 +335,10 @@ int8_t Parameters::IsActiveMotor(int8_t board, int8_t raiseError)
 int8_t Parameters::SetMotorParams(int8_t board, int8_t index, int32_t value)
 {
   if(!IsValidMotor(board)) return ERR_Parameter;
+  if (motorParamArr[board][index] != value) {
+    dirtyGroups[board] |= GetParamGroup(index);
+    changeCount++;
+  }
   motorParamArr[board][index] = value;
   return ERR_None;
 }
@@ -237,6 +356,50 @@ int8_t Parameters::GetMotorParams(int8_t board, int8_t index, int32_t &value)
 }
 
 
+// ----------------------------
+// Get the parameter group from the first letter of the ID
+// ----------------------------
+
+uint8_t Parameters::GetParamGroup(int8_t index)
+{
+  switch (motParamsIDList[index][0]) {
+    case 'C': return PARAMS_GROUP_CURRENT;
+    case 'M': return PARAMS_GROUP_MODE;
+    case 'H': return PARAMS_GROUP_HOMING;
+    case 'R': return PARAMS_GROUP_RATE;
+    case 'E': return PARAMS_GROUP_ENCODER;
+    case 'S': return PARAMS_GROUP_SWITCH;
+    case 'L': return PARAMS_GROUP_LIMITS;
+    default:  return 0;
+  }
+}
+
+
+// ----------------------------
+// Get the parameter groups changed since the last config
+// ----------------------------
+
+uint8_t Parameters::GetDirtyGroups(int8_t board)
+{
+  if(!IsValidMotor(board)) return 0;
+  return dirtyGroups[board];
+}
+
+
+// ----------------------------
+// Mark parameter groups as changed or applied
+// ----------------------------
+
+void Parameters::SetDirtyGroups(int8_t board, uint8_t groups, int8_t dirty)
+{
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (board != -1 && board != z) continue;
+    if (dirty) dirtyGroups[z] |= groups;
+    else dirtyGroups[z] &= ~groups;
+  }
+}
+
+
 // ----------------------------
 // Set the remote parameter for the board
 //  Note: no parameter error checking here
@@ -246,10 +409,13 @@ int8_t Parameters::SetRemoteParams(int8_t board, int8_t index, int32_t value)
 {
   // enable is the only command that allows for a -1 for the board
   if (strncmp(remoteIDList[index], "ENAB", 4)==0 && board==-1) {
-    for (int z=0; z<MAXNUMMOTORS; z++)
+    for (int z=0; z<MAXNUMMOTORS; z++) {
+      if (remoteParamArr[z][index] != value) changeCount++;
       remoteParamArr[z][index] = value;
+    }
   } else {
     if(!IsValidMotor(board)) return ERR_Parameter;
+    if (remoteParamArr[board][index] != value) changeCount++;
     remoteParamArr[board][index] = value;
   }
   return ERR_None;
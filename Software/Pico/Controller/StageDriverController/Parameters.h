@@ -6,6 +6,7 @@
 
 #include "Motors.h"
 #include "RemoteComm.h"
+#include "ParamStore.h"
 
 
 // *************************************************************************************
@@ -52,7 +53,27 @@ class Parameters
 private:
   char errorMsg[MAXERRORSTRINGSIZE]; // error message buffer for storing parameter-related errors
   Motors *motors; // pointer to the Motors class instance, which manages multiple motors
+  uint8_t dirtyGroups[MAXNUMMOTORS]; // parameter groups changed since the last config of each board
   RemoteComm *remote; // pointer to the RemoteComm class instance, which handles remote communication
+  ParamStore store; // log-structured flash storage of the parameters
+  int8_t configBoard = -1; // next board of a config in progress (MAXNUMMOTORS -> remote), -1 -> none
+  uint32_t bootTime_ms = 0; // millis() when the boot config completed, 0 -> still configuring
+  uint32_t changeCount = 0; // number of motor and remote parameter value changes (GPC_PCNT)
+
+  /**
+   * @brief Copies the hardware, motor and remote parameters into a flat item list (see ParamStore).
+   */
+  void PackItems(int32_t *items);
+
+  /**
+   * @brief Copies a flat item list back into the hardware, motor and remote parameters.
+   */
+  void UnpackItems(const int32_t *items);
+
+  /**
+   * @brief Loads the parameters from the legacy EEPROM layout (firmware before the parameter log).
+   */
+  int8_t LoadLegacyConfig(void);
 
 public:
 
@@ -154,10 +175,49 @@ public:
    */
   int8_t Config(ConfigType confType);
 
+  /**
+   * @brief Starts a configuration that is applied one board at a time (see ConfigNextBoard).
+   * 
+   * The parameter sets are loaded like in Config(), but the boards are only configured by the
+   * following ConfigNextBoard() calls, so the caller can keep serving the host in between. This is
+   * used during the boot, Config() runs the same steps back to back.
+   * 
+   * @param confType The type of configuration to apply (CONFIG_DEFAULT, CONFIG_RECONFIG, CONFIG_LOAD_FROM_FLASH).
+   * @return int8_t Returns 0 on success, or a negative error code on failure (no config in progress then).
+   */
+  int8_t BeginConfig(ConfigType confType);
+
+  /**
+   * @brief Configures the next board of the config started with BeginConfig(), the remote after the last board.
+   * 
+   * @return int8_t Returns 0 on success, or a negative error code on failure (which ends the config).
+   */
+  int8_t ConfigNextBoard(void);
+
+  /**
+   * @brief Checks whether a config started with BeginConfig() is still in progress.
+   */
+  int8_t IsConfiguring(void) { return configBoard >= 0; }
+
+  /**
+   * @brief Gets the time from the power up until the boot config completed.
+   * @return uint32_t Time in ms, 0 while the boot config is still in progress.
+   */
+  uint32_t GetBootTime(void) { return bootTime_ms; }
+
+  /**
+   * @brief Gets the number of motor and remote parameter value changes since the power up.
+   *
+   * Each set that changes a value counts once per value, loading a parameter set (defaults or
+   * flash) counts once. Hosts compare it to detect changes made by others (e.g. the remote).
+   */
+  uint32_t GetChangeCount(void) { return changeCount; }
+
   /**
    * @brief Saves the current configuration to flash memory.
    * 
    * This method persists the current motor and remote parameters to flash memory for later retrieval.
+   * Only the parameters that changed since the last save are appended to the parameter log (see ParamStore).
    * 
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
@@ -247,6 +307,33 @@ public:
    */
   int8_t GetMotorParams(int8_t board, int8_t index, int32_t &value);
 
+  /**
+   * @brief Gets the parameter group of a motor parameter.
+   * 
+   * The groups follow the first letter of the parameter ID (CSCA -> PARAMS_GROUP_CURRENT, etc.).
+   * 
+   * @param index The index of motParamsIDList[index] of the parameter.
+   * @return uint8_t The group bit (PARAMS_GROUP_xxx), or 0 for an unknown ID.
+   */
+  static uint8_t GetParamGroup(int8_t index);
+
+  /**
+   * @brief Gets the parameter groups that were changed since the last successful config of the board.
+   * 
+   * @param board The index of the motor board to query (0 to MAXNUMMOTORS-1).
+   * @return uint8_t Bit mask of the changed groups (PARAMS_GROUP_xxx).
+   */
+  uint8_t GetDirtyGroups(int8_t board);
+
+  /**
+   * @brief Marks parameter groups as changed (or applied) for a board.
+   * 
+   * @param board The index of the motor board (0 to MAXNUMMOTORS-1), or -1 for all boards.
+   * @param groups Bit mask of the groups (PARAMS_GROUP_xxx).
+   * @param dirty 1 to mark the groups as changed, 0 to mark them as applied.
+   */
+  void SetDirtyGroups(int8_t board, uint8_t groups, int8_t dirty);
+
   /**
    * @brief Sets a remote parameter for a specific board.
    * 
@@ -0,0 +1,26 @@
+#include <Arduino.h>
+#include "Common.h"
+
+#include "Perf.h"
+
+
+// *************************************************************************************
+// Performance counters
+// *************************************************************************************
+
+volatile uint32_t g_perf[PERF_NUM_ITEMS] = {0};
+volatile int8_t g_perfEnabled = PERF_ENABLED;
+uint32_t g_perfLoopTime = 0;
+
+
+// ----------------------------
+// Clear the counters
+// ----------------------------
+
+void PerfReset(int8_t enable)
+{
+  g_perfEnabled = 0; // stop counting while clearing (the other core may still finish an update)
+  for (uint8_t z=0; z<PERF_NUM_ITEMS; z++) g_perf[z] = 0;
+  g_perfLoopTime = 0;
+  g_perfEnabled = (PERF_ENABLED && enable) ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <Arduino.h>
+#include "Common.h"
+
+
+// *************************************************************************************
+// Performance counters
+// *************************************************************************************
+
+/**
+ * @enum PerfItem
+ * @brief Index of the performance counters, as read with GPC_PERF,<item>.
+ *
+ * Timed items always come as a triple (count, total time, max time), so PerfAddTime() can
+ * update all three from the index of the count. Times are in us. The loop period histogram
+ * uses power-of-two bins: bin n counts periods of 2^(n-1) .. 2^n-1 us (bin 0: <1 us), the last
+ * bin also collects everything above.
+ */
+typedef enum {
+  PERF_LOOP_COUNT = 0,       // main loop (core 0) iterations
+  PERF_LOOP_TOTAL_US,
+  PERF_LOOP_MAX_US,
+  PERF_CMD_COUNT,            // host commands (ASCII lines and binary frames)
+  PERF_CMD_TOTAL_US,
+  PERF_CMD_MAX_US,
+  PERF_SPI_COUNT,            // SPI datagrams to the drivers
+  PERF_SPI_TOTAL_US,
+  PERF_SPI_MAX_US,
+  PERF_UPDATE_COUNT,         // Motors::ProcessUpdateChanges calls
+  PERF_UPDATE_TOTAL_US,
+  PERF_UPDATE_MAX_US,
+  PERF_UART_RX_BYTES,        // bytes received from the remote (without the message terminators)
+  PERF_UART_TX_BYTES,        // bytes sent to the remote
+  PERF_UART_CHECKSUM_ERRORS, // remote messages dropped due to a wrong checksum
+  PERF_LOOP_HIST,            // first bin of the loop period histogram
+  PERF_NUM_ITEMS = PERF_LOOP_HIST + PERF_LOOP_HIST_BINS
+} PerfItem;
+
+extern volatile uint32_t g_perf[PERF_NUM_ITEMS]; // counters, each one is only written by one core
+extern volatile int8_t g_perfEnabled; // runtime switch (SPC_PERF), checked before any timing
+extern uint32_t g_perfLoopTime; // micros() at the start of the current loop iteration, 0 -> not started
+
+
+/**
+ * @brief Adds the time since the start to a timed item (count, total, max).
+ *
+ * @param item Index of the count of the timed item.
+ * @param start micros() at the start of the measurement.
+ */
+inline void PerfAddTime(uint8_t item, uint32_t start)
+{
+  uint32_t dt = micros() - start;
+
+  g_perf[item]++;
+  g_perf[item+1] += dt;
+  if (dt > g_perf[item+2]) g_perf[item+2] = dt;
+}
+
+/**
+ * @brief Records one main loop period in the timed item and the histogram.
+ */
+inline void PerfLoop(void)
+{
+  uint32_t currentTime = micros();
+  uint32_t dt = currentTime - g_perfLoopTime;
+  uint8_t bin;
+
+  if (g_perfLoopTime != 0) {
+    bin = (dt == 0 ? 0 : 32 - __builtin_clz(dt));
+    if (bin >= PERF_LOOP_HIST_BINS) bin = PERF_LOOP_HIST_BINS-1;
+    g_perf[PERF_LOOP_HIST + bin]++;
+    PerfAddTime(PERF_LOOP_COUNT, g_perfLoopTime);
+  }
+  g_perfLoopTime = currentTime;
+}
+
+/**
+ * @brief Clears all counters and switches them on or off.
+ *
+ * @param enable 1 to count, 0 to stop counting.
+ */
+void PerfReset(int8_t enable);
+
+// The macros compile to nothing with PERF_ENABLED 0, otherwise they cost a load and a branch
+// while the counters are switched off at runtime.
+#if PERF_ENABLED
+
+#define PERF_START(var)           uint32_t var = (g_perfEnabled ? micros() : 0)
+#define PERF_STOP(item, var)      do { if (g_perfEnabled && var) PerfAddTime(item, var); } while (0)
+#define PERF_COUNT(item, n)       do { if (g_perfEnabled) g_perf[item] += (n); } while (0)
+#define PERF_LOOP()               do { if (g_perfEnabled) PerfLoop(); } while (0)
+
+#else
+
+#define PERF_START(var)
+#define PERF_STOP(item, var)
+#define PERF_COUNT(item, n)
+#define PERF_LOOP()
+
+#endif // PERF_ENABLED
+
+#endif // PERF_H
@@ -2,6 +2,7 @@
 #include "Common.h"
 
 #include "RemoteComm.h"
+#include "Perf.h"
 
 #define SERIAL_DEBUG  0
 #include "Serial_Debug.h"
@@ -91,7 +92,7 @@ int8_t RemoteComm::Config(int8_t mot)
 
 void RemoteComm::SendPositionUpdates(void)
 {
-  int32_t pos;
+  int32_t pos, delta;
   char cmdData[MSG_MAXLENGTH+1]; // one extra for the null char
   char uartData[MSG_MAXLENGTH+1];
   size_t len = 0;
@@ -101,13 +102,26 @@ void RemoteComm::SendPositionUpdates(void)
 
 
   if (currentTime - lastSendTime > REMOTE_SEND_INTERVAL_MS) {
-    D_println("Updating positions");
+    lastSendTime = currentTime;
+    if (!isRemoteReady) return; // nobody listening yet
 
     cmdData[0]='\0';
     for (int8_t idx=0; idx<MAXNUMMOTORS; idx++) {
       if (!params->IsActiveMotor(idx)) continue; // silently skip if not defined
-      motors->GetPos(idx, pos);
-      len += snprintf(cmdData + len, sizeof(cmdData) - len, "POS%hhi=%i;", idx, pos);
+      if (motors->GetPos(idx, pos)) continue;
+      delta = pos - sentPos[idx];
+      // idle, but a chain of deltas ends with one absolute update once the axis rests
+      if (isSentPosValid[idx] && delta == 0 && (sentPosCount[idx] == 0 || currentTime - sentPosTime[idx] < REMOTE_POS_REST_MS)) continue;
+      if (isSentPosValid[idx] && abs(delta) < REMOTE_POS_THRESHOLD && currentTime - sentPosTime[idx] < REMOTE_POS_REST_MS) continue;
+      if (!isSentPosValid[idx] || abs(delta) < REMOTE_POS_THRESHOLD || ++sentPosCount[idx] >= REMOTE_POS_KEYFRAME_COUNT) {
+        len += snprintf(cmdData + len, sizeof(cmdData) - len, "POS%hhi=%i;", idx, pos); // absolute
+        sentPosCount[idx] = 0;
+        isSentPosValid[idx] = 1;
+      } else {
+        len += snprintf(cmdData + len, sizeof(cmdData) - len, "DP%hhi=%i;", idx, delta);
+      }
+      sentPos[idx] = pos;
+      sentPosTime[idx] = currentTime;
     }
     if (len>0)
       *(cmdData+len-1) = '\0'; // overwrite the last ';'
@@ -117,8 +131,39 @@ void RemoteComm::SendPositionUpdates(void)
     snprintf (uartData, sizeof(uartData), "<%s|%hhu>", cmdData, checksum);
     D_println(uartData);
     safeSerial1Write(uartData, strlen(uartData));
+  }
+}
 
-    lastSendTime = currentTime;
+
+// ----------------------------
+// Ping the remote until it answered
+// ----------------------------
+
+void RemoteComm::CheckHandshake(void)
+{
+  unsigned long currentTime = millis();
+
+  if (isRemoteReady) {
+#if REMOTE_LINK_PING_INTERVAL_MS > 0
+    if (currentTime - lastLinkPingTime > REMOTE_LINK_PING_INTERVAL_MS) {
+      char cmdData[24];
+      snprintf(cmdData, sizeof(cmdData), "LPNG=%u", (unsigned int)micros());
+      transmitRemoteCommand(cmdData);
+      linkStats[LINK_PING_COUNT]++;
+      lastLinkPingTime = currentTime;
+    }
+#endif // REMOTE_LINK_PING_INTERVAL_MS
+    return;
+  }
+  if (currentTime > REMOTE_HANDSHAKE_TIMEOUT_MS) { // no answer, assume a remote without the handshake
+    D_println("No remote handshake, sending the parameters anyway");
+    isRemoteReady = 1;
+    if (!params->IsConfiguring()) Config(-1); // otherwise the end of the config sends them
+    return;
+  }
+  if (currentTime - lastPingTime > REMOTE_HANDSHAKE_INTERVAL_MS) {
+    transmitRemoteCommand("PING");
+    lastPingTime = currentTime;
   }
 }
 
@@ -130,24 +175,8 @@ void RemoteComm::SendPositionUpdates(void)
 int8_t RemoteComm::SendRemoteCommand(const char *cmd, int8_t channel, int32_t value)
 {
   char cmdData[MSG_MAXLENGTH+1]; // one extra for the null char
-  int32_t intValue;
 
-  // Check for validity of parameters
-  if (strncmp(cmd, "ENAB", 4)  == 0) { // allow for axis=-1 for the ENAB command
-    if (!IsValueInRange(channel, "channel", -1, MAXNUMMOTORS)) return ERR_Remote;
-  } else {
-    if (!IsValueInRange(channel, "channel", 0, MAXNUMMOTORS-1)) return ERR_Remote;
-  }
-  if (strncmp(cmd, "ENAB", 4)  == 0) {
-     if (!IsValueInRange(value, cmd, 0, 1)) return ERR_Remote;
-  } else if (strncmp(cmd, "JDIR", 4)  == 0) { 
-     if (!IsValueInRange(abs(value), cmd, 1, 1)) return ERR_Remote;
-  } else if (strncmp(cmd, "JMAX", 4)  == 0) {
-    FindParamVal(channel, "RMXV", intValue);
-    if (!IsValueInRange(value, cmd, 0, intValue)) return ERR_Remote;
-  } else if (strncmp(cmd, "EDIR", 4)  == 0) {
-    if (!IsValueInRange(abs(value), cmd, 1, 1))return ERR_Remote;
-  }  
+  if (int8_t err=CheckRemoteCommand(cmd, channel, value)) return err;
     
    // ENAB is the only command that needs to send info to the motor section and allows -1 for the channel
   if (strncmp(cmd, "ENAB", 4)  == 0) {
@@ -173,6 +202,34 @@ int8_t RemoteComm::SendRemoteCommand(const char *cmd, int8_t channel, int32_t va
 }
 
 
+// ----------------------------
+// Check a command for the remote without sending it
+// ----------------------------
+
+int8_t RemoteComm::CheckRemoteCommand(const char *cmd, int8_t channel, int32_t value, const int32_t *motorParams)
+{
+  int32_t intValue;
+
+  // Check for validity of parameters
+  if (strncmp(cmd, "ENAB", 4)  == 0) { // allow for axis=-1 for the ENAB command
+    if (!IsValueInRange(channel, "channel", -1, MAXNUMMOTORS)) return ERR_Remote;
+  } else {
+    if (!IsValueInRange(channel, "channel", 0, MAXNUMMOTORS-1)) return ERR_Remote;
+  }
+  if (strncmp(cmd, "ENAB", 4)  == 0) {
+     if (!IsValueInRange(value, cmd, 0, 1)) return ERR_Remote;
+  } else if (strncmp(cmd, "JDIR", 4)  == 0) { 
+     if (!IsValueInRange(abs(value), cmd, 1, 1)) return ERR_Remote;
+  } else if (strncmp(cmd, "JMAX", 4)  == 0) {
+    if (FindParamVal(channel, "RMXV", intValue, motorParams)) return ERR_Remote;
+    if (!IsValueInRange(value, cmd, 0, intValue)) return ERR_Remote;
+  } else if (strncmp(cmd, "EDIR", 4)  == 0) {
+    if (!IsValueInRange(abs(value), cmd, 1, 1))return ERR_Remote;
+  }  
+  return ERR_None;
+}
+
+
 // ----------------------------
 // Send the formatted command
 // ----------------------------
@@ -204,20 +261,27 @@ void RemoteComm::CheckRemoteCommands(void)
 
   if (currentTime - lastReceiveTime > REMOTE_RECEIVE_INTERVAL_MS) {
 
-    if (Serial1.available() > 0){
+    // drain all frames that arrived since the last check (the remote sends as soon as the inputs change)
+    while (Serial1.available() > 0){
       // max allowed command size is MSG_MAXLENGTH char, ends with a term char
       int bytesRead = Serial1.readBytesUntil('>', uartData, MSG_MAXLENGTH);
+      PERF_COUNT(PERF_UART_RX_BYTES, bytesRead);
+      linkStats[LINK_RX_BYTES] += bytesRead;
+      linkStats[LINK_RX_FRAMES]++;
       // check for at least some bytes
       if (bytesRead<3) {
         D_println("Invalid UART command string");
+        linkStats[LINK_RX_PARSE_ERRORS]++;
         SetErrorMsg("Invalid UART command string");
-        return;
+        break;
       }
       // terminate with an end character
       uartData[bytesRead]='\0';
       if (validateChecksum(uartData)) {
         D_println("Checksum error");
-        return;
+        PERF_COUNT(PERF_UART_CHECKSUM_ERRORS, 1);
+        linkStats[LINK_RX_CHECKSUM_ERRORS]++;
+        continue;
       }
 
       if (strchr(uartData+1, ';') == NULL) { // single command
@@ -231,7 +295,7 @@ void RemoteComm::CheckRemoteCommands(void)
           token = strtok_r(NULL, ";", &savePtr);
         }
       }
-    } // if (Serial1.available() > 0) 
+    } // while (Serial1.available() > 0) 
     lastReceiveTime = currentTime;
   }
 }
@@ -253,6 +317,7 @@ void RemoteComm::processRemoteCommand(const char *cmd)
   // check for SetMotorPosition command
   if (strncmp(cmd, "POS", 3)  == 0){
     if (sscanf(cmd, "POS%hhi=%d", &board, &intVal)!=2) {
+      linkStats[LINK_RX_PARSE_ERRORS]++;
       SetErrorMsg("Invalid remote POS command format");
       return;
     }
@@ -274,6 +339,7 @@ void RemoteComm::processRemoteCommand(const char *cmd)
   // check for SetMotorVelocity command
   if (strncmp(cmd, "VEL", 3)  == 0){
     if (sscanf(cmd, "VEL%hhi=%d", &board, &intVal)!=2) {
+      linkStats[LINK_RX_PARSE_ERRORS]++;
       SetErrorMsg("Invalid remote VEL command format");
       return;
     }
@@ -286,10 +352,21 @@ void RemoteComm::processRemoteCommand(const char *cmd)
     return;
   }
 
+  /////////////////////
+  // check for Ready command (answer to the handshake ping, or the remote (re)booted)
+  if (strncmp(cmd, "RDY", 3)  == 0){
+    D_println("Remote ready");
+    isRemoteReady = 1;
+    for (int8_t z=0; z<MAXNUMMOTORS; z++) isSentPosValid[z] = 0; // the remote (re)booted, start over with absolute positions
+    if (!params->IsConfiguring() && Config(-1)) SetErrorMsg("Could not configure remote"); // otherwise the end of the config sends them
+    return;
+  }
+
   /////////////////////
   // check for AccessRequest command
   if (strncmp(cmd, "ACCREQ", 6)  == 0){
     if (sscanf(cmd, "ACCREQ%hhi", &board)!=1) {
+      linkStats[LINK_RX_PARSE_ERRORS]++;
       SetErrorMsg("Invalid remote ACCREQ command format");
       return;
     }
@@ -302,6 +379,67 @@ void RemoteComm::processRemoteCommand(const char *cmd)
     return;
   }
 
+  /////////////////////
+  // check for the answer to a timestamped ping
+  if (strncmp(cmd, "LPON", 4)  == 0){
+    ProcessLinkPong(cmd);
+    return;
+  }
+
+  linkStats[LINK_RX_PARSE_ERRORS]++; // unknown command
+}
+
+
+// ----------------------------
+// Evaluate the answer to a timestamped ping
+// ----------------------------
+
+void RemoteComm::ProcessLinkPong(const char *cmd)
+{
+  unsigned int sendTime;
+  unsigned int remoteStats[6]; // rx frames, rx bytes, checksum errors, parse errors, tx frames, access time
+  uint32_t rtt;
+
+  if (sscanf(cmd, "LPON=%u,%u,%u,%u,%u,%u,%u", &sendTime, &remoteStats[0], &remoteStats[1], &remoteStats[2],
+             &remoteStats[3], &remoteStats[4], &remoteStats[5]) != 7) {
+    linkStats[LINK_RX_PARSE_ERRORS]++;
+    return;
+  }
+  rtt = (uint32_t)micros() - (uint32_t)sendTime;
+  linkStats[LINK_PONG_COUNT]++;
+  linkStats[LINK_RTT_LAST_US] = rtt;
+  if (linkStats[LINK_RTT_MIN_US] == 0 || rtt < linkStats[LINK_RTT_MIN_US]) linkStats[LINK_RTT_MIN_US] = rtt;
+  if (rtt > linkStats[LINK_RTT_MAX_US]) linkStats[LINK_RTT_MAX_US] = rtt;
+  linkStats[LINK_RTT_TOTAL_US] += rtt;
+  for (int8_t z=0; z<6; z++) linkStats[LINK_REMOTE_RX_FRAMES + z] = remoteStats[z];
+}
+
+
+// ----------------------------
+// Get one of the link statistics
+// ----------------------------
+
+int8_t RemoteComm::GetLinkStat(int32_t item, int32_t &value)
+{
+  if (item < 0 || item >= LINK_NUM_ITEMS) {
+    SetErrorMsg("Link statistics item out of range");
+    return ERR_Remote;
+  }
+  value = (int32_t)linkStats[item];
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Clear the link statistics on both sides
+// ----------------------------
+
+void RemoteComm::ResetLinkStats(void)
+{
+  for (int8_t z=0; z<LINK_NUM_ITEMS; z++) linkStats[z] = 0;
+#if REMOTE_ENABLED
+  if (isRemoteReady) transmitRemoteCommand("LRST");
+#endif // REMOTE_ENABLED
 }
 
 
@@ -329,6 +467,9 @@ void RemoteComm::safeSerial1Write(const char* data, size_t len)
     }
 
     serial1Busy = false;
+    PERF_COUNT(PERF_UART_TX_BYTES, len);
+    linkStats[LINK_TX_FRAMES]++; // each write is one frame
+    linkStats[LINK_TX_BYTES] += len;
 }
 
 
@@ -404,13 +545,13 @@ uint8_t RemoteComm::calculateChecksum(const char *data)
 // Find the index of the parameter value
 // ----------------------------
 
-int8_t RemoteComm::FindParamVal(int8_t board, const char *name, int32_t &value)
+int8_t RemoteComm::FindParamVal(int8_t board, const char *name, int32_t &value, const int32_t *motorParams)
 {
   char errMsg[MSG_MAXLENGTH];
 
   for (int32_t idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
     if (strncmp(Parameters::motParamsIDList[idx], name, 4)  == 0) {
-      value = params->motorParamArr[board][idx];
+      value = (motorParams ? motorParams[idx] : params->motorParamArr[board][idx]);
       return ERR_None;
     }
   }
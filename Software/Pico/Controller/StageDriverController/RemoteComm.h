@@ -14,6 +14,41 @@ class Parameters;
 class Motors;
 
 
+// *************************************************************************************
+// Link statistics
+// *************************************************************************************
+
+/**
+ * @enum RemoteLinkItem
+ * @brief Index of the link statistics, as read with GPC_LINK,<item>.
+ *
+ * The controller counts its side of the link. Round-trip times come from the timestamped
+ * pings (every REMOTE_LINK_PING_INTERVAL_MS), the answer of the remote also carries its
+ * counters, so the LINK_REMOTE_* items are as of the last answer. Times are in us unless noted.
+ */
+typedef enum {
+  LINK_RX_FRAMES = 0,          // frames received from the remote
+  LINK_RX_BYTES,               // bytes received from the remote
+  LINK_RX_CHECKSUM_ERRORS,     // frames dropped due to a wrong checksum
+  LINK_RX_PARSE_ERRORS,        // frames or commands that couldn't be parsed
+  LINK_TX_FRAMES,              // frames sent to the remote
+  LINK_TX_BYTES,               // bytes sent to the remote
+  LINK_PING_COUNT,             // timestamped pings sent
+  LINK_PONG_COUNT,             // answers received
+  LINK_RTT_LAST_US,            // round-trip time of the last answer
+  LINK_RTT_MIN_US,             // min round-trip time (0 -> no answer yet)
+  LINK_RTT_MAX_US,             // max round-trip time
+  LINK_RTT_TOTAL_US,           // sum of the round-trip times (average = total / LINK_PONG_COUNT)
+  LINK_REMOTE_RX_FRAMES,       // frames the remote received
+  LINK_REMOTE_RX_BYTES,        // bytes the remote received
+  LINK_REMOTE_CHECKSUM_ERRORS, // frames the remote dropped due to a wrong checksum
+  LINK_REMOTE_PARSE_ERRORS,    // frames or commands the remote couldn't parse (incl. overlong frames)
+  LINK_REMOTE_TX_FRAMES,       // frames the remote sent
+  LINK_REMOTE_ACCESS_MS,       // ms from the last ACCREQ of the remote to its ENAB (0 -> none yet)
+  LINK_NUM_ITEMS
+} RemoteLinkItem;
+
+
 // *************************************************************************************
 // RemoteComm class
 // *************************************************************************************
@@ -35,6 +70,19 @@ private:
   Motors *motors; // pointer to the Motors class instance, which manages multiple motors
   char errorMsg[MAXERRORSTRINGSIZE]; // error message buffer for storing remote error messages
   volatile bool serial1Busy = false; // flag to indicate if Serial1 is busy with a write operation
+  int8_t isRemoteReady = 0; // set once the remote answered the handshake (or the handshake timed out)
+  unsigned long lastPingTime = 0; // time the last handshake ping was sent
+  int32_t sentPos[MAXNUMMOTORS]; // position the remote displays for each board
+  unsigned long sentPosTime[MAXNUMMOTORS]; // time of the last position update for each board
+  uint8_t sentPosCount[MAXNUMMOTORS]; // updates since the last absolute one
+  int8_t isSentPosValid[MAXNUMMOTORS] = {0}; // 0 -> the next update of the board is absolute
+  volatile uint32_t linkStats[LINK_NUM_ITEMS] = {0}; // link statistics (see RemoteLinkItem)
+  unsigned long lastLinkPingTime = 0; // time the last timestamped ping was sent
+
+  /**
+   * @brief Evaluates the answer of the remote to a timestamped ping (round-trip time and remote counters).
+   */
+  void ProcessLinkPong(const char *cmd);
 
 public:
   int8_t errorFlag; // error flag to indicate if there is an error in the remote communication
@@ -71,11 +119,39 @@ public:
   /**
    * @brief Sends position updates to the remote device.
    *
-   * This method retrieves the current positions of all motors and sends them
-   * to the remote device for display.
+   * This method retrieves the current positions of all motors and sends the ones that changed
+   * to the remote device for display. A moving axis is sent every REMOTE_SEND_INTERVAL_MS as the
+   * change to the last update (DP<board>=<delta>), with an absolute update (POS<board>=<pos>)
+   * every REMOTE_POS_KEYFRAME_COUNT updates and once it came to rest. Idle axes aren't sent.
    */
   void SendPositionUpdates(void);
 
+  /**
+   * @brief Looks for the remote until it answers, then sends it the parameters.
+   *
+   * The remote may boot later than the controller, so instead of waiting a fixed time during the
+   * boot the controller pings it periodically. The remote answers with RDY (it also sends RDY
+   * when it boots), which triggers Config(-1). A remote firmware without the handshake never
+   * answers, so the parameters are sent anyway after REMOTE_HANDSHAKE_TIMEOUT_MS.
+   * Once the remote is ready, a timestamped ping (LPNG=<us>) goes out every
+   * REMOTE_LINK_PING_INTERVAL_MS for the link statistics.
+   */
+  void CheckHandshake(void);
+
+  /**
+   * @brief Retrieves one of the link statistics.
+   *
+   * @param item Index of the statistics (see RemoteLinkItem).
+   * @param value Reference to store the value.
+   * @return int8_t Returns 0 on success, or ERR_Remote if the item is out of range.
+   */
+  int8_t GetLinkStat(int32_t item, int32_t &value);
+
+  /**
+   * @brief Clears the link statistics on both sides (sends LRST to the remote).
+   */
+  void ResetLinkStats(void);
+
   /**
    * @brief Sends a remote command to the specified channel with a value.
    *
@@ -89,6 +165,19 @@ public:
    */
   int8_t SendRemoteCommand(const char *cmd, int8_t channel, int32_t value);
 
+  /**
+   * @brief Checks a remote command without sending it.
+   *
+   * Applies the same checks as SendRemoteCommand, so a list of values can be validated before any is set.
+   *
+   * @param cmd The command string to check.
+   * @param channel The channel number (motor index) for the command.
+   * @param value The value associated with the command.
+   * @param motorParams Motor parameters of the channel to check against (nullptr for the stored ones).
+   * @return int8_t Returns 0 if the command is valid, or a negative error code otherwise.
+   */
+  int8_t CheckRemoteCommand(const char *cmd, int8_t channel, int32_t value, const int32_t *motorParams = nullptr);
+
   /**
    * @brief Checks for incoming remote commands and processes them.
    *
@@ -179,9 +268,10 @@ public:
    * @param board The index of the motor board to search (0 to MAXNUMMOTORS-1).
    * @param name The name of the parameter to find.
    * @param value Reference to an integer to store the found value.
+   * @param motorParams Motor parameters to search instead of the stored ones of the board (nullptr if not used).
    * @return int8_t Returns 0 on success, or a negative error code if not found.
    */
-  int8_t FindParamVal(int8_t board, const char *name, int32_t &value);
+  int8_t FindParamVal(int8_t board, const char *name, int32_t &value, const int32_t *motorParams = nullptr);
 
 
   /**
@@ -0,0 +1,72 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <stdint.h>
+
+
+// *************************************************************************************
+// SPSCQueue class
+// *************************************************************************************
+
+/**
+ * @class SPSCQueue
+ * @brief Lock-free single-producer/single-consumer ring buffer for passing data between the two cores.
+ *
+ * One core only ever calls Push(), the other only ever calls Pop(). The head index is written by the
+ * producer only and the tail index by the consumer only, so no lock is required. A memory barrier
+ * makes sure the entry is visible to the other core before the index is published.
+ * One slot is always kept free to distinguish a full from an empty queue.
+ *
+ * @tparam T Type of the queue entries (should be a small, trivially copyable struct).
+ * @tparam N Number of slots in the queue (N-1 usable entries).
+ */
+template <typename T, uint16_t N>
+class SPSCQueue
+{
+private:
+  T buffer[N]; // storage for the entries
+  volatile uint16_t head = 0; // next slot to write, only modified by the producer
+  volatile uint16_t tail = 0; // next slot to read, only modified by the consumer
+
+public:
+  /**
+   * @brief Adds an entry to the queue (producer side only).
+   *
+   * @param item The entry to add.
+   * @return bool Returns true on success, or false if the queue is full.
+   */
+  bool Push(const T &item)
+  {
+    uint16_t next = (head + 1) % N;
+    if (next == tail) return false; // full
+    buffer[head] = item;
+    __sync_synchronize(); // entry must be visible before the index is updated
+    head = next;
+    return true;
+  }
+
+  /**
+   * @brief Removes the oldest entry from the queue (consumer side only).
+   *
+   * @param item Reference to store the removed entry.
+   * @return bool Returns true on success, or false if the queue is empty.
+   */
+  bool Pop(T &item)
+  {
+    if (tail == head) return false; // empty
+    __sync_synchronize(); // read the entry only after the index was seen
+    item = buffer[tail];
+    __sync_synchronize(); // entry must be copied before the slot is released
+    tail = (tail + 1) % N;
+    return true;
+  }
+
+  /**
+   * @brief Checks whether the queue is empty.
+   *
+   * @return bool Returns true if there are no entries in the queue.
+   */
+  bool IsEmpty(void) const { return tail == head; }
+};
+
+#endif // SPSCQUEUE_H
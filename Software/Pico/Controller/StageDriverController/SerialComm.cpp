@@ -2,6 +2,7 @@
 #include "Common.h"
 
 #include "SerialComm.h"
+#include "Perf.h"
 
 
 #define SERIAL_DEBUG  0
@@ -11,7 +12,33 @@
 // *************************************************************************************
 // defines
 // *************************************************************************************
-#define MSG_MAXLENGTH  100
+#define MSG_MAXLENGTH  100 // replies and error messages (the bulk parameter reply has its own buffer)
+#define TELE_MAXLENGTH (16 + MAXNUMMOTORS*(5+3*12)) // "TELE=<time>" + ";<board>,<xact>,<xenc>,<status>" per board
+
+static_assert(1 + PARAMS_NUM_BULK <= SERIAL_MAX_ARGS, "SMP_PALL doesn't fit into the argument list");
+static_assert(TELE_MAXLENGTH >= sizeof("TELE=4294967295") + MAXNUMMOTORS*(sizeof(";-128,-2147483648,-2147483648,-2147483648")-1),
+              "the worst-case ASCII telemetry record doesn't fit into TELE_MAXLENGTH");
+
+
+
+// *************************************************************************************
+// Helper functions
+// *************************************************************************************
+
+// ----------------------------
+// CRC-16/CCITT-FALSE
+// ----------------------------
+
+uint16_t Crc16(const uint8_t *data, uint16_t len, uint16_t crc)
+{
+  for (uint16_t z=0; z<len; z++) {
+    crc ^= (uint16_t)data[z] << 8;
+    for (int8_t bit=0; bit<8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+  return crc;
+}
 
 
 
@@ -48,369 +75,1366 @@ void SerialComm::Init(Parameters *paramPtr, Motors *motorPtr, RemoteComm *remote
 
 void SerialComm::CheckSerialCommand(void)
 {
-  int8_t board;
-  int8_t status;
-  int8_t err;
-  uint8_t registerAddr;
-  int32_t idx;
-  int32_t intVal;
-  char tmpStr[MSG_MAXLENGTH];
-  unsigned long currentTime = millis();
-  static unsigned long lastCheckTime = 0;
+  int c;
 
+  // drop a binary frame that stopped arriving (e.g. the host was interrupted)
+  if (binLength > 0 && millis() - binStartTime > SERIAL_BIN_TIMEOUT_MS) {
+    binLength = 0;
+    SetErrorMsg("Incomplete binary frame discarded");
+  }
 
-  static char serialData[MSG_MAXLENGTH+1]; // one extra for the null char
+  // a command that arrived during the boot config runs once the boards are ready
+  if (pendingInput) {
+    if (params->IsConfiguring()) return;
+    PERF_START(perfStart);
+    if (pendingInput == 1) ProcessCommand(lineBuffer);
+    else ProcessBinaryFrame(binBuffer);
+    PERF_STOP(PERF_CMD_COUNT, perfStart);
+    pendingInput = 0;
+    return;
+  }
 
-  if (currentTime - lastCheckTime > SERIAL_CHECK_INTERVAL_MS) {
+  while (Serial.available() > 0) {
+    c = Serial.read();
+    if (c < 0) break;
+
+    // binary frames start with the sync byte at the beginning of a line and have a fixed size
+    if (binLength > 0 || (lineLength == 0 && !lineOverflow && c == SERIAL_BIN_SYNC)) {
+      if (binLength == 0) binStartTime = millis();
+      binBuffer[binLength++] = (uint8_t)c;
+      if (binLength == SERIAL_BIN_REQUEST_SIZE) {
+        binLength = 0;
+        if (params->IsConfiguring()) { // hold the frame (and the rest of the input) back
+          pendingInput = 2;
+          return;
+        }
+        PERF_START(perfStart);
+        ProcessBinaryFrame(binBuffer);
+        PERF_STOP(PERF_CMD_COUNT, perfStart);
+        return; // one command per call
+      }
+      continue;
+    }
 
-    if (Serial.available() > 0){
-      // max allowed command size is MSG_MAXLENGTH char, ends with a term char
-      int bytesRead = Serial.readBytesUntil(SERIAL_TERMCHAR, serialData, MSG_MAXLENGTH); // LF or CR
-      // terminate with an end character
-      serialData[bytesRead]='\0';
-      // check for at least some bytes
-      if (bytesRead<5) {
-        snprintf(tmpStr, MSG_MAXLENGTH, "Command <5 chars. Recvd: %s", serialData);
-        SetErrorMsg(tmpStr);
+    if (c == SERIAL_TERMCHAR) {
+      if (lineOverflow) { // discard the entire line
+        lineOverflow = 0;
+        lineLength = 0;
+        SetErrorMsg("Command too long");
         ReportErrorCode(ERR_Serial);
         return;
       }
-
-      /////////////////////
-      // check for SetMotorPosition command
-      if (strncmp(serialData, "SMC_MPOS", 8)  == 0){
-        if (sscanf(serialData, "SMC_MPOS%hhi,%d", &board, &intVal)!=2) {
-          SetErrorMsg("Invalid SMC_MPOS command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=CheckRemoteControl(board)) {ReportErrorCode(err); return;}
-        err=motors->MoveToPos(board, intVal, 1); // set the velocity
-        ReportErrorCode(err);
-        return; 
-      }  
-
-      /////////////////////
-      // check for SetMotorVelocity command
-      if (strncmp(serialData, "SMC_MVEL", 8)  == 0){
-        if (sscanf(serialData, "SMC_MVEL%hhi,%d", &board, &intVal)!=2) {
-          SetErrorMsg("Invalid SMC_MVEL command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=CheckRemoteControl(board)) {ReportErrorCode(err); return;}
-        err=motors->MoveAtVel(board, intVal);
-        ReportErrorCode(err);
-        return;
-      }  
-
-      /////////////////////
-      // check for GetStatus command
-      if (strncmp(serialData, "GMC_STAT", 8)  == 0){
-        if (sscanf(serialData, "GMC_STAT%hhi", &board)!=1) {
-          SetErrorMsg("Invalid GMC_STAT command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=motors->GetStatusFlags(board, intVal)) {ReportErrorCode(err); return;} 
-        Serial.print("MC_STAT");Serial.print(board);Serial.print("=");
-        Serial.println(intVal);
-        return;
-      }  
-
-      /////////////////////
-      // check for GetPositionReached command
-      if (strncmp(serialData, "GMC_POSR", 8)  == 0){
-        if (sscanf(serialData, "GMC_POSR%hhi", &board)!=1) {
-          SetErrorMsg("Invalid GMC_POSR command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=motors->IsMotionDone(board, intVal)) {ReportErrorCode(err); return;} 
-        Serial.print("MC_POSR");Serial.print(board);Serial.print("=");
-        Serial.println(intVal);
-        return;
-      }  
-
-      /////////////////////
-      // check for Set Motor Status command (starts with an 'SMS_')
-      if (strncmp(serialData, "SMS_", 4)  == 0) {
-        for (idx=0; idx<MOTORS_NUM_STATUS; idx++) {
-          if (strncmp(serialData+4, motors->motStatIDList[idx], 4)  == 0){ // loop through possible IDs
-            sprintf(tmpStr, "SMS_%s%%hhd,%%d", motors->motStatIDList[idx]);
-            if (sscanf(serialData, tmpStr, &board, &intVal)!=2) {
-              snprintf(tmpStr, MSG_MAXLENGTH, "Invalid command format: %s", serialData);
-              SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-            }
-            err=motors->SetStatusValue(board, idx, intVal);
-            ReportErrorCode(err);
-            return;
-          }
-        }
-        SetErrorMsg("Unrecognized SMS_ parameter"); ReportErrorCode(ERR_Serial); return;
-      } // if (strncmp(serialData, "SMS_")
-
-      /////////////////////
-      // check for Get Motor Status command (starts with an 'GMS_')
-      if (strncmp(serialData, "GMS_", 4)  == 0) {
-        for (idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
-          if (strncmp(serialData+4, motors->motStatIDList[idx], 4)  == 0){ // loop through possible IDs
-            sprintf(tmpStr, "GMS_%s%%hhd", motors->motStatIDList[idx]);
-            if (sscanf(serialData, tmpStr, &board)!=1) {
-              snprintf(tmpStr, MSG_MAXLENGTH, "Invalid command format: %s", serialData);
-              SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-            }
-            if (err=motors->GetStatusValue(board, idx, intVal)) {ReportErrorCode(err); return;}
-            Serial.print("MS_"); Serial.print(motors->motStatIDList[idx]); Serial.print(board); Serial.print("=");
-            Serial.println(intVal);
-            return;
-          }
-        }
-        SetErrorMsg("Unrecognized GMS_ parameter"); ReportErrorCode(ERR_Serial); return;
-      } // if (strncmp(serialData, "GMS_")
-
-      /////////////////////
-      // check for SetDeviceType command ()
-      if (strncmp(serialData, "SMP_TDEV", 8)  == 0){
-        if (sscanf(serialData, "SMP_TDEV%hhi,%d", &board, &intVal)!=2) {
-          SetErrorMsg("Invalid SMP_TDEV command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        err=params->SetDeviceType(board, intVal);
-        ReportErrorCode(err);
+      // remove a trailing CR (or LF) from CR-LF terminated lines
+      if (lineLength > 0 && (lineBuffer[lineLength-1]=='\r' || lineBuffer[lineLength-1]=='\n')) lineLength--;
+      lineBuffer[lineLength] = '\0';
+      lineLength = 0;
+      if (params->IsConfiguring() && strcmp(lineBuffer, "*IDN?") != 0) { // only the ID is answered right away
+        pendingInput = 1;
         return;
       }
+      PERF_START(perfStart);
+      ProcessCommand(lineBuffer);
+      PERF_STOP(PERF_CMD_COUNT, perfStart);
+      return; // one command per call, the rest stays in the serial buffer
+    }
 
-      /////////////////////
-      // check for GetDeviceType command ()
-      if (strncmp(serialData, "GMP_TDEV", 8)  == 0){
-        if (sscanf(serialData, "GMP_TDEV%hhi", &board)!=1) {
-          SetErrorMsg("Invalid GMP_TDEV command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=params->GetDeviceType(board, intVal)) {ReportErrorCode(err); return;}
-        Serial.print("MP_TDEV"); Serial.print(board); Serial.print("=");
-        Serial.println(intVal);
-        return;
-      }
+    if (lineLength < SERIAL_MAX_LINE_LENGTH) {
+      lineBuffer[lineLength++] = (char)c;
+    } else {
+      lineOverflow = 1;
+    }
+  }
+}
 
-      /////////////////////
-      // check for SetAxisType command ()
-      if (strncmp(serialData, "SMP_TAXI", 8)  == 0){
-        if (sscanf(serialData, "SMP_TAXI%hhi,%d", &board, &intVal)!=2) {
-          SetErrorMsg("Invalid SMP_TAXI command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        err=params->SetAxisType(board, intVal);
-        ReportErrorCode(err);
-        return;
-      }
 
-      /////////////////////
-      // check for GetAxisType command ()
-      if (strncmp(serialData, "GMP_TAXI", 8)  == 0){
-        if (sscanf(serialData, "GMP_TAXI%hhi", &board)!=1) {
-          SetErrorMsg("Invalid GMP_TAXI command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=params->GetAxisType(board, intVal)) {ReportErrorCode(err); return;}
-        Serial.print("MP_TAXI"); Serial.print(board); Serial.print("=");
-        Serial.println(intVal);
-        return;
-      }
+// ----------------------------
+// Send the latest telemetry record to the host
+// ----------------------------
 
-      /////////////////////
-      // check for Set Motor Parameter command (starts with an 'SMP_')
-      if (strncmp(serialData, "SMP_", 4)  == 0) {
-        for (idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
-          if (strncmp(serialData+4, params->motParamsIDList[idx], 4)  == 0){ // loop through possible IDs
-            sprintf(tmpStr, "SMP_%s%%hhd,%%d", params->motParamsIDList[idx]);
-            if (sscanf(serialData, tmpStr, &board, &intVal)!=2) {
-              snprintf(tmpStr, MSG_MAXLENGTH, "Invalid command format: %s", serialData);
-              SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-            }
-            err=params->SetMotorParams(board, idx, intVal);
-            ReportErrorCode(err);
-            return;
-          }
-        }
-        sprintf(tmpStr, "Unrecognized parameter  %s", serialData);
-        SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-      } // if (strncmp(serialData, "SMP_")
-
-      /////////////////////
-      // check for Get Motor Parameter command (starts with an 'GMP_')
-      if (strncmp(serialData, "GMP_", 4)  == 0) {
-        for (idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
-          if (strncmp(serialData+4, params->motParamsIDList[idx], 4)  == 0){ // loop through possible IDs
-            sprintf(tmpStr, "GMP_%s%%hhd", params->motParamsIDList[idx]);
-            if (sscanf(serialData, tmpStr, &board)!=1) {
-              snprintf(tmpStr, MSG_MAXLENGTH, "Invalid command format: %s", serialData);
-              SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-            }
-            if (err=params->GetMotorParams(board, idx, intVal)) {ReportErrorCode(err); return;}
-            Serial.print("MP_"); Serial.print(params->motParamsIDList[idx]); Serial.print(board); Serial.print("=");
-            Serial.println(intVal);
-            return;
-          }
-        }
-        sprintf(tmpStr, "Unrecognized parameter  %s", serialData);
-        SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-      } // if (strncmp(serialData, "GMP_")
-
-      /////////////////////
-      // check for Set Remote Parameter command (starts with an 'SRP_')
-      if (strncmp(serialData, "SRP_", 4)  == 0) {
-        for (idx=0; idx<REMOTE_NUM_PARAMS; idx++) {
-          if (strncmp(serialData+4, params->remoteIDList[idx], 4)  == 0){ // loop through possible IDs
-            sprintf(tmpStr, "SRP_%s%%hhd,%%d", params->remoteIDList[idx]);
-            if (sscanf(serialData, tmpStr, &board, &intVal)!=2) {
-              snprintf(tmpStr, MSG_MAXLENGTH, "Invalid command format: %s", serialData);
-              SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-            }
-#if REMOTE_ENABLED
-            if (err=remote->SendRemoteCommand(params->remoteIDList[idx], board, intVal)) {ReportErrorCode(err); return;}
-#endif
-            err=params->SetRemoteParams(board, idx, intVal);
-            ReportErrorCode(err);
-            return;
-          }
-        }
-        sprintf(tmpStr, "Unrecognized parameter  %s", serialData);
-        SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-      } // if (strncmp(serialData, "SRP_")
-
-      /////////////////////
-      // check for Get Remote Parameter command (starts with an 'GRP_')
-      if (strncmp(serialData, "GRP_", 4)  == 0) {
-        for (idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
-          if (strncmp(serialData+4, params->remoteIDList[idx], 4)  == 0){ // loop through possible IDs
-            sprintf(tmpStr, "GRP_%s%%hhd", params->remoteIDList[idx]);
-            if (sscanf(serialData, tmpStr, &board)!=1) {
-              snprintf(tmpStr, MSG_MAXLENGTH, "Invalid command format: %s", serialData);
-              SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-            }
-            if (err=params->GetRemoteParams(board, idx, intVal)) {ReportErrorCode(err); return;}
-            Serial.print("RP_"); Serial.print(params->remoteIDList[idx]); Serial.print(board); Serial.print("=");
-            Serial.println(intVal);
-            return;
-          }
-        }
-        sprintf(tmpStr, "Unrecognized parameter  %s", serialData);
-        SetErrorMsg(tmpStr); ReportErrorCode(ERR_Serial); return;
-      } // if (strncmp(serialData, "GRP_")
+void SerialComm::SendTelemetry(void)
+{
+  MotorTelemetry tele;
+  uint32_t seq;
+  char tmpStr[TELE_MAXLENGTH];
+  int len;
+
+  if (!telemetryRate) return;
+  if (motors->GetTelemetry(tele, seq) != ERR_None || seq == telemetrySeq) return; // nothing new
+  telemetrySeq = seq;
+
+  if (telemetryBinary) {
+    uint8_t frame[8 + 11*MAXNUMMOTORS];
+    uint16_t crc;
+    len = 0;
+    frame[len++] = SERIAL_TELE_SYNC;
+    frame[len++] = (uint8_t)tele.num;
+    for (int8_t z=0; z<4; z++) frame[len++] = (uint8_t)(tele.time >> (8*z));
+    for (int8_t b=0; b<tele.num; b++) {
+      frame[len++] = (uint8_t)tele.board[b];
+      for (int8_t z=0; z<4; z++) frame[len++] = (uint8_t)((uint32_t)tele.xact[b] >> (8*z));
+      for (int8_t z=0; z<4; z++) frame[len++] = (uint8_t)((uint32_t)tele.xenc[b] >> (8*z));
+      for (int8_t z=0; z<2; z++) frame[len++] = (uint8_t)((uint32_t)tele.status[b] >> (8*z));
+    }
+    crc = Crc16(frame, len);
+    frame[len++] = (uint8_t)(crc & 0xFF);
+    frame[len++] = (uint8_t)(crc >> 8);
+    if (Serial.availableForWrite() < len) return; // drop the record rather than stall the loop
+    Serial.write(frame, len);
+  } else {
+    len = snprintf(tmpStr, TELE_MAXLENGTH, "TELE=%lu", tele.time);
+    for (int8_t b=0; b<tele.num; b++) {
+      len += snprintf(tmpStr+len, TELE_MAXLENGTH-len, ";%d,%ld,%ld,%ld", tele.board[b],
+                      (long)tele.xact[b], (long)tele.xenc[b], (long)tele.status[b]);
+      if (len >= TELE_MAXLENGTH) return; // never send a cut record (can't happen, see TELE_MAXLENGTH)
+    }
+    if (Serial.availableForWrite() < len+2) return; // drop the record rather than stall the loop
+    Serial.println(tmpStr);
+  }
+}
 
+void SerialComm::SkipPendingTelemetry(void)
+{
+  uint32_t seq = motors->GetTelemetrySeq();
+  if (!(seq & 1)) telemetrySeq = seq; // a snapshot being written now was started after the command
+}
 
-      /////////////////////
-      // check for set board config command
-      if (strncmp(serialData, "SMC_CONF", 8)  == 0){
-        if (sscanf(serialData, "SMC_CONF%hhi", &board)!=1) {
-          SetErrorMsg("Invalid SMC_CONF command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        err=motors->ConfigBoard(board);
-        if (err) {ReportErrorCode(err); return;}
-        err=remote->Config(board);
-        ReportErrorCode(err);
-        return;
-      }
 
-      /////////////////////
-      // check for ClearStatusRegs command
-      if (strncmp(serialData, "SMC_SCLR", 8)  == 0){
-        if (sscanf(serialData, "SMC_SCLR%hhi", &board)!=1) {
-          SetErrorMsg("Invalid SMC_SCLR command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        err=motors->ClearStatusRegs(board);
-        ReportErrorCode(err);
-        return;
-      }  
-
-      /////////////////////
-      // check for SetHomingMode command
-      if (strncmp(serialData, "SMC_HOME", 8)  == 0){
-        if (sscanf(serialData, "SMC_HOME%hhi", &board)!=1) {
-          SetErrorMsg("Invalid SMC_HOME command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=CheckRemoteControl(board)) {ReportErrorCode(err); return;}
-        err=motors->StartHoming(board);
-        ReportErrorCode(err);
-        return;
-      }  
+// ----------------------------
+// Parse and execute a command line
+// ----------------------------
 
+void SerialComm::ProcessCommand(const char *line)
+{
+  SerialCommand cmd;
+  const SerialCommandEntry *entry;
+  int8_t err;
+  size_t len = strlen(line);
+  char tmpStr[MSG_MAXLENGTH];
 
-      /////////////////////
-      // check for SetDriverRegisterValue command
-      if (strncmp(serialData, "SMC_DREG", 8)  == 0){
-        if (sscanf(serialData, "SMC_DREG%hhi,%hhu,%i", &board, &registerAddr, &intVal)!=3) {
-          SetErrorMsg("Invalid SMC_DREG command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        err=motors->SetRegisterValue(board, registerAddr, intVal);
-        ReportErrorCode(err);
-        return;
-      }  
-
-      /////////////////////
-      // check for GetDriverRegisterValue command
-      if (strncmp(serialData, "GMC_DREG", 8)  == 0){
-        if (sscanf(serialData, "GMC_DREG%hhi,%hhu", &board, &registerAddr)!=2) {
-          SetErrorMsg("Invalid GMC_DREG command format");
-          ReportErrorCode(ERR_Serial); return;
-        }
-        if (err=motors->GetRegisterValue(board, registerAddr, intVal)) {ReportErrorCode(err); return;} 
-        Serial.print("MC_DREG");Serial.print(board);Serial.print("=");
-        Serial.println(intVal);
-        return;
-      }  
+  // check for at least some bytes
+  if (len<5) {
+    snprintf(tmpStr, MSG_MAXLENGTH, "Command <5 chars. Recvd: %s", line);
+    SetErrorMsg(tmpStr);
+    ReportErrorCode(ERR_Serial);
+    return;
+  }
 
-      /////////////////////
-      // check for ID query
-      if (strncmp(serialData, "*IDN?", 5)  == 0){
-        Serial.println(SERIAL_ID_STRING);
-        return;
-      }
+  // look up the command
+  entry = LookupCommand(line, cmd.idx);
+  if (entry == nullptr) {
+    ReportErrorCode(ERR_Serial);
+    return;
+  }
 
-      /////////////////////
-      // check for GetNumberDevices command
-      if (strncmp(serialData, "GPC_NDEV", 8)  == 0){
-        Serial.print("PC_NDEV=");
-        Serial.println(MAXNUMMOTORS);
-        return;
-      }
+  // parse the arguments following the 8-char command
+  // (commands without board take their values after a comma, e.g. "SPC_TELE,100")
+  cmd.line = line;
+  cmd.value = 0;
+  const char *argStr = line + (len<8 ? len : 8);
+  if (entry->numArgs == 0 && *argStr == ',') argStr++;
+  if (ParseArgs(argStr, cmd.args, SERIAL_MAX_ARGS, cmd.numArgs)) {
+    snprintf(tmpStr, MSG_MAXLENGTH, "Argument out of range: %s", line);
+    SetErrorMsg(tmpStr);
+    ReportErrorCode(ERR_Serial);
+    return;
+  }
+  if ( (cmd.numArgs < entry->numArgs) || 
+       (entry->numArgs > 0 && (cmd.args[0] < INT8_MIN || cmd.args[0] > INT8_MAX)) ) {
+    snprintf(tmpStr, MSG_MAXLENGTH, "Invalid command format: %s", line);
+    SetErrorMsg(tmpStr);
+    ReportErrorCode(ERR_Serial);
+    return;
+  }
+  cmd.board = (cmd.numArgs > 0 ? (int8_t)cmd.args[0] : 0);
+
+  // execute and reply
+  err = (this->*(entry->handler))(cmd);
+  if (line[0] == 'S') SkipPendingTelemetry();
+  switch (entry->replyType) {
+    case REPLY_VALUE:
+      if (err) {ReportErrorCode(err); return;}
+      Serial.write(line+1, 7); // e.g. "MC_STAT" for "GMC_STAT"
+      Serial.print(cmd.board); Serial.print("=");
+      Serial.println(cmd.value);
+      break;
+    case REPLY_VALUE_NOBOARD:
+      if (err) {ReportErrorCode(err); return;}
+      Serial.write(line+1, 7); Serial.print("=");
+      Serial.println(cmd.value);
+      break;
+    case REPLY_CUSTOM:
+      break;
+    default:
+      ReportErrorCode(err);
+      break;
+  }
+}
 
-      /////////////////////
-      // check for version query
-      if (strncmp(serialData, "GPC_VERS", 8)  == 0){
-        Serial.print("PC_VERS=");
-        Serial.println(VERSION);
-        return;
-      }
 
-      /////////////////////
-      // check for error query
-      if (strncmp(serialData, "GPC_EMSG", 8)  == 0){
-        ReportErrorMsg();
-        return;
-      }
+// ----------------------------
+// Execute a binary request frame
+// ----------------------------
+
+void SerialComm::ProcessBinaryFrame(const uint8_t *frame)
+{
+  SerialCommand cmd;
+  const SerialCommandEntry *entry;
+  char name[9];
+  int8_t err;
+  uint16_t crc = (uint16_t)frame[12] | ((uint16_t)frame[13] << 8);
+
+  if (Crc16(frame, SERIAL_BIN_REQUEST_SIZE-2) != crc) {
+    SetErrorMsg("Binary frame CRC mismatch");
+    SendBinaryReply(ERR_Serial, 0);
+    return;
+  }
+  if (frame[1] >= binaryGroupCount) {
+    SetErrorMsg("Unrecognized binary command group");
+    SendBinaryReply(ERR_Serial, 0);
+    return;
+  }
+
+  // rebuild the command name, e.g. "GMS_XACT", and look it up like an ASCII command
+  memcpy(name, binaryGroupList[frame[1]], 4);
+  memcpy(name+4, frame+2, 4);
+  name[8] = '\0';
+  entry = LookupCommand(name, cmd.idx);
+  if (entry == nullptr) {
+    SendBinaryReply(ERR_Serial, 0);
+    return;
+  }
+  if (entry->replyType == REPLY_CUSTOM) { // text replies don't fit into a frame
+    SetErrorMsg("Command not available in binary mode");
+    SendBinaryReply(ERR_Serial, 0);
+    return;
+  }
+
+  // map board, sub-argument and value onto the argument list of the handler
+  cmd.line = name;
+  cmd.value = 0;
+  cmd.numArgs = entry->numArgs;
+  cmd.board = (cmd.numArgs > 0 ? (int8_t)frame[6] : 0);
+  cmd.args[0] = cmd.board;
+  int32_t value = (int32_t)((uint32_t)frame[8] | ((uint32_t)frame[9] << 8) |
+                            ((uint32_t)frame[10] << 16) | ((uint32_t)frame[11] << 24));
+  if (cmd.numArgs == 0) { // commands without board take the value only if the sub-argument flags it
+    if (frame[7] & SERIAL_BIN_SUB_VALUE) {
+      cmd.numArgs = 1;
+      cmd.args[0] = value;
+    }
+  } else if (cmd.numArgs == 1) { // set commands take the value (e.g. SMC_ORIG), gets the optional fresh read flag
+    cmd.numArgs = 2;
+    cmd.args[1] = (name[0] == 'S') ? value : frame[7];
+  } else if (cmd.numArgs == 2) {
+    cmd.args[1] = value;
+  } else if (cmd.numArgs >= 3) {
+    cmd.numArgs = 3;
+    cmd.args[1] = frame[7];
+    cmd.args[2] = value;
+  }
+
+  err = (this->*(entry->handler))(cmd);
+  if (name[0] == 'S') SkipPendingTelemetry();
+  SendBinaryReply(err, (entry->replyType == REPLY_ERROR || err) ? 0 : cmd.value);
+}
+
+
+// ----------------------------
+// Send a binary reply frame
+// ----------------------------
+
+void SerialComm::SendBinaryReply(int8_t err, int32_t value)
+{
+  uint8_t frame[SERIAL_BIN_REPLY_SIZE];
+  uint16_t crc;
+
+  frame[0] = SERIAL_BIN_REPLY_SYNC;
+  frame[1] = (uint8_t)err;
+  for (int8_t z=0; z<4; z++) frame[2+z] = (uint8_t)((uint32_t)value >> (8*z));
+  crc = Crc16(frame, SERIAL_BIN_REPLY_SIZE-2);
+  frame[6] = (uint8_t)(crc & 0xFF);
+  frame[7] = (uint8_t)(crc >> 8);
+  Serial.write(frame, SERIAL_BIN_REPLY_SIZE);
+}
+
+
+// ----------------------------
+// Look up a command name, incl. the ID lists
+// ----------------------------
+
+const SerialCommandEntry* SerialComm::LookupCommand(const char *name, int32_t &idx)
+{
+  const SerialCommandEntry *entry;
+  uint32_t id = PackID(name+4);
+  char tmpStr[MSG_MAXLENGTH];
+
+  // first the exact command, then the ID list of the group
+  idx = -1;
+  entry = FindCommand(PackID(name), id);
+  if (entry != nullptr) return entry;
+  entry = FindCommand(PackID(name), 0);
+  if (entry == nullptr) {
+    SetErrorMsg("Unrecognized command");
+    return nullptr;
+  }
+  int16_t lo = 0;
+  int16_t hi = entry->idCount - 1;
+  while (lo <= hi) { // binary search in the sorted ID list
+    int16_t mid = (lo + hi) / 2;
+    if (entry->idKeys[mid] == id) {
+      idx = entry->idIndex[mid];
+      return entry;
+    }
+    if (entry->idKeys[mid] < id) lo = mid + 1; else hi = mid - 1;
+  }
+  snprintf(tmpStr, MSG_MAXLENGTH, "Unrecognized parameter %s", name);
+  SetErrorMsg(tmpStr);
+  return nullptr;
+}
 
-      /////////////////////
-      // check for EEPROM save
-      if (strncmp(serialData, "SPC_SAFL", 8)  == 0){
-        err=params->SaveConfigToFlash();
-        ReportErrorCode(err);
-        return;
-      }
 
-      /////////////////////
-      // if we ever get to here, it was an unrecognized command
-      SetErrorMsg("Unrecognized command");
-      ReportErrorCode(ERR_Serial);
+// ----------------------------
+// Find a command in the dispatch table
+// ----------------------------
+
+const SerialCommandEntry* SerialComm::FindCommand(uint32_t group, uint32_t id)
+{
+  uint64_t key = ((uint64_t)group << 32) | id;
+  int16_t lo = 0;
+  int16_t hi = commandTableSize - 1;
+
+  while (lo <= hi) {
+    int16_t mid = (lo + hi) / 2;
+    uint64_t midKey = ((uint64_t)commandTable[mid].group << 32) | commandTable[mid].id;
+    if (midKey == key) return &commandTable[mid];
+    if (midKey < key) lo = mid + 1; else hi = mid - 1;
+  }
+  return nullptr;
+}
+
+
+// ----------------------------
+// Parse a comma-separated list of integers
+// ----------------------------
+
+int8_t SerialComm::ParseArgs(const char *str, int32_t *args, uint8_t maxArgs, uint8_t &num)
+{
+  const char *p = str;
+
+  num = 0;
+  while (num < maxArgs) {
+    int8_t neg = 0;
+    uint8_t base = 10;
+    uint32_t val = 0;
+    uint32_t maxVal;
+    const char *digitStart;
+
+    while (*p==' ' || *p=='\t') p++;
+    if (*p=='-' || *p=='+') {
+      neg = (*p=='-');
+      p++;
+    }
+    if (p[0]=='0' && (p[1]=='x' || p[1]=='X')) {
+      base = 16;
+      p += 2;
+    }
+    // hex values are bit patterns (up to 0xFFFFFFFF), decimal values have to fit into an int32
+    maxVal = (base==16) ? UINT32_MAX : (neg ? (uint32_t)INT32_MAX + 1 : (uint32_t)INT32_MAX);
+    digitStart = p;
+    while (1) {
+      uint8_t digit;
+      if (*p>='0' && *p<='9') digit = *p - '0';
+      else if (base==16 && *p>='a' && *p<='f') digit = *p - 'a' + 10;
+      else if (base==16 && *p>='A' && *p<='F') digit = *p - 'A' + 10;
+      else break;
+      if (val > (maxVal - digit) / base) return ERR_Serial;
+      val = val*base + digit;
+      p++;
+    }
+    if (p == digitStart) break; // no number here
+    args[num++] = (int32_t)(neg ? 0u - val : val);
+    while (*p==' ' || *p=='\t') p++;
+    if (*p != ',') break;
+    p++;
+  }
+  return ERR_None;
+}
+
+
+// *************************************************************************************
+// Command dispatch table
+// *************************************************************************************
+
+/**
+ * @brief Sorted list of packed IDs with the index into the original ID list.
+ */
+template <size_t N>
+struct SortedIDList {
+  uint32_t keys[N];
+  uint8_t index[N];
+};
+
+/**
+ * @brief Builds the sorted packed ID list at compile time (insertion sort).
+ */
+template <size_t N>
+constexpr SortedIDList<N> SortIDList(const char* const (&list)[N])
+{
+  SortedIDList<N> out{};
+  for (size_t z=0; z<N; z++) {
+    uint32_t key = PackID(list[z]);
+    size_t pos = z;
+    while (pos>0 && out.keys[pos-1]>key) {
+      out.keys[pos] = out.keys[pos-1];
+      out.index[pos] = out.index[pos-1];
+      pos--;
+    }
+    out.keys[pos] = key;
+    out.index[pos] = (uint8_t)z;
+  }
+  return out;
+}
+
+/**
+ * @brief Checks at compile time that the keys are strictly increasing (sorted, no duplicates).
+ */
+template <size_t N>
+constexpr bool IsIDListSorted(const SortedIDList<N> &list)
+{
+  for (size_t z=1; z<N; z++) if (list.keys[z-1] >= list.keys[z]) return false;
+  return true;
+}
+
+static constexpr SortedIDList<MOTORS_NUM_STATUS> motStatIDs = SortIDList(Motors::motStatIDList);
+static constexpr SortedIDList<MOTORS_NUM_PARAMS> motParamsIDs = SortIDList(Parameters::motParamsIDList);
+static constexpr SortedIDList<REMOTE_NUM_PARAMS> remoteIDs = SortIDList(Parameters::remoteIDList);
+static_assert(IsIDListSorted(motStatIDs), "Duplicate ID in Motors::motStatIDList");
+static_assert(IsIDListSorted(motParamsIDs), "Duplicate ID in Parameters::motParamsIDList");
+static_assert(IsIDListSorted(remoteIDs), "Duplicate ID in Parameters::remoteIDList");
+
+/**
+ * @brief Checks at compile time that the dispatch table is sorted (required for the binary search).
+ */
+constexpr bool IsCommandTableSorted(void)
+{
+  const SerialCommandEntry *table = SerialComm::commandTable; // the table is defined below, before the check
+
+  for (uint8_t z=1; z<SerialComm::commandTableSize; z++) {
+    uint64_t prev = ((uint64_t)table[z-1].group << 32) | table[z-1].id;
+    uint64_t curr = ((uint64_t)table[z].group << 32) | table[z].id;
+    if (prev >= curr) return false;
+  }
+  return true;
+}
+
+// single command: group, ID, min number of args (incl. board), reply type, handler
+#define CMD(group, id, nargs, reply, handler) \
+  {PackID(group), PackID(id), nargs, reply, &SerialComm::handler, nullptr, nullptr, 0}
+// ID list command: group, min number of args (incl. board), reply type, handler, sorted ID list
+#define CMD_LIST(group, nargs, reply, handler, list) \
+  {PackID(group), 0, nargs, reply, &SerialComm::handler, list.keys, list.index, sizeof(list.keys)/sizeof(list.keys[0])}
+
+// Note: the table must be sorted by group, then by ID (alphabetical). This is checked at compile time.
+constexpr SerialCommandEntry SerialComm::commandTable[] = {
+  CMD(      "*IDN", "?",    0, REPLY_CUSTOM,        CmdIdentify),
+  CMD(      "GMC_", "DREG", 2, REPLY_VALUE,         CmdGetRegister),
+  CMD(      "GMC_", "POSR", 1, REPLY_VALUE,         CmdGetPosReached),
+  CMD(      "GMC_", "SQLN", 1, REPLY_VALUE,         CmdGetSequenceLength),
+  CMD(      "GMC_", "STAT", 1, REPLY_VALUE,         CmdGetStatusFlags),
+  CMD(      "GMC_", "TQLN", 1, REPLY_VALUE,         CmdGetTrajectoryLength),
+  CMD_LIST( "GMP_",         1, REPLY_VALUE,         CmdGetMotorParam, motParamsIDs),
+  CMD(      "GMP_", "PALL", 1, REPLY_CUSTOM,        CmdGetAllParams),
+  CMD(      "GMP_", "TAXI", 1, REPLY_VALUE,         CmdGetAxisType),
+  CMD(      "GMP_", "TDEV", 1, REPLY_VALUE,         CmdGetDeviceType),
+  CMD_LIST( "GMS_",         1, REPLY_VALUE,         CmdGetMotorStatus, motStatIDs),
+  CMD(      "GPC_", "BOOT", 0, REPLY_VALUE_NOBOARD, CmdGetBootTime),
+  CMD(      "GPC_", "CAPT", 0, REPLY_VALUE_NOBOARD, CmdGetCapture),
+  CMD(      "GPC_", "CDMP", 0, REPLY_CUSTOM,        CmdGetCaptureDump),
+  CMD(      "GPC_", "CNUM", 0, REPLY_VALUE_NOBOARD, CmdGetCaptureLength),
+  CMD(      "GPC_", "EMSG", 0, REPLY_CUSTOM,        CmdGetErrorMsg),
+  CMD(      "GPC_", "LINK", 0, REPLY_VALUE_NOBOARD, CmdGetLinkStat),
+  CMD(      "GPC_", "MSTA", 0, REPLY_CUSTOM,        CmdGetMultiStatus),
+  CMD(      "GPC_", "NDEV", 0, REPLY_VALUE_NOBOARD, CmdGetNumDevices),
+  CMD(      "GPC_", "PCNT", 0, REPLY_VALUE_NOBOARD, CmdGetParamChangeCount),
+  CMD(      "GPC_", "PERF", 0, REPLY_VALUE_NOBOARD, CmdGetPerfCounter),
+  CMD(      "GPC_", "SQML", 0, REPLY_VALUE_NOBOARD, CmdGetSequenceMaxLength),
+  CMD(      "GPC_", "STLD", 0, REPLY_VALUE_NOBOARD, CmdGetSettledOutput),
+  CMD(      "GPC_", "TELE", 0, REPLY_VALUE_NOBOARD, CmdGetTelemetry),
+  CMD(      "GPC_", "TQML", 0, REPLY_VALUE_NOBOARD, CmdGetTrajectoryMaxLength),
+  CMD(      "GPC_", "VERS", 0, REPLY_VALUE_NOBOARD, CmdGetVersion),
+  CMD_LIST( "GRP_",         1, REPLY_VALUE,         CmdGetRemoteParam, remoteIDs),
+  CMD(      "SMC_", "CONF", 1, REPLY_ERROR,         CmdConfig),
+  CMD(      "SMC_", "DREG", 3, REPLY_ERROR,         CmdSetRegister),
+  CMD(      "SMC_", "HOME", 1, REPLY_ERROR,         CmdHome),
+  CMD(      "SMC_", "MPOS", 2, REPLY_ERROR,         CmdMoveToPos),
+  CMD(      "SMC_", "MVEL", 2, REPLY_ERROR,         CmdMoveAtVel),
+  CMD(      "SMC_", "ORIG", 1, REPLY_ERROR,         CmdSetOrigin),
+  CMD(      "SMC_", "SCLR", 1, REPLY_ERROR,         CmdClearStatus),
+  CMD(      "SMC_", "SPOS", 2, REPLY_ERROR,         CmdMoveToPosSync),
+  CMD(      "SMC_", "SQAD", 2, REPLY_ERROR,         CmdAddToSequence),
+  CMD(      "SMC_", "SQCL", 1, REPLY_ERROR,         CmdClearSequence),
+  CMD(      "SMC_", "SQST", 2, REPLY_ERROR,         CmdStartSequence),
+  CMD(      "SMC_", "TQAD", 3, REPLY_ERROR,         CmdAddToTrajectory),
+  CMD(      "SMC_", "TQCL", 1, REPLY_ERROR,         CmdClearTrajectory),
+  CMD(      "SMC_", "TQST", 2, REPLY_ERROR,         CmdStartTrajectory),
+  CMD_LIST( "SMP_",         2, REPLY_ERROR,         CmdSetMotorParam, motParamsIDs),
+  CMD(      "SMP_", "PALL", 1, REPLY_ERROR,         CmdSetAllParams),
+  CMD(      "SMP_", "TAXI", 2, REPLY_ERROR,         CmdSetAxisType),
+  CMD(      "SMP_", "TDEV", 2, REPLY_ERROR,         CmdSetDeviceType),
+  CMD_LIST( "SMS_",         2, REPLY_ERROR,         CmdSetMotorStatus, motStatIDs),
+  CMD(      "SPC_", "CAPT", 0, REPLY_ERROR,         CmdSetCapture),
+  CMD(      "SPC_", "CCFG", 0, REPLY_ERROR,         CmdSetCaptureConfig),
+  CMD(      "SPC_", "LINK", 0, REPLY_ERROR,         CmdResetLinkStats),
+  CMD(      "SPC_", "PERF", 0, REPLY_ERROR,         CmdSetPerfCounters),
+  CMD(      "SPC_", "SAFL", 0, REPLY_ERROR,         CmdSaveToFlash),
+  CMD(      "SPC_", "SQTR", 0, REPLY_ERROR,         CmdTriggerSequence),
+  CMD(      "SPC_", "STLD", 0, REPLY_ERROR,         CmdSetSettledOutput),
+  CMD(      "SPC_", "TELE", 0, REPLY_ERROR,         CmdSetTelemetry),
+  CMD_LIST( "SRP_",         2, REPLY_ERROR,         CmdSetRemoteParam, remoteIDs),
+};
+constexpr uint8_t SerialComm::commandTableSize = sizeof(commandTable)/sizeof(commandTable[0]);
+static_assert(IsCommandTableSorted(), "SerialComm::commandTable is not sorted");
+
+#undef CMD
+#undef CMD_LIST
+
+
+// *************************************************************************************
+// Command handlers
+// *************************************************************************************
+
+// ----------------------------
+// *IDN?: ID query
+// ----------------------------
+
+int8_t SerialComm::CmdIdentify(SerialCommand &cmd)
+{
+  if (params->IsConfiguring()) {
+    Serial.println(SERIAL_ID_STRING SERIAL_ID_CONFIGURING); // same prefix, so hosts already find the controller
+  } else {
+    Serial.println(SERIAL_ID_STRING);
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GMC_DREG: get driver register value
+// ----------------------------
+
+int8_t SerialComm::CmdGetRegister(SerialCommand &cmd)
+{
+  int8_t fresh = (cmd.numArgs > 2 && cmd.args[2]) ? 1 : 0; // optional fresh read flag
+  return motors->GetRegisterValue(cmd.board, (uint8_t)cmd.args[1], cmd.value, fresh);
+}
+
+
+// ----------------------------
+// GMC_POSR: get position reached
+// ----------------------------
+
+int8_t SerialComm::CmdGetPosReached(SerialCommand &cmd)
+{
+  return motors->IsMotionDone(cmd.board, cmd.value);
+}
+
+
+// ----------------------------
+// GMC_SQLN: get the number of positions in the sequence
+// ----------------------------
+
+int8_t SerialComm::CmdGetSequenceLength(SerialCommand &cmd)
+{
+  return motors->GetSequenceLength(cmd.board, cmd.value);
+}
+
+
+// ----------------------------
+// GMC_STAT: get status flags
+// ----------------------------
+
+int8_t SerialComm::CmdGetStatusFlags(SerialCommand &cmd)
+{
+  int8_t fresh = (cmd.numArgs > 1 && cmd.args[1]) ? 1 : 0; // optional fresh read flag
+  return motors->GetStatusFlags(cmd.board, cmd.value, fresh);
+}
+
+
+// ----------------------------
+// GMC_TQLN: get the number of segments waiting in the trajectory queue
+// ----------------------------
+
+int8_t SerialComm::CmdGetTrajectoryLength(SerialCommand &cmd)
+{
+  return motors->GetTrajectoryLength(cmd.board, cmd.value);
+}
+
+
+// ----------------------------
+// GMP_xxxx: get motor parameter
+// ----------------------------
+
+int8_t SerialComm::CmdGetMotorParam(SerialCommand &cmd)
+{
+  return params->GetMotorParams(cmd.board, cmd.idx, cmd.value);
+}
+
+
+// ----------------------------
+// GMP_PALL: get all motor and remote parameters of a board (-1 -> all boards, one line each)
+// ----------------------------
+
+int8_t SerialComm::CmdGetAllParams(SerialCommand &cmd)
+{
+  char reply[SERIAL_MAX_LINE_LENGTH];
+  int8_t first = cmd.board;
+  int8_t last = cmd.board;
+  int len;
+
+  if (cmd.board == -1) {
+    first = 0;
+    last = MAXNUMMOTORS-1;
+  } else if (!params->IsValidMotor(cmd.board)) {
+    ReportErrorCode(ERR_Parameter);
+    return ERR_Parameter;
+  }
+  // e.g. "MP_PALL0=<motor params in motParamsIDList order>,<remote params in remoteIDList order>"
+  for (int8_t b=first; b<=last; b++) {
+    len = snprintf(reply, sizeof(reply), "MP_PALL%d=", b);
+    for (int8_t z=0; z<MOTORS_NUM_PARAMS; z++) {
+      len += snprintf(reply+len, sizeof(reply)-len, z ? ",%ld" : "%ld", (long)params->motorParamArr[b][z]);
+    }
+    for (int8_t z=0; z<REMOTE_NUM_PARAMS; z++) {
+      len += snprintf(reply+len, sizeof(reply)-len, ",%ld", (long)params->remoteParamArr[b][z]);
+    }
+    Serial.println(reply);
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GMP_TAXI: get axis type
+// ----------------------------
+
+int8_t SerialComm::CmdGetAxisType(SerialCommand &cmd)
+{
+  return params->GetAxisType(cmd.board, cmd.value);
+}
+
+
+// ----------------------------
+// GMP_TDEV: get device type
+// ----------------------------
+
+int8_t SerialComm::CmdGetDeviceType(SerialCommand &cmd)
+{
+  return params->GetDeviceType(cmd.board, cmd.value);
+}
+
+
+// ----------------------------
+// GMS_xxxx: get motor status
+// ----------------------------
+
+int8_t SerialComm::CmdGetMotorStatus(SerialCommand &cmd)
+{
+  int8_t fresh = (cmd.numArgs > 1 && cmd.args[1]) ? 1 : 0; // optional fresh read flag
+  return motors->GetStatusValue(cmd.board, cmd.idx, cmd.value, fresh);
+}
+
+
+// ----------------------------
+// GPC_BOOT: get the time from the power up until the boards were configured (0 -> still configuring)
+// ----------------------------
 
-    } // if (Serial.available() > 0) 
+int8_t SerialComm::CmdGetBootTime(SerialCommand &cmd)
+{
+  cmd.value = (int32_t)params->GetBootTime();
+  return ERR_None;
+}
 
-    // reset the check time
-    lastCheckTime = currentTime;
 
-  } // if (currentTime - lastCheckTime > SERIAL_CHECK_INTERVAL_MS)
+// ----------------------------
+// GPC_CAPT: get the state of the capture (see CaptureState)
+// ----------------------------
+
+int8_t SerialComm::CmdGetCapture(SerialCommand &cmd)
+{
+  cmd.value = motors->GetCaptureState();
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_CDMP: dump samples of the stopped capture as a binary block
+// ----------------------------
+
+int8_t SerialComm::CmdGetCaptureDump(SerialCommand &cmd)
+{
+  char reply[SERIAL_MAX_LINE_LENGTH];
+  int32_t numSamples = (int32_t)motors->GetCaptureLength();
+  int32_t first = (cmd.numArgs > 0 ? cmd.args[0] : 0);
+  int32_t num = (cmd.numArgs > 1 ? cmd.args[1] : numSamples - first);
+  uint16_t sampleSize = motors->GetCaptureSampleSize();
+  uint16_t crc = 0xFFFF;
+  uint8_t bytes[4];
+
+  if (motors->GetCaptureState() != CAPTURE_OFF) {
+    SetErrorMsg("Capture is running");
+    ReportErrorCode(ERR_Serial);
+    return ERR_Serial;
+  }
+  if (first < 0 || first > numSamples || num < 0) {
+    SetErrorMsg("Capture sample index out of range");
+    ReportErrorCode(ERR_Serial);
+    return ERR_Serial;
+  }
+  if (num > numSamples - first) num = numSamples - first;
+
+  // e.g. "PC_CDMP=0,1000,3" (first sample, number of samples, values per sample), followed by
+  // num*sampleSize values (int32, little endian) and the CRC-16 of these bytes (little endian)
+  snprintf(reply, sizeof(reply), "PC_CDMP=%ld,%ld,%u", (long)first, (long)num, sampleSize);
+  Serial.println(reply);
+  for (int32_t z=0; z<num; z++) {
+    const int32_t *sample = motors->GetCaptureSample(first + z);
+    for (uint16_t v=0; v<sampleSize; v++) {
+      for (int8_t b=0; b<4; b++) bytes[b] = (uint8_t)((uint32_t)sample[v] >> (8*b));
+      crc = Crc16(bytes, 4, crc);
+      Serial.write(bytes, 4);
+    }
+  }
+  bytes[0] = (uint8_t)(crc & 0xFF);
+  bytes[1] = (uint8_t)(crc >> 8);
+  Serial.write(bytes, 2);
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_CNUM: get the number of samples in the capture buffer
+// ----------------------------
+
+int8_t SerialComm::CmdGetCaptureLength(SerialCommand &cmd)
+{
+  cmd.value = (int32_t)motors->GetCaptureLength();
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_EMSG: get error message
+// ----------------------------
+
+int8_t SerialComm::CmdGetErrorMsg(SerialCommand &cmd)
+{
+  ReportErrorMsg();
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_LINK: get a statistics item of the remote link
+// ----------------------------
+
+int8_t SerialComm::CmdGetLinkStat(SerialCommand &cmd)
+{
+  if (cmd.numArgs == 0) { // without an item: number of items
+    cmd.value = LINK_NUM_ITEMS;
+    return ERR_None;
+  }
+  return remote->GetLinkStat(cmd.args[0], cmd.value);
+}
+
+
+// ----------------------------
+// GPC_MSTA: get motion done, position and status flags of several boards in one reply
+// ----------------------------
+
+int8_t SerialComm::CmdGetMultiStatus(SerialCommand &cmd)
+{
+  MotorMultiStatus multi;
+  char reply[SERIAL_MAX_LINE_LENGTH];
+  int32_t mask = (cmd.numArgs > 0) ? cmd.args[0] : -1; // default -> all active boards
+  int8_t fresh = (cmd.numArgs > 1 && cmd.args[1]) ? 1 : 0; // optional fresh read flag
+  int len;
+
+  if (int8_t err=motors->GetStatusMulti(mask, multi, fresh)) {
+    ReportErrorCode(err);
+    return err;
+  }
+  // e.g. "PC_MSTA=0,1,1200,3072;1,0,-350,3584" (board, done, XACT, status flags for each board)
+  len = snprintf(reply, sizeof(reply), "PC_MSTA=");
+  for (int8_t b=0; b<multi.num; b++) {
+    len += snprintf(reply+len, sizeof(reply)-len, b ? ";%d,%ld,%ld,%ld" : "%d,%ld,%ld,%ld", multi.board[b],
+                    (long)multi.done[b], (long)multi.xact[b], (long)multi.status[b]);
+  }
+  Serial.println(reply);
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_NDEV: get number of devices
+// ----------------------------
+
+int8_t SerialComm::CmdGetNumDevices(SerialCommand &cmd)
+{
+  cmd.value = MAXNUMMOTORS;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_PCNT: get the number of parameter value changes (hosts use it to validate their parameter cache)
+// ----------------------------
+
+int8_t SerialComm::CmdGetParamChangeCount(SerialCommand &cmd)
+{
+  cmd.value = (int32_t)params->GetChangeCount();
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_SQML: get the max sequence length (0 if there is no trigger input)
+// ----------------------------
+
+int8_t SerialComm::CmdGetSequenceMaxLength(SerialCommand &cmd)
+{
+  cmd.value = (MOTORS_SEQ_TRIGGER_PIN >= 0 ? MOTORS_SEQ_MAX_LENGTH : 0);
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_PERF: get a performance counter
+// ----------------------------
+
+int8_t SerialComm::CmdGetPerfCounter(SerialCommand &cmd)
+{
+#if PERF_ENABLED
+  if (cmd.numArgs == 0) { // without an item: number of counters
+    cmd.value = PERF_NUM_ITEMS;
+    return ERR_None;
+  }
+  if (cmd.args[0] < 0 || cmd.args[0] >= PERF_NUM_ITEMS) {
+    SetErrorMsg("Performance counter out of range");
+    return ERR_Serial;
+  }
+  cmd.value = (int32_t)g_perf[cmd.args[0]];
+  return ERR_None;
+#else
+  SetErrorMsg("Performance counters not available (PERF_ENABLED 0)");
+  return ERR_Serial;
+#endif // PERF_ENABLED
+}
+
+
+// ----------------------------
+// GPC_STLD: get the board mask of the settled output
+// ----------------------------
+
+int8_t SerialComm::CmdGetSettledOutput(SerialCommand &cmd)
+{
+  cmd.value = motors->GetSettledMask();
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_VERS: get version
+// ----------------------------
+
+int8_t SerialComm::CmdGetVersion(SerialCommand &cmd)
+{
+  cmd.value = VERSION;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_TELE: get the telemetry rate
+// ----------------------------
+
+int8_t SerialComm::CmdGetTelemetry(SerialCommand &cmd)
+{
+  cmd.value = telemetryRate;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GPC_TQML: get the max number of segments in the trajectory queue
+// ----------------------------
+
+int8_t SerialComm::CmdGetTrajectoryMaxLength(SerialCommand &cmd)
+{
+  cmd.value = MOTORS_TRAJ_MAX_SEGMENTS;
+  return ERR_None;
+}
+
+
+// ----------------------------
+// GRP_xxxx: get remote parameter
+// ----------------------------
+
+int8_t SerialComm::CmdGetRemoteParam(SerialCommand &cmd)
+{
+  return params->GetRemoteParams(cmd.board, cmd.idx, cmd.value);
+}
+
+
+// ----------------------------
+// SMC_CONF: configure board
+// ----------------------------
+
+int8_t SerialComm::CmdConfig(SerialCommand &cmd)
+{
+  int8_t err;
+
+  int8_t full = (cmd.numArgs > 1 && cmd.args[1]) ? 1 : 0; // optional flag to rewrite all parameter groups
+  if (err=motors->ConfigBoard(cmd.board, full)) return err;
+  return remote->Config(cmd.board);
+}
+
+
+// ----------------------------
+// SMC_DREG: set driver register value
+// ----------------------------
+
+int8_t SerialComm::CmdSetRegister(SerialCommand &cmd)
+{
+  return motors->SetRegisterValue(cmd.board, (uint8_t)cmd.args[1], cmd.args[2]);
+}
+
+
+// ----------------------------
+// SMC_HOME: start homing
+// ----------------------------
+
+int8_t SerialComm::CmdHome(SerialCommand &cmd)
+{
+  int8_t err;
+
+  if (err=CheckRemoteControl(cmd.board)) return err;
+  return motors->StartHoming(cmd.board);
+}
+
+
+// ----------------------------
+// SMC_MPOS: move to position
+// ----------------------------
+
+int8_t SerialComm::CmdMoveToPos(SerialCommand &cmd)
+{
+  int8_t err;
+  MotorMoveList moves;
+
+  if (cmd.numArgs > 2) { // several <board>,<pos> pairs -> batched move
+    if (err=BuildMoveList(cmd, moves)) return err;
+    return motors->MoveToPosMulti(moves, 0);
+  }
+  if (err=CheckRemoteControl(cmd.board)) return err;
+  return motors->MoveToPos(cmd.board, cmd.args[1], 1); // set the velocity
+}
+
+
+// ----------------------------
+// SMC_SPOS: synchronized move to position (all axes arrive together)
+// ----------------------------
+
+int8_t SerialComm::CmdMoveToPosSync(SerialCommand &cmd)
+{
+  int8_t err;
+  MotorMoveList moves;
+
+  if (err=BuildMoveList(cmd, moves)) return err;
+  return motors->MoveToPosMulti(moves, 1);
+}
+
+
+// ----------------------------
+// SMC_MVEL: move at velocity
+// ----------------------------
+
+int8_t SerialComm::CmdMoveAtVel(SerialCommand &cmd)
+{
+  int8_t err;
+
+  if (err=CheckRemoteControl(cmd.board)) return err;
+  return motors->MoveAtVel(cmd.board, cmd.args[1]);
+}
+
+
+// ----------------------------
+// SMC_ORIG: set XACT, XTAR and XENC without moving
+// (SMC_ORIG<board>[,<pos>] with -1 -> all active boards, or several <board>,<pos> pairs)
+// ----------------------------
+
+int8_t SerialComm::CmdSetOrigin(SerialCommand &cmd)
+{
+  int8_t err;
+  MotorMoveList origins;
+
+  if (cmd.numArgs > 2) {
+    if (err=BuildMoveList(cmd, origins)) return err;
+    return motors->SetOrigin(origins);
+  }
+  if (cmd.board != -1) {
+    if (err=CheckRemoteControl(cmd.board)) return err;
+    origins.num = 1;
+    origins.board[0] = cmd.board;
+    origins.pos[0] = (cmd.numArgs > 1) ? cmd.args[1] : 0;
+    return motors->SetOrigin(origins);
+  }
+  origins.num = 0;
+  for (int8_t z=0; z<MAXNUMMOTORS; z++) {
+    if (!params->IsActiveMotor(z)) continue; // silently skip if not defined
+    if (err=CheckRemoteControl(z)) return err;
+    origins.board[origins.num] = z;
+    origins.pos[origins.num] = (cmd.numArgs > 1) ? cmd.args[1] : 0;
+    origins.num++;
+  }
+  return motors->SetOrigin(origins);
+}
+
+
+// ----------------------------
+// SMC_SCLR: clear status registers
+// ----------------------------
+
+int8_t SerialComm::CmdClearStatus(SerialCommand &cmd)
+{
+  return motors->ClearStatusRegs(cmd.board);
+}
+
+
+// ----------------------------
+// SMC_SQAD: append positions to the sequence
+// ----------------------------
+
+int8_t SerialComm::CmdAddToSequence(SerialCommand &cmd)
+{
+  return motors->AddToSequence(cmd.board, cmd.args+1, cmd.numArgs-1);
+}
+
+
+// ----------------------------
+// SMC_SQCL: clear the sequence
+// ----------------------------
+
+int8_t SerialComm::CmdClearSequence(SerialCommand &cmd)
+{
+  return motors->ClearSequence(cmd.board);
+}
+
+
+// ----------------------------
+// SMC_SQST: arm or stop the sequence
+// ----------------------------
+
+int8_t SerialComm::CmdStartSequence(SerialCommand &cmd)
+{
+  int8_t err;
+  MotorMoveList states;
+
+  if (cmd.numArgs > 2) { // <board>,<state> pairs, armed from the same trigger edge
+    if (err=BuildMoveList(cmd, states)) return err;
+  } else {
+    if (cmd.args[1] && (err=CheckRemoteControl(cmd.board))) return err;
+    states.num = 1;
+    states.board[0] = cmd.board;
+    states.pos[0] = cmd.args[1];
+  }
+  for (int8_t z=0; z<states.num; z++) states.pos[z] = states.pos[z] ? 1 : 0;
+  return motors->StartSequence(states);
+}
+
+
+// ----------------------------
+// SMC_TQAD: append a segment to the trajectory queue
+// ----------------------------
+
+int8_t SerialComm::CmdAddToTrajectory(SerialCommand &cmd)
+{
+  MotorSegment seg;
+
+  // SMC_TQAD<motor>,<pos>,<vel>[,<acc>[,<mode>]]
+  seg.pos = cmd.args[1];
+  seg.vel = cmd.args[2];
+  seg.acc = (cmd.numArgs > 3 ? cmd.args[3] : 0);
+  seg.velMode = (cmd.numArgs > 4 && cmd.args[4]) ? 1 : 0;
+  return motors->AddToTrajectory(cmd.board, seg);
+}
+
+
+// ----------------------------
+// SMC_TQCL: clear the trajectory queue
+// ----------------------------
+
+int8_t SerialComm::CmdClearTrajectory(SerialCommand &cmd)
+{
+  return motors->ClearTrajectory(cmd.board);
+}
+
+
+// ----------------------------
+// SMC_TQST: start or stop the trajectory
+// ----------------------------
+
+int8_t SerialComm::CmdStartTrajectory(SerialCommand &cmd)
+{
+  int8_t err;
+
+  if (cmd.args[1] && (err=CheckRemoteControl(cmd.board))) return err;
+  return motors->StartTrajectory(cmd.board, cmd.args[1] ? 1 : 0);
+}
+
+
+// ----------------------------
+// SMP_xxxx: set motor parameter
+// ----------------------------
+
+int8_t SerialComm::CmdSetMotorParam(SerialCommand &cmd)
+{
+  return params->SetMotorParams(cmd.board, cmd.idx, cmd.args[1]);
+}
+
+
+// ----------------------------
+// SMP_PALL: set all motor and remote parameters of a board (same order as GMP_PALL)
+// ----------------------------
+
+int8_t SerialComm::CmdSetAllParams(SerialCommand &cmd)
+{
+  int8_t err;
+  int32_t value, current;
+
+  if (cmd.numArgs != 1 + PARAMS_NUM_BULK) {
+    SetErrorMsg("Expected <board> followed by all motor and remote parameters");
+    return ERR_Serial;
+  }
+  if (!params->IsValidMotor(cmd.board)) return ERR_Parameter;
+  // check all remote values first (JMAX against the new RMXV), so either all values are set or none
+#if REMOTE_ENABLED
+  for (int8_t z=0; z<REMOTE_NUM_PARAMS; z++) {
+    value = cmd.args[1+MOTORS_NUM_PARAMS+z];
+    params->GetRemoteParams(cmd.board, z, current);
+    if (value == current) continue;
+    if (err=remote->CheckRemoteCommand(params->remoteIDList[z], cmd.board, value, &cmd.args[1])) return err;
+  }
+#endif
+  for (int8_t z=0; z<MOTORS_NUM_PARAMS; z++) {
+    if (err=params->SetMotorParams(cmd.board, z, cmd.args[1+z])) return err;
+  }
+  for (int8_t z=0; z<REMOTE_NUM_PARAMS; z++) {
+    value = cmd.args[1+MOTORS_NUM_PARAMS+z];
+    params->GetRemoteParams(cmd.board, z, current);
+    if (value == current) continue; // only the changes go out to the remote
+#if REMOTE_ENABLED
+    if (err=remote->SendRemoteCommand(params->remoteIDList[z], cmd.board, value)) return err;
+#endif
+    if (err=params->SetRemoteParams(cmd.board, z, value)) return err;
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// SMP_TAXI: set axis type
+// ----------------------------
+
+int8_t SerialComm::CmdSetAxisType(SerialCommand &cmd)
+{
+  return params->SetAxisType(cmd.board, cmd.args[1]);
+}
+
+
+// ----------------------------
+// SMP_TDEV: set device type
+// ----------------------------
+
+int8_t SerialComm::CmdSetDeviceType(SerialCommand &cmd)
+{
+  return params->SetDeviceType(cmd.board, cmd.args[1]);
+}
+
+
+// ----------------------------
+// SMS_xxxx: set motor status
+// ----------------------------
+
+int8_t SerialComm::CmdSetMotorStatus(SerialCommand &cmd)
+{
+  return motors->SetStatusValue(cmd.board, cmd.idx, cmd.args[1]);
+}
+
+
+// ----------------------------
+// SPC_SAFL: save config to flash
+// ----------------------------
+
+int8_t SerialComm::CmdSaveToFlash(SerialCommand &cmd)
+{
+  return params->SaveConfigToFlash();
+}
+
+
+// ----------------------------
+// SPC_SQTR: advance the sequences like a trigger edge
+// ----------------------------
+
+int8_t SerialComm::CmdTriggerSequence(SerialCommand &cmd)
+{
+  return motors->TriggerSequence();
+}
+
+
+// ----------------------------
+// SPC_LINK: clear the statistics of the remote link
+// ----------------------------
+
+int8_t SerialComm::CmdResetLinkStats(SerialCommand &cmd)
+{
+  remote->ResetLinkStats();
+  return ERR_None;
+}
+
+
+// ----------------------------
+// SPC_PERF: clear the performance counters and switch them on or off
+// ----------------------------
+
+int8_t SerialComm::CmdSetPerfCounters(SerialCommand &cmd)
+{
+#if PERF_ENABLED
+  int32_t enable = (cmd.numArgs > 0 ? cmd.args[0] : 1);
+
+  if (enable < 0 || enable > 1) {
+    SetErrorMsg("Performance counter mode out of range");
+    return ERR_Serial;
+  }
+  PerfReset((int8_t)enable);
+  return ERR_None;
+#else
+  SetErrorMsg("Performance counters not available (PERF_ENABLED 0)");
+  return ERR_Serial;
+#endif // PERF_ENABLED
+}
+
+
+// ----------------------------
+// SPC_CAPT: start (1), arm (2) or stop (0) the capture
+// ----------------------------
+
+int8_t SerialComm::CmdSetCapture(SerialCommand &cmd)
+{
+  int32_t mode = (cmd.numArgs > 0 ? cmd.args[0] : 0);
+
+  if (mode < 0 || mode > 2) {
+    SetErrorMsg("Capture mode out of range");
+    return ERR_Serial;
+  }
+  return motors->StartCapture((int8_t)mode);
+}
+
+
+// ----------------------------
+// SPC_CCFG: configure the boards, signals and sample rate of the capture
+// ----------------------------
+
+int8_t SerialComm::CmdSetCaptureConfig(SerialCommand &cmd)
+{
+  if (cmd.numArgs < 3) {
+    SetErrorMsg("Capture boards, signals and rate required");
+    return ERR_Serial;
+  }
+  if (cmd.args[0] < 0 || cmd.args[0] > 0xFF || cmd.args[1] < 0 || cmd.args[1] > 0xFF
+      || cmd.args[2] < 1 || cmd.args[2] > MOTORS_CAPTURE_MAX_RATE_HZ) {
+    SetErrorMsg("Capture boards, signals or rate out of range");
+    return ERR_Serial;
+  }
+  return motors->ConfigCapture((uint8_t)cmd.args[0], (uint8_t)cmd.args[1], (uint16_t)cmd.args[2]);
+}
+
+
+// ----------------------------
+// SPC_STLD: configure the settled output
+// ----------------------------
+
+int8_t SerialComm::CmdSetSettledOutput(SerialCommand &cmd)
+{
+  int32_t mask = (cmd.numArgs > 0 ? cmd.args[0] : 0);
+  int32_t settleTime = (cmd.numArgs > 1 ? cmd.args[1] : 0);
+  int32_t pulse = (cmd.numArgs > 2 ? cmd.args[2] : 0);
+
+  if (mask < 0 || mask > 0xFF || settleTime < 0 || settleTime > MOTORS_SETTLED_MAX_TIME_MS || pulse < 0 || pulse > 1) {
+    SetErrorMsg("Settled output mask, time or mode out of range");
+    return ERR_Serial;
+  }
+  return motors->SetSettledOutput((uint8_t)mask, (uint16_t)settleTime, (int8_t)pulse);
+}
+
+
+// ----------------------------
+// SPC_TELE: start or stop the telemetry stream
+// ----------------------------
+
+int8_t SerialComm::CmdSetTelemetry(SerialCommand &cmd)
+{
+  int32_t rate = (cmd.numArgs > 0 ? cmd.args[0] : 0);
+  int32_t format = (cmd.numArgs > 1 ? cmd.args[1] : 0);
+
+  if (rate < 0 || rate > SERIAL_TELE_MAX_RATE_HZ || format < 0 || format > 1) {
+    SetErrorMsg("Telemetry rate or format out of range");
+    return ERR_Serial;
+  }
+  telemetryRate = (uint16_t)rate;
+  telemetryBinary = (int8_t)format;
+  motors->SetTelemetryInterval(rate ? (uint16_t)(1000/rate) : 0);
+  return ERR_None;
+}
+
+
+// ----------------------------
+// SRP_xxxx: set remote parameter
+// ----------------------------
+
+int8_t SerialComm::CmdSetRemoteParam(SerialCommand &cmd)
+{
+#if REMOTE_ENABLED
+  int8_t err;
+
+  if (err=remote->SendRemoteCommand(params->remoteIDList[cmd.idx], cmd.board, cmd.args[1])) return err;
+#endif
+  return params->SetRemoteParams(cmd.board, cmd.idx, cmd.args[1]);
+}
+
+
+// ----------------------------
+// Build the move list from the <board>,<pos> pairs of a batched move
+// ----------------------------
+
+int8_t SerialComm::BuildMoveList(SerialCommand &cmd, MotorMoveList &moves)
+{
+  int8_t err;
+
+  if ( (cmd.numArgs % 2) || (cmd.numArgs/2 > MAXNUMMOTORS) ) {
+    SetErrorMsg("Expected up to MAXNUMMOTORS <board>,<pos> pairs");
+    return ERR_Serial;
+  }
+  moves.num = cmd.numArgs/2;
+  for (int8_t z=0; z<moves.num; z++) {
+    if (cmd.args[2*z] < INT8_MIN || cmd.args[2*z] > INT8_MAX) {
+      SetErrorMsg("Invalid board number");
+      return ERR_Serial;
+    }
+    moves.board[z] = (int8_t)cmd.args[2*z];
+    moves.pos[z] = cmd.args[2*z+1];
+    if (err=CheckRemoteControl(moves.board[z])) return err;
+  }
+  return ERR_None;
 }
 
 
@@ -420,6 +1444,7 @@ void SerialComm::CheckSerialCommand(void)
 
 int8_t SerialComm::CheckRemoteControl(int8_t board)
 {
+  if (board < 0 || board >= MAXNUMMOTORS) return ERR_None; // invalid boards are reported by the motor module
   if (motors->isRemoteControlled[board]) {
     SetErrorMsg("Motor is under remote control");
     return ERR_Serial;
@@ -476,7 +1501,7 @@ void SerialComm::ReportErrorMsg(void)
   int8_t firstError = 1;
 
   Serial.print("PC_EMSG=");
-  if(errorFlag || params->errorFlag || motors->errorFlag || remote->errorFlag) {
+  if(errorFlag || params->errorFlag || motors->errorFlag || motors->errorMsgQueue || remote->errorFlag) {
     // print all the error messages
     if (errorFlag) {
       Serial.print("Serial: ");
@@ -489,7 +1514,7 @@ void SerialComm::ReportErrorMsg(void)
       params->PrintErrorMsg();
       firstError = 0;
     }
-    if (motors->errorFlag) {
+    if (motors->errorFlag || motors->errorMsgQueue) {
       if (!firstError) Serial.print("; "); 
       Serial.print("Motors: ");
       motors->PrintErrorMsg();
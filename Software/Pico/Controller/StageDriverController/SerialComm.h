@@ -9,6 +9,122 @@
 #include "RemoteComm.h"
 
 
+// *************************************************************************************
+// forward declarations
+// *************************************************************************************
+class SerialComm;
+
+
+// *************************************************************************************
+// Helper functions
+// *************************************************************************************
+
+/**
+ * @brief Packs up to four characters into a 32-bit key (first char in the most significant byte).
+ *
+ * Shorter strings are padded with zeros, so the numeric order of the keys matches the alphabetical
+ * order of the strings. Used to compare the 4-char command groups and IDs with a single integer compare.
+ *
+ * @param str The string to pack (only the first four characters are used).
+ * @return uint32_t The packed key.
+ */
+constexpr uint32_t PackID(const char *str)
+{
+  uint32_t key = 0;
+  int8_t z = 0;
+  for (; z<4 && str[z]!='\0'; z++) key = (key << 8) | (uint8_t)str[z];
+  for (; z<4; z++) key <<= 8;
+  return key;
+}
+
+
+/**
+ * @brief Calculates the CRC-16/CCITT-FALSE (polynomial 0x1021, start value 0xFFFF) of a byte array.
+ *
+ * @param data Pointer to the data.
+ * @param len Number of bytes.
+ * @param crc Start value, pass the CRC of the previous bytes to continue a CRC over several blocks.
+ * @return uint16_t The CRC value.
+ */
+uint16_t Crc16(const uint8_t *data, uint16_t len, uint16_t crc = 0xFFFF);
+
+
+// *************************************************************************************
+// Binary framing
+// *************************************************************************************
+
+/**
+ * @brief Command groups of the binary protocol, the group code of a frame is the index into this list.
+ *
+ * Binary request frame (SERIAL_BIN_REQUEST_SIZE bytes, multi-byte values little-endian):
+ *   [0] SERIAL_BIN_SYNC, [1] group code, [2..5] command ID (4 chars, e.g. "XACT"),
+ *   [6] board (int8), [7] sub-argument (uint8, e.g. the register for MC_DREG, or SERIAL_BIN_SUB_VALUE),
+ *   [8..11] value (int32), [12..13] CRC16 of bytes 0..11.
+ * Binary reply frame (SERIAL_BIN_REPLY_SIZE bytes):
+ *   [0] SERIAL_BIN_REPLY_SYNC, [1] error code (int8), [2..5] value (int32), [6..7] CRC16 of bytes 0..5.
+ *
+ * Only append new groups at the end, the codes are part of the host protocol.
+ */
+static constexpr const char* binaryGroupList[] = {
+    "GMC_", "GMP_", "GMS_", "GPC_", "GRP_",
+    "SMC_", "SMP_", "SMS_", "SPC_", "SRP_"
+  };
+static constexpr uint8_t binaryGroupCount = sizeof(binaryGroupList) / sizeof(binaryGroupList[0]);
+
+
+// *************************************************************************************
+// Structure definitions
+// *************************************************************************************
+
+/**
+ * @struct SerialCommand
+ * @brief A parsed serial command, passed to the command handlers.
+ */
+struct SerialCommand {
+  const char *line; // the complete command line (null-terminated)
+  int8_t board; // board index (first argument, 0 if the command has no arguments)
+  int32_t idx; // index into the ID list for parameter and status commands (-1 otherwise)
+  uint8_t numArgs; // number of parsed integer arguments (incl. the board)
+  int32_t args[SERIAL_MAX_ARGS]; // parsed integer arguments, args[0] is the board
+  int32_t value; // value returned by get commands
+};
+
+/**
+ * @enum SerialReplyType
+ * @brief How the dispatcher answers a command after the handler returns.
+ */
+typedef enum {
+  REPLY_ERROR = 0,    // set commands: "ERROR=<err>"
+  REPLY_VALUE,        // get commands: "<cmd><board>=<value>" (or "ERROR=<err>" on failure)
+  REPLY_VALUE_NOBOARD,// get commands without board: "<cmd>=<value>" (or "ERROR=<err>" on failure)
+  REPLY_CUSTOM        // the handler prints the reply itself
+} SerialReplyType;
+
+/**
+ * @brief Command handler function: returns 0 on success, or a negative error code on failure.
+ */
+typedef int8_t (SerialComm::*SerialCommandHandler)(SerialCommand &cmd);
+
+/**
+ * @struct SerialCommandEntry
+ * @brief Entry in the command dispatch table.
+ *
+ * Commands are identified by the packed group (e.g. "SMC_") and the packed ID (e.g. "MPOS").
+ * Entries with an ID of 0 match all IDs of an ID list (e.g. all motor parameters for "SMP_"),
+ * the index of the matching ID is passed to the handler in SerialCommand::idx.
+ */
+struct SerialCommandEntry {
+  uint32_t group; // packed command group, e.g. PackID("SMC_")
+  uint32_t id; // packed command ID, e.g. PackID("MPOS"), or 0 for an ID list
+  uint8_t numArgs; // minimum number of integer arguments (incl. the board)
+  uint8_t replyType; // one of SerialReplyType
+  SerialCommandHandler handler; // function to execute the command
+  const uint32_t *idKeys; // sorted packed IDs of the ID list (nullptr if not a list)
+  const uint8_t *idIndex; // index into the original ID list for each sorted key
+  uint8_t idCount; // number of IDs in the list
+};
+
+
 // *************************************************************************************
 // SerialComm class
 // *************************************************************************************
@@ -27,6 +143,139 @@ private:
   Motors *motors; // pointer to the Motors class instance, which manages multiple motors
   RemoteComm *remote; // pointer to the RemoteComm class instance, which handles remote communication
   char errorMsg[MAXERRORSTRINGSIZE]; // error message buffer for storing serial communication errors
+  char lineBuffer[SERIAL_MAX_LINE_LENGTH+1]; // buffer to assemble the incoming command line (one extra for the null char)
+  uint16_t lineLength = 0; // number of chars currently in lineBuffer
+  int8_t lineOverflow = 0; // flag to indicate that the current line is too long and gets discarded
+  uint8_t binBuffer[SERIAL_BIN_REQUEST_SIZE]; // buffer to assemble an incoming binary frame
+  uint8_t binLength = 0; // number of bytes currently in binBuffer (0 -> no binary frame in progress)
+  unsigned long binStartTime = 0; // time the first byte of the current binary frame arrived
+  int8_t pendingInput = 0; // command held back until the boot config completed (1 -> lineBuffer, 2 -> binBuffer)
+  uint16_t telemetryRate = 0; // rate of the telemetry stream in Hz (0 -> off)
+  int8_t telemetryBinary = 0; // flag whether the telemetry records are sent as binary frames
+  uint32_t telemetrySeq = 0; // counter of the last telemetry snapshot that was sent
+
+  static const SerialCommandEntry commandTable[]; // dispatch table, sorted by group and ID
+  static const uint8_t commandTableSize; // number of entries in commandTable
+  friend constexpr bool IsCommandTableSorted(void); // compile-time check of commandTable (SerialComm.cpp)
+
+  /**
+   * @brief Finds the table entry for a command group and ID (binary search).
+   *
+   * @param group The packed command group.
+   * @param id The packed command ID (0 finds the ID list entry of the group).
+   * @return const SerialCommandEntry* Pointer to the entry, or nullptr if not found.
+   */
+  const SerialCommandEntry* FindCommand(uint32_t group, uint32_t id);
+
+  /**
+   * @brief Looks up a command name in the dispatch table, including the ID lists of the groups.
+   *
+   * Sets the error message if the command is not found.
+   *
+   * @param name The command (at least the 8-char group and ID, e.g. "GMS_XACT").
+   * @param idx Reference to store the index into the ID list (-1 if the command is not a list entry).
+   * @return const SerialCommandEntry* Pointer to the entry, or nullptr if not found.
+   */
+  const SerialCommandEntry* LookupCommand(const char *name, int32_t &idx);
+
+  /**
+   * @brief Executes a binary request frame and sends the binary reply.
+   *
+   * The frame is mapped onto the same table entry and handler as the ASCII command.
+   *
+   * @param frame The SERIAL_BIN_REQUEST_SIZE bytes of the request frame.
+   */
+  void ProcessBinaryFrame(const uint8_t *frame);
+
+  /**
+   * @brief Sends a binary reply frame.
+   *
+   * @param err The error code of the command.
+   * @param value The returned value (0 for set commands).
+   */
+  void SendBinaryReply(int8_t err, int32_t value);
+
+  /**
+   * @brief Parses a comma-separated list of integers (decimal or 0x-prefixed hex).
+   *
+   * Parsing stops at the first character that is not part of the list, as sscanf would.
+   * Decimal values have to fit into an int32, hex values into 32 bits.
+   *
+   * @param str The string to parse.
+   * @param args Array to store the parsed values.
+   * @param maxArgs Maximum number of values to parse.
+   * @param num Reference to store the number of parsed values.
+   * @return int8_t Returns 0 on success, or ERR_Serial if a value is out of range.
+   */
+  static int8_t ParseArgs(const char *str, int32_t *args, uint8_t maxArgs, uint8_t &num);
+
+  /**
+   * @brief Fills a move list from the <board>,<pos> pairs of a batched move command.
+   *
+   * Also checks that none of the boards is under remote control.
+   *
+   * @param cmd The parsed command.
+   * @param moves Reference to the move list to fill.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t BuildMoveList(SerialCommand &cmd, MotorMoveList &moves);
+
+  // command handlers (see commandTable in SerialComm.cpp)
+  int8_t CmdIdentify(SerialCommand &cmd);
+  int8_t CmdGetRegister(SerialCommand &cmd);
+  int8_t CmdGetPosReached(SerialCommand &cmd);
+  int8_t CmdGetSequenceLength(SerialCommand &cmd);
+  int8_t CmdGetStatusFlags(SerialCommand &cmd);
+  int8_t CmdGetTrajectoryLength(SerialCommand &cmd);
+  int8_t CmdGetMotorParam(SerialCommand &cmd);
+  int8_t CmdGetAllParams(SerialCommand &cmd);
+  int8_t CmdGetAxisType(SerialCommand &cmd);
+  int8_t CmdGetDeviceType(SerialCommand &cmd);
+  int8_t CmdGetMotorStatus(SerialCommand &cmd);
+  int8_t CmdGetBootTime(SerialCommand &cmd);
+  int8_t CmdGetCapture(SerialCommand &cmd);
+  int8_t CmdGetCaptureDump(SerialCommand &cmd);
+  int8_t CmdGetCaptureLength(SerialCommand &cmd);
+  int8_t CmdGetErrorMsg(SerialCommand &cmd);
+  int8_t CmdGetLinkStat(SerialCommand &cmd);
+  int8_t CmdGetMultiStatus(SerialCommand &cmd);
+  int8_t CmdGetNumDevices(SerialCommand &cmd);
+  int8_t CmdGetParamChangeCount(SerialCommand &cmd);
+  int8_t CmdGetPerfCounter(SerialCommand &cmd);
+  int8_t CmdGetSequenceMaxLength(SerialCommand &cmd);
+  int8_t CmdGetSettledOutput(SerialCommand &cmd);
+  int8_t CmdGetTelemetry(SerialCommand &cmd);
+  int8_t CmdGetTrajectoryMaxLength(SerialCommand &cmd);
+  int8_t CmdGetVersion(SerialCommand &cmd);
+  int8_t CmdGetRemoteParam(SerialCommand &cmd);
+  int8_t CmdConfig(SerialCommand &cmd);
+  int8_t CmdSetRegister(SerialCommand &cmd);
+  int8_t CmdHome(SerialCommand &cmd);
+  int8_t CmdMoveToPos(SerialCommand &cmd);
+  int8_t CmdMoveToPosSync(SerialCommand &cmd);
+  int8_t CmdMoveAtVel(SerialCommand &cmd);
+  int8_t CmdSetOrigin(SerialCommand &cmd);
+  int8_t CmdClearStatus(SerialCommand &cmd);
+  int8_t CmdAddToSequence(SerialCommand &cmd);
+  int8_t CmdClearSequence(SerialCommand &cmd);
+  int8_t CmdStartSequence(SerialCommand &cmd);
+  int8_t CmdAddToTrajectory(SerialCommand &cmd);
+  int8_t CmdClearTrajectory(SerialCommand &cmd);
+  int8_t CmdStartTrajectory(SerialCommand &cmd);
+  int8_t CmdSetMotorParam(SerialCommand &cmd);
+  int8_t CmdSetAllParams(SerialCommand &cmd);
+  int8_t CmdSetAxisType(SerialCommand &cmd);
+  int8_t CmdSetDeviceType(SerialCommand &cmd);
+  int8_t CmdSetMotorStatus(SerialCommand &cmd);
+  int8_t CmdSetCapture(SerialCommand &cmd);
+  int8_t CmdSetCaptureConfig(SerialCommand &cmd);
+  int8_t CmdResetLinkStats(SerialCommand &cmd);
+  int8_t CmdSetPerfCounters(SerialCommand &cmd);
+  int8_t CmdSaveToFlash(SerialCommand &cmd);
+  int8_t CmdTriggerSequence(SerialCommand &cmd);
+  int8_t CmdSetSettledOutput(SerialCommand &cmd);
+  int8_t CmdSetTelemetry(SerialCommand &cmd);
+  int8_t CmdSetRemoteParam(SerialCommand &cmd);
 
 public:
   int8_t errorFlag; // error flag to indicate if there is an error in the serial communication
@@ -46,18 +295,50 @@ public:
    * @param paramPtr Pointer to the Parameters instance containing motor and remote settings.
    * @param motorPtr Pointer to the Motors instance managing motor operations.
    * @param remotePtr Pointer to the RemoteComm instance handling remote communication.
-   * @param timeout_ms Timeout for initialization in milliseconds (default is 1000 ms).
+   * @param timeout_ms Timeout for blocking serial reads in milliseconds (default is 1000 ms).
+   * Command lines are read without blocking, so this only applies to Serial.readBytes() and similar.
    */
   void Init(Parameters *paramPtr, Motors *motorPtr, RemoteComm *remotePtr, long timeout_ms = 1000);
 
   /**
    * @brief Checks for incoming serial commands and processes them.
    *
-   * This method reads data from the serial port, checks for valid commands, and processes
-   * them accordingly. It handles command parsing and command execution.
+   * This method never blocks: it moves the available bytes from the serial port into the line buffer
+   * and executes the command as soon as the termination char arrives. At most one command is executed
+   * per call, the remaining bytes are read in the next call.
+   * A line that starts with SERIAL_BIN_SYNC is read as a fixed-size binary frame instead (see binaryGroupList),
+   * so hosts can mix binary and ASCII commands freely.
    */
   void CheckSerialCommand(void);
 
+  /**
+   * @brief Sends the latest telemetry snapshot to the host if the stream is on (SPC_TELE).
+   *
+   * Each new snapshot of the supervision loop is sent once. ASCII records have the format
+   * "TELE=<time>;<board>,<xact>,<xenc>,<flags>;..." (one group per active board),
+   * binary records start with SERIAL_TELE_SYNC (see CommandList.md).
+   * Records are dropped if the serial output buffer is full, so a slow host never stalls the loop.
+   */
+  void SendTelemetry(void);
+
+  /**
+   * @brief Marks the pending telemetry snapshot as sent (called after a set command).
+   *
+   * The snapshot was taken before the command ran, so sending it after the answer would
+   * show the host the state before the command. The next record is taken after the command.
+   */
+  void SkipPendingTelemetry(void);
+
+  /**
+   * @brief Parses and executes a single command line and sends the reply.
+   *
+   * The command is looked up in the dispatch table by its packed group and ID.
+   * The integer arguments are parsed and handed to the handler of the command.
+   *
+   * @param line The null-terminated command line (without the termination char).
+   */
+  void ProcessCommand(const char *line);
+
   /**
    * @brief Helper function to check if a motor is under remote control.
    */
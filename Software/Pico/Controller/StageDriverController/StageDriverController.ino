@@ -5,6 +5,7 @@
 #include "Motors.h"
 #include "RemoteComm.h"
 #include "SerialComm.h"
+#include "Perf.h"
 
 
 //************************************************
@@ -29,26 +30,28 @@ void setup()
   // prep pin to read later
   pinMode(DEFAULT_STARTUP_PIN, INPUT_PULLUP);
 
-  Serial.begin(115200);
+  // the host serial comes up first, it answers *IDN? while the boards are configured
+  g_serComm.Init(&g_params, &g_motors, &g_remComm, 1000); // 1 s timeout
 
   // initialize all the modules
   g_params.Init(&g_motors, &g_remComm);
   g_motors.Init(&g_params);
-  delay(500); // wait for a bit for remote to boot up
-  g_remComm.Init(&g_params, &g_motors, 100); // 100 ms timeout
-  g_serComm.Init(&g_params, &g_motors, &g_remComm, 1000); // 1 s timeout
+  g_remComm.Init(&g_params, &g_motors, 100); // 100 ms timeout, the remote is found by the handshake in the loop
 
   // configuration of the Parameter modules also configures the Motor and Remote modules
   // The Serial module doesn't require a config
   // If the default button is pressed during the boot, the config bypasses the "load from flash"
   // and uses default "safe" configurations with the given number of motors instead
+  // Only the parameters are loaded here, the loop configures one board per pass (see Parameters::ConfigNextBoard)
   
   if (digitalRead(DEFAULT_STARTUP_PIN)==LOW) { // pin pressed during boot
-    g_params.Config(CONFIG_DEFAULT); // set to default motors
+    g_params.BeginConfig(CONFIG_DEFAULT); // set to default motors
   } else {
-    g_params.Config(CONFIG_LOAD_FROM_FLASH); // load from flash
+    g_params.BeginConfig(CONFIG_LOAD_FROM_FLASH); // load from flash
   }
 
+  // from here on, the motor supervision runs on core 1 (if enabled)
+  g_motors.StartSupervisor();
 }
 
 //************************************************
@@ -56,11 +59,34 @@ void setup()
 //************************************************
 void loop()
 {
+  PERF_LOOP(); // loop period histogram
 
+  if (g_params.IsConfiguring()) g_params.ConfigNextBoard(); // boot config, one board per pass
   g_serComm.CheckSerialCommand();
+  g_serComm.SendTelemetry();
+#if !MOTORS_DUAL_CORE
+  PERF_START(perfStart);
   g_motors.ProcessUpdateChanges();
+  PERF_STOP(PERF_UPDATE_COUNT, perfStart);
+#endif // !MOTORS_DUAL_CORE
 #if REMOTE_ENABLED
+  g_remComm.CheckHandshake();
   g_remComm.SendPositionUpdates();
   g_remComm.CheckRemoteCommands();
 #endif // REMOTE_ENABLED
 }
+
+#if MOTORS_DUAL_CORE
+//************************************************
+// setup and loop for core 1 (motor supervision)
+//************************************************
+void setup1()
+{
+  // nothing to do, core 1 waits in RunSupervisor until core 0 completed the setup
+}
+
+void loop1()
+{
+  g_motors.RunSupervisor();
+}
+#endif // MOTORS_DUAL_CORE
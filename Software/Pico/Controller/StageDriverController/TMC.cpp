@@ -4,6 +4,7 @@
 #include "SPI.h"
 #include "TMC.h"
 #include "Motors.h"
+#include "Perf.h"
 
 #define SERIAL_DEBUG  0
 #include "Serial_Debug.h"
@@ -30,6 +31,7 @@ extern "C"
 static TMC5240BusType activeBus = IC_BUS_SPI; // currently only SPI is supported, but UART is possible
 static uint8_t nodeAddress = 0; 
 static pin_size_t g_csPin[MAXNUMMOTORS] = {0};
+static uint32_t g_spiWriteCount[MAXNUMMOTORS] = {0}; // write datagrams per board, used to invalidate the snapshots
 
 
 // *************************************************************************************
@@ -44,15 +46,24 @@ TMC5240BusType tmc5240_getBusType(uint16_t icID) {
     return activeBus;
 }
 
+// Busy wait for at least the given time (CSN timing of the SPI datagrams)
+static inline void tmcSpiDelayNs(uint32_t ns) {
+    busy_wait_at_least_cycles((uint32_t)(((uint64_t)ns*rp2040.f_cpu() + 999999999u)/1000000000u));
+}
+
+// The datagram is sent as one block transfer. The waits keep the CSN timing of the datasheet
+// (tCC, tCSH), whatever the clock of the CPU and the speed of the GPIO writes.
 void tmc5240_readWriteSPI(uint16_t icID, uint8_t *data, size_t dataLength) {
 
+    if (data[0] & TMC5240_WRITE_BIT) g_spiWriteCount[icID]++;
+    PERF_START(perfStart);
     digitalWrite(g_csPin[icID], LOW);
-    delayMicroseconds(10);
-    for (uint32_t i = 0; i < dataLength; i++) {
-        data[i] = SPI.transfer(data[i]);
-    }
-    delayMicroseconds(10);
+    tmcSpiDelayNs(TMC_SPI_TCC_NS); // setup before the first SCK edge
+    SPI.transfer(data, dataLength);
+    tmcSpiDelayNs(TMC_SPI_TCC_NS); // hold after the last SCK edge
     digitalWrite(g_csPin[icID], HIGH);
+    tmcSpiDelayNs(TMC_SPI_TCSH_NS); // high time before the next datagram
+    PERF_STOP(PERF_SPI_COUNT, perfStart);
 }
 
 bool tmc5240_readWriteUART(uint16_t icID, uint8_t *data, size_t writeLength, size_t readLength)
@@ -101,6 +112,12 @@ int8_t TMC::Init(int8_t tNum, Motors *motorsPtr, int32_t *mParamPtr, HWParamStru
   // transfer the pin information into the global variable so the SPIwrite function can access
   int8_t defaultDRIVER_CS[MAXNUMMOTORS] = MOTORS_DEFAULT_DRIVER_CS;
   g_csPin[board] = defaultDRIVER_CS[board];
+  int8_t defaultDIAG0[MAXNUMMOTORS] = MOTORS_DEFAULT_DIAG0_PIN;
+  int8_t defaultDIAG1[MAXNUMMOTORS] = MOTORS_DEFAULT_DIAG1_PIN;
+  diag0Pin = defaultDIAG0[board];
+  diag1Pin = defaultDIAG1[board];
+  tmc5240_invalidateShadow(board); // nothing is known about the driver registers yet
+  fullConfigRequired = 1;
 
   return ERR_None;
 }
@@ -110,14 +127,16 @@ int8_t TMC::Init(int8_t tNum, Motors *motorsPtr, int32_t *mParamPtr, HWParamStru
 // Configure the TMC controller
 // ----------------------------
 
-int8_t TMC::Config(void)
+int8_t TMC::Config(uint8_t groups)
 {
   int8_t err;
   int32_t index, value;
 
   D_print("TMC::Config board ");
   D_println(board);
-
+  if (fullConfigRequired) groups = PARAMS_GROUP_ALL; // first config or after a driver reset
+  if (rampScale != 1.0f) groups |= PARAMS_GROUP_RATE; // a scaled move left AMAX/DMAX off RSEA
+  rampScale = 1.0f; // the config writes the regular acceleration (RSEA)
 
   if (hwParam->motorType[board]==MOTOR_TMC) {
 
@@ -134,102 +153,15 @@ int8_t TMC::Config(void)
 
     if (err=CheckError()) return err;
 
-    // config the driver
-    for (int8_t idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
-
-      // CurrentParams
-      if (strncmp(Parameters::motParamsIDList[idx], "CSCA", 4)  == 0) {
-        if (!IsParamInRange(idx, 32, 255)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_GLOBAL_SCALER_FIELD, motorParam[idx]); 
-      } else if (strncmp(Parameters::motParamsIDList[idx], "CRAN", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 3)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_CURRENT_RANGE_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "CRUN", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 31)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_IRUN_FIELD, motorParam[idx]); 
-      } else if (strncmp(Parameters::motParamsIDList[idx], "CHOL", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 31)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_IHOLD_FIELD, motorParam[idx]); 
-
-      // ModeParams
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "MMIC", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 8)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_MRES_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "MINV", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_SHAFT_FIELD, motorParam[idx]); 
-      } else if (strncmp(Parameters::motParamsIDList[idx], "MTOF", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 10)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_TOFF_FIELD, 0); // TOFF=0 so the motor won't start
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "MSGE", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_SG_STOP_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "MSGT", 4)  == 0) {
-        if (!IsParamInRange(idx, -64, 63)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_SGT_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "MCTC", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 100000000)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_TCOOLTHRS_FIELD, motorParam[idx]); 
-
-      // HomingParams (not set here)
-
-      // RateParams (RMXV, RMXA, RSEV, HVEL are not set here)
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "RSEA", 4)  == 0) {
-        FindParamIndexVal("RMXA", index, value);
-        if (!IsParamInRange(idx, 0, value)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_AMAX_FIELD, motorParam[idx]); 
-        tmc5240_fieldWrite(board, TMC5240_DMAX_FIELD, motorParam[idx]); 
-
-      // EncoderParams
-      } else if (strncmp(Parameters::motParamsIDList[idx], "ECON", 4)  == 0) {
-        encConst = motorParam[idx]; // transfer to local copy
-        tmc5240_fieldWrite(board, TMC5240_ENC_SEL_DECIMAL_FIELD, 1);
-        tmc5240_fieldWrite(board, TMC5240_ENC_CONST_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "EDEV", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1000000000)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_ENC_DEVIATION_FIELD, motorParam[idx]); 
-      // these just get transferred to local copies (ECON already done above)
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "EMAX", 4)  == 0) {
-        maxIterations = motorParam[idx];
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "ETOL", 4)  == 0) {
-        tolerance = motorParam[idx];
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "ERST", 4)  == 0) {
-        resetXafterCL = motorParam[idx];
-
-      // SwitchParams
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "SLEN", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_STOP_L_ENABLE_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "SREN", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_STOP_R_ENABLE_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "SLPO", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_POL_STOP_L_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "SRPO", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_POL_STOP_R_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "SSWP", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_SWAP_LR_FIELD, motorParam[idx]); 
-
-      // LimitsParam
-
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "LENC", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_VIRTUAL_STOP_ENC_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "LLEN", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_EN_VIRTUAL_STOP_L_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "LREN", 4)  == 0) {
-        if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
-        tmc5240_fieldWrite(board, TMC5240_EN_VIRTUAL_STOP_R_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "LLPS", 4)  == 0) {
-        tmc5240_fieldWrite(board, TMC5240_VIRTUAL_STOP_L_FIELD, motorParam[idx]); 
-      }  else if (strncmp(Parameters::motParamsIDList[idx], "LRPS", 4)  == 0) {
-        tmc5240_fieldWrite(board, TMC5240_VIRTUAL_STOP_R_FIELD, motorParam[idx]); 
-      }
-    }
+    // config the driver, the field writes are collected and each register is written once
+    tmc5240_beginBulkWrite(board);
+    err = ConfigParams(groups);
+    // DIAG0 as push-pull interrupt output for the ramp events and stalls, DIAG1 as push-pull position compare output
+    tmc5240_fieldWrite(board, TMC5240_DIAG0_INT_PUSHPULL_FIELD, (diag0Pin>=0) ? 1 : 0);
+    tmc5240_fieldWrite(board, TMC5240_DIAG0_STALL_STEP_FIELD, (diag0Pin>=0) ? 1 : 0);
+    tmc5240_fieldWrite(board, TMC5240_DIAG1_POSCOMP_PUSHPULL_FIELD, (diag1Pin>=0) ? 1 : 0);
+    tmc5240_endBulkWrite(board);
+    if (err) return err;
 
     // set overtemp pre-warn threshold
     tmc5240_fieldWrite(board, TMC5240_OVERTEMPPREWARNING_VTH_FIELD, TMC_OVERTEMP_PREWARN);
@@ -253,6 +185,7 @@ int8_t TMC::Config(void)
 //    ClearStatusRegs();
     tmc5240_writeRegister(board, TMC5240_ENC_STATUS, ~0); // clear the enc following error flag
     tmc5240_writeRegister(board, TMC5240_RAMPSTAT, ~0);
+    fullConfigRequired = 0;
 
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
 
@@ -261,8 +194,11 @@ int8_t TMC::Config(void)
       pinMode(g_csPin[board], INPUT_PULLUP);
     }
 
-    encConst = 0;
-    maxIterations = 1;
+    // the simulated encoder works in microsteps, so the closed loop can run against the model
+    FindParamIndexVal("ECON", index, encConst);
+    FindParamIndexVal("EMAX", index, maxIterations);
+    FindParamIndexVal("ETOL", index, tolerance);
+    FindParamIndexVal("ERST", index, resetXafterCL);
     
     // for (int8_t idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
     //   // just copy the value over, no error checking
@@ -285,8 +221,12 @@ int8_t TMC::Config(void)
         simValues.xmax = INT32_MAX;
     }
 
-    simValues.xact = simValues.xenc = 0;
+    simValues.pos = simValues.load = simValues.encOffset = simValues.v = 0.0f;
+    simValues.xact = simValues.xtar = simValues.xenc = 0;
     simValues.vel = 0;
+    simValues.velocityMode = 0;
+    SetSimRamp(1.0f);
+    simValues.lastVelCalcTime = micros();
 
   } else { // Motor not defined
     SetErrorMsg("Motor is defined as MOTOR_NONE");
@@ -301,6 +241,116 @@ int8_t TMC::Config(void)
 }
 
 
+// ----------------------------
+// Write the driver registers of the selected parameter groups
+// ----------------------------
+
+int8_t TMC::ConfigParams(uint8_t groups)
+{
+  int32_t index, value;
+
+  for (int8_t idx=0; idx<MOTORS_NUM_PARAMS; idx++) {
+    // unchanged groups are skipped, MTOF is always applied since the config disables the driver
+    if ( !(groups & Parameters::GetParamGroup(idx)) 
+         && strncmp(Parameters::motParamsIDList[idx], "MTOF", 4)!=0 ) continue;
+
+    // CurrentParams
+    if (strncmp(Parameters::motParamsIDList[idx], "CSCA", 4)  == 0) {
+      if (!IsParamInRange(idx, 32, 255)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_GLOBAL_SCALER_FIELD, motorParam[idx]); 
+    } else if (strncmp(Parameters::motParamsIDList[idx], "CRAN", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 3)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_CURRENT_RANGE_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "CRUN", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 31)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_IRUN_FIELD, motorParam[idx]); 
+    } else if (strncmp(Parameters::motParamsIDList[idx], "CHOL", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 31)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_IHOLD_FIELD, motorParam[idx]); 
+
+    // ModeParams
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "MMIC", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 8)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_MRES_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "MINV", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_SHAFT_FIELD, motorParam[idx]); 
+    } else if (strncmp(Parameters::motParamsIDList[idx], "MTOF", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 10)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_TOFF_FIELD, 0); // TOFF=0 so the motor won't start
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "MSGE", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_SG_STOP_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "MSGT", 4)  == 0) {
+      if (!IsParamInRange(idx, -64, 63)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_SGT_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "MCTC", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 100000000)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_TCOOLTHRS_FIELD, motorParam[idx]); 
+
+    // HomingParams (not set here)
+
+    // RateParams (RMXV, RMXA, RSEV, HVEL are not set here)
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "RSEA", 4)  == 0) {
+      FindParamIndexVal("RMXA", index, value);
+      if (!IsParamInRange(idx, 0, value)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_AMAX_FIELD, motorParam[idx]); 
+      tmc5240_fieldWrite(board, TMC5240_DMAX_FIELD, motorParam[idx]); 
+
+    // EncoderParams
+    } else if (strncmp(Parameters::motParamsIDList[idx], "ECON", 4)  == 0) {
+      encConst = motorParam[idx]; // transfer to local copy
+      tmc5240_fieldWrite(board, TMC5240_ENC_SEL_DECIMAL_FIELD, 1);
+      tmc5240_fieldWrite(board, TMC5240_ENC_CONST_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "EDEV", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1000000000)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_ENC_DEVIATION_FIELD, motorParam[idx]); 
+    // these just get transferred to local copies (ECON already done above)
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "EMAX", 4)  == 0) {
+      maxIterations = motorParam[idx];
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "ETOL", 4)  == 0) {
+      tolerance = motorParam[idx];
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "ERST", 4)  == 0) {
+      resetXafterCL = motorParam[idx];
+
+    // SwitchParams
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "SLEN", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_STOP_L_ENABLE_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "SREN", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_STOP_R_ENABLE_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "SLPO", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_POL_STOP_L_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "SRPO", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_POL_STOP_R_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "SSWP", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_SWAP_LR_FIELD, motorParam[idx]); 
+
+    // LimitsParam
+
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "LENC", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_VIRTUAL_STOP_ENC_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "LLEN", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_EN_VIRTUAL_STOP_L_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "LREN", 4)  == 0) {
+      if (!IsParamInRange(idx, 0, 1)) return ERR_TMC;
+      tmc5240_fieldWrite(board, TMC5240_EN_VIRTUAL_STOP_R_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "LLPS", 4)  == 0) {
+      tmc5240_fieldWrite(board, TMC5240_VIRTUAL_STOP_L_FIELD, motorParam[idx]); 
+    }  else if (strncmp(Parameters::motParamsIDList[idx], "LRPS", 4)  == 0) {
+      tmc5240_fieldWrite(board, TMC5240_VIRTUAL_STOP_R_FIELD, motorParam[idx]); 
+    }
+  }
+  return ERR_None;
+}
+
+
 // ----------------------------
 // Clear the registers
 // ----------------------------
@@ -332,8 +382,10 @@ int8_t TMC::MoveAtVel(int32_t velocity)
     tmc5240_writeRegister(board, TMC5240_VMAX, abs(velocity));
     if (int8_t err=CheckError()) return err;
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
-    simValues.vel = velocity;
-    simValues.lastVelCalcTime = millis();
+    UpdateSim();
+    SetSimRamp(1.0f);
+    simValues.velocityMode = 1;
+    simValues.vmax = velocity * TMC_VEL_SCALE;
   } else {
     SetErrorMsg("Motor is defined as MOTOR_NONE");
     return ERR_TMC;
@@ -346,7 +398,7 @@ int8_t TMC::MoveAtVel(int32_t velocity)
 // Move to position
 // ----------------------------
 
-int8_t TMC::MoveToPos(int32_t pos, int8_t setVel)
+int8_t TMC::MoveToPos(int32_t pos, int8_t setVel, float scale)
 {
   int32_t index, value;
 
@@ -355,19 +407,38 @@ int8_t TMC::MoveToPos(int32_t pos, int8_t setVel)
     tmc5240_fieldWrite(board, TMC5240_EVENT_POS_REACHED_FIELD, 1); // clear the flag
     tmc5240_fieldWrite(board, TMC5240_RAMPMODE_FIELD, TMC5240_MODE_POSITION);
     if (setVel) {
+      if (scale < TMC_MIN_RAMP_SCALE) scale = TMC_MIN_RAMP_SCALE;
+      if (scale > 1.0f) scale = 1.0f;
+      if (scale != rampScale) { // only touch the acceleration if the ramp changed from the last move
+        FindParamIndexVal("RSEA", index, value);
+        value = (int32_t)(value*scale*scale);
+        if (value < 1) value = 1;
+        tmc5240_writeRegister(board, TMC5240_AMAX, value);
+        tmc5240_writeRegister(board, TMC5240_DMAX, value);
+        rampScale = scale;
+      }
       FindParamIndexVal("RSEV", index, value);
+      value = (int32_t)(value*scale);
+      if (value < 1) value = 1;
       D_print("Speed="); D_println(value);
       tmc5240_writeRegister(board, TMC5240_VMAX, value);
     }
     D_print("Pos="); D_println(pos);
+    if (diag1Pin>=0) tmc5240_writeRegister(board, TMC5240_X_COMPARE, pos); // DIAG1 goes high at the target
     tmc5240_writeRegister(board, TMC5240_XTARGET, pos);
     if (int8_t err=CheckError()) return err;
 
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
-    simValues.vel = 0;
+    UpdateSim();
+    if (setVel) {
+      if (scale < TMC_MIN_RAMP_SCALE) scale = TMC_MIN_RAMP_SCALE;
+      if (scale > 1.0f) scale = 1.0f;
+      SetSimRamp(scale);
+    }
     if (pos < simValues.xmin) pos = simValues.xmin;
     if (pos > simValues.xmax) pos = simValues.xmax;
-    simValues.xact = simValues.xenc = pos;
+    simValues.velocityMode = 0;
+    simValues.xtar = pos;
   } else {
     SetErrorMsg("Motor is defined as MOTOR_NONE");
     return ERR_TMC;
@@ -376,6 +447,176 @@ int8_t TMC::MoveToPos(int32_t pos, int8_t setVel)
 }
 
 
+// ----------------------------
+// Start a trajectory segment with its own ramp
+// ----------------------------
+
+int8_t TMC::StartSegment(int32_t pos, int32_t vel, int32_t acc, int8_t velMode)
+{
+  int32_t index;
+
+  if (!IsValueInRange(vel, "VEL", -TMC_SEGMENT_MAX_VEL, TMC_SEGMENT_MAX_VEL)) return ERR_TMC;
+  if (acc <= 0) FindParamIndexVal("RSEA", index, acc);
+  if (!velMode && vel == 0) FindParamIndexVal("RSEV", index, vel);
+  if (acc < 1) acc = 1;
+
+  if (hwParam->motorType[board]==MOTOR_TMC) {
+    if (velMode) {
+      tmc5240_fieldWrite(board, TMC5240_RAMPMODE_FIELD, vel>0 ? TMC5240_MODE_VELPOS : TMC5240_MODE_VELNEG);
+      tmc5240_writeRegister(board, TMC5240_AMAX, acc);
+      tmc5240_writeRegister(board, TMC5240_VMAX, abs(vel));
+    } else {
+      tmc5240_fieldWrite(board, TMC5240_EVENT_POS_REACHED_FIELD, 1); // clear the flag
+      tmc5240_fieldWrite(board, TMC5240_RAMPMODE_FIELD, TMC5240_MODE_POSITION);
+      tmc5240_writeRegister(board, TMC5240_AMAX, acc);
+      tmc5240_writeRegister(board, TMC5240_DMAX, acc);
+      tmc5240_writeRegister(board, TMC5240_VMAX, abs(vel));
+      if (diag1Pin>=0) tmc5240_writeRegister(board, TMC5240_X_COMPARE, pos); // DIAG1 goes high at the target
+      tmc5240_writeRegister(board, TMC5240_XTARGET, pos);
+    }
+    if (int8_t err=CheckError()) return err;
+  } else if (hwParam->motorType[board]==MOTOR_SIM) {
+    UpdateSim();
+    simValues.amax = acc * TMC_ACC_SCALE;
+    if (velMode) {
+      simValues.velocityMode = 1;
+      simValues.vmax = vel * TMC_VEL_SCALE;
+    } else {
+      if (pos < simValues.xmin) pos = simValues.xmin;
+      if (pos > simValues.xmax) pos = simValues.xmax;
+      simValues.velocityMode = 0;
+      simValues.vmax = abs(vel) * TMC_VEL_SCALE;
+      simValues.xtar = pos;
+    }
+  } else {
+    SetErrorMsg("Motor is defined as MOTOR_NONE");
+    return ERR_TMC;
+  }
+  rampScale = 0.0f; // AMAX/DMAX are off RSEA, the next regular move writes them again
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Estimate the duration of a position move
+// ----------------------------
+
+float TMC::EstimateMoveTime(int32_t distance)
+{
+  int32_t index, vmax, amax;
+  float v, a, d;
+
+  FindParamIndexVal("RSEV", index, vmax);
+  FindParamIndexVal("RSEA", index, amax);
+  if (vmax<=0 || amax<=0) return 0.0f;
+  v = vmax * TMC_VEL_SCALE;
+  a = amax * TMC_ACC_SCALE;
+  d = (float)abs(distance);
+  if (d < v*v/a) return 2.0f*sqrtf(d/a); // triangular ramp, VMAX is never reached
+  return d/v + v/a; // trapezoidal ramp
+}
+
+
+// ----------------------------
+// Set the ramp of the simulated motor
+// ----------------------------
+
+void TMC::SetSimRamp(float scale)
+{
+  int32_t index, value;
+
+  FindParamIndexVal("RSEV", index, value);
+  if (value <= 0) value = TMC_SIM_DEFAULT_VMAX;
+  simValues.vmax = value * scale * TMC_VEL_SCALE;
+  FindParamIndexVal("RSEA", index, value);
+  if (value <= 0) value = TMC_SIM_DEFAULT_AMAX;
+  simValues.amax = value * scale * scale * TMC_ACC_SCALE;
+}
+
+
+// ----------------------------
+// Advance the simulated motor to the current time
+// ----------------------------
+
+void TMC::UpdateSim(void)
+{
+  unsigned long currentTime = micros();
+  float dt = (currentTime - simValues.lastVelCalcTime) * 1.0e-6f;
+  float vTarget, dist, stopDist;
+  float a = simValues.amax;
+
+  simValues.lastVelCalcTime = currentTime;
+  if (dt <= 0.0f) return;
+
+  int8_t braking = 0;
+  if (simValues.velocityMode) { // ramp to the requested velocity
+    vTarget = simValues.vmax;
+  } else { // position mode: accelerate towards the target, brake so the ramp ends on it
+    dist = (float)simValues.xtar - simValues.pos;
+    stopDist = simValues.v * simValues.v / (2.0f * a);
+    if (dist == 0.0f && simValues.v == 0.0f) {
+      vTarget = 0.0f;
+    } else if ( (dist > 0.0f) != (simValues.v > 0.0f) && simValues.v != 0.0f ) {
+      vTarget = 0.0f; // moving the wrong way, stop first
+    } else if (stopDist >= fabsf(dist)) {
+      vTarget = 0.0f; // braking distance reached
+      braking = 1;
+      a = simValues.v * simValues.v / (2.0f * fabsf(dist)); // the deceleration that ends exactly on the target
+    } else {
+      vTarget = (dist > 0.0f ? simValues.vmax : -simValues.vmax);
+    }
+  }
+
+  // integrate with the average velocity of the step
+  float vOld = simValues.v;
+  if (simValues.v < vTarget) {
+    simValues.v += a * dt;
+    if (simValues.v > vTarget) simValues.v = vTarget;
+  } else if (simValues.v > vTarget) {
+    simValues.v -= a * dt;
+    if (simValues.v < vTarget) simValues.v = vTarget;
+  }
+  simValues.pos += 0.5f * (vOld + simValues.v) * dt;
+
+  // the ramp ends on the target, without overshoot
+  if (!simValues.velocityMode) {
+    dist = (float)simValues.xtar - simValues.pos;
+    if ( (braking && (simValues.v == 0.0f || (dist > 0.0f) != (vOld > 0.0f))) || (fabsf(dist) < 0.5f && fabsf(simValues.v) <= simValues.amax * dt) ) {
+      simValues.pos = (float)simValues.xtar;
+      simValues.v = 0.0f;
+    }
+  }
+
+  // virtual stops
+  if (simValues.pos < (float)simValues.xmin) {
+    simValues.pos = (float)simValues.xmin;
+    simValues.v = 0.0f;
+    if (simValues.velocityMode) simValues.vmax = 0.0f;
+  }
+  if (simValues.pos > (float)simValues.xmax) {
+    simValues.pos = (float)simValues.xmax;
+    simValues.v = 0.0f;
+    if (simValues.velocityMode) simValues.vmax = 0.0f;
+  }
+  simValues.xact = (int32_t)lroundf(simValues.pos);
+  simValues.vel = (int32_t)lroundf(simValues.v / TMC_VEL_SCALE);
+
+  // the load follows the motor once the backlash is taken up
+  if (simValues.pos - simValues.load > 0.5f * TMC_SIM_BACKLASH) simValues.load = simValues.pos - 0.5f * TMC_SIM_BACKLASH;
+  if (simValues.load - simValues.pos > 0.5f * TMC_SIM_BACKLASH) simValues.load = simValues.pos + 0.5f * TMC_SIM_BACKLASH;
+
+  // encoder: quantization and uniform noise (xorshift)
+  float enc = simValues.load + simValues.encOffset;
+  if (TMC_SIM_ENC_NOISE > 0) {
+    simValues.noiseState ^= simValues.noiseState << 13;
+    simValues.noiseState ^= simValues.noiseState >> 17;
+    simValues.noiseState ^= simValues.noiseState << 5;
+    enc += (float)((int32_t)(simValues.noiseState % (2*TMC_SIM_ENC_NOISE + 1)) - TMC_SIM_ENC_NOISE);
+  }
+  simValues.xenc = (int32_t)lroundf(enc / TMC_SIM_ENC_RESOLUTION) * TMC_SIM_ENC_RESOLUTION;
+}
+
+
 // ----------------------------
 // Sets the X position
 // ----------------------------
@@ -391,8 +632,36 @@ int8_t TMC::SetXPos(int32_t pos)
     tmc5240_writeRegister(board, TMC5240_XACTUAL, pos);
     tmc5240_writeRegister(board, TMC5240_VMAX, vel);
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
-    simValues.vel = 0;
+    UpdateSim();
+    simValues.load += pos - simValues.pos; // the load (and encoder) stay where they are
+    simValues.encOffset -= pos - simValues.pos;
+    simValues.pos = (float)pos;
+    simValues.v = 0.0f;
+    simValues.velocityMode = 0;
     simValues.xact = simValues.xtar = pos;
+    simValues.vel = 0;
+  }
+  return ERR_None;
+}
+
+
+// ----------------------------
+// Set all positions without moving
+// ----------------------------
+
+int8_t TMC::SetOrigin(int32_t pos)
+{
+  if (hwParam->motorType[board]==MOTOR_TMC) {
+    SetXPos(pos);
+    tmc5240_writeRegister(board, TMC5240_XENC, pos);
+    tmc5240_writeRegister(board, TMC5240_ENC_STATUS, ~0); // clear the enc following error flag
+  } else if (hwParam->motorType[board]==MOTOR_SIM) {
+    SetXPos(pos);
+    simValues.encOffset = pos - simValues.load;
+    simValues.xenc = pos;
+  } else {
+    SetErrorMsg("Motor is defined as MOTOR_NONE");
+    return ERR_TMC;
   }
   return ERR_None;
 }
@@ -407,6 +676,7 @@ int8_t TMC::GetPos(int32_t &pos)
   if (hwParam->motorType[board]==MOTOR_TMC) {
     pos = tmc5240_readRegister(board, TMC5240_XACTUAL); 
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
+    UpdateSim();
     pos = simValues.xact; 
   } else {
     SetErrorMsg("Motor is defined as MOTOR_NONE");
@@ -425,7 +695,8 @@ int8_t TMC::GetEnc(int32_t &pos)
   if (hwParam->motorType[board]==MOTOR_TMC) {
     pos = tmc5240_readRegister(board, TMC5240_XENC); 
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
-    pos = simValues.xact; 
+    UpdateSim();
+    pos = simValues.xenc; 
   } else {
     SetErrorMsg("Motor is defined as MOTOR_NONE");
     return ERR_TMC;
@@ -465,8 +736,15 @@ int8_t TMC::SetEnable(int32_t mode)
   
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
 
+    UpdateSim();
     motors->isMotorEnabled[board]= (mode!=0);
-    if (mode==0) simValues.vel = 0;
+    if (mode==0) { // like TOFF=0 with VMAX=0: stop right away and hold the position
+      simValues.v = 0.0f;
+      simValues.vel = 0;
+      simValues.velocityMode = 0;
+      simValues.xtar = simValues.xact;
+      simValues.pos = (float)simValues.xact;
+    }
 
   } else {
     SetErrorMsg("Motor is defined as MOTOR_NONE");
@@ -570,8 +848,9 @@ int8_t TMC::StartHoming(void)
 
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
 
-    simValues.xact = simValues.xenc = 0; 
-    simValues.vel = 0;
+    SetXPos(0);
+    simValues.encOffset = -simValues.load; // the encoder is zeroed at home as well
+    simValues.xenc = 0;
     motors->isMotorHoming[board]=0;
 
   } else {
@@ -733,14 +1012,19 @@ int8_t TMC::SetStatusValue(int32_t index, int32_t value)
         return ERR_Motor;
       } else {
         // set stuff (if allowed) 
+        UpdateSim();
         if (strncmp(motors->motStatIDList[index], "XACT", 4)  == 0) {
-          simValues.xact = value;
+          SetXPos(value);
         } else if (strncmp(motors->motStatIDList[index], "XTAR", 4)  == 0) {
-          simValues.xact = value;
+          simValues.velocityMode = 0;
+          simValues.xtar = value; // starts a move, as on the driver
         } else if (strncmp(motors->motStatIDList[index], "XENC", 4)  == 0) {
+          simValues.encOffset = value - simValues.load;
           simValues.xenc = value;
         } else if (strncmp(motors->motStatIDList[index], "VELO", 4)  == 0) {
-          simValues.vel = value;
+          simValues.vmax = copysignf(value * TMC_VEL_SCALE, simValues.velocityMode ? simValues.vmax : 1.0f); // keeps the direction
+        } else if (strncmp(motors->motStatIDList[index], "ACCE", 4)  == 0) {
+          simValues.amax = value * TMC_ACC_SCALE;
         }
       }
     }
@@ -757,19 +1041,23 @@ int8_t TMC::SetStatusValue(int32_t index, int32_t value)
 // Get the status value
 // ----------------------------
 
-int8_t TMC::GetStatusValue(int32_t index, int32_t &value)
+int8_t TMC::GetStatusValue(int32_t index, int32_t &value, int8_t fresh)
 {
   char errMsg[MSG_MAXLENGTH];
 
 
   if (hwParam->motorType[board]==MOTOR_TMC) {
 
+    // positions come from the snapshot, VMAX and AMAX from the register shadow
     if (strncmp(motors->motStatIDList[index], "XACT", 4)  == 0) {
-      value = tmc5240_readRegister(board, TMC5240_XACTUAL); 
+      UseSnapshot(fresh);
+      value = snapshot.xact; 
     } else if (strncmp(motors->motStatIDList[index], "XTAR", 4)  == 0) {
-        value = tmc5240_readRegister(board, TMC5240_XTARGET); 
+      UseSnapshot(fresh);
+      value = snapshot.xtar; 
     } else if (strncmp(motors->motStatIDList[index], "XENC", 4)  == 0) {
-      value = tmc5240_readRegister(board, TMC5240_XENC);
+      UseSnapshot(fresh);
+      value = snapshot.xenc;
     } else if (strncmp(motors->motStatIDList[index], "VELO", 4)  == 0) {
       value = tmc5240_readRegister(board, TMC5240_VMAX); 
     } else if (strncmp(motors->motStatIDList[index], "ACCE", 4)  == 0) {
@@ -782,16 +1070,17 @@ int8_t TMC::GetStatusValue(int32_t index, int32_t &value)
 
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
 
+    UpdateSim();
     if (strncmp(motors->motStatIDList[index], "XACT", 4)  == 0) {
       value = simValues.xact; 
     } else if (strncmp(motors->motStatIDList[index], "XTAR", 4)  == 0) {
-      value = simValues.xact; 
+      value = simValues.xtar; 
     } else if (strncmp(motors->motStatIDList[index], "XENC", 4)  == 0) {
       value = simValues.xenc; 
     } else if (strncmp(motors->motStatIDList[index], "VELO", 4)  == 0) {
       value = simValues.vel; 
     } else if (strncmp(motors->motStatIDList[index], "ACCE", 4)  == 0) {
-      value = 0; 
+      value = (int32_t)(simValues.amax / TMC_ACC_SCALE); 
     } else if (strncmp(motors->motStatIDList[index], "ENAB", 4)  == 0) {
       value = (int32_t) motors->isMotorEnabled[board];
     } else if (strncmp(motors->motStatIDList[index], "TEMP", 4)  == 0) {
@@ -824,11 +1113,11 @@ int8_t TMC::SetRegisterValue(uint8_t address, int32_t value)
 // Get the register value at address
 // ----------------------------
 
-int8_t TMC::GetRegisterValue(uint8_t address, int32_t &value)
+int8_t TMC::GetRegisterValue(uint8_t address, int32_t &value, int8_t fresh)
 {
   if (hwParam->motorType[board]==MOTOR_TMC) {
     D_println("Reading register value");
-    value = tmc5240_readRegister(board, address);
+    value = fresh ? tmc5240_readRegisterFresh(board, address) : tmc5240_readRegister(board, address);
   } else {
     value = 0; // no register value for sim
   }
@@ -854,6 +1143,10 @@ int8_t TMC::CheckError(void)
     D_println("Reading GSTAT register value");
     value = tmc5240_readRegister(board, TMC5240_GSTAT);
     if (value) { // any error
+      if (value & (TMC5240_RESET_MASK | TMC5240_REGISTER_RESET_MASK)) {
+        tmc5240_invalidateShadow(board); // the driver lost its registers
+        fullConfigRequired = 1;
+      }
       SetEnable(0);
       if (value & TMC5240_RESET_MASK) {
         sprintf(msg, "GSTAT: reset error bit set");
@@ -910,15 +1203,17 @@ int8_t TMC::CheckStatus(int32_t &isMotionDone)
 
   if (hwParam->motorType[board]==MOTOR_TMC) {
 
+    // read the status registers (this is also the snapshot refresh of this tick)
+    D_println("Refreshing the register snapshot");
+    RefreshSnapshot();
+
     // check for following errors
-    D_println("Reading ENC_STATUS register value");
-    if( tmc5240_fieldRead(board, TMC5240_DEVIATION_WARN_FIELD) ) {
+    if( tmc5240_fieldExtract(snapshot.encStatus, TMC5240_DEVIATION_WARN_FIELD) ) {
       SetEnable(0);
       SetErrorMsg("Following error");
       return ERR_TMC; 
     }
-    D_println("Reading RAMPSTAT register value");
-    flags = tmc5240_readRegister(board, TMC5240_RAMPSTAT);
+    flags = snapshot.rampStat;
     // set motion done flag
     isMotionDone = (   (flags & TMC5240_EVENT_POS_REACHED_MASK) 
                     || (flags & TMC5240_POSITION_REACHED_MASK)  ) ? 1 : 0;
@@ -965,23 +1260,12 @@ int8_t TMC::CheckStatus(int32_t &isMotionDone)
     }
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
 
-    unsigned long currentTime = millis();
-    if (simValues.vel==0) {
-      isMotionDone = 1;
+    UpdateSim();
+    if (simValues.velocityMode) {
+      isMotionDone = (simValues.v == 0.0f && simValues.vmax == 0.0f) ? 1 : 0;
     } else {
-      isMotionDone = 0;
-      simValues.xact += ((int32_t)(currentTime - simValues.lastVelCalcTime) * simValues.vel)/1000;
-    }
-    simValues.lastVelCalcTime = currentTime;
-    if (simValues.xact < simValues.xmin) {
-      simValues.xact = simValues.xmin;
-      simValues.vel = 0;
-    }
-    if (simValues.xact > simValues.xmax) {
-      simValues.xact = simValues.xmax;
-      simValues.vel = 0;
+      isMotionDone = (simValues.v == 0.0f && simValues.xact == simValues.xtar) ? 1 : 0;
     }
-    simValues.xenc = simValues.xact;
 
   } else {
     SetErrorMsg("Motor is defined as MOTOR_NONE");
@@ -998,49 +1282,23 @@ int8_t TMC::CheckStatus(int32_t &isMotionDone)
 // flag:  enabled |  atPos |  isMov |latch_R |latch_L | encDev |SG_evnt |SG_stat | virt_R | virt_L | stop_R | stop_L |
 // ----------------------------
 
-int8_t TMC::GetStatusFlags(int32_t &status)
+int8_t TMC::GetStatusFlags(int32_t &status, int8_t fresh)
 {
   int32_t flags = 0;
-  int32_t value;
 
   if (hwParam->motorType[board]==MOTOR_TMC) {
 
-    // flags from the RAMP_STAT
-    value = tmc5240_readRegister(board, TMC5240_RAMPSTAT);
-    if ( motors->isMotorEnabled[board] )
-      flags |= (0x1 << 11); // motor enabled
-    if ( value & TMC5240_POSITION_REACHED_MASK )
-      flags |= (0x1 << 10); // pos_reached status, NOT the event
-    if ( !(value & TMC5240_VZERO_MASK) )
-      flags |= (0x1 << 9); // velocity is not zero
-    if ( value & TMC5240_STATUS_LATCH_R_MASK )
-      flags |= (0x1 << 8); // status latch right available
-    if ( value & TMC5240_STATUS_LATCH_L_MASK )
-      flags |= (0x1 << 7); // status latch left available
-    if ( value & TMC5240_EVENT_STOP_SG_MASK )
-      flags |= (0x1 << 5); // SG event
-    if ( value & TMC5240_STATUS_SG_MASK )
-      flags |= (0x1 << 4); // SG status, NOT the event
-    if ( value & TMC5240_STATUS_VIRTUAL_STOP_R_MASK )
-      flags |= (0x1 << 3); // virt_R status, NOT the event
-    if ( value & TMC5240_STATUS_VIRTUAL_STOP_L_MASK )
-      flags |= (0x1 << 2); // virt_L status, NOT the event
-    if ( value & TMC5240_STATUS_STOP_R_MASK )
-      flags |= (0x1 << 1); // stop_R status, NOT the event
-    if ( value & TMC5240_STATUS_STOP_L_MASK )
-      flags |= 0x1; // stop_L status, NOT the event
-
-    // flags from the RAMP_STAT
-    value = tmc5240_readRegister(board, TMC5240_ENC_STATUS);
-    if ( value & TMC5240_DEVIATION_WARN_MASK )
-      flags |= (0x1 << 6); // stop_R status, NOT the event
-    status = flags;
+    UseSnapshot(fresh);
+    status = ComposeStatusFlags(snapshot.rampStat, snapshot.encStatus);
 
   } else if (hwParam->motorType[board]==MOTOR_SIM) {
 
     if ( motors->isMotorEnabled[board] )
       flags |= (0x1 << 11); // motor enabled
-    if ( simValues.vel != 0 )
+    UpdateSim();
+    if ( !simValues.velocityMode && simValues.v == 0.0f && simValues.xact == simValues.xtar )
+      flags |= (0x1 << 10); // pos_reached status, NOT the event
+    if ( simValues.v != 0.0f )
       flags |= (0x1 << 9); // velocity is not zero
 
     if ( simValues.xact >= simValues.xmax )
@@ -1057,6 +1315,129 @@ int8_t TMC::GetStatusFlags(int32_t &status)
 }
 
 
+// ----------------------------
+// Refresh the register snapshot
+// ----------------------------
+
+void TMC::RefreshSnapshot(void)
+{
+  static const uint8_t addresses[5] = {TMC5240_XACTUAL, TMC5240_XTARGET, TMC5240_XENC, TMC5240_RAMPSTAT, TMC5240_ENC_STATUS};
+  int32_t values[5];
+
+  if (hwParam->motorType[board]!=MOTOR_TMC) return; // simulated motors are read directly
+
+  tmc5240_readRegisters(board, addresses, values, 5); // 6 datagrams instead of 10
+  snapshot.xact = values[0];
+  snapshot.xtar = values[1];
+  snapshot.xenc = values[2];
+  snapshot.rampStat = values[3];
+  snapshot.encStatus = values[4];
+  snapshot.writeCount = g_spiWriteCount[board];
+  snapshot.time = millis();
+  snapshot.valid = 1;
+}
+
+
+// ----------------------------
+// Make sure the snapshot is usable, refresh it if needed
+// ----------------------------
+
+void TMC::UseSnapshot(int8_t fresh)
+{
+  if ( fresh || !snapshot.valid 
+       || (snapshot.writeCount != g_spiWriteCount[board]) // registers were written since the refresh
+       || (millis() - snapshot.time > MOTORS_SNAPSHOT_MAX_AGE_MS) ) {
+    RefreshSnapshot();
+  }
+}
+
+
+// ----------------------------
+// Get positions and status flags from the snapshot
+// ----------------------------
+
+int8_t TMC::ReadSnapshot(int32_t &xact, int32_t &xenc, int32_t &status, int8_t fresh)
+{
+  if (hwParam->motorType[board]==MOTOR_TMC) {
+    UseSnapshot(fresh);
+    xact = snapshot.xact;
+    xenc = snapshot.xenc;
+    status = ComposeStatusFlags(snapshot.rampStat, snapshot.encStatus);
+    return ERR_None;
+  }
+  // the simulation has no SPI cost, use the single functions
+  if (int8_t err=GetPos(xact)) return err;
+  if (int8_t err=GetEnc(xenc)) return err;
+  return GetStatusFlags(status);
+}
+
+
+// ----------------------------
+// Read the signals of the capture
+// ----------------------------
+
+int8_t TMC::ReadCapture(uint8_t signals, int32_t *values)
+{
+  static const uint8_t regs[MOTORS_CAPTURE_NUM_SIGNALS] = {TMC5240_XACTUAL, TMC5240_XENC, TMC5240_VACTUAL,
+                                                           TMC5240_DRVSTATUS, TMC5240_RAMPSTAT};
+  int8_t num = 0;
+
+  if (hwParam->motorType[board]==MOTOR_SIM) UpdateSim();
+  for (int8_t z=0; z<MOTORS_CAPTURE_NUM_SIGNALS; z++) {
+    if (!(signals & (1 << z))) continue;
+    int32_t value = 0;
+    if (hwParam->motorType[board]==MOTOR_TMC) {
+      value = tmc5240_readRegisterFresh(board, regs[z]);
+      if (regs[z]==TMC5240_VACTUAL) value = (int32_t)((uint32_t)value << 8) >> 8; // 24 bit signed
+    } else if (hwParam->motorType[board]==MOTOR_SIM) {
+      if (regs[z]==TMC5240_XACTUAL) value = simValues.xact;
+      else if (regs[z]==TMC5240_XENC) value = simValues.xenc;
+      else if (regs[z]==TMC5240_VACTUAL) value = simValues.vel;
+    }
+    values[num++] = value;
+  }
+  return num;
+}
+
+
+// ----------------------------
+// Compose the status flags from RAMPSTAT and ENC_STATUS
+// ----------------------------
+
+int32_t TMC::ComposeStatusFlags(int32_t rampStat, int32_t encStatus)
+{
+  int32_t flags = 0;
+  // flags from the RAMP_STAT
+  if ( motors->isMotorEnabled[board] )
+    flags |= (0x1 << 11); // motor enabled
+  if ( rampStat & TMC5240_POSITION_REACHED_MASK )
+    flags |= (0x1 << 10); // pos_reached status, NOT the event
+  if ( !(rampStat & TMC5240_VZERO_MASK) )
+    flags |= (0x1 << 9); // velocity is not zero
+  if ( rampStat & TMC5240_STATUS_LATCH_R_MASK )
+    flags |= (0x1 << 8); // status latch right available
+  if ( rampStat & TMC5240_STATUS_LATCH_L_MASK )
+    flags |= (0x1 << 7); // status latch left available
+  if ( rampStat & TMC5240_EVENT_STOP_SG_MASK )
+    flags |= (0x1 << 5); // SG event
+  if ( rampStat & TMC5240_STATUS_SG_MASK )
+    flags |= (0x1 << 4); // SG status, NOT the event
+  if ( rampStat & TMC5240_STATUS_VIRTUAL_STOP_R_MASK )
+    flags |= (0x1 << 3); // virt_R status, NOT the event
+  if ( rampStat & TMC5240_STATUS_VIRTUAL_STOP_L_MASK )
+    flags |= (0x1 << 2); // virt_L status, NOT the event
+  if ( rampStat & TMC5240_STATUS_STOP_R_MASK )
+    flags |= (0x1 << 1); // stop_R status, NOT the event
+  if ( rampStat & TMC5240_STATUS_STOP_L_MASK )
+    flags |= 0x1; // stop_L status, NOT the event
+
+  // flags from the ENC_STATUS
+  if ( encStatus & TMC5240_DEVIATION_WARN_MASK )
+    flags |= (0x1 << 6); // stop_R status, NOT the event
+  return flags;
+}
+
+
 // ----------------------------
 // Find the index and the value of the parameter
 // ----------------------------
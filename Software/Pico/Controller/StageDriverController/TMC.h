@@ -11,6 +11,19 @@
 #define TMC_HOMING_STANDSTILL_TIMEOUT_MS  1000 // max time to wait for motor to stop after switch is reached during homing  
 #define TMC_OVERTEMP_PREWARN              0xB92 // ADC value corresponding to 120 deg C
                                                 // ADC = 7.7 * temp_C + 2038    
+#define TMC_FCLK_HZ                       12500000.0f // driver clock (internal oscillator)
+#define TMC_VEL_SCALE                     (TMC_FCLK_HZ/16777216.0f) // VMAX -> usteps/s (f/2^24)
+#define TMC_ACC_SCALE                     (TMC_FCLK_HZ*TMC_FCLK_HZ/2199023255552.0f) // AMAX -> usteps/s^2 (f^2/2^41)
+#define TMC_MIN_RAMP_SCALE                0.01f // lower limit for the ramp scaling of synchronized moves
+#define TMC_SEGMENT_MAX_VEL               8388095 // max VMAX of a trajectory segment (TMC5240: 2^23-512)
+#define TMC_SPI_CLOCK_HZ                  4000000 // SPI clock (datasheet max. is fCLK/2 with the internal oscillator)
+#define TMC_SPI_TCC_NS                    10 // min. time between a CSN edge and the next SCK edge (datasheet tCC)
+#define TMC_SPI_TCSH_NS                   90 // min. CSN high time between datagrams (datasheet tCSH = tCLK+10 ns)
+#define TMC_SIM_ENC_RESOLUTION            1 // MOTOR_SIM: encoder quantization in microsteps (1 -> every microstep)
+#define TMC_SIM_ENC_NOISE                 0 // MOTOR_SIM: max. encoder noise in microsteps (uniform, 0 -> off)
+#define TMC_SIM_BACKLASH                  0 // MOTOR_SIM: backlash between motor and encoder in microsteps (0 -> off)
+#define TMC_SIM_DEFAULT_VMAX              32000 // MOTOR_SIM: ramp velocity (internal units) used when RSEV is not set
+#define TMC_SIM_DEFAULT_AMAX              4000 // MOTOR_SIM: ramp acceleration (internal units) used when RSEA is not set
 
 
 // *************************************************************************************
@@ -30,16 +43,45 @@ class Motors; // forward declaration
  * including parameter values, actual and target positions, encoder position, velocity,
  * and the timestamp of the last velocity calculation.
  *
+ * The motion follows the trapezoidal ramp of the TMC5240 (AMAX = DMAX from RSEA, VMAX from RSEV
+ * in position mode or the requested velocity in velocity mode) and is integrated with micros().
+ * The encoder follows the load, i.e. the motor position behind the backlash, with optional
+ * quantization and noise (see TMC_SIM_ENC_RESOLUTION, TMC_SIM_ENC_NOISE, TMC_SIM_BACKLASH).
  */
 struct TMCSimStatus {
 //  int32_t params[MOTORS_NUM_PARAMS];
-  int32_t xact;
-  int32_t xtar;
-  int32_t xenc;
-  int32_t xmin;
-  int32_t xmax;
-  int32_t vel;
-  unsigned long lastVelCalcTime = 0;
+  int32_t xact; // actual (motor) position, rounded from pos
+  int32_t xtar; // target position in position mode
+  int32_t xenc; // encoder position
+  int32_t xmin; // left limit (virtual stop)
+  int32_t xmax; // right limit (virtual stop)
+  int32_t vel; // velocity in VMAX units (signed), rounded from v
+  float pos = 0.0f; // motor position in microsteps
+  float load = 0.0f; // load position (motor position behind the backlash) in microsteps
+  float encOffset = 0.0f; // offset between the encoder and the load position (set via XENC)
+  float v = 0.0f; // current velocity in microsteps/s (signed)
+  float vmax = 0.0f; // max velocity of the ramp in microsteps/s (or the target velocity in velocity mode)
+  float amax = 0.0f; // acceleration and deceleration in microsteps/s^2
+  int8_t velocityMode = 0; // 1 -> velocity mode (MoveAtVel), 0 -> position mode
+  uint32_t noiseState = 1; // state of the encoder noise generator
+  unsigned long lastVelCalcTime = 0; // micros() of the last update
+};
+
+
+/**
+ * @struct TMCSnapshot
+ * @brief Copy of the frequently queried driver registers of one board.
+ *
+ * The snapshot is refreshed once per supervision tick and used to answer host queries without
+ * SPI traffic. It is discarded when it is older than MOTORS_SNAPSHOT_MAX_AGE_MS or when any
+ * register of the board was written since the refresh.
+ */
+struct TMCSnapshot {
+  unsigned long time = 0; // millis() of the last refresh
+  uint32_t writeCount = 0; // SPI write count of the board at the time of the refresh
+  int8_t valid = 0; // 0 until the first refresh
+  int32_t xact, xtar, xenc; // positions
+  int32_t rampStat, encStatus; // raw status registers
 };
 
 
@@ -65,6 +107,9 @@ private:
   int32_t *motorParam; // pointer to the motor parameters array, which is defined in the Parameters class
   // a subset of motorParam is copied here for faster access
   TMCSimStatus simValues; // simulation values for TMC motor controller
+  float rampScale = 1.0f; // ramp scaling of the last position move (1 = regular RSEV/RSEA ramp)
+  TMCSnapshot snapshot; // register snapshot for host queries (TMC motors only)
+  int8_t fullConfigRequired = 1; // set until the first config and after a driver reset, forces all parameter groups
 
 /**
  * @brief Sets an error message for the TMC controller.
@@ -73,9 +118,15 @@ private:
  * @param msg The error message to set.
  */
   void SetErrorMsg(const char *msg);
+  int32_t ComposeStatusFlags(int32_t rampStat, int32_t encStatus); // builds the GetStatusFlags bits from the raw registers
+  void UseSnapshot(int8_t fresh); // refreshes the snapshot if requested, outdated or invalid
+  int8_t ConfigParams(uint8_t groups); // writes the registers of the selected parameter groups
+  void UpdateSim(void); // advances the simulated ramp to the current time (MOTOR_SIM only)
+  void SetSimRamp(float scale); // sets the simulated VMAX and AMAX from RSEV and RSEA
 
 public:
   int32_t encConst, maxIterations, tolerance, resetXafterCL; // closed-loop parameters
+  int8_t diag0Pin = -1, diag1Pin = -1; // GPIOs wired to the DIAG0 (INT) and DIAG1 (PP) outputs, -1 if not connected
 
   /**
    * @brief Default constructor for the TMC class.
@@ -102,10 +153,13 @@ public:
    * @brief Configures the TMC controller based on the current motor parameters.
    * 
    * This function sets up the TMC driver with the parameters defined in the motorParam array.
+   * Only the parameter groups in groups are written. The first config after init or after a driver
+   * reset always writes all groups.
    * 
+   * @param groups Bit mask of the parameter groups to apply (PARAMS_GROUP_xxx, default all).
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
-  int8_t Config(void);
+  int8_t Config(uint8_t groups = PARAMS_GROUP_ALL);
 
   /**
    * @brief Clears the status registers.
@@ -134,9 +188,35 @@ public:
    * 
    * @param pos The target position in microsteps.
    * @param setVel Flag to indicate whether the velocity should be set (as opposed to just the position).
+   * @param scale Scaling of the ramp for synchronized moves (VMAX=RSEV*scale, AMAX=DMAX=RSEA*scale^2).
+   * The move then takes 1/scale times as long. Only applied if setVel is set.
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
-  int8_t MoveToPos(int32_t pos, int8_t setVel);
+  int8_t MoveToPos(int32_t pos, int8_t setVel, float scale = 1.0f);
+
+  /**
+   * @brief Starts a segment of a trajectory with its own ramp (see Motors::AddToTrajectory).
+   * 
+   * A position segment moves to pos with VMAX=|vel| and AMAX=DMAX=acc. A velocity segment runs at vel
+   * (the sign gives the direction) with AMAX=acc, pos is only used by the caller to end the segment.
+   * 
+   * @param pos The target position in microsteps.
+   * @param vel The velocity, 0 for the regular velocity (RSEV, position segments only).
+   * @param acc The acceleration, 0 for the regular acceleration (RSEA).
+   * @param velMode 1 for a velocity segment, 0 for a position segment.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t StartSegment(int32_t pos, int32_t vel, int32_t acc, int8_t velMode);
+
+  /**
+   * @brief Estimates the duration of a position move with the regular ramp (RSEV, RSEA).
+   * 
+   * Assumes a symmetric trapezoidal ramp starting and ending at standstill.
+   * 
+   * @param distance The distance to move in microsteps (sign is ignored).
+   * @return float The estimated move time in seconds (0 if the ramp parameters are not set).
+   */
+  float EstimateMoveTime(int32_t distance);
 
   /**
    * @brief Sets the X positions to the specified position without moving the motor.
@@ -149,6 +229,16 @@ public:
    */
   int8_t SetXPos(int32_t pos);
 
+  /**
+   * @brief Sets the actual, target and encoder positions to the same value without moving the motor.
+   * 
+   * The enable state of the driver is not touched. Also clears the encoder deviation flag.
+   * 
+   * @param pos The new position in microsteps.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t SetOrigin(int32_t pos);
+
   /**
    * @brief Gets the current position X_ACT of the motor.
    * 
@@ -222,9 +312,10 @@ public:
    * @param index Index for the array motStatIDList, defined in Motors.h.
    * This array is a list of accepted status IDs (short strings), also used during serial comm.
    * @param value Reference to an integer to store the retrieved status value.
+   * @param fresh If 1, the positions are read from the driver instead of the snapshot.
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
-  int8_t GetStatusValue(int32_t index, int32_t &value);
+  int8_t GetStatusValue(int32_t index, int32_t &value, int8_t fresh = 0);
 
   /**
    * @brief Sets a specific register value in the TMC driver.
@@ -235,10 +326,12 @@ public:
 
   /**
    * @brief Gets the value of a specific register in the TMC driver.
+   * Configuration registers are answered from the register shadow unless a fresh read is requested.
    * @param address The register address to read.
    * @param value Reference to an integer to store the retrieved register value.
+   * @param fresh If 1, the register is always read from the driver.
    */
-  int8_t GetRegisterValue(uint8_t address, int32_t &value);
+  int8_t GetRegisterValue(uint8_t address, int32_t &value, int8_t fresh = 0);
 
   /**
    * @brief Checks for errors in the TMC driver.
@@ -272,9 +365,42 @@ public:
    * flag:  enabled |  atPos |  isMov |latch_R |latch_L | encDev |SG_evnt |SG_stat | virt_R | virt_L | stop_R | stop_L |
    * 
    * @param status Reference to an integer to store the status flags.
+   * @param fresh If 1, the registers are read from the driver instead of the snapshot.
    * @return int8_t Returns 0 on success, or a negative error code on failure.
    */
-  int8_t GetStatusFlags(int32_t &status);
+  int8_t GetStatusFlags(int32_t &status, int8_t fresh = 0);
+
+  /**
+   * @brief Reads the position and status registers into the snapshot.
+   * 
+   * For TMC motors the five registers (XACTUAL, XTARGET, XENC, RAMPSTAT, ENC_STATUS) are read with 
+   * pipelined SPI datagrams. This is called once per supervision tick. Simulated motors do not use a snapshot.
+   */
+  void RefreshSnapshot(void);
+
+  /**
+   * @brief Gets the actual position, the encoder position and the status flags from the snapshot.
+   * 
+   * @param xact Reference to store the actual position.
+   * @param xenc Reference to store the encoder position.
+   * @param status Reference to store the status flags (same format as GetStatusFlags).
+   * @param fresh If 1, the snapshot is refreshed first.
+   * @return int8_t Returns 0 on success, or a negative error code on failure.
+   */
+  int8_t ReadSnapshot(int32_t &xact, int32_t &xenc, int32_t &status, int8_t fresh = 0);
+
+  /**
+   * @brief Reads the selected signals of the capture (fresh SPI reads, no snapshot).
+   * 
+   * The signals are written in the order of their bits: bit 0 XACTUAL, bit 1 XENC, bit 2 VACTUAL (sign extended),
+   * bit 3 DRV_STATUS (SG_RESULT in bits 0 to 9), bit 4 RAMP_STAT. Simulated motors report the position, the encoder
+   * and the velocity, the other signals are 0.
+   * 
+   * @param signals Bit mask of the signals (see MOTORS_CAPTURE_NUM_SIGNALS).
+   * @param values Array to store the values, one per selected signal.
+   * @return int8_t Returns the number of values written.
+   */
+  int8_t ReadCapture(uint8_t signals, int32_t *values);
 
   /**
    * @brief Finds the index and value of a specific parameter by its name.
@@ -36,29 +36,156 @@ const uint8_t tmcCRCTable_Poly7Reflected[256] = {
 /************************************************************** Register read / write Implementation ******************************************************************/
 
 static int32_t readRegisterSPI(uint16_t icID, uint8_t address);
+static void readRegistersSPI(uint16_t icID, const uint8_t *addresses, int32_t *values, size_t count);
 static void writeRegisterSPI(uint16_t icID, uint8_t address, int32_t value);
 static int32_t readRegisterUART(uint16_t icID, uint8_t registerAddress);
 static void writeRegisterUART(uint16_t icID, uint8_t registerAddress, int32_t value);
 static uint8_t CRC8(uint8_t *data, uint32_t bytes);
 
+/************************************************************** Register shadow ****************************************************************************************/
+
+// Shadow copy of the configuration registers. These are only changed by writes from this side,
+// so reads can be answered from the shadow and writes of an unchanged value can be skipped.
+// Registers the IC modifies itself (positions, status, flags) or writes that trigger an action
+// (XTARGET, OTP_PROG) are never shadowed.
+#if TMC5240_SHADOW_IC_COUNT > 0
+static int32_t shadowRegister[TMC5240_SHADOW_IC_COUNT][TMC5240_REGISTER_COUNT];
+static uint32_t shadowValid[TMC5240_SHADOW_IC_COUNT][TMC5240_REGISTER_COUNT/32];
+static uint32_t shadowPending[TMC5240_SHADOW_IC_COUNT][TMC5240_REGISTER_COUNT/32]; // changed during a bulk write, not sent yet
+static bool bulkActive[TMC5240_SHADOW_IC_COUNT];
+#endif
+
+bool tmc5240_isShadowed(uint8_t address)
+{
+    address &= TMC5240_ADDRESS_MASK;
+    if(tmc5240_registerAccess[address] != 0x03)
+        return false; // read-only, write-to-clear or reserved
+    switch(address)
+    {
+    case TMC5240_INP_OUT:
+    case TMC5240_OTP_PROG:
+    case TMC5240_XACTUAL:
+    case TMC5240_XTARGET:
+    case TMC5240_XENC:
+        return false;
+    default:
+        return true;
+    }
+}
+
+void tmc5240_invalidateShadow(uint16_t icID)
+{
+#if TMC5240_SHADOW_IC_COUNT > 0
+    if(icID < TMC5240_SHADOW_IC_COUNT)
+    {
+        memset(shadowValid[icID], 0, sizeof(shadowValid[icID]));
+        memset(shadowPending[icID], 0, sizeof(shadowPending[icID]));
+    }
+#endif
+}
+
+// Between begin and end, writes to shadowed registers only update the shadow. The end sends
+// each changed register once, so several field writes to one register cost a single datagram.
+void tmc5240_beginBulkWrite(uint16_t icID)
+{
+#if TMC5240_SHADOW_IC_COUNT > 0
+    if(icID < TMC5240_SHADOW_IC_COUNT)
+        bulkActive[icID] = true;
+#endif
+}
+
+void tmc5240_endBulkWrite(uint16_t icID)
+{
+#if TMC5240_SHADOW_IC_COUNT > 0
+    if(icID >= TMC5240_SHADOW_IC_COUNT)
+        return;
+    bulkActive[icID] = false;
+    for(uint8_t address = 0; address < TMC5240_REGISTER_COUNT; address++)
+    {
+        if(!(shadowPending[icID][address/32] & (1UL << (address%32))))
+            continue;
+        shadowPending[icID][address/32] &= ~(1UL << (address%32));
+        if(tmc5240_getBusType(icID) == IC_BUS_SPI)
+            writeRegisterSPI(icID, address, shadowRegister[icID][address]);
+        else if(tmc5240_getBusType(icID) == IC_BUS_UART)
+            writeRegisterUART(icID, address, shadowRegister[icID][address]);
+    }
+#endif
+}
+
+static bool getShadow(uint16_t icID, uint8_t address, int32_t *value)
+{
+#if TMC5240_SHADOW_IC_COUNT > 0
+    address &= TMC5240_ADDRESS_MASK;
+    if(icID < TMC5240_SHADOW_IC_COUNT && (shadowValid[icID][address/32] & (1UL << (address%32))))
+    {
+        *value = shadowRegister[icID][address];
+        return true;
+    }
+#endif
+    return false;
+}
+
+static void setShadow(uint16_t icID, uint8_t address, int32_t value)
+{
+#if TMC5240_SHADOW_IC_COUNT > 0
+    address &= TMC5240_ADDRESS_MASK;
+    if(icID < TMC5240_SHADOW_IC_COUNT && tmc5240_isShadowed(address))
+    {
+        shadowRegister[icID][address] = value;
+        shadowValid[icID][address/32] |= (1UL << (address%32));
+    }
+#endif
+}
+
 int32_t tmc5240_readRegister(uint16_t icID, uint8_t address)
+{
+    int32_t value;
+
+    if(getShadow(icID, address, &value))
+        return value;
+
+    return tmc5240_readRegisterFresh(icID, address);
+}
+
+// Always reads the register from the IC and updates the shadow
+int32_t tmc5240_readRegisterFresh(uint16_t icID, uint8_t address)
 {
     TMC5240BusType bus = tmc5240_getBusType(icID);
+    int32_t value;
 
     if(bus == IC_BUS_SPI)
     {
-        return readRegisterSPI(icID, address);
+        value = readRegisterSPI(icID, address);
     }
     else if (bus == IC_BUS_UART)
     {
-        return readRegisterUART(icID, address);
+        value = readRegisterUART(icID, address);
+    }
+    else
+    {
+        return -1;
     }
-    return -1;
+    setShadow(icID, address, value);
+    return value;
 }
 
 void tmc5240_writeRegister(uint16_t icID, uint8_t address, int32_t value)
 {
     TMC5240BusType bus = tmc5240_getBusType(icID);
+    int32_t shadow;
+
+    if(getShadow(icID, address, &shadow) && shadow == value)
+        return; // unchanged configuration register, skip the write
+    setShadow(icID, address, value);
+#if TMC5240_SHADOW_IC_COUNT > 0
+    if(icID < TMC5240_SHADOW_IC_COUNT && bulkActive[icID] && tmc5240_isShadowed(address))
+    {
+        address &= TMC5240_ADDRESS_MASK;
+        shadowPending[icID][address/32] |= (1UL << (address%32));
+        return; // sent by tmc5240_endBulkWrite
+    }
+#endif
 
     if(bus == IC_BUS_SPI)
     {
@@ -70,6 +197,23 @@ void tmc5240_writeRegister(uint16_t icID, uint8_t address, int32_t value)
     }
 }
 
+// Reads several registers of one IC. On SPI the reply to a read request arrives with the next
+// datagram, so the requests are pipelined: count+1 datagrams instead of 2*count.
+void tmc5240_readRegisters(uint16_t icID, const uint8_t *addresses, int32_t *values, size_t count)
+{
+    TMC5240BusType bus = tmc5240_getBusType(icID);
+
+    if(bus == IC_BUS_SPI)
+    {
+        readRegistersSPI(icID, addresses, values, count);
+    }
+    else
+    {
+        for(size_t i = 0; i < count; i++)
+            values[i] = tmc5240_readRegister(icID, addresses[i]);
+    }
+}
+
 int32_t readRegisterSPI(uint16_t icID, uint8_t address)
 {
     uint8_t data[5] = { 0 };
@@ -89,6 +233,27 @@ int32_t readRegisterSPI(uint16_t icID, uint8_t address)
     return ((int32_t)data[1] << 24) | ((int32_t) data[2] << 16) | ((int32_t) data[3] <<  8) | ((int32_t) data[4]);
 }
 
+void readRegistersSPI(uint16_t icID, const uint8_t *addresses, int32_t *values, size_t count)
+{
+    uint8_t data[5];
+
+    if(count == 0)
+        return;
+
+    for(size_t i = 0; i <= count; i++)
+    {
+        // request the next address (the last datagram repeats the final one just to clock out the reply)
+        data[0] = addresses[(i < count) ? i : count-1] & TMC5240_ADDRESS_MASK;
+        data[1] = data[2] = data[3] = data[4] = 0;
+
+        tmc5240_readWriteSPI(icID, &data[0], sizeof(data));
+
+        // the reply belongs to the request of the previous datagram
+        if(i > 0)
+            values[i-1] = ((int32_t)data[1] << 24) | ((int32_t) data[2] << 16) | ((int32_t) data[3] <<  8) | ((int32_t) data[4]);
+    }
+}
+
 void writeRegisterSPI(uint16_t icID, uint8_t address, int32_t value)
 {
     uint8_t data[5] = { 0 };
@@ -26,6 +26,12 @@
 // and put the table into your own .c file
 //#define TMC_API_EXTERNAL_CRC_TABLE 1
 
+// Number of ICs with a shadow copy of the configuration registers (should match MAXNUMMOTORS).
+// Set to 0 to always access the hardware.
+#ifndef TMC5240_SHADOW_IC_COUNT
+#define TMC5240_SHADOW_IC_COUNT 4
+#endif
+
 /******************************************************************************/
 
 typedef enum {
@@ -52,6 +58,12 @@ extern uint8_t tmc5240_getNodeAddress(uint16_t icID);
 
 int32_t tmc5240_readRegister(uint16_t icID, uint8_t address);
 void tmc5240_writeRegister(uint16_t icID, uint8_t address, int32_t value);
+void tmc5240_readRegisters(uint16_t icID, const uint8_t *addresses, int32_t *values, size_t count);
+int32_t tmc5240_readRegisterFresh(uint16_t icID, uint8_t address);
+bool tmc5240_isShadowed(uint8_t address);
+void tmc5240_invalidateShadow(uint16_t icID);
+void tmc5240_beginBulkWrite(uint16_t icID);
+void tmc5240_endBulkWrite(uint16_t icID);
 void tmc5240_rotateMotor(uint16_t icID, uint8_t motor, int32_t velocity);
 
 
@@ -0,0 +1,201 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/**
+ * @file Arduino.h
+ * @brief Host shim of the Arduino-Pico core for the native build of the controller (env:native).
+ *
+ * Provides the part of the Arduino API the controller uses, on top of the host OS:
+ * - millis(), micros() and the delays from the monotonic clock (0 at the program start),
+ *   busy_wait_at_least_cycles() of the Pico SDK as a no-op (the simulated SPI has no timing).
+ * - GPIOs as a plain pin state array (CS pins select the simulated TMC5240, see SPI.h).
+ * - Serial backed by stdin/stdout or a pseudo terminal, Serial1 (remote UART) as a silent link.
+ * - rp2040.cpuid() from the thread that runs the core (see HostMain.cpp).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+typedef uint8_t pin_size_t;
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define INPUT_PULLDOWN  3
+#define CHANGE          2
+#define FALLING         3
+#define RISING          4
+#define MSBFIRST        1
+#define LSBFIRST        0
+
+#define D15             15
+#define A0              26
+#define A1              27
+#define A2              28
+#define PIN_SERIAL1_TX  0 // UART0 pins of the Pico variant
+#define PIN_SERIAL1_RX  1
+#define HOST_NUM_PINS   48 // number of GPIOs of the pin state array
+
+
+// *************************************************************************************
+// Time, GPIO and interrupts
+// *************************************************************************************
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void busy_wait_at_least_cycles(uint32_t cycles); // Pico SDK
+
+void pinMode(pin_size_t pin, int mode);
+void digitalWrite(pin_size_t pin, int value);
+int digitalRead(pin_size_t pin);
+int analogRead(pin_size_t pin);
+void analogReadResolution(int bits);
+static inline int digitalPinToInterrupt(pin_size_t pin) { return pin; }
+void attachInterrupt(int pin, void (*isr)(void), int mode);
+void detachInterrupt(int pin);
+static inline void noInterrupts(void) {}
+static inline void interrupts(void) {}
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+
+
+// *************************************************************************************
+// Print and Stream
+// *************************************************************************************
+
+/**
+ * @class Print
+ * @brief Formatted output on top of the write functions of the derived class.
+ */
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return write((const uint8_t*)str, strlen(str)); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+  virtual int availableForWrite(void) { return 0; }
+  virtual void flush(void) {}
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value) { return printf("%d", value); }
+  size_t print(unsigned int value) { return printf("%u", value); }
+  size_t print(long value) { return printf("%ld", value); }
+  size_t print(unsigned long value) { return printf("%lu", value); }
+  size_t print(long long value) { return printf("%lld", value); }
+  size_t print(unsigned long long value) { return printf("%llu", value); }
+  size_t print(double value, int digits = 2) { return printf("%.*f", digits, value); }
+  size_t println(void) { return write("\r\n"); }
+  template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  size_t println(double value, int digits) { size_t n = print(value, digits); return n + println(); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/**
+ * @class Stream
+ * @brief Input on top of available/read/peek of the derived class.
+ */
+class Stream : public Print
+{
+protected:
+  unsigned long timeout_ms = 1000; // timeout of the blocking reads
+
+public:
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+  virtual int peek(void) = 0;
+  void setTimeout(unsigned long timeout) { timeout_ms = timeout; }
+  size_t readBytes(char *buffer, size_t length);
+  size_t readBytesUntil(char terminator, char *buffer, size_t length);
+};
+
+
+// *************************************************************************************
+// Serial ports
+// *************************************************************************************
+
+/**
+ * @class HostSerial
+ * @brief Serial port backed by a pair of file descriptors (stdin/stdout or a pseudo terminal).
+ *
+ * Without descriptors (Serial1, the remote UART) nothing is received and everything sent is dropped.
+ * The descriptors are attached by HostMain.cpp before setup() runs.
+ */
+class HostSerial : public Stream
+{
+  int inFd = -1; // descriptor to read from, -1 -> nothing to receive
+  int outFd = -1; // descriptor to write to, -1 -> output dropped
+  uint8_t rxBuffer[4096]; // bytes read from inFd, not yet consumed
+  size_t rxHead = 0; // position of the next byte in rxBuffer
+  size_t rxLength = 0; // number of valid bytes in rxBuffer
+  int8_t isInputClosed = 0; // 1 once inFd reached the end of the file
+
+  void FillBuffer(void);
+
+public:
+  void Attach(int in, int out);
+  int8_t IsInputClosed(void) { return isInputClosed && rxHead == rxLength; }
+
+  void begin(unsigned long baud) {}
+  void end(void) {}
+  bool setRX(pin_size_t pin) { return true; }
+  bool setTX(pin_size_t pin) { return true; }
+  bool setFIFOSize(size_t size) { return true; }
+  operator bool() { return true; }
+
+  int available(void) override;
+  int read(void) override;
+  int peek(void) override;
+  int availableForWrite(void) override;
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+};
+
+extern HostSerial Serial;
+extern HostSerial Serial1;
+
+
+// *************************************************************************************
+// RP2040/RP2350 specifics
+// *************************************************************************************
+
+/**
+ * @class HostRP2040
+ * @brief The rp2040 object of the core: core number and core control.
+ */
+class HostRP2040
+{
+public:
+  int cpuid(void);
+  int f_cpu(void) { return 150000000; } // clock of the RP2350
+  void idleOtherCore(void) {} // the flash of the host can be written while the other thread runs
+  void resumeOtherCore(void) {}
+};
+
+extern HostRP2040 rp2040;
+
+#endif // __cplusplus
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,45 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+/**
+ * @file EEPROM.h
+ * @brief Host shim of the EEPROM emulation, backed by the storage file (see HostStorage.cpp).
+ */
+
+#include <Arduino.h>
+
+#define HOST_EEPROM_SIZE  4096 // max size of the emulated EEPROM (as the Arduino-Pico core)
+
+/**
+ * @class EEPROMClass
+ * @brief Byte array that is written to the storage file on commit().
+ */
+class EEPROMClass
+{
+  uint8_t data[HOST_EEPROM_SIZE]; // content, 0xFF when erased
+  size_t size = 0; // size given to begin()
+
+public:
+  void begin(size_t length);
+  bool commit(void);
+  uint8_t read(int address) { return data[address]; }
+  void write(int address, uint8_t value) { data[address] = value; }
+  uint8_t* getDataPtr(void) { return data; }
+  size_t length(void) { return size; }
+
+  template <typename T> T& get(int address, T &value)
+  {
+    memcpy(&value, data + address, sizeof(T));
+    return value;
+  }
+
+  template <typename T> const T& put(int address, const T &value)
+  {
+    memcpy(data + address, &value, sizeof(T));
+    return value;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // HOST_EEPROM_H
@@ -0,0 +1,51 @@
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+/**
+ * @file SPI.h
+ * @brief Host shim of the SPI library: the datagrams go to simulated TMC5240 register files.
+ *
+ * Each CS pin (selected by digitalWrite(pin, LOW)) has its own simulated driver, see HostTMC5240.cpp.
+ */
+
+#include <Arduino.h>
+
+#define SPI_MODE0  0
+#define SPI_MODE3  3
+
+/**
+ * @class SPISettings
+ * @brief Clock, bit order and mode of a transaction (ignored by the simulation).
+ */
+class SPISettings
+{
+public:
+  SPISettings() {}
+  SPISettings(uint32_t clock, int bitOrder, int dataMode) {}
+};
+
+/**
+ * @class SPIClass
+ * @brief SPI bus to the simulated drivers.
+ */
+class SPIClass
+{
+public:
+  void begin(void) {}
+  void end(void) {}
+  void beginTransaction(SPISettings settings) {}
+  void endTransaction(void) {}
+  uint8_t transfer(uint8_t data);
+  void transfer(void *buffer, size_t length);
+};
+
+extern SPIClass SPI;
+
+/**
+ * @brief Selects the simulated driver of a CS pin (called by digitalWrite).
+ *
+ * @param pin The CS pin, or -1 to deselect all drivers.
+ */
+void HostSPISelect(int pin);
+
+#endif // HOST_SPI_H
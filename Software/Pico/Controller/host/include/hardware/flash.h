@@ -0,0 +1,26 @@
+#ifndef HOST_HARDWARE_FLASH_H
+#define HOST_HARDWARE_FLASH_H
+
+/**
+ * @file flash.h
+ * @brief Host shim of the pico-sdk flash functions, backed by the storage file (see HostStorage.cpp).
+ *
+ * The filesystem region (_FS_start to _FS_end, see board_build.filesystem_size) is the array g_hostFlash,
+ * the linker symbols are defined by the build flags of env:native. XIP_BASE is chosen so the flash offsets
+ * of ParamStore are offsets into that array.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FLASH_SECTOR_SIZE     4096
+#define FLASH_PAGE_SIZE       256
+#define HOST_FLASH_SIZE       (4 * FLASH_SECTOR_SIZE) // size of the filesystem region (board_build.filesystem_size)
+
+extern "C" uint8_t g_hostFlash[HOST_FLASH_SIZE];
+#define XIP_BASE              ((uintptr_t)g_hostFlash)
+
+extern "C" void flash_range_erase(uint32_t flash_offs, size_t count);
+extern "C" void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif // HOST_HARDWARE_FLASH_H
@@ -0,0 +1,266 @@
+// *************************************************************************************
+//
+// Host shim of the Arduino-Pico core: time, GPIOs, Print/Stream and the serial ports
+//
+// *************************************************************************************
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <chrono>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "HostShim.h"
+
+#define HOST_SERIAL_WRITE_TIMEOUT_MS  100 // output is dropped when the host doesn't read it for this time (like USB CDC)
+
+
+// *************************************************************************************
+// globals
+// *************************************************************************************
+static const std::chrono::steady_clock::time_point g_startTime = std::chrono::steady_clock::now();
+static volatile int8_t g_pinState[HOST_NUM_PINS] = {0}; // last written or pulled level of each pin
+static int8_t g_pinHeldLow[HOST_NUM_PINS] = {0}; // pins forced low (HostHoldPinLow)
+static thread_local int g_core = 0; // core number of the calling thread
+
+HostSerial Serial;
+HostSerial Serial1;
+HostRP2040 rp2040;
+
+
+// *************************************************************************************
+// Time
+// *************************************************************************************
+
+unsigned long millis(void)
+{
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - g_startTime).count();
+}
+
+unsigned long micros(void)
+{
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_startTime).count();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  // busy wait as on the Pico, a sleep would take at least the scheduler tick
+  unsigned long start = micros();
+  while (micros() - start < us) {}
+}
+
+void busy_wait_at_least_cycles(uint32_t cycles)
+{
+  (void)cycles; // nanosecond waits, shorter than the call itself on the host
+}
+
+
+// *************************************************************************************
+// GPIO and interrupts
+// *************************************************************************************
+
+void pinMode(pin_size_t pin, int mode)
+{
+  if (pin >= HOST_NUM_PINS) return;
+  if (mode == INPUT_PULLUP) g_pinState[pin] = HIGH;
+  if (mode == INPUT_PULLDOWN) g_pinState[pin] = LOW;
+}
+
+void digitalWrite(pin_size_t pin, int value)
+{
+  if (pin >= HOST_NUM_PINS) return;
+  g_pinState[pin] = value ? HIGH : LOW;
+  // the TMC driver frames each datagram with its CS pin
+  HostSPISelect(value ? -1 : pin);
+}
+
+int digitalRead(pin_size_t pin)
+{
+  if (pin >= HOST_NUM_PINS) return LOW;
+  return g_pinHeldLow[pin] ? LOW : g_pinState[pin];
+}
+
+int analogRead(pin_size_t pin)
+{
+  return 0;
+}
+
+void analogReadResolution(int bits)
+{
+}
+
+// nothing drives the DIAG and trigger pins of the host build, the periodic checks of the supervision loop take over
+void attachInterrupt(int pin, void (*isr)(void), int mode)
+{
+}
+
+void detachInterrupt(int pin)
+{
+}
+
+void HostHoldPinLow(pin_size_t pin)
+{
+  if (pin < HOST_NUM_PINS) g_pinHeldLow[pin] = 1;
+}
+
+
+// *************************************************************************************
+// Print and Stream
+// *************************************************************************************
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (n < size && write(buffer[n])) n++;
+  return n;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  char buffer[1024];
+  va_list args;
+  int len;
+
+  va_start(args, format);
+  len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+  return write((const uint8_t*)buffer, (size_t)len);
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+  unsigned long start = millis();
+  size_t n = 0;
+
+  while (n < length && millis() - start < timeout_ms) {
+    int c = read();
+    if (c < 0) continue;
+    buffer[n++] = (char)c;
+  }
+  return n;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+  unsigned long start = millis();
+  size_t n = 0;
+
+  while (n < length && millis() - start < timeout_ms) {
+    int c = read();
+    if (c < 0) continue;
+    if (c == terminator) break;
+    buffer[n++] = (char)c;
+  }
+  return n;
+}
+
+
+// *************************************************************************************
+// HostSerial
+// *************************************************************************************
+
+// ----------------------------
+// Attach the file descriptors
+// ----------------------------
+
+void HostSerial::Attach(int in, int out)
+{
+  inFd = in;
+  outFd = out;
+  if (inFd >= 0) fcntl(inFd, F_SETFL, fcntl(inFd, F_GETFL) | O_NONBLOCK);
+}
+
+
+// ----------------------------
+// Read what arrived without waiting
+// ----------------------------
+
+void HostSerial::FillBuffer(void)
+{
+  ssize_t len;
+
+  if (inFd < 0 || isInputClosed || rxHead < rxLength) return;
+  rxHead = rxLength = 0;
+  len = ::read(inFd, rxBuffer, sizeof(rxBuffer));
+  if (len > 0) {
+    rxLength = (size_t)len;
+  } else if (len == 0) {
+    isInputClosed = 1; // end of the replayed input
+  }
+}
+
+int HostSerial::available(void)
+{
+  FillBuffer();
+  return (int)(rxLength - rxHead);
+}
+
+int HostSerial::read(void)
+{
+  FillBuffer();
+  return (rxHead < rxLength) ? rxBuffer[rxHead++] : -1;
+}
+
+int HostSerial::peek(void)
+{
+  FillBuffer();
+  return (rxHead < rxLength) ? rxBuffer[rxHead] : -1;
+}
+
+
+// ----------------------------
+// Output
+// ----------------------------
+
+int HostSerial::availableForWrite(void)
+{
+  struct pollfd pfd = {outFd, POLLOUT, 0};
+
+  if (outFd < 0) return 4096; // dropped anyway
+  return (poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLOUT)) ? 4096 : 0;
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+  size_t sent = 0;
+
+  if (outFd < 0) return size;
+  while (sent < size) {
+    ssize_t len = ::write(outFd, buffer + sent, size - sent);
+    if (len > 0) {
+      sent += (size_t)len;
+      continue;
+    }
+    if (len < 0 && errno != EAGAIN && errno != EINTR) break;
+    struct pollfd pfd = {outFd, POLLOUT, 0};
+    if (poll(&pfd, 1, HOST_SERIAL_WRITE_TIMEOUT_MS) == 0) break; // nobody reads, drop the rest
+  }
+  return size;
+}
+
+
+// *************************************************************************************
+// HostRP2040
+// *************************************************************************************
+
+int HostRP2040::cpuid(void)
+{
+  return g_core;
+}
+
+void HostSetCore(int core)
+{
+  g_core = core;
+}
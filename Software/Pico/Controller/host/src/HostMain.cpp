@@ -0,0 +1,124 @@
+// *************************************************************************************
+//
+// Entry point of the host build: sets up the shim and runs setup()/loop() of the controller
+// on a thread per core, as the Arduino-Pico core does on the RP2350
+//
+// *************************************************************************************
+
+#include <Arduino.h>
+#include "Common.h"
+
+#include <thread>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "HostShim.h"
+
+#define HOST_DEFAULT_LINGER_MS  200 // time the controller keeps running after the end of the replayed input
+
+void setup();
+void loop();
+#if MOTORS_DUAL_CORE
+void setup1();
+void loop1();
+#endif // MOTORS_DUAL_CORE
+
+
+// ----------------------------
+// Command line help
+// ----------------------------
+
+static void PrintUsage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [--pty] [--storage FILE] [--defaults] [--linger MS]\n"
+          "  Runs the controller firmware, the host serial is stdin/stdout (replay, benchmarks).\n"
+          "  --pty           serve the host serial on a pseudo terminal instead (path printed on stderr)\n"
+          "  --storage FILE  keep the EEPROM and the parameter flash in FILE (default: RAM only)\n"
+          "  --defaults      boot with the default parameters (DEFAULT_STARTUP_PIN held low)\n"
+          "  --linger MS     keep running MS ms after the end of stdin (default %d)\n",
+          name, HOST_DEFAULT_LINGER_MS);
+}
+
+
+// ----------------------------
+// Open a pseudo terminal for the host serial
+// ----------------------------
+
+static int OpenPty(void)
+{
+  struct termios tio;
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  int slave;
+
+  if (master < 0 || grantpt(master) || unlockpt(master)) return -1;
+  // keep the slave open, so the master doesn't hang up between two client programs
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0) return -1;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  fprintf(stderr, "Serial on %s\n", ptsname(master));
+  return master;
+}
+
+
+// ----------------------------
+// main
+// ----------------------------
+
+int main(int argc, char **argv)
+{
+  const char *storageFile = nullptr;
+  unsigned long linger_ms = HOST_DEFAULT_LINGER_MS;
+  int8_t usePty = 0;
+
+  for (int z=1; z<argc; z++) {
+    if (!strcmp(argv[z], "--pty")) {
+      usePty = 1;
+    } else if (!strcmp(argv[z], "--storage") && z+1 < argc) {
+      storageFile = argv[++z];
+    } else if (!strcmp(argv[z], "--defaults")) {
+      HostHoldPinLow(DEFAULT_STARTUP_PIN);
+    } else if (!strcmp(argv[z], "--linger") && z+1 < argc) {
+      linger_ms = strtoul(argv[++z], nullptr, 10);
+    } else {
+      PrintUsage(argv[0]);
+      return strcmp(argv[z], "--help") ? 1 : 0;
+    }
+  }
+
+  HostStorageOpen(storageFile);
+  if (usePty) {
+    int fd = OpenPty();
+    if (fd < 0) {
+      perror("Could not open a pseudo terminal");
+      return 1;
+    }
+    Serial.Attach(fd, fd);
+  } else {
+    Serial.Attach(STDIN_FILENO, STDOUT_FILENO);
+  }
+
+#if MOTORS_DUAL_CORE
+  // core 1 starts with core 0, RunSupervisor waits until the setup of core 0 is complete
+  std::thread core1([]() {
+    HostSetCore(1);
+    setup1();
+    for (;;) loop1();
+  });
+  core1.detach();
+#endif // MOTORS_DUAL_CORE
+
+  HostSetCore(0);
+  setup();
+  for (;;) {
+    loop();
+    if (Serial.IsInputClosed()) { // end of the replay: answer the last commands, then stop
+      unsigned long start = millis();
+      while (millis() - start < linger_ms) loop();
+      return 0;
+    }
+  }
+}
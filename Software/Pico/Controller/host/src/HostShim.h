@@ -0,0 +1,28 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+/**
+ * @file HostShim.h
+ * @brief Functions of the host shim that are used by HostMain.cpp only (not part of the Arduino API).
+ */
+
+#include <Arduino.h>
+
+/**
+ * @brief Sets the core number returned by rp2040.cpuid() for the calling thread.
+ */
+void HostSetCore(int core);
+
+/**
+ * @brief Holds a pin low, e.g. DEFAULT_STARTUP_PIN to boot with the default parameters.
+ */
+void HostHoldPinLow(pin_size_t pin);
+
+/**
+ * @brief Opens the storage file for the EEPROM and the flash region (created on the first write).
+ *
+ * @param fileName Path of the file, nullptr keeps the storage in RAM only (erased at each start).
+ */
+void HostStorageOpen(const char *fileName);
+
+#endif // HOST_SHIM_H
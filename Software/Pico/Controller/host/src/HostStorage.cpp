@@ -0,0 +1,106 @@
+// *************************************************************************************
+//
+// Host shim of the EEPROM emulation and the flash functions, backed by one storage file
+//
+// *************************************************************************************
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <hardware/flash.h>
+
+#include "HostShim.h"
+
+// layout of the storage file: the EEPROM (HOST_EEPROM_SIZE bytes) followed by the flash region
+
+
+// *************************************************************************************
+// globals
+// *************************************************************************************
+extern "C" {
+alignas(FLASH_SECTOR_SIZE) uint8_t g_hostFlash[HOST_FLASH_SIZE]; // filesystem region (_FS_start to _FS_end)
+}
+
+static const char *g_storageFile = nullptr; // nullptr -> RAM only
+
+EEPROMClass EEPROM;
+
+
+// ----------------------------
+// Load the storage file
+// ----------------------------
+
+void HostStorageOpen(const char *fileName)
+{
+  FILE *file;
+
+  memset(EEPROM.getDataPtr(), 0xFF, HOST_EEPROM_SIZE);
+  memset(g_hostFlash, 0xFF, HOST_FLASH_SIZE);
+  g_storageFile = fileName;
+  if (!fileName || !(file = fopen(fileName, "rb"))) return; // erased, the file is created on the first write
+  if (fread(EEPROM.getDataPtr(), 1, HOST_EEPROM_SIZE, file) != HOST_EEPROM_SIZE
+      || fread(g_hostFlash, 1, HOST_FLASH_SIZE, file) != HOST_FLASH_SIZE) {
+    fprintf(stderr, "Storage file %s is incomplete, the missing part reads as erased\n", fileName);
+  }
+  fclose(file);
+}
+
+
+// ----------------------------
+// Write the storage file
+// ----------------------------
+
+static void SaveStorage(void)
+{
+  FILE *file;
+
+  if (!g_storageFile) return;
+  if (!(file = fopen(g_storageFile, "wb"))) {
+    fprintf(stderr, "Could not write the storage file %s\n", g_storageFile);
+    return;
+  }
+  fwrite(EEPROM.getDataPtr(), 1, HOST_EEPROM_SIZE, file);
+  fwrite(g_hostFlash, 1, HOST_FLASH_SIZE, file);
+  fclose(file);
+}
+
+
+// *************************************************************************************
+// EEPROMClass
+// *************************************************************************************
+
+void EEPROMClass::begin(size_t length)
+{
+  size = (length <= HOST_EEPROM_SIZE) ? length : HOST_EEPROM_SIZE;
+}
+
+bool EEPROMClass::commit(void)
+{
+  SaveStorage();
+  return true;
+}
+
+
+// *************************************************************************************
+// flash functions (same alignment rules as the pico-sdk)
+// *************************************************************************************
+
+extern "C" void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+  if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > HOST_FLASH_SIZE) {
+    fprintf(stderr, "flash_range_erase(%u, %zu): not sector aligned or outside the region\n", flash_offs, count);
+    abort();
+  }
+  memset(g_hostFlash + flash_offs, 0xFF, count);
+  SaveStorage();
+}
+
+extern "C" void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+  if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > HOST_FLASH_SIZE) {
+    fprintf(stderr, "flash_range_program(%u, %zu): not page aligned or outside the region\n", flash_offs, count);
+    abort();
+  }
+  // programming can only clear bits
+  for (size_t z=0; z<count; z++) g_hostFlash[flash_offs + z] &= data[z];
+  SaveStorage();
+}
@@ -0,0 +1,190 @@
+// *************************************************************************************
+//
+// Host shim of the SPI bus: simulated TMC5240 register files, one per CS pin
+//
+// *************************************************************************************
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "TMC5240_HW_Abstraction.h"
+
+#define HOST_TMC_FCLK_HZ          12500000.0 // driver clock, as TMC_FCLK_HZ
+#define HOST_TMC_VEL_SCALE        (HOST_TMC_FCLK_HZ/16777216.0) // VMAX -> usteps/s (f/2^24)
+#define HOST_TMC_ACC_SCALE        (HOST_TMC_FCLK_HZ*HOST_TMC_FCLK_HZ/2199023255552.0) // AMAX -> usteps/s^2 (f^2/2^41)
+#define HOST_TMC_DATAGRAM_SIZE    5 // bytes of an SPI datagram (address + 32 bit data)
+
+
+// *************************************************************************************
+// simulated driver
+// *************************************************************************************
+
+/**
+ * @struct HostTMC
+ * @brief Register file and motion state of a simulated TMC5240.
+ *
+ * Registers are stored as written and read back as such, except for the ones the ramp generator of
+ * the IC updates itself (XACTUAL, VACTUAL, RAMPSTAT, XENC, DRV_STATUS). The ramp follows RAMPMODE,
+ * VMAX and AMAX (AMAX is used for the deceleration as well), the encoder follows XACTUAL 1:1.
+ * Reads are pipelined as on the IC: the reply of a datagram holds the register requested by the
+ * previous one. Write-to-clear registers (GSTAT, RAMPSTAT events) always read 0.
+ */
+struct HostTMC {
+  int32_t reg[TMC5240_REGISTER_COUNT] = {0}; // register file
+  double pos = 0.0; // position in microsteps
+  double v = 0.0; // velocity in microsteps/s (signed)
+  double encOffset = 0.0; // XENC - XACTUAL
+  unsigned long lastUpdate_us = 0; // micros() of the last ramp update
+  int32_t reply = 0; // data latched by the last read request
+};
+
+static HostTMC g_tmc[HOST_NUM_PINS];
+static int g_selectedPin = -1; // CS pin that is low, -1 -> none
+
+SPIClass SPI;
+
+
+// ----------------------------
+// Advance the ramp generator
+// ----------------------------
+
+static void UpdateRamp(HostTMC &tmc)
+{
+  unsigned long currentTime = micros();
+  double dt = (currentTime - tmc.lastUpdate_us) * 1.0e-6;
+  double vmax = (double)tmc.reg[TMC5240_VMAX] * HOST_TMC_VEL_SCALE;
+  double a = (double)tmc.reg[TMC5240_AMAX] * HOST_TMC_ACC_SCALE;
+  double vTarget = 0.0;
+  double dist = (double)tmc.reg[TMC5240_XTARGET] - tmc.pos;
+  int32_t mode = tmc.reg[TMC5240_RAMPMODE] & 0x3;
+
+  tmc.lastUpdate_us = currentTime;
+  if (dt <= 0.0 || dt > 1.0) return; // first call or the process was stopped
+  if (mode == TMC5240_MODE_POSITION) {
+    double stopDist = (a > 0.0) ? tmc.v * tmc.v / (2.0 * a) : 0.0;
+    if (fabs(dist) > stopDist) vTarget = (dist > 0.0) ? vmax : -vmax;
+  } else if (mode == TMC5240_MODE_VELPOS) {
+    vTarget = vmax;
+  } else if (mode == TMC5240_MODE_VELNEG) {
+    vTarget = -vmax;
+  } else {
+    vTarget = tmc.v; // hold
+  }
+
+  double vOld = tmc.v;
+  double dv = (a > 0.0) ? a * dt : fabs(vTarget - tmc.v);
+  if (tmc.v < vTarget) tmc.v = (tmc.v + dv < vTarget) ? tmc.v + dv : vTarget;
+  if (tmc.v > vTarget) tmc.v = (tmc.v - dv > vTarget) ? tmc.v - dv : vTarget;
+  tmc.pos += 0.5 * (vOld + tmc.v) * dt;
+
+  // the position ramp ends on the target (the step that reaches or passes it stops there)
+  if (mode == TMC5240_MODE_POSITION && dist != 0.0) {
+    double distNew = (double)tmc.reg[TMC5240_XTARGET] - tmc.pos;
+    if (distNew == 0.0 || (distNew > 0.0) != (dist > 0.0)) {
+      tmc.pos = (double)tmc.reg[TMC5240_XTARGET];
+      tmc.v = 0.0;
+    }
+  }
+}
+
+
+// ----------------------------
+// Read a register as the IC would answer it
+// ----------------------------
+
+static int32_t ReadRegister(HostTMC &tmc, uint8_t address)
+{
+  int32_t xact = (int32_t)llround(tmc.pos);
+  int32_t rampStat = 0;
+
+  switch (address) {
+    case TMC5240_XACTUAL:
+      return xact;
+    case TMC5240_VACTUAL:
+      return (int32_t)llround(tmc.v / HOST_TMC_VEL_SCALE) & 0xFFFFFF; // 24 bit signed
+    case TMC5240_XENC:
+      return (int32_t)llround(tmc.pos + tmc.encOffset);
+    case TMC5240_RAMPSTAT:
+      if (tmc.v == 0.0) rampStat |= TMC5240_RS_VZERO;
+      if ((tmc.reg[TMC5240_RAMPMODE] & 0x3) == TMC5240_MODE_POSITION && tmc.v == 0.0 && xact == tmc.reg[TMC5240_XTARGET]) {
+        rampStat |= TMC5240_RS_POSREACHED;
+      }
+      if (fabs(tmc.v) == (double)tmc.reg[TMC5240_VMAX] * HOST_TMC_VEL_SCALE) rampStat |= TMC5240_RS_VELREACHED;
+      return rampStat;
+    case TMC5240_DRVSTATUS:
+      return (tmc.v == 0.0) ? (int32_t)0x80000000 : 0; // stst, no errors, SG_RESULT 0
+    case TMC5240_GSTAT:
+      return 0;
+    default:
+      return tmc.reg[address];
+  }
+}
+
+
+// ----------------------------
+// Write a register
+// ----------------------------
+
+static void WriteRegister(HostTMC &tmc, uint8_t address, int32_t value)
+{
+  switch (address) {
+    case TMC5240_XACTUAL:
+      tmc.pos = (double)value;
+      break;
+    case TMC5240_XENC:
+      tmc.encOffset = (double)value - tmc.pos;
+      break;
+    case TMC5240_GSTAT:
+    case TMC5240_RAMPSTAT: // write to clear
+      break;
+    default:
+      tmc.reg[address] = value;
+      break;
+  }
+}
+
+
+// *************************************************************************************
+// SPIClass
+// *************************************************************************************
+
+void HostSPISelect(int pin)
+{
+  g_selectedPin = pin;
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  return 0; // the driver transfers whole datagrams only
+}
+
+void SPIClass::transfer(void *buffer, size_t length)
+{
+  uint8_t *data = static_cast<uint8_t*>(buffer);
+
+  if (g_selectedPin < 0 || length != HOST_TMC_DATAGRAM_SIZE) {
+    memset(buffer, 0, length); // no driver selected, MISO stays low
+    return;
+  }
+  HostTMC &tmc = g_tmc[g_selectedPin];
+  uint8_t address = data[0] & TMC5240_ADDRESS_MASK;
+  int32_t value = (int32_t)(((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 8) | data[4]);
+  int32_t reply = tmc.reply;
+  int32_t rampStat;
+
+  UpdateRamp(tmc);
+  if (data[0] & TMC5240_WRITE_BIT) {
+    WriteRegister(tmc, address, value);
+  } else {
+    tmc.reply = ReadRegister(tmc, address); // answered with the next datagram
+  }
+
+  // SPI_STATUS: standstill, velocity reached and position reached from RAMP_STAT
+  rampStat = ReadRegister(tmc, TMC5240_RAMPSTAT);
+  data[0] = ((rampStat & TMC5240_RS_VZERO) ? 0x08 : 0) | ((rampStat & TMC5240_RS_VELREACHED) ? 0x10 : 0)
+            | ((rampStat & TMC5240_RS_POSREACHED) ? 0x20 : 0);
+  data[1] = (uint8_t)(reply >> 24);
+  data[2] = (uint8_t)(reply >> 16);
+  data[3] = (uint8_t)(reply >> 8);
+  data[4] = (uint8_t)reply;
+}
@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include "AdcSampler.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+#define SERIAL_DEBUG  1
+#include "Serial_Debug.h"
+
+
+// *************************************************************************************
+// defines
+// *************************************************************************************
+#define ADC_NATIVE_RESOLUTION   12 // bit depth of the RP2040/RP2350 ADC
+#define ADC_CLOCK_HZ            48000000 // ADC clock (USB PLL)
+#define ADC_DMA_TRANSFER_COUNT  0x0FFFFFFC // transfers per DMA run (multiple of ADC_NUM_INPUTS keeps the ring order)
+
+static_assert((1<<ADC_BUFFER_BASE) >= 2*ADC_NUM_INPUTS*(1<<ADC_AVERAGING_BASE),
+              "The ADC ring buffer must hold twice the averaging window of all inputs");
+static_assert(ADC_NATIVE_RESOLUTION + ADC_AVERAGING_BASE <= 32, "The ADC sum overflows");
+
+
+// *************************************************************************************
+// AdcSampler class
+// *************************************************************************************
+
+// ----------------------------
+// Ring buffer of the samples
+// ----------------------------
+
+uint16_t AdcSampler::buffer[1<<ADC_BUFFER_BASE] __attribute__((aligned(2<<ADC_BUFFER_BASE)));
+
+
+// ----------------------------
+// (Private) constructor enforces singleton
+// ----------------------------
+
+AdcSampler::AdcSampler() {}
+
+
+// ----------------------------
+// Return the singleton instance
+// ----------------------------
+
+AdcSampler& AdcSampler::getInstance() {
+  static AdcSampler instance;  // Only created once
+  return instance;
+}
+
+
+// ----------------------------
+// Set up the ADC and the DMA and start the sampling
+// ----------------------------
+
+void AdcSampler::init(void)
+{
+  dma_channel_config config;
+
+  if (dmaChannel >= 0) return; // already running
+  D_println("AdcSampler Init.");
+  adc_init();
+  for (int8_t input=0; input<ADC_NUM_INPUTS; input++) {
+    adc_gpio_init(A0 + input);
+  }
+  adc_select_input(0); // the first sample goes into slot 0 of the ring
+  adc_set_round_robin((1<<ADC_NUM_INPUTS) - 1);
+  adc_fifo_setup(true, true, 1, false, false); // FIFO on, DREQ at one sample, no error bit, 16 bit samples
+  adc_set_clkdiv((float)ADC_CLOCK_HZ/ADC_SAMPLE_RATE_HZ - 1);
+
+  dmaChannel = dma_claim_unused_channel(true);
+  config = dma_channel_get_default_config(dmaChannel);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+  channel_config_set_read_increment(&config, false);
+  channel_config_set_write_increment(&config, true);
+  channel_config_set_ring(&config, true, ADC_BUFFER_BASE+1); // wrap the write address (in bytes)
+  channel_config_set_dreq(&config, DREQ_ADC);
+  dma_channel_configure(dmaChannel, &config, buffer, &adc_hw->fifo, ADC_DMA_TRANSFER_COUNT, true);
+
+  dma_channel_set_irq0_enabled(dmaChannel, true);
+  irq_add_shared_handler(DMA_IRQ_0, AdcSampler::dmaISR, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_0, true);
+
+  adc_run(true);
+}
+
+
+// ----------------------------
+// Re-arm the DMA channel (the write address continues in the ring)
+// ----------------------------
+
+void AdcSampler::dmaISR()
+{
+  AdcSampler& instance = AdcSampler::getInstance();
+  if (instance.dmaChannel < 0 || !dma_channel_get_irq0_status(instance.dmaChannel)) return; // shared IRQ
+  dma_channel_acknowledge_irq0(instance.dmaChannel);
+  dma_channel_set_trans_count(instance.dmaChannel, ADC_DMA_TRANSFER_COUNT, true);
+}
+
+
+// ----------------------------
+// Convert a pin number to the ADC input
+// ----------------------------
+
+int8_t AdcSampler::getInput(int pin)
+{
+  if (pin < A0 || pin >= A0 + ADC_NUM_INPUTS) return -1;
+  return (int8_t)(pin - A0);
+}
+
+
+// ----------------------------
+// Average the latest samples of an input
+// ----------------------------
+
+uint16_t AdcSampler::getValue(int8_t input)
+{
+  const uint16_t mask = (1<<ADC_BUFFER_BASE) - 1;
+  uint32_t sum = 0;
+  uint16_t idx;
+
+  if (input < 0 || input >= ADC_NUM_INPUTS || dmaChannel < 0) return 0;
+  // slot the DMA writes next, step back to the latest completed sample of the input
+  idx = (uint16_t)((dma_channel_hw_addr(dmaChannel)->write_addr - (uintptr_t)buffer) / sizeof(buffer[0]));
+  idx = (idx - ADC_NUM_INPUTS + ((input - idx) & (ADC_NUM_INPUTS-1))) & mask;
+  for (uint16_t z=0; z<(1<<ADC_AVERAGING_BASE); z++) {
+    sum += buffer[idx];
+    idx = (idx - ADC_NUM_INPUTS) & mask;
+  }
+  return (uint16_t)(sum >> (ADC_AVERAGING_BASE + ADC_NATIVE_RESOLUTION - COMMON_ADC_RESOLUTION));
+}
@@ -0,0 +1,82 @@
+#ifndef ADCSAMPLER_H
+#define ADCSAMPLER_H
+
+#include <Arduino.h>
+#include "Common.h"
+
+
+/**
+ * @class AdcSampler
+ * @brief Singleton class for the free-running, DMA-driven sampling of the analog inputs.
+ *
+ * The ADC converts the inputs ADC0..ADC3 round robin at ADC_SAMPLE_RATE_HZ (in total) without
+ * any CPU involvement: a DMA channel drains the ADC FIFO into a ring buffer of 2^ADC_BUFFER_BASE
+ * samples. As the number of inputs and the ring length are powers of two, the slot of a sample in
+ * the ring tells its input. A reader averages the last 2^ADC_AVERAGING_BASE samples of its input
+ * from the ring (block decimation), so the value is never older than the averaging window and no
+ * timer or analogRead is needed. The DMA transfer count is re-armed from the completion IRQ
+ * (about every 1.8 hours).
+ *
+ * Private Members:
+ * - dmaChannel: DMA channel that moves the samples, -1 before init.
+ * - buffer: Ring buffer of the samples (aligned to its size for the DMA address wrapping).
+ *
+ * Private Methods:
+ * - AdcSampler(): Private constructor to enforce singleton pattern.
+ * - dmaISR(): Static interrupt service routine re-arming the DMA transfer count.
+ *
+ * Public Methods:
+ * - getInstance(): Returns the singleton instance.
+ * - init(): Sets up the ADC and the DMA and starts the sampling.
+ * - getInput(): Converts a pin number to the ADC input.
+ * - getValue(): Returns the averaged value of an input.
+ */
+class AdcSampler
+{
+private:
+  int dmaChannel = -1; // DMA channel draining the ADC FIFO
+  static uint16_t buffer[1<<ADC_BUFFER_BASE]; // ring buffer of the samples
+
+  /**
+   * @brief Private constructor to enforce the singleton pattern.
+   */
+  AdcSampler();
+
+  /**
+   * @brief Static interrupt service routine re-arming the DMA channel when the transfer count ran out.
+   */
+  static void dmaISR();
+
+public:
+  /**
+   * @brief Retrieves the singleton instance of the AdcSampler class.
+   *
+   * @return Reference to the singleton AdcSampler instance.
+   */
+  static AdcSampler& getInstance();
+
+  /**
+   * @brief Sets up the ADC (round robin, free running) and the DMA channel and starts the sampling.
+   *
+   * Calling the method again has no effect.
+   */
+  void init(void);
+
+  /**
+   * @brief Converts a pin number to the ADC input.
+   *
+   * @param pin The pin number (A0..A3).
+   * @return The ADC input (0 to ADC_NUM_INPUTS-1), -1 if the pin has no ADC.
+   */
+  static int8_t getInput(int pin);
+
+  /**
+   * @brief Retrieves the average of the latest 2^ADC_AVERAGING_BASE samples of an input.
+   *
+   * @param input The ADC input (0 to ADC_NUM_INPUTS-1).
+   * @return The averaged value scaled to COMMON_ADC_RESOLUTION bits, 0 for an invalid input.
+   */
+  uint16_t getValue(int8_t input);
+};
+
+#endif // ADCSAMPLER_H
@@ -1,12 +1,33 @@
 
 #define MAX_NUM_MOTORS                      4 // maximum number of motors (at most 4)
 #define COMMON_ADC_RESOLUTION               10 // bit depth of the ADC (Joystick and SensAdjust)
-#define ADC_AVERAGING_BASE                  6 // average 2^6=64 samples, ADC_RES + BASE must be <= 16
-#define ADC_UPDATE_INTERVAL_MS              4 // ADC sampling interval in ms for averaging
+#define ADC_NUM_INPUTS                      4 // ADC0..ADC3 are converted round robin (power of two)
+#define ADC_SAMPLE_RATE_HZ                  40000 // total conversion rate of the free-running ADC (10 kHz per input)
+#define ADC_AVERAGING_BASE                  5 // average the latest 2^5=32 samples of an input (3.2 ms at 10 kHz)
+#define ADC_BUFFER_BASE                     9 // DMA ring of 2^9 samples, must hold twice the averaging window of all inputs
+#define ADC_CALIBRATION_DELAY_MS            20 // settling time before the joystick center is calibrated
+
+#define JOYSTICK_FILTER_INTERVAL_MS         4 // update interval of the joystick filters in ms
+#define JOYSTICK_FILTER_TYPE                FILTER_ADAPTIVE // default filter of the axes (see FilterType in Filters.h)
+#define JOYSTICK_BOXCAR_BASE                4 // boxcar window of 2^4=16 updates (64 ms)
+#define JOYSTICK_EXPONENTIAL_BASE           3 // exponential filter alpha=2^-3 (time constant 32 ms)
+#define JOYSTICK_ADAPTIVE_MIN_BASE          4 // adaptive filter alpha at rest 2^-4 (time constant 64 ms)
+#define JOYSTICK_ADAPTIVE_SPEED_BASE        2 // speed estimate of the adaptive filter smoothed with alpha=2^-2
+#define JOYSTICK_ADAPTIVE_BETA              4096 // alpha increase per ADC count/update of speed (2^-16), no lag above 16 counts/update
+#define JOYSTICK_TABLE_LENGTH               ((1<<(COMMON_ADC_RESOLUTION-1))+1) // entries of the velocity table (deflection 0 to full scale)
+#define JOYSTICK_CURVE_GAIN                 0.0f // shape of the deflection-to-velocity curve, 0 -> linear, >0 -> exponential (finer control near the center)
+#define JOYSTICK_SEND_THRESHOLD_BASE        6 // velocity changes of at least JMAX/2^6 are sent right away
+#define JOYSTICK_SEND_SETTLE_MS             50 // smaller changes are sent once they persist for this time in ms
 
 #define INPUT_MODE_CHECK_INTERVAL_MS        10 // check interval for joystick/encoder switchover in ms
 #define INPUT_MODE_DEBOUNCE_TIMEOUT_MS      300 // dbounce timeout for switching input mode in ms
 
+#define ENCODER_SAMPLE_INTERVAL_MS          2 // the encoder counts are sampled and timestamped at this interval in ms
+#define ENCODER_SPEED_SMOOTHING_BASE        2 // knob speed estimate smoothed with alpha=2^-2
+#define ENCODER_SPEED_TIMEOUT_MS            200 // knob at rest after no count change for this time in ms
+#define ENCODER_ACCEL_MIN_SPEED             20 // knob speed in counts/s up to which ESTP is used as is (fine steps)
+#define ENCODER_ACCEL_MAX_SPEED             400 // knob speed in counts/s at which the step size reaches the max factor
+#define ENCODER_ACCEL_MAX_FACTOR            32 // step size multiplier for a fast spun knob (1 -> no acceleration)
 #define ENCODER_CH0_PIN_ENCA                D14   // pin number (GPxx) for signal A (-1 for unused); B is the next pin
 #define ENCODER_CH1_PIN_ENCA                D10
 #define ENCODER_CH2_PIN_ENCA                D8
@@ -32,11 +53,14 @@
 #define DISPLAY_I2C_ADDRESS                 0x3C
 #define DISPLAY_SCREEN_WIDTH                128
 #define DISPLAY_SCREEN_HEIGHT               64
+#define DISPLAY_I2C_CLOCK_HZ                1000000 // I2C clock (Fast-mode Plus), set to 400000 for displays that don't keep up
+#define DISPLAY_UPDATE_INTERVAL_MS          40 // min time in ms between two display refreshes (caps the frame rate at 25 Hz)
+#define DISPLAY_I2C_CHUNK_SIZE              31 // display data bytes per I2C transfer (plus one control byte, fits the Wire buffer)
 
 #define UART_BAUDRATE                       921600
 #define UART_PIN_TX                         PIN_SERIAL1_TX
 #define UART_PIN_RX                         PIN_SERIAL1_RX
 
 #define UART_BUFFER_SIZE                    1024
-#define UART_SEND_INTERVAL_MS               20 // interval in ms for sending updates to the controller
-#define UART_RECEIVE_INTERVAL_MS            10 // interval in ms for receiving updates from the controller
+#define UART_SEND_MIN_INTERVAL_MS           5 // min time in ms between two updates to the controller (rate cap)
+#define UART_MAX_FRAME_LENGTH               256 // max length of a "<...|chk>" frame from the controller, longer ones are dropped
@@ -2,7 +2,7 @@
 #include "Common.h"
 
 #include "ControllerComm.h"
-#include "Display.h"
+#include "RemoteState.h"
 #include "Encoders.h"
 #include "Joystick.h"
 
@@ -47,6 +47,7 @@ void ControllerComm::init(long timeout_ms)
   Serial1.begin(UART_BAUDRATE);
   D_println("\nControllerComm started.");
   Serial1.setTimeout(timeout_ms);
+  sendCommand("RDY"); // tell the controller to send the parameters (in case it booted first)
 }
 
 
@@ -56,46 +57,64 @@ void ControllerComm::init(long timeout_ms)
 
 void ControllerComm::receiveUpdatesFromController(void)
 {
-  Joystick& joystick = Joystick::getInstance();
-  Encoders& encoders = Encoders::getInstance();
-  static unsigned long lastUARTReceiveTime = 0;
-  char uartData[MSG_MAXLENGTH+1]; // one extra for the null char
-  size_t len = 0;
-  uint8_t checksum = 0;
-  int32_t intVal;
-  int8_t valChanged = 0;
+  int c;
+  int bytesLeft = Serial1.available(); // only what is there already, new bytes wait for the next call
+
+  while (bytesLeft-- > 0) {
+    c = Serial1.read();
+    if (c < 0) break;
+    rxBytes++;
+
+    if (c == '<') { // start of a frame (also resyncs after a lost '>')
+      frameBuffer[0] = '<';
+      frameLength = 1;
+      frameOverflow = 0;
+      continue;
+    }
+    if (frameLength == 0) continue; // outside of a frame
+
+    if (c == '>') {
+      frameBuffer[frameLength] = '\0';
+      rxFrames++;
+      if (!frameOverflow) processFrame();
+      else parseErrors++;
+      frameLength = 0;
+      continue;
+    }
 
-  unsigned long currentTime = millis();
+    if (frameLength < UART_MAX_FRAME_LENGTH) {
+      frameBuffer[frameLength++] = (char)c;
+    } else {
+      frameOverflow = 1;
+    }
+  }
+}
 
-  if (currentTime - lastUARTReceiveTime > UART_RECEIVE_INTERVAL_MS) {
 
-    if (Serial1.available() > 0){
-      // max allowed command size is MSG_MAXLENGTH char, ends with a term char
-      int bytesRead = Serial1.readBytesUntil('>', uartData, MSG_MAXLENGTH);
-      // terminate with an end character
-      uartData[bytesRead]='\0';
+// ----------------------------
+// Checks and executes a complete frame
+// ----------------------------
 
-      if (validateChecksum(uartData)) {
-        D_print("recd: ");
-        D_println(uartData+1); // skip the first char, which is '<'
-        return;
-      }
+void ControllerComm::processFrame(void)
+{
+  if (validateChecksum(frameBuffer)) {
+    D_print("recd: ");
+    D_println(frameBuffer+1); // skip the first char, which is '<'
+    checksumErrors++;
+    return;
+  }
 
-      if (strchr(uartData+1, ';') == NULL) { // single command
-        processCommand(uartData+1);
-        return;
-      } else { // multiple commands
-        char* savePtr;
-        char* token = strtok_r(uartData+1, ";", &savePtr);
-        while (token != NULL) {
-          processCommand(token);
-          // Get the next token
-          token = strtok_r(NULL, ";", &savePtr);
-        }
-      }
-    } // if (Serial1.available() > 0) 
-    lastUARTReceiveTime = currentTime;
-  } // if (currentTime - lastUARTReceiveTime > UART_CONTROLLER_RECEIVE_INTERVAL_MS)
+  if (strchr(frameBuffer+1, ';') == NULL) { // single command
+    if (processCommand(frameBuffer+1)) parseErrors++;
+  } else { // multiple commands
+    char* savePtr;
+    char* token = strtok_r(frameBuffer+1, ";", &savePtr);
+    while (token != NULL) {
+      if (processCommand(token)) parseErrors++;
+      // Get the next token
+      token = strtok_r(NULL, ";", &savePtr);
+    }
+  }
 }
 
 
@@ -110,12 +129,40 @@ int8_t ControllerComm::processCommand(const char *cmd)
   int8_t channel;
   int32_t intVal;
 
+  // check for handshake ping (the controller looks for the remote)
+  if (strncmp(cmd, "PING", 4)  == 0){
+    sendCommand("RDY");
+    return 0;
+  }
+
+  // check for timestamped ping (link statistics)
+  if (strncmp(cmd, "LPNG", 4)  == 0){
+    sendLinkPong(cmd);
+    return 0;
+  }
+
+  // check for reset of the link statistics
+  if (strncmp(cmd, "LRST", 4)  == 0){
+    rxFrames = rxBytes = checksumErrors = parseErrors = txFrames = 0;
+    accessLatency = 0;
+    return 0;
+  }
+
   // check for position update
   if (strncmp(cmd, "POS", 3)  == 0){
     if (sscanf(cmd, "POS%hhi=%i", &channel, &intVal) != 2) {
       D_println("Invalid position command."); return -1;
     }
-    Display::getInstance().setPosition(channel, intVal);
+    RemoteState::getInstance().setPosition(channel, intVal);
+    return 0;
+  }
+
+  // check for position change (delta to the last position, see the controller's RemoteComm::SendPositionUpdates)
+  if (strncmp(cmd, "DP", 2)  == 0){
+    if (sscanf(cmd, "DP%hhi=%i", &channel, &intVal) != 2) {
+      D_println("Invalid position delta command."); return -1;
+    }
+    RemoteState::getInstance().setPosition(channel, RemoteState::getInstance().getPosition(channel) + intVal);
     return 0;
   }
 
@@ -124,8 +171,14 @@ int8_t ControllerComm::processCommand(const char *cmd)
     if (sscanf(cmd, "ENAB%hhi=%i", &channel, &intVal) != 2) {
       D_println("Invalid enable command."); return -1;
     }
+    if (channel < 0 || channel >= MAX_NUM_MOTORS) return -1;
     isRemoteControlled[channel] = (intVal==0 ? 0 : 1);
+    publishMode(channel);
     if (intVal) encoders.resetEncoderReference(channel);
+    if (intVal && accessRequestTime[channel]) { // answer to our access request
+      accessLatency = millis() - accessRequestTime[channel];
+      accessRequestTime[channel] = 0;
+    }
     return 0;
   }
 
@@ -169,12 +222,48 @@ int8_t ControllerComm::processCommand(const char *cmd)
     return 0;
   }
 
-  return 0;
+  D_println("Unknown command.");
+  return -1;
+}
+
+
+// ----------------------------
+// Updates the input mode of a channel in the shared state (for the display)
+// ----------------------------
+
+void ControllerComm::publishMode(int8_t idx)
+{
+  InputMode mode = INPUT_MODE_NONE;
+
+  if (isRemoteControlled[idx]) {
+    mode = (isJoystickControlled[idx] && Joystick::getInstance().isChannelPresent(idx)) ? INPUT_MODE_JOYSTICK : INPUT_MODE_ENCODER;
+  }
+  RemoteState::getInstance().setMode(idx, mode);
+}
+
+
+// ----------------------------
+// Answers a timestamped ping with the timestamp and the link statistics
+// ----------------------------
+
+void ControllerComm::sendLinkPong(const char *cmd)
+{
+  char uartData[MSG_MAXLENGTH+1]; // one extra for the null char
+  unsigned int sendTime;
+
+  if (sscanf(cmd, "LPNG=%u", &sendTime) != 1) {
+    parseErrors++;
+    return;
+  }
+  snprintf(uartData, sizeof(uartData), "LPON=%u,%u,%u,%u,%u,%u,%u", sendTime, (unsigned int)rxFrames,
+           (unsigned int)rxBytes, (unsigned int)checksumErrors, (unsigned int)parseErrors,
+           (unsigned int)(txFrames+1), (unsigned int)accessLatency); // txFrames incl. this answer
+  sendCommand(uartData);
 }
 
 
 // ----------------------------
-// Periodically sends updates to the controller
+// Sends the pending input changes to the controller (rate capped)
 // ----------------------------
 
 void ControllerComm::sendUpdatesToController(void)
@@ -189,7 +278,8 @@ void ControllerComm::sendUpdatesToController(void)
 
   unsigned long currentTime = millis();
 
-  if (currentTime - lastUARTSendTime > UART_SEND_INTERVAL_MS) {
+  // changes are sent as soon as they show up, the interval only caps the rate (pending changes wait in the inputs)
+  if (currentTime - lastUARTSendTime >= UART_SEND_MIN_INTERVAL_MS) {
     
     uartData[0]='\0';
     for (int8_t idx=0; idx<MAX_NUM_MOTORS; idx++) {
@@ -223,6 +313,7 @@ void ControllerComm::sendCommand(const char *cmd)
   D_print("send: ");
   D_println(cmd);
   Serial1.printf("<%s|%hhu>", cmd, checksum);
+  txFrames++;
 }
 
 
@@ -256,6 +347,7 @@ void ControllerComm::inputModeCheck(void)
         if (!isRemoteControlled[idx]) { // request remote control
           snprintf(uartData, sizeof(uartData), "ACCREQ%hhi", idx);
           sendCommand(uartData);
+          accessRequestTime[idx] = (currentTime ? currentTime : 1); // 0 means none pending
         }
 
         if (isJoystickControlled[idx]) {
@@ -263,6 +355,7 @@ void ControllerComm::inputModeCheck(void)
           if (encoders.getButtonPressed(idx)) {
             D_print("Switching to encoder input mode on channel "); D_println(idx);
             isJoystickControlled[idx] = 0;
+            publishMode(idx);
             // reset the encoder reference position
             encoders.resetEncoderReference(idx);
           }
@@ -272,6 +365,7 @@ void ControllerComm::inputModeCheck(void)
           if (joystick.getButtonPressed(idx)) {
             D_print("Switching to joystick input mode on channel "); D_println(idx);    
             isJoystickControlled[idx] = 1;
+            publishMode(idx);
           }
         }
 
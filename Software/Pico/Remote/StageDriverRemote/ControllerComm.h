@@ -17,13 +17,39 @@ class ControllerComm
  * and includes mechanisms for command processing, checksum validation, and encoder reference reset.
  *
  * Private members include configuration for the number of motors, control mode tracking,
- * and button press state. Public methods allow for initialization, communication,
+ * button press state and the link statistics (reported to the controller in the answer to its
+ * timestamped pings, see GPC_LINK). Public methods allow for initialization, communication,
  * input mode checks, and interrupt handling.
  */
 {
 private:
   int8_t isRemoteControlled[MAX_NUM_MOTORS] = {0}; // flag whether axis is remotely controlled
   int8_t isJoystickControlled[MAX_NUM_MOTORS] = {0}; // flag whether axis is controlled by joystick
+  char frameBuffer[UART_MAX_FRAME_LENGTH+1]; // frame from the controller being assembled, starting with '<' (one extra for the null char)
+  uint16_t frameLength = 0; // number of chars in frameBuffer, 0 -> waiting for the next '<'
+  int8_t frameOverflow = 0; // flag whether the current frame is too long and gets dropped
+  uint32_t rxFrames = 0; // link statistics: frames received from the controller
+  uint32_t rxBytes = 0; // bytes received from the controller
+  uint32_t checksumErrors = 0; // frames dropped due to a wrong checksum
+  uint32_t parseErrors = 0; // overlong frames and commands that couldn't be parsed
+  uint32_t txFrames = 0; // frames sent to the controller
+  unsigned long accessRequestTime[MAX_NUM_MOTORS] = {0}; // millis() of a pending ACCREQ, 0 -> none
+  uint32_t accessLatency = 0; // ms from the last ACCREQ to its ENAB
+
+  /**
+   * @brief Updates the input mode of a channel in the shared state (see RemoteState).
+   */
+  void publishMode(int8_t idx);
+
+  /**
+   * @brief Answers a timestamped ping of the controller with the timestamp and the link statistics.
+   */
+  void sendLinkPong(const char *cmd);
+
+  /**
+   * @brief Checks and executes a complete frame in frameBuffer.
+   */
+  void processFrame(void);
 
   /**
    * @brief Private constructor to enforce the singleton pattern.
@@ -108,14 +134,17 @@ public:
   /**
    * @brief Sends a list of command strings to the controller.
    *
-   * This method is periodically called to communicate with the controller.
+   * This method is called from every loop pass. It sends the joystick and encoder changes
+   * as soon as they are reported, at most every UART_SEND_MIN_INTERVAL_MS.
    */
   void sendUpdatesToController(void);
 
   /**
    * @brief Receives updates from the controller.
    *
-   * This method checks for incoming commands from the controller and processes them.
+   * This method takes the bytes that arrived in the UART receive buffer (filled by the UART
+   * interrupt of the core) and assembles them into frames, so it never waits for the rest of
+   * a frame. Complete frames are checked and processed right away.
    */
   void receiveUpdatesFromController(void);
 
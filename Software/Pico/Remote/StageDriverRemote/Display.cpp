@@ -38,42 +38,51 @@ Display& Display::getInstance() {
 void Display::init(void)
 {
   D_println("Display Init.");
-  disp = new Adafruit_SSD1306(DISPLAY_SCREEN_WIDTH, DISPLAY_SCREEN_HEIGHT, &Wire, OLED_RESET);
+  disp = new Adafruit_SSD1306(DISPLAY_SCREEN_WIDTH, DISPLAY_SCREEN_HEIGHT, &Wire, OLED_RESET, DISPLAY_I2C_CLOCK_HZ, DISPLAY_I2C_CLOCK_HZ);
   // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
   if(!disp->begin(SSD1306_SWITCHCAPVCC, DISPLAY_I2C_ADDRESS)) { // calls Wire.begin with default Wire parameters
     D_println("SSD1306 allocation failed");
     for(;;); // Don't proceed, loop forever
   }
   disp->clearDisplay();
+  disp->display();
   disp->setTextSize(1);
   disp->setTextColor(SSD1306_WHITE, SSD1306_BLACK);
 }
 
 
 // ----------------------------
-// Set the position for a specific motor channel
+// Draw the channels that changed
 // ----------------------------
 
-void Display::setPosition(uint8_t channel, int32_t position)
+void Display::render(const RemoteSnapshot &snapshot)
 {
-  if (channel >= MAX_NUM_MOTORS) return; // unsuppored chanel
-  lastPosition[channel] = position; // store the last position for this channel
-  disp->setCursor(0, 8*channel);
-  for (int i = 0; i < (disp->width() / 6); ++i) disp->print(' ');
-  disp->setCursor(0, 8*channel);
-  disp->printf("Ch%hhu: %i", channel, position);
-  disp->display();
+  for (uint8_t channel=0; channel<MAX_NUM_MOTORS; channel++) {
+    if (!snapshot.isPositionValid[channel]) continue; // nothing from the controller yet
+    if (isPositionShown[channel] && lastPosition[channel] == snapshot.position[channel]
+        && lastMode[channel] == snapshot.mode[channel]) continue; // nothing to redraw
+    lastPosition[channel] = snapshot.position[channel];
+    lastMode[channel] = snapshot.mode[channel];
+    isPositionShown[channel] = 1;
+    drawLine(channel);
+  }
 }
 
 
 // ----------------------------
-// Get the last known position for a specific motor channel
+// Redraw the line of a channel
 // ----------------------------
 
-int32_t Display::getPosition(uint8_t channel)
+void Display::drawLine(uint8_t channel)
 {
-  if (channel >= MAX_NUM_MOTORS) return 0; // unsuppored chanel
-  return (lastPosition[channel]);
+  static const char modeChar[] = {' ', 'E', 'J'}; // see InputMode
+
+  disp->fillRect(0, 8*channel, disp->width(), 8, SSD1306_BLACK);
+  disp->setCursor(0, 8*channel);
+  disp->printf("Ch%hhu: %i", channel, lastPosition[channel]);
+  disp->setCursor(disp->width() - 6, 8*channel); // mode at the right end of the line
+  disp->write(modeChar[lastMode[channel] % sizeof(modeChar)]);
+  dirtyPages |= (1 << channel); // one text line is one page
 }
 
 
@@ -84,5 +93,55 @@ int32_t Display::getPosition(uint8_t channel)
 void Display::clear(void)
 {
   disp->clearDisplay();
+  dirtyPages = 0xFF;
+}
+
+
+// ----------------------------
+// Send the changed pages to the display
+// ----------------------------
+
+void Display::update(void)
+{
+  unsigned long currentTime = millis();
+
+  if (!flushPages) { // start the next refresh
+    if (!dirtyPages || currentTime - lastUpdateTime < DISPLAY_UPDATE_INTERVAL_MS) return;
+    flushPages = dirtyPages;
+    dirtyPages = 0;
+    lastUpdateTime = currentTime;
+  }
+  for (uint8_t page=0; page<DISPLAY_SCREEN_HEIGHT/8; page++) {
+    if (!(flushPages & (1 << page))) continue;
+    flushPage(page);
+    flushPages &= ~(1 << page);
+    return; // one page per call
+  }
+}
+
+
+// ----------------------------
+// Send one page of the framebuffer
+// ----------------------------
+
+void Display::flushPage(uint8_t page)
+{
+  const uint8_t *data = disp->getBuffer() + (uint16_t)page * DISPLAY_SCREEN_WIDTH;
+
+  // restrict the display RAM window to the page, the data then fills it column by column
+  disp->ssd1306_command(SSD1306_PAGEADDR);
+  disp->ssd1306_command(page);
+  disp->ssd1306_command(page);
+  disp->ssd1306_command(SSD1306_COLUMNADDR);
+  disp->ssd1306_command(0);
+  disp->ssd1306_command(DISPLAY_SCREEN_WIDTH - 1);
+  for (uint16_t pos=0; pos<DISPLAY_SCREEN_WIDTH; pos+=DISPLAY_I2C_CHUNK_SIZE) {
+    uint16_t len = DISPLAY_SCREEN_WIDTH - pos;
+    if (len > DISPLAY_I2C_CHUNK_SIZE) len = DISPLAY_I2C_CHUNK_SIZE;
+    Wire.beginTransmission(DISPLAY_I2C_ADDRESS);
+    Wire.write((uint8_t)0x40); // Co = 0, D/C = 1: display data follows
+    Wire.write(data + pos, len);
+    Wire.endTransmission();
+  }
 }
 
@@ -5,6 +5,7 @@
 #include <Arduino.h>
 #include "Common.h"
 #include <Adafruit_SSD1306.h>
+#include "RemoteState.h"
 
 class Display
 /**
@@ -12,30 +13,53 @@ class Display
  * @brief Singleton class for managing an Adafruit_SSD1306 display and tracking motor positions.
  *
  * This class provides an interface to initialize and interact with an SSD1306 display,
- * as well as to store and retrieve the last known positions for multiple motors.
+ * showing the position and the input mode of each motor channel. It runs on core 1 and
+ * renders the snapshots published by core 0 (see RemoteState).
  *
  * Private Members:
- * - lastPosition: Array storing the last position for each motor channel.
+ * - lastPosition, lastMode: Position and input mode drawn for each motor channel.
  * - disp: Pointer to the Adafruit_SSD1306 display object.
+ * - dirtyPages: Pages (8 pixel rows) of the framebuffer that changed since they were sent.
  * - Display(): Private constructor to enforce singleton pattern.
+ * - flushPage(page): Sends one page of the framebuffer to the display.
+ * - drawLine(channel): Redraws the line of a channel in the framebuffer.
  *
  * Public Methods:
  * - getInstance(): Returns the singleton instance of the Display class.
  * - init(): Initializes the display.
- * - setPosition(channel, position): Sets the position for a specific motor channel.
- * - getPosition(channel): Retrieves the last known position for a specific motor channel.
+ * - render(snapshot): Draws the channels that changed in a snapshot.
+ * - update(): Sends the changed pages to the display (called from the loop of core 1).
  * - clear(): Clears the display.
  */
 {
 private:
   int32_t lastPosition[MAX_NUM_MOTORS] = {0}; // last position displayed for each channel
+  int8_t lastMode[MAX_NUM_MOTORS] = {0}; // last input mode displayed for each channel
+  int8_t isPositionShown[MAX_NUM_MOTORS] = {0}; // flag whether lastPosition is on the screen (no redraw needed)
   Adafruit_SSD1306 *disp; // Pointer to the display object
+  uint8_t dirtyPages = 0; // bit mask of the pages changed since they were sent to the display
+  uint8_t flushPages = 0; // bit mask of the pages of the refresh in progress
+  unsigned long lastUpdateTime = 0; // time the last refresh started
 
   /**
    * @brief Private constructor to enforce the singleton pattern.
    */
   Display();
 
+  /**
+   * @brief Sends one page of the framebuffer to the display.
+   *
+   * @param page The page (0 to DISPLAY_SCREEN_HEIGHT/8-1), i.e. 8 pixel rows.
+   */
+  void flushPage(uint8_t page);
+
+  /**
+   * @brief Redraws the line of a channel (position and input mode) in the framebuffer.
+   *
+   * @param channel The motor channel (0 to MAX_NUM_MOTORS-1).
+   */
+  void drawLine(uint8_t channel);
+
 
 public:
   /**
@@ -58,20 +82,22 @@ public:
   void init(void);
 
   /**
-   * @brief Sets the position for a specific motor channel.
+   * @brief Draws the channels whose position or input mode changed.
    *
-   * @param channel The motor channel (0 to MAX_NUM_MOTORS-1).
-   * @param position The position value to set.
+   * A line is only redrawn if it changed, and only in the framebuffer. update() sends it to the display.
+   * Channels without a position from the controller aren't shown.
+   *
+   * @param snapshot The state published by core 0.
    */
-  void setPosition(uint8_t channel, int32_t position);
+  void render(const RemoteSnapshot &snapshot);
   
   /**
-   * @brief Retrieves the last known position for a specific motor channel.
+   * @brief Sends the changed parts of the framebuffer to the display.
    *
-   * @param channel The motor channel (0 to MAX_NUM_MOTORS-1).
-   * @return The last known position for the specified channel.
+   * A refresh starts at most every DISPLAY_UPDATE_INTERVAL_MS and only covers the pages that changed.
+   * Each call sends one page, so the main loop isn't held up by a full framebuffer transfer.
    */
-  int32_t getPosition(uint8_t channel);
+  void update(void);
 
   /**
    * @brief Clears the display.
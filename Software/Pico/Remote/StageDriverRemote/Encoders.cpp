@@ -4,7 +4,8 @@
 #include "Encoders.h"
 #include "quadrature_encoder.pio.h"
 #include "SensAdjust.h"
-#include "Display.h"
+#include "RemoteState.h"
+#include "pico/stdlib.h"
 
 #define SERIAL_DEBUG  1
 #include "Serial_Debug.h"
@@ -55,6 +56,8 @@ void Encoders::init(void)
     attachInterrupt(digitalPinToInterrupt(buttonPins[3]), Encoders::buttonISR3, FALLING);  
   }
 
+  // set up the timer for sampling the counts
+  add_repeating_timer_ms(ENCODER_SAMPLE_INTERVAL_MS, Encoders::repeating_timer_callback, NULL, &Encoders::timer);
 }
 
 
@@ -78,6 +81,66 @@ void Encoders::buttonISR2(void) { Encoders::getInstance().buttonPressed[2] = 1;
 void Encoders::buttonISR3(void) { Encoders::getInstance().buttonPressed[3] = 1; }
 
 
+// ---------------------------------
+// Struct for the timer calls
+// ---------------------------------
+
+struct repeating_timer Encoders::timer;
+
+
+// ---------------------------------
+// Timer callback sampling the counts and estimating the knob speed
+// ---------------------------------
+
+bool Encoders::repeating_timer_callback(struct repeating_timer *t) {
+  Encoders& instance = Encoders::getInstance();
+  uint32_t currentTime = time_us_32();
+
+  for (int idx=0; idx<MAX_NUM_MOTORS; idx++) {
+    if (instance.pins[idx]<0) continue; // not enabled
+    int32_t count = quadrature_encoder_get_count(instance.pio, instance.sm[idx]);
+    int32_t change = count - instance.sampledCount[idx];
+    uint32_t dt = currentTime - instance.lastChangeTime[idx];
+    if (change) {
+      // counts per second since the last change (a move that starts from rest only counts the change itself)
+      uint32_t newSpeed = (dt < ENCODER_SPEED_TIMEOUT_MS*1000) ? (uint32_t)abs(change)*1000000/(dt ? dt : 1) : 0;
+      instance.speed[idx] += ((int32_t)newSpeed - (int32_t)instance.speed[idx]) >> ENCODER_SPEED_SMOOTHING_BASE;
+      instance.sampledCount[idx] = count;
+      instance.lastChangeTime[idx] = currentTime;
+    } else if (dt >= ENCODER_SPEED_TIMEOUT_MS*1000) {
+      instance.speed[idx] = 0; // at rest
+    }
+  }
+  return true;
+}
+
+
+// ---------------------------------
+// Returns the step size multiplier for the current knob speed
+// ---------------------------------
+
+int32_t Encoders::getAccelFactor(uint8_t channel)
+{
+  uint32_t currentSpeed = speed[channel];
+
+  if (currentSpeed <= ENCODER_ACCEL_MIN_SPEED) return 256;
+  if (currentSpeed >= ENCODER_ACCEL_MAX_SPEED) return ENCODER_ACCEL_MAX_FACTOR*256;
+  return 256 + (int32_t)((currentSpeed - ENCODER_ACCEL_MIN_SPEED)*(ENCODER_ACCEL_MAX_FACTOR-1)*256
+                         /(ENCODER_ACCEL_MAX_SPEED - ENCODER_ACCEL_MIN_SPEED));
+}
+
+
+// ---------------------------------
+// Gets the estimated knob speed
+// ---------------------------------
+
+uint32_t Encoders::getSpeed(uint8_t channel)
+{
+  if (channel >= MAX_NUM_MOTORS) return 0; // unsupported channel
+  return speed[channel];
+}
+
+
 // ----------------------------
 // Returns a flag indicating the presence of te channel
 // ----------------------------
@@ -128,13 +191,14 @@ int8_t Encoders::getChangedPosition(uint8_t channel, int32_t &pos)
   // Note: the encoder position is read from the PIO state machine. However, the sensitivity scaling
   // below should only affect the current step size, not the absolute difference from the reference position.
   // Hence, I need to keep track of the last encoder position. 
+  // The count is sampled by the timer ISR (reading the FIFO here as well would race with it).
 
-  encPosition = quadrature_encoder_get_count(pio, sm[channel]);
+  encPosition = sampledCount[channel];
 
   SensAdjust::getInstance().getUpdatedValue(sensVal);
   encChange = encPosition - lastEncPos[channel]; // calculate the change in position
-  posChange = direction[channel] * stepSize[channel] * encChange
-        * sensVal / (1<<COMMON_ADC_RESOLUTION); // scale by the sensitivity    
+  posChange = (int32_t)((int64_t)direction[channel] * stepSize[channel] * encChange
+        * sensVal * getAccelFactor(channel) / (1<<(COMMON_ADC_RESOLUTION + 8))); // scale by the sensitivity and the knob speed
   pos = lastPos[channel] + posChange + refPosition[channel]; // add the reference position and the last position
   if (posChange) {
     lastEncPos[channel]+=encChange;
@@ -156,7 +220,7 @@ void Encoders::resetEncoderReference(uint8_t channel)
   refPosition[channel] = 0;
   int32_t encPos;
   getChangedPosition(channel, encPos);
-  int32_t displayedPos = Display::getInstance().getPosition(channel);
+  int32_t displayedPos = RemoteState::getInstance().getPosition(channel); // as reported by the controller
   refPosition[channel] = displayedPos - encPos;
 }
 
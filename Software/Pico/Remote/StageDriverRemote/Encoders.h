@@ -11,6 +11,9 @@
  *
  * This class provides an interface for initializing and interacting with up to MAX_NUM_MOTORS rotary encoders,
  * including reading their positions, handling button presses via interrupts, and configuring step size and direction.
+ * A timer ISR samples the counts of the PIO state machines every ENCODER_SAMPLE_INTERVAL_MS and timestamps
+ * the changes to estimate the knob speed. The step size grows with the speed (fine steps when turned slowly,
+ * coarse steps when spun fast), see ENCODER_ACCEL_* in Common.h.
  *
  * Private Members:
  * - pio: The PIO instance used for encoder input.
@@ -21,10 +24,14 @@
  * - refPosition: Reference positions for each encoder channel (used when switching between encoder and joystick mode).
  * - stepSize: Step size for position increments per channel.
  * - direction: Direction of counting for each channel (1 or -1).
+ * - sampledCount, lastChangeTime, speed: Count, time of the last count change and knob speed (written by the timer ISR).
+ * - timer: Timer for sampling the counts.
  *
  * Private Methods:
  * - Encoders(): Private constructor to enforce singleton pattern.
  * - buttonISR(): Static interrupt service routine for handling button presses.
+ * - repeating_timer_callback(): Timer callback sampling the counts and estimating the speed.
+ * - getAccelFactor(): Returns the step size multiplier for the current knob speed.
  *
  * Public Methods:
  * - getInstance(): Returns the singleton instance of the Encoders class.
@@ -49,6 +56,10 @@ private:
   int32_t refPosition[MAX_NUM_MOTORS] = {0}; // reference position for each channel
   int32_t stepSize[MAX_NUM_MOTORS] = {1, 1, 1, 1}; // step size for the position
   int32_t direction[MAX_NUM_MOTORS] = {1, 1, 1, 1}; // step direction (1 or -1)
+  volatile int32_t sampledCount[MAX_NUM_MOTORS] = {0}; // count of the state machine at the last sample
+  volatile uint32_t lastChangeTime[MAX_NUM_MOTORS] = {0}; // time_us_32() of the last count change
+  volatile uint32_t speed[MAX_NUM_MOTORS] = {0}; // smoothed knob speed in counts/s
+  static struct repeating_timer timer; // timer for sampling the counts
 
   /**
    * @brief Private constructor to enforce the singleton pattern.
@@ -78,6 +89,19 @@ private:
    */
   static void buttonISR3();  // interrupt servoce routine for button press
 
+  /**
+   * @brief Timer callback sampling the counts and timestamping their changes.
+   */
+  static bool repeating_timer_callback(struct repeating_timer *t);
+
+  /**
+   * @brief Returns the step size multiplier for the current knob speed.
+   *
+   * @param channel The encoder channel (0 to MAX_NUM_MOTORS-1).
+   * @return The multiplier in units of 1/256 (256 up to ENCODER_ACCEL_MIN_SPEED).
+   */
+  int32_t getAccelFactor(uint8_t channel);
+
 
 public:
 
@@ -111,6 +135,10 @@ public:
   /**
    * @brief Gets the changed position of the specified encoder channel.
    *
+   * The count change since the last call is scaled by the step size, the direction,
+   * the sensitivity and the speed dependent multiplier. The changes between two sends
+   * are aggregated into one position.
+   *
    * @param channel The encoder channel to check (0 to MAX_NUM_MOTORS-1).
    * @param pos Reference to store the current position.
    * @return 0 if unchanged, 1 if changed.
@@ -147,6 +175,14 @@ public:
    */
   void setDirection(uint8_t channel, int32_t dir);
 
+  /**
+   * @brief Gets the estimated knob speed of the specified encoder channel.
+   *
+   * @param channel The encoder channel (0 to MAX_NUM_MOTORS-1).
+   * @return The speed in counts/s (0 at rest).
+   */
+  uint32_t getSpeed(uint8_t channel);
+
   /**
    * @brief Sets the step size for position increments for the specified encoder channel.
    *
@@ -0,0 +1,175 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <Arduino.h>
+
+/**
+ * @file Filters.h
+ * @brief Compile-time-sized smoothing filters for the ADC readings.
+ *
+ * All filters share the same interface (addNewValue, getCurrentValue, reset), take unsigned
+ * 16 bit values and are sized and tuned by template parameters, so they need no heap
+ * allocation and no division. The internal state keeps FILTER_FRACTION_BITS extra bits of
+ * resolution to avoid the rounding stall of integer filters.
+ *
+ * - BoxcarFilter: average of the last 2^SizeBase values (latency of half the window).
+ * - ExponentialFilter: first order IIR with alpha = 2^-AlphaBase.
+ * - AdaptiveFilter: one-euro style IIR whose alpha grows with the speed of the input,
+ *   strong smoothing at rest and slow moves, almost no lag on fast changes.
+ */
+
+#define FILTER_FRACTION_BITS  8 // extra bits of the fixed point filter state
+
+/**
+ * @enum FilterType
+ * @brief Filter selection of a joystick axis.
+ */
+typedef enum {
+  FILTER_NONE = 0,    // input passed through
+  FILTER_BOXCAR,      // BoxcarFilter
+  FILTER_EXPONENTIAL, // ExponentialFilter
+  FILTER_ADAPTIVE     // AdaptiveFilter
+} FilterType;
+
+
+/**
+ * @class BoxcarFilter
+ * @brief Moving average of the last 2^SizeBase values.
+ *
+ * Circular buffer and running sum, the sum is 32 bits wide so any 16 bit input fits for
+ * windows of up to 2^16 values.
+ *
+ * @tparam SizeBase The base-2 exponent of the window size (1 to 8).
+ */
+template <uint8_t SizeBase>
+class BoxcarFilter
+{
+  static_assert(SizeBase >= 1 && SizeBase <= 8, "The boxcar window must be 2 to 256 values");
+
+  uint16_t queue[1<<SizeBase] = {0}; // values in the window
+  uint8_t head = 0; // position of the oldest value (overwritten next)
+  uint32_t windowSum = 0; // running sum of the window
+
+public:
+  /**
+   * @brief Replaces the oldest value of the window with a new one.
+   */
+  void addNewValue(uint16_t val)
+  {
+    windowSum = windowSum - queue[head] + val;
+    queue[head] = val;
+    head = (head + 1) & ((1<<SizeBase) - 1);
+  }
+
+  /**
+   * @brief Retrieves the average of the window.
+   */
+  uint16_t getCurrentValue() const { return (uint16_t)(windowSum >> SizeBase); }
+
+  /**
+   * @brief Fills the window with a value.
+   */
+  void reset(uint16_t val)
+  {
+    for (uint16_t z=0; z<(1<<SizeBase); z++) queue[z] = val;
+    windowSum = (uint32_t)val << SizeBase;
+    head = 0;
+  }
+};
+
+
+/**
+ * @class ExponentialFilter
+ * @brief First order IIR filter, y += (x - y) * 2^-AlphaBase.
+ *
+ * The time constant is about 2^AlphaBase updates.
+ *
+ * @tparam AlphaBase The base-2 exponent of the inverse filter coefficient (1 to 15).
+ */
+template <uint8_t AlphaBase>
+class ExponentialFilter
+{
+  static_assert(AlphaBase >= 1 && AlphaBase <= 15, "The exponential filter coefficient must be 2^-1 to 2^-15");
+
+  int32_t state = 0; // filtered value with FILTER_FRACTION_BITS fraction bits
+
+public:
+  /**
+   * @brief Moves the filtered value towards a new value.
+   */
+  void addNewValue(uint16_t val)
+  {
+    state += (((int32_t)val << FILTER_FRACTION_BITS) - state) >> AlphaBase;
+  }
+
+  /**
+   * @brief Retrieves the filtered value (rounded).
+   */
+  uint16_t getCurrentValue() const { return (uint16_t)((state + (1<<(FILTER_FRACTION_BITS-1))) >> FILTER_FRACTION_BITS); }
+
+  /**
+   * @brief Sets the filtered value.
+   */
+  void reset(uint16_t val) { state = (int32_t)val << FILTER_FRACTION_BITS; }
+};
+
+
+/**
+ * @class AdaptiveFilter
+ * @brief One-euro style adaptive IIR filter.
+ *
+ * The speed of the input (absolute change per update) is smoothed with alpha = 2^-SpeedBase.
+ * The coefficient of the value filter is alpha = 2^-MinBase + speed * Beta / 2^16, limited to 1.
+ * At rest the filter smooths like ExponentialFilter<MinBase>, at a speed of about
+ * 2^16 / Beta input counts per update it follows the input without lag.
+ *
+ * @tparam MinBase The base-2 exponent of the inverse coefficient at rest (1 to 15).
+ * @tparam SpeedBase The base-2 exponent of the inverse coefficient of the speed filter (0 to 15).
+ * @tparam Beta Increase of the coefficient per input count of speed, in units of 2^-16.
+ */
+template <uint8_t MinBase, uint8_t SpeedBase, uint16_t Beta>
+class AdaptiveFilter
+{
+  static_assert(MinBase >= 1 && MinBase <= 15, "The adaptive filter coefficient at rest must be 2^-1 to 2^-15");
+  static_assert(SpeedBase <= 15, "The speed filter coefficient must be 2^0 to 2^-15");
+
+  int32_t state = 0; // filtered value with FILTER_FRACTION_BITS fraction bits
+  int32_t lastInput = 0; // previous input with FILTER_FRACTION_BITS fraction bits
+  int32_t speed = 0; // smoothed absolute input change per update with FILTER_FRACTION_BITS fraction bits
+
+public:
+  /**
+   * @brief Updates the speed estimate and moves the filtered value towards a new value.
+   */
+  void addNewValue(uint16_t val)
+  {
+    int32_t input = (int32_t)val << FILTER_FRACTION_BITS;
+    int32_t change = input - lastInput;
+    uint32_t alpha; // coefficient in units of 2^-16
+
+    lastInput = input;
+    speed += ((change < 0 ? -change : change) - speed) >> SpeedBase;
+    alpha = (65536u >> MinBase) + (uint32_t)(((uint64_t)speed * Beta) >> FILTER_FRACTION_BITS);
+    if (alpha >= 65536u) {
+      state = input;
+    } else {
+      state += (int32_t)(((int64_t)(input - state) * alpha) >> 16);
+    }
+  }
+
+  /**
+   * @brief Retrieves the filtered value (rounded).
+   */
+  uint16_t getCurrentValue() const { return (uint16_t)((state + (1<<(FILTER_FRACTION_BITS-1))) >> FILTER_FRACTION_BITS); }
+
+  /**
+   * @brief Sets the filtered value and clears the speed estimate.
+   */
+  void reset(uint16_t val)
+  {
+    state = lastInput = (int32_t)val << FILTER_FRACTION_BITS;
+    speed = 0;
+  }
+};
+
+#endif // FILTERS_H
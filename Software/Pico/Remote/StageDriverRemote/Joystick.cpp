@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include "Joystick.h"
+#include "AdcSampler.h"
 #include "pico/stdlib.h"
 
 #define SERIAL_DEBUG  1
@@ -26,7 +27,7 @@ void Joystick::init(void)
   size_t idx;
 
   D_println("Joystick Init.");
-  analogReadResolution(COMMON_ADC_RESOLUTION);
+  AdcSampler::getInstance().init();
 
   // set up the axes 
   for (idx=0; idx<MAX_NUM_MOTORS; idx++) {
@@ -39,8 +40,8 @@ void Joystick::init(void)
     pinMode(buttonPin[2*idx], INPUT_PULLUP);  // Use pull-up to default pin HIGH
     attachInterrupt(digitalPinToInterrupt(buttonPin[2*idx]), Joystick::buttonISR, FALLING);  
   }
-  // set up the timer
-  add_repeating_timer_ms(ADC_UPDATE_INTERVAL_MS, Joystick::repeating_timer_callback, NULL, &Joystick::timer);
+  // set up the timer for the filters
+  add_repeating_timer_ms(JOYSTICK_FILTER_INTERVAL_MS, Joystick::repeating_timer_callback, NULL, &Joystick::timer);
 }
 
 
@@ -90,13 +91,14 @@ struct repeating_timer Joystick::timer;
 
 
 // ----------------------------
-// Timer callback for periodic updates
+// Timer callback feeding the axis filters
 // ----------------------------
 
 bool Joystick::repeating_timer_callback(struct repeating_timer *t) {
   Joystick& instance = Joystick::getInstance();
-  instance.update();
-//  D_print("x");
+  for (int idx=0; idx<MAX_NUM_MOTORS; idx++) {
+    if (instance.pins[idx]>=0) instance.axis[idx]->update();
+  }
   return true;
 }
 
@@ -135,25 +137,24 @@ void Joystick::setDirection(uint8_t channel, int32_t dir)
 
 
 // ----------------------------
-// Updates the calibration for a given axis
+// Selects the filter for a given axis
 // ----------------------------
 
-void Joystick::updateCalibration(uint8_t channel)
+void Joystick::setFilter(uint8_t channel, FilterType type)
 {
   if (channel>=MAX_NUM_MOTORS) return; // unsupported channel
-  if (pins[channel]>=0) axis[channel]->updateCalibration();
+  if (pins[channel]>=0) axis[channel]->setFilter(type);
 }
 
 
 // ----------------------------
-// Updates the joystick state by reading ADC values and updating the axes
+// Updates the calibration for a given axis
 // ----------------------------
 
-void Joystick::update()
+void Joystick::updateCalibration(uint8_t channel)
 {
-  for (int idx=0; idx<MAX_NUM_MOTORS; idx++) {
-    if (pins[idx]>=0) axis[idx]->update();
-  }
+  if (channel>=MAX_NUM_MOTORS) return; // unsupported channel
+  if (pins[channel]>=0) axis[channel]->updateCalibration();
 }
 
 
@@ -13,7 +13,7 @@ class Joystick
  * @brief Singleton class to manage multiple joystick axes and buttons.
  *
  * This class provides an interface for handling up to MAX_NUM_MOTORS joystick axes and their associated buttons.
- * It manages analog-to-digital conversion (ADC) pins for axis readings and digital pins for button presses.
+ * It manages analog-to-digital conversion (ADC) pins for axis readings (sampled by AdcSampler) and digital pins for button presses.
  * The class supports calibration, direction setting, and value retrieval for each axis, as well as button press detection.
  *
  * Private Members:
@@ -21,13 +21,12 @@ class Joystick
  * - const int pins[MAX_NUM_MOTORS]: ADC pin numbers for each joystick channel.
  * - const int buttonPin[MAX_NUM_MOTORS]: Digital pin numbers for each joystick button.
  * - volatile int8_t buttonPressed[MAX_NUM_MOTORS]: Flags indicating button press state for each channel.
- * - static struct repeating_timer timer: Timer for periodic updates.
+ * - static struct repeating_timer timer: Timer for the filter updates.
  *
  * Private Methods:
  * - Joystick(): Private constructor for singleton pattern.
  * - static void buttonISR(): Interrupt Service Routine for button presses.
- * - static bool repeating_timer_callback(struct repeating_timer *t): Timer callback for periodic updates.
- * - void update(): Updates joystick state.
+ * - static bool repeating_timer_callback(struct repeating_timer *t): Timer callback for the filter updates.
  *
  * Public Methods:
  * - static Joystick& getInstance(): Returns the singleton instance.
@@ -35,6 +34,7 @@ class Joystick
  * - void setMaxValue(uint8_t channel, int32_t value): Sets the maximum value for a given axis.
  * - void setCenterMargin(uint8_t channel, int16_t value): Sets the center margin for a given axis.
  * - void setDirection(uint8_t channel, int32_t dir): Sets the direction for a given axis.
+ * - void setFilter(uint8_t channel, FilterType type): Selects the filter for a given axis.
  * - void updateCalibration(uint8_t channel): Updates calibration for a given axis.
  * - int8_t getUpdatedValue(uint8_t channel, int32_t &newValue): Retrieves the latest value for a given axis.
  * - int8_t getButtonPressed(uint8_t channel): Checks if the button for a given channel is pressed.
@@ -48,7 +48,7 @@ private:
   const int buttonPin[MAX_NUM_MOTORS] = {JOYSTICK_CH0_PIN_BUTTON, JOYSTICK_CH1_PIN_BUTTON, // pins for the button
                                          JOYSTICK_CH2_PIN_BUTTON, JOYSTICK_CH3_PIN_BUTTON}; // pins for the button
   volatile int8_t buttonPressed[MAX_NUM_MOTORS] = {0}; // button pressed flag for each channel
-  static struct repeating_timer timer; // Timer for periodic updates
+  static struct repeating_timer timer; // timer for the filter updates
 
   /**
    * @brief Private constructor to enforce the singleton pattern.
@@ -62,18 +62,11 @@ private:
    * @brief Static interrupt service routine for handling button presses.
    */
   static void buttonISR();
- 
-  /**
-   * @brief Timer callback for periodic updates.
-   */
-  static bool repeating_timer_callback(struct repeating_timer *t); 
- 
+
   /**
-   * @brief Updates the joystick state by reading ADC values and updating the axes.
-   *
-   * This method is called periodically by the timer ISR.
+   * @brief Timer callback feeding the latest ADC values into the axis filters.
    */
-  void update();
+  static bool repeating_timer_callback(struct repeating_timer *t);
 
 public:
  
@@ -129,6 +122,14 @@ public:
    */
   void setDirection(uint8_t channel, int32_t dir);
 
+  /**
+   * @brief Selects the filter for a given axis.
+   *
+   * @param channel The joystick channel (0 to MAX_NUM_MOTORS-1).
+   * @param type The filter type (see FilterType).
+   */
+  void setFilter(uint8_t channel, FilterType type);
+
   /**
    * @brief Updates the calibration for a given axis.
    *
@@ -3,6 +3,7 @@
 
 #include "JoystickAxis.h"
 #include "SensAdjust.h"
+#include "AdcSampler.h"
 
 #define SERIAL_DEBUG  1
 #include "Serial_Debug.h"
@@ -18,7 +19,8 @@
 
 JoystickAxis::JoystickAxis(uint8_t ADCPin) : ADCPin{ADCPin}
 {
-  pinMode(ADCPin, INPUT);
+  ADCInput = AdcSampler::getInput(ADCPin);
+  setFilter(filterType);
 }
 
 
@@ -29,6 +31,7 @@ JoystickAxis::JoystickAxis(uint8_t ADCPin) : ADCPin{ADCPin}
 void JoystickAxis::setMaxValue(int32_t value)
 {
   maxValue = value;
+  buildVelocityTable();
 }
 
 
@@ -39,6 +42,7 @@ void JoystickAxis::setMaxValue(int32_t value)
 void JoystickAxis::setCenterMargin(int16_t value)
 {
   centerMargin = value;
+  buildVelocityTable();
 }
 
 
@@ -57,23 +61,99 @@ void JoystickAxis::setDirection(int32_t dir)
 
 
 // ----------------------------
-// Sets the current ADC value as the Calibration for this axis.
+// Sets the shape of the deflection-to-velocity curve.
 // ----------------------------
 
-void JoystickAxis::updateCalibration()
+void JoystickAxis::setCurveGain(float gain)
+{
+  if (gain < 0) {
+    D_println("Invalid curve gain, must be 0 or positive.");
+    return; // invalid gain
+  }
+  curveGain = gain;
+  buildVelocityTable();
+}
+
+
+// ----------------------------
+// Recomputes the velocity table (only when a setting changes, not per reading).
+// ----------------------------
+
+void JoystickAxis::buildVelocityTable()
 {
-  centerADCValue = adcAverage.getCurrentValue();
+  const int32_t fullScale = JOYSTICK_TABLE_LENGTH-1; // deflection for maxValue
+  float curveScale = (curveGain > 0) ? 1.0f/(expf(curveGain) - 1.0f) : 0;
+
+  for (int32_t r=0; r<JOYSTICK_TABLE_LENGTH; r++) {
+    if (r < centerMargin) {
+      velocityTable[r] = 0; // dead zone
+    } else if (curveGain > 0) {
+      velocityTable[r] = (int32_t)lroundf(maxValue*(expf(curveGain*r/fullScale) - 1.0f)*curveScale);
+    } else {
+      velocityTable[r] = (int32_t)((int64_t)maxValue*r/fullScale);
+    }
+  }
+  sendThreshold = maxValue >> JOYSTICK_SEND_THRESHOLD_BASE;
+  if (sendThreshold < 1) sendThreshold = 1;
+}
+
+
+// ----------------------------
+// Selects the filter and starts it from the current ADC value.
+// ----------------------------
+
+void JoystickAxis::setFilter(FilterType type)
+{
+  uint16_t currentADCValue = AdcSampler::getInstance().getValue(ADCInput);
+
+  noInterrupts(); // the timer ISR feeds the filter
+  boxcar.reset(currentADCValue);
+  exponential.reset(currentADCValue);
+  adaptive.reset(currentADCValue);
+  filterType = type;
+  interrupts();
 }
 
 
 // ----------------------------
-// Updates the ADC value and adds it to the moving average.
+// Feeds the latest ADC value into the selected filter.
 // ----------------------------
 
 void JoystickAxis::update()
 {
-  if (ADCPin < 0) return; // not enabled
-  adcAverage.addNewValue(analogRead(ADCPin));
+  uint16_t currentADCValue = AdcSampler::getInstance().getValue(ADCInput);
+
+  switch (filterType) {
+    case FILTER_BOXCAR: boxcar.addNewValue(currentADCValue); break;
+    case FILTER_EXPONENTIAL: exponential.addNewValue(currentADCValue); break;
+    case FILTER_ADAPTIVE: adaptive.addNewValue(currentADCValue); break;
+    default: break;
+  }
+}
+
+
+// ----------------------------
+// Retrieves the output of the selected filter.
+// ----------------------------
+
+uint16_t JoystickAxis::getFilteredValue()
+{
+  switch (filterType) {
+    case FILTER_BOXCAR: return boxcar.getCurrentValue();
+    case FILTER_EXPONENTIAL: return exponential.getCurrentValue();
+    case FILTER_ADAPTIVE: return adaptive.getCurrentValue();
+    default: return AdcSampler::getInstance().getValue(ADCInput);
+  }
+}
+
+
+// ----------------------------
+// Sets the current ADC value as the Calibration for this axis.
+// ----------------------------
+
+void JoystickAxis::updateCalibration()
+{
+  centerADCValue = AdcSampler::getInstance().getValue(ADCInput);
 }
 
 
@@ -85,21 +165,29 @@ int8_t JoystickAxis::getUpdatedValue(int32_t &newValue)
 {
   int32_t r; // ADC distance from center
   int32_t sensVal;
+  int32_t change;
 
-  uint16_t currentADCValue = adcAverage.getCurrentValue();
+  uint16_t currentADCValue = getFilteredValue();
   r = currentADCValue - centerADCValue;
-  if (abs(r) < centerMargin) {
-    r=0;
-  }
-  // scale by the sensitivity
+  // look up the velocity and scale by the sensitivity
   SensAdjust::getInstance().getUpdatedValue(sensVal);
-  newValue = 2*direction*maxValue*r/(1<<COMMON_ADC_RESOLUTION)
-              *sensVal/(1<<COMMON_ADC_RESOLUTION);
-
-  if (newValue==lastVelValue) {
+  newValue = velocityTable[abs(r) < JOYSTICK_TABLE_LENGTH ? abs(r) : JOYSTICK_TABLE_LENGTH-1];
+  newValue = (int32_t)(((int64_t)newValue*sensVal) >> COMMON_ADC_RESOLUTION);
+  if (r < 0) newValue = -newValue;
+  newValue *= direction;
+
+  change = newValue - lastVelValue;
+  if (change == 0) {
+    pendingSince = 0;
     return 0; // no update
-  } else {
-    lastVelValue = newValue;
-    return 1; // value has changed
   }
+  // small changes wait until they persist (starts and stops always go out)
+  if (abs(change) < sendThreshold && newValue != 0 && lastVelValue != 0) {
+    unsigned long currentTime = millis();
+    if (pendingSince == 0) pendingSince = currentTime;
+    if (currentTime - pendingSince < JOYSTICK_SEND_SETTLE_MS) return 0;
+  }
+  pendingSince = 0;
+  lastVelValue = newValue;
+  return 1; // value to be sent
 }
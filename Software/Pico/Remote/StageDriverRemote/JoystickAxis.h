@@ -2,14 +2,16 @@
 #define JOYSTICKAXIS_H
 
 #include <Arduino.h>
-#include "MovingAverage.h"
+#include "Common.h"
+#include "Filters.h"
 
 /**
  * @brief Represents a joystick axis with ADC input, calibration, and value processing.
  *
- * This class handles reading from an ADC pin, applying a moving average filter,
- * calibrating the center position, applying a dead zone (center margin), and
- * scaling/inverting the output value as needed.
+ * This class handles reading the averaged ADC value of a pin (see AdcSampler),
+ * smoothing it with the selected filter (see Filters.h), calibrating the center position,
+ * and mapping the deflection to a velocity. The mapping (dead zone, max value and curve) is
+ * precomputed into a lookup table whenever one of its settings changes.
  *
  * Members:
  * - ADCPin: The pin number connected to the ADC for this axis.
@@ -17,16 +19,22 @@
  * - direction: Direction multiplier (1 or -1) to invert the axis if needed.
  * - centerMargin: Margin around the center ADC value to treat as zero (dead zone).
  * - centerADCValue: The calibrated center ADC value.
- * - adcAverage: Moving average filter for smoothing ADC readings.
+ * - curveGain: Shape of the deflection-to-velocity curve (0 for linear).
+ * - velocityTable: Velocity for each deflection (in ADC counts from the center).
+ * - sendThreshold, pendingSince: Velocity change sent right away, start of a smaller pending change.
+ * - ADCInput: The ADC input of the pin (-1 if the pin has no ADC).
+ * - filterType: The selected filter, boxcar/exponential/adaptive: The filter instances.
  *
  * Methods:
  * - JoystickAxis(uint8_t ADCPin): Constructor, initializes the axis with the given ADC pin.
  * - void setMaxValue(int32_t value): Sets the maximum output value for the axis.
  * - void setCenterMargin(int16_t value): Sets the dead zone margin around the center.
  * - void setDirection(int32_t dir): Sets the direction multiplier (1 or -1).
- * - void update(): Reads and processes the latest ADC value.
+ * - void setCurveGain(float gain): Sets the shape of the velocity curve.
+ * - void setFilter(FilterType type): Selects the filter of the ADC readings.
+ * - void update(): Feeds the latest ADC value into the filter.
  * - void updateCalibration(): Calibrates the center ADC value.
- * - int8_t getUpdatedValue(int32_t &newValue): Returns the processed value if updated.
+ * - int8_t getUpdatedValue(int32_t &newValue): Returns the processed value if it changed enough to be sent.
  */
 class JoystickAxis
 {
@@ -35,9 +43,26 @@ class JoystickAxis
   int32_t direction = 1; // direction multiplier (1 or -1)
   int16_t centerMargin = 0; // ADC readings within this margin yields zero (to avoid imprecise offsets)
   uint16_t centerADCValue = 0; // center ADC value (calibrated)
-  int32_t lastVelValue = 0; // last velocity value
+  float curveGain = JOYSTICK_CURVE_GAIN; // shape of the velocity curve, 0 -> linear
+  int32_t velocityTable[JOYSTICK_TABLE_LENGTH] = {0}; // velocity (without direction and sensitivity) for each deflection
+  int32_t sendThreshold = 1; // velocity change that is reported right away
+  int32_t lastVelValue = 0; // last reported velocity value
+  unsigned long pendingSince = 0; // millis() when a smaller change was first seen, 0 -> none pending
+  int8_t ADCInput; // ADC input of the pin (sampled by AdcSampler)
+  volatile FilterType filterType = JOYSTICK_FILTER_TYPE; // filter of the ADC readings
+  BoxcarFilter<JOYSTICK_BOXCAR_BASE> boxcar; // filter instances (only the selected one is updated)
+  ExponentialFilter<JOYSTICK_EXPONENTIAL_BASE> exponential;
+  AdaptiveFilter<JOYSTICK_ADAPTIVE_MIN_BASE, JOYSTICK_ADAPTIVE_SPEED_BASE, JOYSTICK_ADAPTIVE_BETA> adaptive;
 
-  MovingAverage adcAverage = MovingAverage(ADC_AVERAGING_BASE); // moving average of the ADC readings
+  /**
+   * @brief Retrieves the output of the selected filter.
+   */
+  uint16_t getFilteredValue();
+
+  /**
+   * @brief Recomputes the velocity table and the send threshold from the current settings.
+   */
+  void buildVelocityTable();
 	
 public:
   /**
@@ -71,9 +96,28 @@ public:
   void setDirection(int32_t dir);
 
   /**
-   * @brief Reads the ADC value and updates the moving average.
+   * @brief Sets the shape of the deflection-to-velocity curve.
+   *
+   * A gain of 0 maps the deflection linearly. With a gain k>0, the velocity follows
+   * (exp(k*x)-1)/(exp(k)-1) of the max value (x: deflection from 0 to 1), for finer control near the center.
+   *
+   * @param gain The curve gain (0 or positive).
+   */
+  void setCurveGain(float gain);
+
+  /**
+   * @brief Selects the filter of the ADC readings.
+   *
+   * The filter starts from the current ADC value.
+   *
+   * @param type The filter type (see FilterType).
+   */
+  void setFilter(FilterType type);
+
+  /**
+   * @brief Feeds the latest ADC value into the selected filter.
    *
-   * This method should be called periodically to keep the moving average updated.
+   * This method is called every JOYSTICK_FILTER_INTERVAL_MS by the timer ISR of Joystick.
    */
   void update();
 
@@ -87,11 +131,13 @@ public:
   /**
    * @brief Retrieves the current processed value for this axis.
    *
-   * This method checks if the ADC value has changed since the last call,
-   * applies the dead zone, scales, and inverts the value as necessary.
+   * This method looks up the velocity of the filtered deflection, applies the direction and
+   * the sensitivity and compares it with the last reported value. Changes of at least
+   * JMAX/2^JOYSTICK_SEND_THRESHOLD_BASE and any start or stop are reported right away,
+   * smaller changes once they persist for JOYSTICK_SEND_SETTLE_MS.
    *
    * @param newValue Reference to an int32_t where the updated value will be stored.
-   * @return 1 if the value has changed, 0 if it remains the same.
+   * @return 1 if the value is to be sent, 0 otherwise.
    */
   int8_t getUpdatedValue(int32_t &newValue);
 };
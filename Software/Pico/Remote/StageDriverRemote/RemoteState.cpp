@@ -0,0 +1,100 @@
+#include <Arduino.h>
+#include "RemoteState.h"
+#include "hardware/sync.h"
+
+
+// *************************************************************************************
+// RemoteState class
+// *************************************************************************************
+
+// ----------------------------
+// (Private) constructor enforces singleton
+// ----------------------------
+
+RemoteState::RemoteState() {}
+
+
+// ----------------------------
+// Return the singleton instance
+// ----------------------------
+
+RemoteState& RemoteState::getInstance() {
+  static RemoteState instance;  // Only created once
+  return instance;
+}
+
+
+// ----------------------------
+// Set the position of a channel (working copy)
+// ----------------------------
+
+void RemoteState::setPosition(uint8_t channel, int32_t position)
+{
+  if (channel >= MAX_NUM_MOTORS) return; // unsupported channel
+  if (working.isPositionValid[channel] && working.position[channel] == position) return;
+  working.position[channel] = position;
+  working.isPositionValid[channel] = 1;
+  isChanged = 1;
+}
+
+
+// ----------------------------
+// Get the position of a channel (working copy)
+// ----------------------------
+
+int32_t RemoteState::getPosition(uint8_t channel)
+{
+  if (channel >= MAX_NUM_MOTORS) return 0; // unsupported channel
+  return working.position[channel];
+}
+
+
+// ----------------------------
+// Set the input mode of a channel (working copy)
+// ----------------------------
+
+void RemoteState::setMode(uint8_t channel, InputMode mode)
+{
+  if (channel >= MAX_NUM_MOTORS) return; // unsupported channel
+  if (working.mode[channel] == mode) return;
+  working.mode[channel] = mode;
+  isChanged = 1;
+}
+
+
+// ----------------------------
+// Publish the working copy into the buffer that isn't the latest
+// ----------------------------
+
+void RemoteState::publish(void)
+{
+  uint8_t idx = 1 - latest;
+
+  if (!isChanged) return;
+  sequence[idx]++; // odd: being written
+  __dmb();
+  buffer[idx] = working;
+  __dmb();
+  sequence[idx]++; // even: complete
+  latest = idx;
+  isChanged = 0;
+}
+
+
+// ----------------------------
+// Copy the latest snapshot (retry if the writer reused the buffer meanwhile)
+// ----------------------------
+
+void RemoteState::read(RemoteSnapshot &snapshot)
+{
+  uint8_t idx;
+  uint32_t seq;
+
+  do {
+    idx = latest;
+    seq = sequence[idx];
+    __dmb();
+    snapshot = buffer[idx];
+    __dmb();
+  } while ((seq & 1) || sequence[idx] != seq);
+}
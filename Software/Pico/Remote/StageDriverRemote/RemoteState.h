@@ -0,0 +1,114 @@
+#ifndef REMOTESTATE_H
+#define REMOTESTATE_H
+
+#include <Arduino.h>
+#include "Common.h"
+
+
+/**
+ * @enum InputMode
+ * @brief Input mode of a channel as shown on the display.
+ */
+typedef enum {
+  INPUT_MODE_NONE = 0, // not remote controlled
+  INPUT_MODE_ENCODER,  // remote controlled with the encoder
+  INPUT_MODE_JOYSTICK  // remote controlled with the joystick
+} InputMode;
+
+
+/**
+ * @struct RemoteSnapshot
+ * @brief State of the remote that the display core renders.
+ */
+struct RemoteSnapshot {
+  int32_t position[MAX_NUM_MOTORS]; // last position reported by the controller
+  int8_t isPositionValid[MAX_NUM_MOTORS]; // 1 once the controller sent a position for the channel
+  int8_t mode[MAX_NUM_MOTORS]; // input mode (see InputMode)
+};
+
+
+/**
+ * @class RemoteState
+ * @brief Singleton class sharing the remote state between the two cores without locks.
+ *
+ * Core 0 (input sampling and the controller link) owns a working copy of the state and
+ * publishes it into one of two buffers, the one that is not the latest. Core 1 (display)
+ * copies the latest buffer. Each buffer has a sequence count that is odd while it is written,
+ * so the reader retries in the rare case that the writer got around to the buffer while it
+ * was copying. The writer never waits, and the reader only ever sees complete snapshots.
+ *
+ * Private Members:
+ * - working: State as maintained by core 0.
+ * - buffer, sequence: The two published snapshots and their sequence counts.
+ * - latest: Index of the latest published buffer.
+ * - isChanged: Flag whether the working copy changed since the last publish.
+ *
+ * Private Methods:
+ * - RemoteState(): Private constructor to enforce singleton pattern.
+ *
+ * Public Methods:
+ * - getInstance(): Returns the singleton instance.
+ * - setPosition(), getPosition(), setMode(): Update or read the working copy (core 0).
+ * - publish(): Publishes the working copy if it changed (core 0).
+ * - read(): Copies the latest snapshot (core 1).
+ */
+class RemoteState
+{
+private:
+  RemoteSnapshot working = {}; // state as maintained by core 0
+  RemoteSnapshot buffer[2] = {}; // published snapshots
+  volatile uint32_t sequence[2] = {0}; // sequence count of each buffer, odd while it is written
+  volatile uint8_t latest = 0; // index of the latest published buffer
+  int8_t isChanged = 0; // flag whether the working copy changed since the last publish
+
+  /**
+   * @brief Private constructor to enforce the singleton pattern.
+   */
+  RemoteState();
+
+public:
+  /**
+   * @brief Retrieves the singleton instance of the RemoteState class.
+   *
+   * @return Reference to the singleton RemoteState instance.
+   */
+  static RemoteState& getInstance();
+
+  /**
+   * @brief Sets the position of a channel in the working copy (core 0).
+   *
+   * @param channel The motor channel (0 to MAX_NUM_MOTORS-1).
+   * @param position The position reported by the controller.
+   */
+  void setPosition(uint8_t channel, int32_t position);
+
+  /**
+   * @brief Retrieves the position of a channel from the working copy (core 0).
+   *
+   * @param channel The motor channel (0 to MAX_NUM_MOTORS-1).
+   * @return The last position reported by the controller (0 if none yet).
+   */
+  int32_t getPosition(uint8_t channel);
+
+  /**
+   * @brief Sets the input mode of a channel in the working copy (core 0).
+   *
+   * @param channel The motor channel (0 to MAX_NUM_MOTORS-1).
+   * @param mode The input mode (see InputMode).
+   */
+  void setMode(uint8_t channel, InputMode mode);
+
+  /**
+   * @brief Publishes the working copy for the display core, if it changed (core 0).
+   */
+  void publish(void);
+
+  /**
+   * @brief Copies the latest published snapshot (core 1).
+   *
+   * @param snapshot Receives the snapshot.
+   */
+  void read(RemoteSnapshot &snapshot);
+};
+
+#endif // REMOTESTATE_H
@@ -11,15 +11,18 @@
  *
  * Components initialized:
  * - Encoders: Handles rotary encoder input.
+ * - AdcSampler: Samples the analog inputs (free-running ADC with DMA).
  * - SensAdjust: Manages sensitivity adjustment.
  * - Joystick: Reads and calibrates joystick input.
- * - Display: Manages the user interface display.
+ * - Display: Manages the user interface display (core 1).
+ * - RemoteState: Shares the state between the cores without locks.
  * - ControllerComm: Handles communication with the stage controller.
  *
- * The main loop is responsible for:
- * - Sending movement commands to the controller.
- * - Receiving updates from the controller (such as position or mode changes).
- * - Checking for input mode switches.
+ * The work is split across the two cores, so sending input never waits on a display refresh:
+ * - Core 0 (setup/loop): input sampling, sending movement commands to the controller,
+ *   receiving updates from the controller (such as position or mode changes) and checking
+ *   for input mode switches. It publishes the positions and modes (see RemoteState).
+ * - Core 1 (setup1/loop1): renders the published state and sends it to the display.
  *
  * Debug output is available via serial if SERIAL_DEBUG is enabled.
  */
@@ -29,6 +32,7 @@
 #include "Joystick.h"
 #include "Display.h"
 #include "ControllerComm.h"
+#include "RemoteState.h"
 
 #define SERIAL_DEBUG  0
 #include "Serial_Debug.h"
@@ -61,13 +65,12 @@ void setup() {
   joystick.setMaxValue(1, 10000);
   joystick.setDirection(1, -1);
   
-  // do some updates to get a baseline for the center position
-  delay(2*ADC_UPDATE_INTERVAL_MS*(1<<ADC_AVERAGING_BASE));
+  // let the ADC ring fill up to get a baseline for the center position
+  delay(ADC_CALIBRATION_DELAY_MS);
   joystick.updateCalibration(0);
   joystick.updateCalibration(1);
   D_println("Joystick calibration complete.");
 
-  Display::getInstance().init();
   ControllerComm::getInstance().init(100); // 100 ms timeout
 
 }
@@ -90,5 +93,31 @@ void loop()
   // check for a switch in input mode
   controller.inputModeCheck();
 
+  // hand the positions and modes to the display core
+  RemoteState::getInstance().publish();
+}
+
+
+// ----------------------------
+// Initializes the display on core 1.
+// ----------------------------
+
+void setup1() {
+  Display::getInstance().init();
+}
+
+
+// ----------------------------
+// Display loop on core 1: renders the latest state and sends the changed lines (rate limited).
+// ----------------------------
+
+void loop1()
+{
+  RemoteSnapshot snapshot;
+  Display& display = Display::getInstance();
+
+  RemoteState::getInstance().read(snapshot);
+  display.render(snapshot);
+  display.update();
 }
 